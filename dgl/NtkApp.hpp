@@ -37,6 +37,8 @@
 # undef override_defined
 #endif
 
+#include "NtkRedrawScheduler.hpp"
+
 // -----------------------------------------------------------------------
 
 namespace DISTRHO_NAMESPACE {
@@ -57,45 +59,423 @@ class NtkWindow;
 typedef DISTRHO_NAMESPACE::Mutex       d_Mutex;
 typedef DISTRHO_NAMESPACE::MutexLocker d_MutexLocker;
 typedef DISTRHO_NAMESPACE::NtkUI       d_NtkUI;
+typedef DISTRHO_NAMESPACE::Signal      d_Signal;
 typedef DISTRHO_NAMESPACE::Thread      d_Thread;
 
 // -----------------------------------------------------------------------
 
 /**
-   DGL compatible App class that uses NTK instead of OpenGL.
-   @see App
+   The NTK thread, shared by all NtkApp instances in the process.
+
+   NTK runs on this thread, blocked in Fl::wait() until there are events to process.
+   Other threads must not touch widgets directly, instead they post requests to the NTK thread.
+   Requests are pushed into lock-free queues and the NTK thread is woken up with Fl::awake().
+   Asynchronous requests go into a preallocated ring, so posting them does not allocate.
+   When the ring is full they are allocated and pushed into the list instead, and so are the ones posted
+   after them until the list has been processed, so that requests keep the order they were posted in.
+   Once the thread has stopped the queues are closed, and requests run on the calling thread instead.
+
+   The thread is reference-counted, it starts with the first NtkApp and stops when the last one is destroyed.
+   @internal
  */
-class NtkApp : d_Thread
+class NtkThread : d_Thread
 {
 public:
+    typedef void (*AsyncFunc)(void* ptr, uint32_t index, float value);
+    typedef void (*SyncFunc)(void* ptr);
+
    /**
-      Constructor.
+      Get the thread instance, starting it if needed.
+      Every call must be matched by a call to release().
     */
-    NtkApp()
+    static NtkThread& acquire()
+    {
+        NtkThread& thread(getInstance());
+
+        const d_MutexLocker cml(thread.fRefLock);
+
+        if (thread.fRefCount++ == 0)
+        {
+#ifdef DISTRHO_OS_LINUX
+            XInitThreads();
+#endif
+            thread.startThread();
+            thread.fThreadInitialized.wait();
+        }
+
+        return thread;
+    }
+
+   /**
+      Release the thread, stopping it if this was the last reference.
+    */
+    void release()
+    {
+        const d_MutexLocker cml(fRefLock);
+        DISTRHO_SAFE_ASSERT_RETURN(fRefCount > 0,);
+
+        if (--fRefCount != 0)
+            return;
+
+        signalThreadShouldExit();
+
+        // the thread quits once it gets to this message, after everything posted before it
+        Message quit;
+        quit.quit = true;
+
+        if (fMessages.push(&quit))
+            Fl::awake((void*)nullptr);
+
+        stopThread(-1);
+    }
+
+    bool isRunning() const noexcept
+    {
+        return isThreadRunning() && ! shouldThreadExit();
+    }
+
+   /**
+      Get the redraw scheduler, must only be used from the NTK thread.
+    */
+    NtkRedrawScheduler& getRedrawScheduler() noexcept
+    {
+        return fRedrawScheduler;
+    }
+
+    // -------------------------------------------------------------------
+
+    void postAsync(const AsyncFunc func, void* const ptr, const uint32_t index, const float value)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(func != nullptr,);
+
+        if (! isCurrentThreadNtk() && isRunning() && pushAsync(func, ptr, index, value))
+        {
+            Fl::awake((void*)nullptr);
+            return;
+        }
+
+        const FlScopedLock csl;
+        func(ptr, index, value);
+    }
+
+    void postSync(const SyncFunc func, void* const ptr)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(func != nullptr,);
+
+        if (! isCurrentThreadNtk() && isRunning())
+        {
+            d_Signal done;
+
+            Message msg;
+            msg.syncFunc = func;
+            msg.ptr      = ptr;
+            msg.done     = &done;
+
+            // fails if the thread has already done its final processing
+            if (fMessages.push(&msg))
+            {
+                Fl::awake((void*)nullptr);
+                done.wait();
+                return;
+            }
+        }
+
+        const FlScopedLock csl;
+        func(ptr);
+    }
+
+    // -------------------------------------------------------------------
+
+private:
+    struct Message {
+        Message*  next;
+        AsyncFunc asyncFunc;
+        SyncFunc  syncFunc;
+        void*     ptr;
+        uint32_t  index;
+        float     value;
+        d_Signal* done;
+        bool      quit;
+
+        Message() noexcept
+            : next(nullptr),
+              asyncFunc(nullptr),
+              syncFunc(nullptr),
+              ptr(nullptr),
+              index(0),
+              value(0.0f),
+              done(nullptr),
+              quit(false) {}
+    };
+
+    struct AsyncMessage {
+        AsyncFunc func;
+        void*     ptr;
+        uint32_t  index;
+        float     value;
+    };
+
+    // Multiple-producer, single-consumer lock-free queue.
+    // Producers push onto a stack with compare-and-swap, the consumer takes the whole stack at once.
+    // While the NTK thread is not running the queue is closed and pushing fails.
+    struct MessageQueue {
+        DISTRHO_NAMESPACE::Atomic<Message*> head;
+
+        MessageQueue() noexcept
+            : head(closedMarker()) {}
+
+        bool isClosed() const noexcept
+        {
+            return head.load(__ATOMIC_SEQ_CST) == closedMarker();
+        }
+
+        bool push(Message* const msg) noexcept
+        {
+            Message* oldHead(head.load(__ATOMIC_RELAXED));
+
+            do {
+                if (oldHead == closedMarker())
+                    return false;
+
+                msg->next = oldHead;
+            } while (! head.compareExchange(oldHead, msg));
+
+            return true;
+        }
+
+        void open() noexcept
+        {
+            Message* expected(closedMarker());
+            head.compareExchange(expected, nullptr);
+        }
+
+        // returns all pending messages in the order they were pushed, optionally closing the queue
+        Message* takeAll(const bool close) noexcept
+        {
+            Message* msg(head.exchange(close ? closedMarker() : nullptr, __ATOMIC_SEQ_CST));
+            Message* ordered(nullptr);
+
+            if (msg == closedMarker())
+                return nullptr;
+
+            for (; msg != nullptr;)
+            {
+                Message* const next(msg->next);
+                msg->next = ordered;
+                ordered   = msg;
+                msg       = next;
+            }
+
+            return ordered;
+        }
+
+        static Message* closedMarker() noexcept
+        {
+            static Message sClosed;
+            return &sClosed;
+        }
+    };
+
+    d_Mutex      fRefLock;
+    uint32_t     fRefCount;
+    d_Signal     fThreadInitialized;
+    MessageQueue fMessages;
+    DISTRHO_NAMESPACE::MpscRingBuffer<AsyncMessage> fAsyncMessages;
+    DISTRHO_NAMESPACE::Atomic<uint32_t> fAsyncWriters;  // threads inside pushAsync()
+    DISTRHO_NAMESPACE::Atomic<uint32_t> fAsyncOverflow; // async requests in fMessages not yet run
+    bool         fDisplayInitialized;
+
+    NtkRedrawScheduler fRedrawScheduler;
+
+    NtkThread()
         : d_Thread("NtkApp"),
-          fWindows(),
-          fWindowMutex(),
-          fNextUI(),
-          fDoNextUI(false),
-          fThreadInitialized(false)
+          fRefLock(),
+          fRefCount(0),
+          fThreadInitialized(),
+          fMessages(),
+          fAsyncMessages(kAsyncMessageCount),
+          fAsyncWriters(0),
+          fAsyncOverflow(0),
+          fDisplayInitialized(false),
+          fRedrawScheduler() {}
+
+    static NtkThread& getInstance()
+    {
+        static NtkThread thread;
+        return thread;
+    }
+
+    static bool& isCurrentThreadNtk() noexcept
+    {
+        static __thread bool ntkThread = false;
+        return ntkThread;
+    }
+
+    static const uint32_t kAsyncMessageCount = 1024;
+
+    // returns false if the queues are closed
+    bool pushAsync(const AsyncFunc func, void* const ptr, const uint32_t index, const float value)
+    {
+        // the final processMessages() waits for writers that got past the closed check
+        fAsyncWriters.fetchAdd(1, __ATOMIC_SEQ_CST);
+
+        bool pushed = false;
+
+        if (! fMessages.isClosed())
+        {
+            // while earlier requests are waiting in the list, the ring would let this one overtake them
+            if (fAsyncOverflow.load(__ATOMIC_SEQ_CST) == 0)
+            {
+                AsyncMessage amsg;
+                amsg.func  = func;
+                amsg.ptr   = ptr;
+                amsg.index = index;
+                amsg.value = value;
+
+                pushed = fAsyncMessages.push(amsg);
+            }
+
+            if (! pushed)
+            {
+                // ring is full or being bypassed, the NTK thread is lagging behind
+                Message* const msg(new Message());
+                msg->asyncFunc = func;
+                msg->ptr       = ptr;
+                msg->index     = index;
+                msg->value     = value;
+
+                fAsyncOverflow.fetchAdd(1, __ATOMIC_SEQ_CST);
+
+                pushed = fMessages.push(msg);
+
+                if (! pushed)
+                {
+                    fAsyncOverflow.fetchSub(1);
+                    delete msg;
+                }
+            }
+        }
+
+        fAsyncWriters.fetchSub(1);
+        return pushed;
+    }
+
+    // must be called with the FLTK lock held, returns false when the quit message was received
+    bool processMessages(const bool close)
     {
+        // take the list first, so async requests posted before a sync one run before it
+        Message* msg(fMessages.takeAll(close));
+        bool keepRunning = true;
+
+        if (close)
+        {
+            for (; fAsyncWriters.load(__ATOMIC_SEQ_CST) != 0;)
+                sched_yield();
+        }
+
+        for (AsyncMessage amsg; fAsyncMessages.pop(amsg);)
+            amsg.func(amsg.ptr, amsg.index, amsg.value);
+
+        for (; msg != nullptr;)
+        {
+            // synchronous messages live in the stack of the waiting thread, read everything before signaling
+            Message* const next(msg->next);
+
+            if (msg->quit)
+            {
+                keepRunning = false;
+            }
+            else if (msg->syncFunc != nullptr)
+            {
+                msg->syncFunc(msg->ptr);
+                msg->done->signal();
+            }
+            else
+            {
+                msg->asyncFunc(msg->ptr, msg->index, msg->value);
+                delete msg;
+                fAsyncOverflow.fetchSub(1);
+            }
+
+            msg = next;
+        }
+
+        return keepRunning;
+    }
+
+    void run() override
+    {
+        isCurrentThreadNtk() = true;
+
+        // Fl::wait() releases the lock while waiting for events
+        const FlScopedLock csl;
+
+        if (! fDisplayInitialized)
+        {
+            fDisplayInitialized = true;
+            fl_register_images();
 #ifdef DISTRHO_OS_LINUX
-        XInitThreads();
+            fl_open_display();
 #endif
+        }
+
+        fMessages.open();
+        fThreadInitialized.signal();
 
-        startThread();
+        for (; processMessages(false);)
+            Fl::wait();
 
-        for (; ! fThreadInitialized;)
-            d_msleep(10);
+        // process requests posted while we were quitting, later ones run on the posting thread
+        processMessages(true);
+
+        // the next start might be for a new set of windows
+        fRedrawScheduler.clear();
+
+        isCurrentThreadNtk() = false;
     }
 
+    DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NtkThread)
+};
+
+// -----------------------------------------------------------------------
+
+/**
+   DGL compatible App class that uses NTK instead of OpenGL.
+
+   All NtkApp instances in a process share the same NTK thread.
+   Other threads must not touch widgets directly, instead they post requests through postAsync() or postSync().
+   @see App
+ */
+class NtkApp
+{
+public:
+   /**
+      Function type for asynchronous requests, see postAsync().
+    */
+    typedef NtkThread::AsyncFunc AsyncFunc;
+
+   /**
+      Function type for synchronous requests, see postSync().
+    */
+    typedef NtkThread::SyncFunc SyncFunc;
+
+   /**
+      Constructor.
+    */
+    NtkApp()
+        : fThread(NtkThread::acquire()),
+          fWindows(),
+          fWindowMutex(),
+          fQuitting(false) {}
+
    /**
       Destructor.
     */
     ~NtkApp()
     {
-        stopThread(-1);
+        fQuitting.store(true);
         fWindows.clear();
+        fThread.release();
     }
 
    /**
@@ -110,18 +490,21 @@ public:
     */
     void exec()
     {
-        while (isThreadRunning() && ! shouldThreadExit())
+        while (! isQuiting())
             d_sleep(1);
     }
 
    /**
       Quit the application.
-      This stops the event-loop and closes all Windows.
+      This closes all Windows of this application.
+      The NTK thread keeps running while other applications use it.
     */
     void quit()
     {
-        signalThreadShouldExit();
-        stopThread(-1);
+        if (fQuitting.exchange(true))
+            return;
+
+        postSync(_hideWindowsCallback, this);
     }
 
    /**
@@ -130,62 +513,77 @@ public:
     */
     bool isQuiting() const noexcept
     {
-        if (isThreadRunning() && ! shouldThreadExit())
-            return false;
-        return true;
+        return fQuitting.load() || ! fThread.isRunning();
     }
 
     // -------------------------------------------------------------------
 
    /**
-      Create UI on our separate thread.
+      Run @a func on the NTK thread without waiting for it.
+      Requests are processed in the order they were posted.
+    */
+    void postAsync(const AsyncFunc func, void* const ptr, const uint32_t index = 0, const float value = 0.0f)
+    {
+        fThread.postAsync(func, ptr, index, value);
+    }
+
+   /**
+      Run @a func on the NTK thread, blocking until it has been called.
+      When called from the NTK thread itself @a func runs immediately.
+    */
+    void postSync(const SyncFunc func, void* const ptr)
+    {
+        fThread.postSync(func, ptr);
+    }
+
+   /**
+      Get the redraw scheduler shared by all NTK windows in this process.
+      Use it to limit repaints caused by fast changes, like parameter automation.
+      Must only be used from the NTK thread.
+    */
+    NtkRedrawScheduler& getRedrawScheduler() noexcept
+    {
+        return fThread.getRedrawScheduler();
+    }
+
+   /**
+      Set the maximum number of redraws per second for NtkWidget based windows, 0 means unlimited.
+      The default is DGL_NTK_MAX_REDRAW_RATE (60).
+      This setting is shared by all NtkApp instances in the process.
+    */
+    void setMaxRedrawRate(const uint hz)
+    {
+        postAsync(_setMaxRedrawRateCallback, this, hz);
+    }
+
+   /**
+      Create UI on the NTK thread.
       Blocks until the UI is created and returns it.
     */
     d_NtkUI* createUI(void* const func)
     {
-        DISTRHO_SAFE_ASSERT_RETURN(isThreadRunning(), nullptr);
-        DISTRHO_SAFE_ASSERT_RETURN(! fDoNextUI, nullptr);
+        DISTRHO_SAFE_ASSERT_RETURN(fThread.isRunning(), nullptr);
 
-        fNextUI.create = true;
-        fNextUI.func   = (NextUI::NtkUiFunc)func;
-        fDoNextUI      = true;
+        NextUI nextUI;
+        nextUI.create = true;
+        nextUI.func   = (NextUI::NtkUiFunc)func;
 
-        if (isThreadRunning() && ! shouldThreadExit())
-        {
-            for (; fDoNextUI;)
-                d_msleep(10);
-        }
-        else
-        {
-            fNextUI.run();
-            fDoNextUI = false;
-        }
+        postSync(_nextUICallback, &nextUI);
 
-        return fNextUI.ui;
+        return nextUI.ui;
     }
 
    /**
-      Delete UI on our separate thread.
+      Delete UI on the NTK thread.
       Blocks until the UI is deleted.
     */
     void deleteUI(d_NtkUI* const ui)
     {
-        DISTRHO_SAFE_ASSERT_RETURN(! fDoNextUI,);
+        NextUI nextUI;
+        nextUI.create = false;
+        nextUI.ui     = ui;
 
-        fNextUI.create = false;
-        fNextUI.ui     = ui;
-        fDoNextUI      = true;
-
-        if (isThreadRunning() && ! shouldThreadExit())
-        {
-            for (; fDoNextUI;)
-                d_msleep(10);
-        }
-        else
-        {
-            fNextUI.run();
-            fDoNextUI = false;
-        }
+        postSync(_nextUICallback, &nextUI);
     }
 
     // -------------------------------------------------------------------
@@ -208,78 +606,60 @@ private:
         void run();
     };
 
+    NtkThread& fThread;
+
     std::list<Fl_Double_Window*> fWindows;
     d_Mutex       fWindowMutex;
-    NextUI        fNextUI;
-    volatile bool fDoNextUI;
-    volatile bool fThreadInitialized;
+    DISTRHO_NAMESPACE::Atomic<bool> fQuitting;
 
-   /** @internal used by NtkWindow. */
-    void addWindow(Fl_Double_Window* const window)
+    static void _nextUICallback(void* ptr)
     {
-        DISTRHO_SAFE_ASSERT_RETURN(window != nullptr,);
-
-        if (fWindows.size() == 0 && ! isThreadRunning())
-            startThread();
-
-        const d_MutexLocker cml(fWindowMutex);
-        fWindows.push_back(window);
+        ((NextUI*)ptr)->run();
     }
 
-   /** @internal used by NtkWindow. */
-    void removeWindow(Fl_Double_Window* const window)
+    static void _setMaxRedrawRateCallback(void* ptr, uint32_t hz, float)
     {
-        DISTRHO_SAFE_ASSERT_RETURN(window != nullptr,);
-
-        const d_MutexLocker cml(fWindowMutex);
-        fWindows.remove(window);
-
-        if (fWindows.size() == 0)
-            signalThreadShouldExit();
+        ((NtkApp*)ptr)->getRedrawScheduler().setMaxRate(hz);
     }
 
-   /** @internal */
-    void run() override
+    static void _hideWindowsCallback(void* ptr)
     {
-        static bool initialized = false;
+        NtkApp* const self((NtkApp*)ptr);
 
-        if (! initialized)
+        // copy, hiding a window removes it from the list
+        std::list<Fl_Double_Window*> windows;
         {
-            initialized = true;
-            fl_register_images();
-#ifdef DISTRHO_OS_LINUX
-            fl_open_display();
-#endif
+            const d_MutexLocker cml(self->fWindowMutex);
+            windows = self->fWindows;
         }
 
-        fThreadInitialized = true;
-
-        for (; ! shouldThreadExit();)
+        for (std::list<Fl_Double_Window*>::reverse_iterator rit = windows.rbegin(), rite = windows.rend(); rit != rite; ++rit)
         {
-            {
-                const FlScopedLock csl;
+            Fl_Double_Window* const window(*rit);
+            window->hide();
+        }
+    }
 
-                if (fDoNextUI)
-                {
-                    fNextUI.run();
-                    fDoNextUI = false;
-                }
+   /** @internal used by NtkWindow. */
+    void addWindow(Fl_Double_Window* const window)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(window != nullptr,);
 
-                Fl::check();
-                Fl::flush();
-            }
+        const d_MutexLocker cml(fWindowMutex);
+        fWindows.push_back(window);
+        fQuitting.store(false);
+    }
 
-            d_msleep(20);
-        }
+   /** @internal used by NtkWindow. */
+    void removeWindow(Fl_Double_Window* const window)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(window != nullptr,);
 
-        const FlScopedLock csl;
         const d_MutexLocker cml(fWindowMutex);
+        fWindows.remove(window);
 
-        for (std::list<Fl_Double_Window*>::reverse_iterator rit = fWindows.rbegin(), rite = fWindows.rend(); rit != rite; ++rit)
-        {
-            Fl_Double_Window* const window(*rit);
-            window->hide();
-        }
+        if (fWindows.size() == 0)
+            fQuitting.store(true);
     }
 
     friend class NtkWindow;
@@ -0,0 +1,366 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DGL_NTK_IMAGE_CACHE_HPP_INCLUDED
+#define DGL_NTK_IMAGE_CACHE_HPP_INCLUDED
+
+#include "NtkApp.hpp"
+
+#ifdef override
+# define override_defined
+# undef override
+#endif
+
+#include <FL/Fl_PNG_Image.H>
+#include <FL/fl_draw.H>
+#include <FL/x.H>
+
+#ifdef override_defined
+# define override
+# undef override_defined
+#endif
+
+START_NAMESPACE_DGL
+
+// -----------------------------------------------------------------------
+
+/**
+   Process-wide cache of decoded images, shared by all NTK UIs.
+
+   Images are identified by a resource ID.
+   Resources compiled into the binary are registered once with registerResource() (or NtkImageResource),
+   IDs that were not registered are treated as PNG file paths.
+
+   Every image is decoded once, scaled variants are created once per size,
+   and static layers rendered into offscreen pixmaps are kept once per ID and size.
+   Everything is reference-counted and freed when its last user releases it,
+   so opening more instances of the same UI costs no extra decoding time nor pixmap memory.
+
+   Images and offscreens must only be requested, drawn and released from the NTK thread.
+ */
+class NtkImageCache
+{
+public:
+   /**
+      Function used to render a static layer, see getOffscreen().
+      It is called with the offscreen as the current drawing surface.
+    */
+    typedef void (*RenderFunc)(void* ptr, int width, int height);
+
+   /**
+      Get the cache instance.
+    */
+    static NtkImageCache& getInstance()
+    {
+        static NtkImageCache cache;
+        return cache;
+    }
+
+   /**
+      Register PNG data compiled into the binary as resource @a id.
+      The data is not copied and must remain valid for the lifetime of the process.
+      Registering the same ID again does nothing.
+    */
+    void registerResource(const char* const id, const uchar* const data, const uint size)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(id != nullptr && id[0] != '\0',);
+        DISTRHO_SAFE_ASSERT_RETURN(data != nullptr && size > 0,);
+
+        const d_MutexLocker cml(fMutex);
+
+        if (findResource(id) != nullptr)
+            return;
+
+        fResources.push_back(Resource(id, data, size));
+    }
+
+   /**
+      Get the decoded image for resource @a id, decoding it if needed.
+      Returns null if the resource cannot be found or decoded.
+      Every successful call must be matched by a call to releaseImage().
+    */
+    Fl_Image* getImage(const char* const id)
+    {
+        return getImage(id, 0, 0);
+    }
+
+   /**
+      Get a variant of resource @a id scaled to @a width x @a height, scaling it if needed.
+      Passing 0 for both sizes returns the original image.
+      Every successful call must be matched by a call to releaseImage().
+    */
+    Fl_Image* getImage(const char* const id, const int width, const int height)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(id != nullptr && id[0] != '\0', nullptr);
+
+        const d_MutexLocker cml(fMutex);
+
+        if (ImageEntry* const entry = findImage(id, width, height))
+        {
+            ++entry->refCount;
+            return entry->image;
+        }
+
+        Fl_Image* image;
+
+        if (width == 0 && height == 0)
+        {
+            image = decode(id);
+        }
+        else
+        {
+            DISTRHO_SAFE_ASSERT_RETURN(width > 0 && height > 0, nullptr);
+
+            // scale from the cached original if there is one, otherwise decode it just for this
+            ImageEntry* const original(findImage(id, 0, 0));
+            Fl_Image* const source((original != nullptr) ? original->image : decode(id));
+
+            if (source == nullptr)
+                return nullptr;
+
+            image = source->copy(width, height);
+
+            if (original == nullptr)
+                delete source;
+        }
+
+        if (image == nullptr)
+            return nullptr;
+
+        fImages.push_back(ImageEntry(id, width, height, image));
+        return image;
+    }
+
+   /**
+      Release an image obtained from getImage().
+      The image is deleted when no other user holds it.
+    */
+    void releaseImage(Fl_Image* const image)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(image != nullptr,);
+
+        const d_MutexLocker cml(fMutex);
+
+        for (std::list<ImageEntry>::iterator it = fImages.begin(), ite = fImages.end(); it != ite; ++it)
+        {
+            ImageEntry& entry(*it);
+
+            if (entry.image != image)
+                continue;
+
+            if (--entry.refCount == 0)
+            {
+                delete entry.image;
+                fImages.erase(it);
+            }
+            return;
+        }
+
+        d_stderr("NtkImageCache::releaseImage(%p) - image not found", image);
+    }
+
+   /**
+      Get an offscreen pixmap with a static layer, like a background with fixed labels and decorations.
+      The first request for @a id at this size calls @a func to render it, later requests reuse the same pixmap.
+      Draw it with fl_copy_offscreen(x, y, width, height, offscreen, 0, 0).
+      Every successful call must be matched by a call to releaseOffscreen().
+    */
+    Fl_Offscreen getOffscreen(const char* const id, const int width, const int height, const RenderFunc func, void* const ptr)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(id != nullptr && id[0] != '\0', 0);
+        DISTRHO_SAFE_ASSERT_RETURN(width > 0 && height > 0, 0);
+        DISTRHO_SAFE_ASSERT_RETURN(func != nullptr, 0);
+
+        const d_MutexLocker cml(fMutex);
+
+        for (std::list<OffscreenEntry>::iterator it = fOffscreens.begin(), ite = fOffscreens.end(); it != ite; ++it)
+        {
+            OffscreenEntry& entry(*it);
+
+            if (entry.width == width && entry.height == height && entry.id == id)
+            {
+                ++entry.refCount;
+                return entry.offscreen;
+            }
+        }
+
+        const Fl_Offscreen offscreen(fl_create_offscreen(width, height));
+        DISTRHO_SAFE_ASSERT_RETURN(offscreen != 0, 0);
+
+        fl_begin_offscreen(offscreen);
+        func(ptr, width, height);
+        fl_end_offscreen();
+
+        fOffscreens.push_back(OffscreenEntry(id, width, height, offscreen));
+        return offscreen;
+    }
+
+   /**
+      Release an offscreen obtained from getOffscreen().
+      The pixmap is deleted when no other user holds it.
+    */
+    void releaseOffscreen(const Fl_Offscreen offscreen)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(offscreen != 0,);
+
+        const d_MutexLocker cml(fMutex);
+
+        for (std::list<OffscreenEntry>::iterator it = fOffscreens.begin(), ite = fOffscreens.end(); it != ite; ++it)
+        {
+            OffscreenEntry& entry(*it);
+
+            if (entry.offscreen != offscreen)
+                continue;
+
+            if (--entry.refCount == 0)
+            {
+                fl_delete_offscreen(entry.offscreen);
+                fOffscreens.erase(it);
+            }
+            return;
+        }
+
+        d_stderr("NtkImageCache::releaseOffscreen() - offscreen not found");
+    }
+
+    // -------------------------------------------------------------------
+
+private:
+    struct Resource {
+        DISTRHO_NAMESPACE::d_string id;
+        const uchar* data;
+        uint size;
+
+        Resource(const char* const i, const uchar* const d, const uint s)
+            : id(i),
+              data(d),
+              size(s) {}
+    };
+
+    struct ImageEntry {
+        DISTRHO_NAMESPACE::d_string id;
+        int width, height;
+        Fl_Image* image;
+        uint refCount;
+
+        ImageEntry(const char* const i, const int w, const int h, Fl_Image* const img)
+            : id(i),
+              width(w),
+              height(h),
+              image(img),
+              refCount(1) {}
+    };
+
+    struct OffscreenEntry {
+        DISTRHO_NAMESPACE::d_string id;
+        int width, height;
+        Fl_Offscreen offscreen;
+        uint refCount;
+
+        OffscreenEntry(const char* const i, const int w, const int h, const Fl_Offscreen off)
+            : id(i),
+              width(w),
+              height(h),
+              offscreen(off),
+              refCount(1) {}
+    };
+
+    d_Mutex fMutex;
+    std::list<Resource>       fResources;
+    std::list<ImageEntry>     fImages;
+    std::list<OffscreenEntry> fOffscreens;
+
+    NtkImageCache()
+        : fMutex(),
+          fResources(),
+          fImages(),
+          fOffscreens() {}
+
+    ~NtkImageCache()
+    {
+        // images still held at exit are leaked on purpose, the display may be gone already
+        if (fImages.size() != 0 || fOffscreens.size() != 0)
+            d_stderr("NtkImageCache: %u images and %u offscreens were never released", uint(fImages.size()), uint(fOffscreens.size()));
+    }
+
+    const Resource* findResource(const char* const id) const
+    {
+        for (std::list<Resource>::const_iterator cit = fResources.begin(), cite = fResources.end(); cit != cite; ++cit)
+        {
+            const Resource& resource(*cit);
+
+            if (resource.id == id)
+                return &resource;
+        }
+
+        return nullptr;
+    }
+
+    ImageEntry* findImage(const char* const id, const int width, const int height)
+    {
+        for (std::list<ImageEntry>::iterator it = fImages.begin(), ite = fImages.end(); it != ite; ++it)
+        {
+            ImageEntry& entry(*it);
+
+            if (entry.width == width && entry.height == height && entry.id == id)
+                return &entry;
+        }
+
+        return nullptr;
+    }
+
+    // decode a registered resource from memory, or a PNG file if the ID is not registered
+    Fl_Image* decode(const char* const id) const
+    {
+        Fl_PNG_Image* image;
+
+        if (const Resource* const resource = findResource(id))
+            image = new Fl_PNG_Image(id, resource->data, int(resource->size));
+        else
+            image = new Fl_PNG_Image(id);
+
+        if (image->w() > 0 && image->h() > 0)
+            return image;
+
+        d_stderr("NtkImageCache: failed to decode image '%s'", id);
+        delete image;
+        return nullptr;
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NtkImageCache)
+};
+
+// -----------------------------------------------------------------------
+
+/**
+   Registers PNG data compiled into the binary with the image cache during static initialization.
+   Declare one per resource at file scope, for example:
+   @code
+   static const NtkImageResource kKnobResource("knob.png", knob_png_data, knob_png_size);
+   @endcode
+ */
+struct NtkImageResource {
+    NtkImageResource(const char* const id, const uchar* const data, const uint size)
+    {
+        NtkImageCache::getInstance().registerResource(id, data, size);
+    }
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DGL
+
+#endif // DGL_NTK_IMAGE_CACHE_HPP_INCLUDED
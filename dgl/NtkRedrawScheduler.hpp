@@ -0,0 +1,314 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DGL_NTK_REDRAW_SCHEDULER_HPP_INCLUDED
+#define DGL_NTK_REDRAW_SCHEDULER_HPP_INCLUDED
+
+#include "Base.hpp"
+#include "../distrho/extra/d_sleep.hpp"
+
+#ifdef override
+# define override_defined
+# undef override
+#endif
+
+#include <algorithm>
+#include <list>
+#include <FL/Fl_Widget.H>
+
+#ifdef override_defined
+# define override
+# undef override_defined
+#endif
+
+#ifndef DISTRHO_OS_WINDOWS
+# include <time.h>
+#endif
+
+#ifndef DGL_NTK_MAX_REDRAW_RATE
+# define DGL_NTK_MAX_REDRAW_RATE 60
+#endif
+
+// paint timing hooks, used by the UI benchmark target
+#ifndef DGL_NTK_PROFILING
+# ifdef DISTRHO_PLUGIN_TARGET_UI_BENCHMARK
+#  define DGL_NTK_PROFILING 1
+# else
+#  define DGL_NTK_PROFILING 0
+# endif
+#endif
+
+START_NAMESPACE_DGL
+
+// -----------------------------------------------------------------------
+
+/**
+   Frame-rate limiter for NTK widgets.
+
+   Redraw requests are collected per widget, coalesced into a single damage region,
+   and applied at most once per frame. Requests for hidden widgets are dropped,
+   NTK repaints windows fully when they are shown again.
+
+   There is one scheduler per NTK thread, it must only be used from that thread.
+   @see NtkWidget::scheduleRedraw(), NtkApp::setMaxRedrawRate(uint)
+ */
+class NtkRedrawScheduler
+{
+public:
+#if DGL_NTK_PROFILING
+    typedef void (*PaintCallback)(void* ptr, Fl_Widget* widget, double start, double end);
+#endif
+
+    NtkRedrawScheduler()
+        : fMaxRate(DGL_NTK_MAX_REDRAW_RATE),
+          fTimerActive(false),
+#if DGL_NTK_PROFILING
+          fPaintCallback(nullptr),
+          fPaintCallbackPtr(nullptr),
+#endif
+          fPending() {}
+
+    ~NtkRedrawScheduler()
+    {
+        clear();
+    }
+
+   /**
+      Set the maximum number of redraws per second, 0 means unlimited.
+    */
+    void setMaxRate(const uint hz)
+    {
+        fMaxRate = hz;
+    }
+
+    uint getMaxRate() const noexcept
+    {
+        return fMaxRate;
+    }
+
+   /**
+      Schedule a redraw of the whole @a widget on the next frame.
+    */
+    void schedule(Fl_Widget* const widget)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(widget != nullptr,);
+
+        Damage& damage(findOrAdd(widget));
+        damage.full = true;
+
+        arm();
+    }
+
+   /**
+      Schedule a redraw of a region of @a widget on the next frame.
+      The region is in window coordinates, as in Fl_Widget::damage().
+    */
+    void schedule(Fl_Widget* const widget, const int x, const int y, const int w, const int h)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(widget != nullptr,);
+
+        if (w <= 0 || h <= 0)
+            return;
+
+        Damage& damage(findOrAdd(widget));
+
+        if (! damage.full)
+        {
+            if (damage.w == 0)
+            {
+                damage.x = x;
+                damage.y = y;
+                damage.w = w;
+                damage.h = h;
+            }
+            else
+            {
+                const int x2(std::max(damage.x+damage.w, x+w));
+                const int y2(std::max(damage.y+damage.h, y+h));
+
+                damage.x = std::min(damage.x, x);
+                damage.y = std::min(damage.y, y);
+                damage.w = x2 - damage.x;
+                damage.h = y2 - damage.y;
+            }
+        }
+
+        arm();
+    }
+
+   /**
+      Check if a widget that last painted at @a lastPaintTime may paint now.
+      Updates @a lastPaintTime when it returns true.
+    */
+    bool canPaintNow(double& lastPaintTime) const
+    {
+        const double now(getTime());
+
+        // allow some jitter, the frame timer is not exact
+        if (fMaxRate != 0 && now - lastPaintTime < 0.9/double(fMaxRate))
+            return false;
+
+        lastPaintTime = now;
+        return true;
+    }
+
+   /**
+      Get a monotonic time in seconds, as used for frame timing.
+    */
+    static double getTime() noexcept
+    {
+#ifdef DISTRHO_OS_WINDOWS
+        return double(::GetTickCount())/1000.0;
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return double(ts.tv_sec) + double(ts.tv_nsec)/1000000000.0;
+#endif
+    }
+
+#if DGL_NTK_PROFILING
+   /**
+      Set a function to be called after every NtkWidget paint, with its start and end times.
+    */
+    void setPaintCallback(const PaintCallback callback, void* const ptr)
+    {
+        fPaintCallback    = callback;
+        fPaintCallbackPtr = ptr;
+    }
+
+   /** @internal used by NtkWidget. */
+    void reportPaint(Fl_Widget* const widget, const double start, const double end) const
+    {
+        if (fPaintCallback != nullptr)
+            fPaintCallback(fPaintCallbackPtr, widget, start, end);
+    }
+#endif
+
+   /**
+      Drop all pending requests.
+    */
+    void clear()
+    {
+        if (fTimerActive)
+        {
+            Fl::remove_timeout(_frameCallback, this);
+            fTimerActive = false;
+        }
+
+        for (std::list<Damage>::iterator it = fPending.begin(), ite = fPending.end(); it != ite; ++it)
+        {
+            Damage& damage(*it);
+
+            if (damage.widget != nullptr)
+                Fl::release_widget_pointer(damage.widget);
+        }
+
+        fPending.clear();
+    }
+
+    // -------------------------------------------------------------------
+
+private:
+    struct Damage {
+        Fl_Widget* widget;
+        bool full;
+        int x, y, w, h;
+
+        Damage(Fl_Widget* const wid) noexcept
+            : widget(wid),
+              full(false),
+              x(0), y(0), w(0), h(0) {}
+    };
+
+    uint fMaxRate;
+    bool fTimerActive;
+
+#if DGL_NTK_PROFILING
+    PaintCallback fPaintCallback;
+    void*         fPaintCallbackPtr;
+#endif
+
+    // a list so entries never move, the widget pointers are watched by NTK
+    std::list<Damage> fPending;
+
+    Damage& findOrAdd(Fl_Widget* const widget)
+    {
+        for (std::list<Damage>::iterator it = fPending.begin(), ite = fPending.end(); it != ite; ++it)
+        {
+            Damage& damage(*it);
+
+            if (damage.widget == widget)
+                return damage;
+        }
+
+        fPending.push_back(Damage(widget));
+
+        // NTK sets this to null if the widget gets deleted before the next frame
+        Damage& damage(fPending.back());
+        Fl::watch_widget_pointer(damage.widget);
+        return damage;
+    }
+
+    void arm()
+    {
+        if (fTimerActive)
+            return;
+
+        fTimerActive = true;
+        Fl::add_timeout((fMaxRate != 0) ? 1.0/double(fMaxRate) : 0.0, _frameCallback, this);
+    }
+
+    void applyPending()
+    {
+        fTimerActive = false;
+
+        // take the list first, redraw() may call back into the scheduler
+        std::list<Damage> pending;
+        pending.swap(fPending);
+
+        for (std::list<Damage>::iterator it = pending.begin(), ite = pending.end(); it != ite; ++it)
+        {
+            Damage& damage(*it);
+
+            if (damage.widget == nullptr)
+                continue;
+
+            Fl_Widget* const widget(damage.widget);
+            Fl::release_widget_pointer(damage.widget);
+
+            if (! widget->visible_r())
+                continue;
+
+            if (damage.full)
+                widget->redraw();
+            else
+                widget->damage(FL_DAMAGE_ALL, damage.x, damage.y, damage.w, damage.h);
+        }
+    }
+
+    static void _frameCallback(void* ptr)
+    {
+        ((NtkRedrawScheduler*)ptr)->applyPending();
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NtkRedrawScheduler)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DGL
+
+#endif // DGL_NTK_REDRAW_SCHEDULER_HPP_INCLUDED
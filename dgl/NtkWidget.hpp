@@ -35,7 +35,8 @@ public:
     */
     explicit NtkWidget(NtkWindow& parent)
         : Fl_Double_Window(100, 100),
-          fParent(parent)
+          fParent(parent),
+          fLastPaintTime(0.0)
     {
         fParent.add(this);
         show();
@@ -67,8 +68,54 @@ public:
         return fParent;
     }
 
+   /**
+      Schedule a redraw of this widget on the next frame.
+      Unlike redraw(), many calls within the same frame result in a single repaint.
+      Use this for changes coming from the plugin side, like parameter changes during automation.
+      Must be called from the NTK thread, like all other widget functions.
+      @see NtkApp::setMaxRedrawRate(uint)
+    */
+    void scheduleRedraw()
+    {
+        getParentApp().getRedrawScheduler().schedule(this);
+    }
+
+   /**
+      Schedule a redraw of a region of this widget on the next frame.
+      Regions requested within the same frame are merged.
+    */
+    void scheduleRedraw(const int x, const int y, const int w, const int h)
+    {
+        getParentApp().getRedrawScheduler().schedule(this, x, y, w, h);
+    }
+
+protected:
+   /**
+      NTK flush function, called when the widget needs to be repainted.
+      This is overriden here to limit repaints to the maximum redraw rate,
+      damage arriving too early is moved to the next frame.
+    */
+    void flush() override
+    {
+        NtkRedrawScheduler& scheduler(getParentApp().getRedrawScheduler());
+
+        if (scheduler.canPaintNow(fLastPaintTime))
+        {
+#if DGL_NTK_PROFILING
+            const double start(NtkRedrawScheduler::getTime());
+            Fl_Double_Window::flush();
+            scheduler.reportPaint(this, start, NtkRedrawScheduler::getTime());
+#else
+            Fl_Double_Window::flush();
+#endif
+        }
+        else
+            scheduler.schedule(this);
+    }
+
 private:
     NtkWindow& fParent;
+    double     fLastPaintTime;
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NtkWidget)
 };
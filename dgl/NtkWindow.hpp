@@ -64,6 +64,11 @@ public:
             fApp.removeWindow(this);
             Fl_Double_Window::hide();
         }
+        else if (fIsVisible)
+        {
+            fIsVisible = false;
+            fApp.removeWindow(this);
+        }
     }
 
     void show() override
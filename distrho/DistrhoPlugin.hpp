@@ -77,6 +77,15 @@ static const uint32_t kParameterIsLogarithmic = 0x08;
  */
 static const uint32_t kParameterIsOutput = 0x10;
 
+/**
+   Parameter can be modulated at audio rate, like a modular synth control voltage.
+   The plugin reads the per-sample values during d_run() with Plugin::d_getParameterCV().
+   LV2 exports it as a CV port and the JACK standalone as an extra audio input,
+   other formats only have block-rate values, which are repeated for every sample.
+   Only valid for inputs.
+ */
+static const uint32_t kParameterIsCV = 0x20;
+
 /** @} */
 
 /* ------------------------------------------------------------------------------------------------------------
@@ -375,6 +384,11 @@ struct TimePosition {
           bbt() {}
 };
 
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+// see extra/d_presets.hpp
+class PresetTable;
+#endif
+
 /* ------------------------------------------------------------------------------------------------------------
  * DPF Plugin */
 
@@ -431,6 +445,28 @@ public:
     */
     uint32_t d_getBufferSize() const noexcept;
 
+   /**
+      Get the minimum number of frames the host will use when calling d_run(), or 0 if unknown.
+      When equal to d_getBufferSize() the host always uses the same block length.
+      @note: Only provided by LV2 hosts, through the buf-size minBlockLength option.
+    */
+    uint32_t d_getMinBufferSize() const noexcept;
+
+   /**
+      Get the number of frames the host will usually use when calling d_run().
+      Use this to size internal blocks for the common case, while still allocating for d_getBufferSize().
+      Returns d_getBufferSize() if the host does not provide it.
+      @note: Only provided by LV2 hosts, through the buf-size nominalBlockLength option.
+    */
+    uint32_t d_getNominalBufferSize() const noexcept;
+
+   /**
+      Get the size in bytes of the host buffers for event (MIDI and atom) ports, or 0 if unknown.
+      Use this to size messages so they fit in a single d_run() call.
+      @note: Only provided by LV2 hosts, through the buf-size sequenceSize option.
+    */
+    uint32_t d_getSequenceSize() const noexcept;
+
    /**
       Get the current sample rate that will be used during processing.
       This value will remain constant between activate and deactivate.
@@ -438,6 +474,22 @@ public:
     */
     double d_getSampleRate() const noexcept;
 
+   /**
+      Check if the host is currently rendering offline (freewheeling, bouncing or exporting).
+      While offline, d_run() is not bound to real-time constraints and can be called faster or slower than real-time,
+      so it is a good time to switch to higher quality algorithms.
+      @see d_offlineChanged(bool)
+    */
+    bool d_isOffline() const noexcept;
+
+   /**
+      Get the per-sample values of a kParameterIsCV input for the current d_run() block.
+      This function should only be called during d_run(), the returned buffer is only valid until it returns.
+      When the host has no audio-rate data for the parameter, the buffer is filled with the current value.
+      Returns null for parameters without the kParameterIsCV hint, or for blocks bigger than d_getBufferSize().
+    */
+    const float* d_getParameterCV(uint32_t index) const noexcept;
+
 #if DISTRHO_PLUGIN_WANT_TIMEPOS
    /**
       Get the current host transport time position.
@@ -465,6 +517,71 @@ public:
     bool d_writeMidiEvent(const MidiEvent& midiEvent) noexcept;
 #endif
 
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+   /**
+      Push @a count floats of audio or analysis data to the UI, for scopes, meters and analyzers.
+      The data is copied into a preallocated lock-free ring of DISTRHO_PLUGIN_UI_STREAM_SIZE floats,
+      the UI pulls it from its own thread using NtkUI::d_readStreamData().
+      This function must only be called during d_run(), it never blocks nor allocates.
+      Returns false (and writes nothing) when the ring does not have enough free space,
+      which usually means the UI is closed or not keeping up; decimate your data if this happens often.
+      @note: DSSI UIs get this data through shared memory, negotiated when the UI starts.
+    */
+    bool d_writeStreamData(const float* data, uint32_t count) noexcept;
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+   /**
+      Publish a snapshot of DSP state for the UI, like meter levels or the data behind a graph display.
+      The UI gets the latest complete copy with NtkUI::d_readSnapshot(), without ever blocking this side
+      or reading a half-written block. This replaces reading plugin members through direct access.
+      Call this at the end of d_run(), @a size must not exceed DISTRHO_PLUGIN_SNAPSHOT_SIZE bytes.
+      @note: Not supported in DSSI, nor in LV2 hosts that run the UI out-of-process.
+    */
+    void d_publishSnapshot(const void* data, uint32_t size) noexcept;
+
+   /**
+      Typed version of the above, @a snapshot must be a plain struct (no pointers or virtuals).
+    */
+    template<typename T>
+    void d_publishSnapshot(const T& snapshot) noexcept
+    {
+        d_publishSnapshot(&snapshot, sizeof(T));
+    }
+#endif
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+   /**
+      Schedule a background job, like loading a file or computing a large table.
+      @a data is copied (up to DISTRHO_PLUGIN_WORKER_MESSAGE_SIZE bytes) and later given to d_work() in a worker thread.
+      This function must only be called during d_run(), it never blocks nor allocates.
+      Returns false when the job could not be queued.
+      @note: Uses the host worker in LV2, a framework-owned low-priority thread in other formats.
+    */
+    bool d_scheduleWork(const void* data, uint32_t size) noexcept;
+
+   /**
+      Send the result of a background job back to the audio thread, where it arrives through d_workCompleted().
+      This function must only be called during d_work().
+      Returns false when the response could not be queued.
+    */
+    bool d_respondWork(const void* data, uint32_t size) noexcept;
+#endif
+
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+   /**
+      Use @a table for program changes, ramping parameter inputs to the new values over @a rampFrames.
+      While a table is set, program changes never call d_setProgram(); the framework moves each parameter input
+      towards its table value through d_setParameterValue() during d_run(), which is split into sub-blocks
+      of DISTRHO_PLUGIN_PROGRAM_RAMP_BLOCK frames while a ramp is running. Boolean and integer parameters switch at once.
+      The table must have one value per parameter, programs beyond its preset count are ignored.
+      The plugin keeps ownership of @a table, which must stay valid until replaced. Pass null to go back to d_setProgram().
+      This function must only be called in the constructor, d_run() or d_workCompleted(),
+      so a table loaded in d_work() can be swapped in without locking and the old one sent back to d_work() for deletion.
+    */
+    void d_setProgramTable(const PresetTable* table, uint32_t rampFrames) noexcept;
+#endif
+
 protected:
    /* --------------------------------------------------------------------------------------------------------
     * Information */
@@ -552,6 +669,7 @@ protected:
       Change the currently used program to @a index.
       The host may call this function from any context, including realtime processing.
       Must be implemented by your plugin class only if DISTRHO_PLUGIN_WANT_PROGRAMS is enabled.
+      Not called for plugins using d_setProgramTable(), which is the real-time safe way to handle programs.
     */
     virtual void d_setProgram(uint32_t index) = 0;
 #endif
@@ -592,6 +710,30 @@ protected:
     virtual void d_run(const float** inputs, float** outputs, uint32_t frames) = 0;
 #endif
 
+#if DISTRHO_PLUGIN_WANT_WORKER
+   /**
+      Run a background job scheduled with d_scheduleWork().
+      This is called from a non real-time thread, so it may block and allocate,
+      but it can run concurrently with d_run().
+      Use d_respondWork() to hand results back to the audio thread.
+    */
+    virtual void d_work(const void* data, uint32_t size) = 0;
+
+   /**
+      Receive a response sent by d_respondWork().
+      This is called from the audio thread between calls to d_run(), so it must not block nor allocate.
+      This is the place to swap in a freshly loaded resource.
+    */
+    virtual void d_workCompleted(const void* data, uint32_t size);
+
+   /**
+      Called after d_workCompleted() got all the responses of a cycle, before the next d_run().
+      Use this to apply related responses together. It can also be called in cycles without responses.
+      @note: Maps to the end_run function of the LV2 worker interface.
+    */
+    virtual void d_workResponsesDone();
+#endif
+
    /* --------------------------------------------------------------------------------------------------------
     * Callbacks (optional) */
 
@@ -611,6 +753,13 @@ protected:
     */
     virtual void d_sampleRateChanged(double newSampleRate);
 
+   /**
+      Optional callback to inform the plugin about a change in offline rendering mode.
+      This function is called from the audio thread right before d_run(), when the new mode takes effect.
+      @see d_isOffline()
+    */
+    virtual void d_offlineChanged(bool offline);
+
     // -------------------------------------------------------------------------------------------------------
 
 private:
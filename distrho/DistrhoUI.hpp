@@ -59,12 +59,16 @@ public:
     double d_getSampleRate() const noexcept;
 
    /**
-      TODO: Document this.
+      Tell the host a user gesture on parameter @a index has started or finished, like grabbing and releasing a knob.
+      Finishing a gesture sends the last value set with d_setParameterValue() right away.
     */
     void d_editParameter(const uint32_t index, const bool started);
 
    /**
-      TODO: Document this.
+      Change the value of parameter @a index on the plugin side.
+      Changes are coalesced per parameter and sent to the host on the next UI idle,
+      so dragging a knob results in at most one host write per parameter per idle cycle.
+      @see d_editParameter(uint32_t, bool)
     */
     void d_setParameterValue(const uint32_t index, const float value);
 
@@ -82,6 +86,34 @@ public:
     void d_sendNote(const uint8_t channel, const uint8_t note, const uint8_t velocity);
 #endif
 
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+   /**
+      Read up to @a maxCount floats pushed by the plugin with Plugin::d_writeStreamData().
+      Returns the number of floats actually copied into @a data, 0 if nothing is pending.
+      Call this from d_uiIdle() and keep reading until it returns less than @a maxCount,
+      otherwise the plugin side will eventually find the stream full and drop data.
+    */
+    uint32_t d_readStreamData(float* data, uint32_t maxCount) noexcept;
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+   /**
+      Copy the latest snapshot published by the plugin with Plugin::d_publishSnapshot() into @a data.
+      Returns false if no snapshot of exactly @a size bytes is available yet, in which case @a data is untouched.
+      Never blocks and never returns a partially written snapshot.
+    */
+    bool d_readSnapshot(void* data, uint32_t size) noexcept;
+
+   /**
+      Typed version of the above, @a T must match the type used on the plugin side.
+    */
+    template<typename T>
+    bool d_readSnapshot(T& snapshot) noexcept
+    {
+        return d_readSnapshot(&snapshot, sizeof(T));
+    }
+#endif
+
 #if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
    /* --------------------------------------------------------------------------------------------------------
     * Direct DSP access - DO NOT USE THIS UNLESS STRICTLY NECESSARY!! */
@@ -0,0 +1,151 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_ATOMIC_HPP_INCLUDED
+#define DISTRHO_ATOMIC_HPP_INCLUDED
+
+#include "../DistrhoUtils.hpp"
+
+// -----------------------------------------------------------------------
+// Atomic values shared between threads, without locks.
+//
+// Thin wrappers over the GCC __atomic builtins, usable without C++11.
+// Unless a different order is given, loads acquire and stores release,
+// which is what flags and counters handed between threads need.
+// Only use types the CPU can handle lock-free (integers, bool, pointers).
+
+// Data written by different threads should be at least this far apart
+#define DISTRHO_CACHE_LINE_SIZE 64
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+template<typename T>
+class Atomic
+{
+public:
+    Atomic() noexcept
+        : fValue(T()) {}
+
+    Atomic(const T value) noexcept
+        : fValue(value) {}
+
+    T load(const int order = __ATOMIC_ACQUIRE) const noexcept
+    {
+        return __atomic_load_n(&fValue, order);
+    }
+
+    void store(const T value, const int order = __ATOMIC_RELEASE) noexcept
+    {
+        __atomic_store_n(&fValue, value, order);
+    }
+
+    /*
+     * Set a new value, returning the previous one.
+     */
+    T exchange(const T value, const int order = __ATOMIC_ACQ_REL) noexcept
+    {
+        return __atomic_exchange_n(&fValue, value, order);
+    }
+
+    /*
+     * Set @a desired if the current value is @a expected.
+     * On failure @a expected is updated to the current value (with relaxed ordering) and false is returned.
+     */
+    bool compareExchange(T& expected, const T desired, const int order = __ATOMIC_ACQ_REL) noexcept
+    {
+        return __atomic_compare_exchange_n(&fValue, &expected, desired, false, order, __ATOMIC_RELAXED);
+    }
+
+    /*
+     * Add to the value, returning the previous one.
+     * Integer types only.
+     */
+    T fetchAdd(const T value, const int order = __ATOMIC_ACQ_REL) noexcept
+    {
+        return __atomic_fetch_add(&fValue, value, order);
+    }
+
+    /*
+     * Subtract from the value, returning the previous one.
+     * Integer types only.
+     */
+    T fetchSub(const T value, const int order = __ATOMIC_ACQ_REL) noexcept
+    {
+        return __atomic_fetch_sub(&fValue, value, order);
+    }
+
+private:
+    T fValue;
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(Atomic)
+};
+
+// -----------------------------------------------------------------------
+// A float that can be written by one thread and read by others, such as a
+// parameter value or a meter level. Stored as its bit pattern, so loads never
+// see a torn value. Relaxed by default, as a lone value needs no ordering.
+
+class AtomicFloat
+{
+public:
+    AtomicFloat() noexcept
+        : fBits(0) {}
+
+    AtomicFloat(const float value) noexcept
+        : fBits(toBits(value)) {}
+
+    float load(const int order = __ATOMIC_RELAXED) const noexcept
+    {
+        return fromBits(__atomic_load_n(&fBits, order));
+    }
+
+    void store(const float value, const int order = __ATOMIC_RELAXED) noexcept
+    {
+        __atomic_store_n(&fBits, toBits(value), order);
+    }
+
+    float exchange(const float value, const int order = __ATOMIC_ACQ_REL) noexcept
+    {
+        return fromBits(__atomic_exchange_n(&fBits, toBits(value), order));
+    }
+
+private:
+    uint32_t fBits;
+
+    static uint32_t toBits(const float value) noexcept
+    {
+        union { float f; uint32_t u; } bits;
+        bits.f = value;
+        return bits.u;
+    }
+
+    static float fromBits(const uint32_t value) noexcept
+    {
+        union { float f; uint32_t u; } bits;
+        bits.u = value;
+        return bits.f;
+    }
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(AtomicFloat)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_ATOMIC_HPP_INCLUDED
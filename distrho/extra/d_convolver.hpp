@@ -0,0 +1,535 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_CONVOLVER_HPP_INCLUDED
+#define DISTRHO_CONVOLVER_HPP_INCLUDED
+
+#include "d_fft.hpp"
+#include "d_thread.hpp"
+
+#include <cstring>
+
+// -----------------------------------------------------------------------
+// Zero-latency partitioned convolution.
+//
+// The impulse response is cut into three segments:
+//  - head, IR[0, H):    direct FIR, no latency
+//  - body, IR[H, 2T):   uniformly partitioned FFT convolution, H sized partitions,
+//                       computed in the audio thread every H samples
+//  - tail, IR[2T, end): uniformly partitioned FFT convolution, T sized partitions,
+//                       computed outside the audio thread every T samples
+//
+// A tail job started when a T block of input is complete has T samples of time
+// to finish before its output is due (about 21 ms for T=1024 at 48 kHz), a late job
+// drops a block of the tail. So it needs a real-time priority thread that is woken
+// right away, like the threads of a ThreadPool created with a priority:
+//
+//   ctor:  fPool = new ThreadPool("convolver", 1, 16, 70);
+//          fConvolver.setTailThreadPool(fPool);
+//
+// Do not use d_scheduleWork() for this, the framework worker runs at background
+// priority and is meant for jobs without a deadline. Other threads can be plugged
+// in with setTailScheduler().
+//
+// Without a pool or scheduler, or if scheduling fails, the tail is computed inline.
+//
+// A ConvolverKernel holds the precomputed partition spectra of one IR and is
+// read-only once built, so any number of Convolver instances can share it.
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+class ConvolverKernel
+{
+public:
+    /*
+     * Build the kernel for @a length samples of @a ir. This allocates and does FFTs, do not use in the audio thread.
+     * @a headSize and @a tailSize are the H and T partition sizes above, powers of 2 with headSize >= 16 and tailSize >= headSize.
+     */
+    ConvolverKernel(const float* const ir, const uint32_t length, const uint32_t headSize = 64, const uint32_t tailSize = 1024)
+        : fLength(0),
+          fHeadSize(headSize),
+          fTailSize(tailSize),
+          fHead(nullptr),
+          fBodyFFT(nullptr),
+          fBodyCount(0),
+          fBodyParts(nullptr),
+          fTailFFT(nullptr),
+          fTailCount(0),
+          fTailParts(nullptr)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(ir != nullptr && length > 0,);
+        DISTRHO_SAFE_ASSERT_RETURN(headSize >= 16 && (headSize & (headSize-1)) == 0,);
+        DISTRHO_SAFE_ASSERT_RETURN(tailSize >= headSize && (tailSize & (tailSize-1)) == 0,);
+
+        const uint32_t H(headSize), T(tailSize);
+
+        // head, stored reversed so the FIR is a plain dot product
+        fHead = new float[H];
+
+        for (uint32_t i=0; i < H; ++i)
+            fHead[H-1-i] = (i < length) ? ir[i] : 0.0f;
+
+        const uint32_t bodyEnd((length < 2*T) ? length : 2*T);
+
+        if (bodyEnd > H)
+        {
+            fBodyFFT   = new FFT(2*H);
+            fBodyCount = (bodyEnd - H + H - 1) / H;
+            fBodyParts = makePartitions(*fBodyFFT, ir + H, bodyEnd - H, fBodyCount, H);
+        }
+
+        if (length > 2*T)
+        {
+            fTailFFT   = new FFT(2*T);
+            fTailCount = (length - 2*T + T - 1) / T;
+            fTailParts = makePartitions(*fTailFFT, ir + 2*T, length - 2*T, fTailCount, T);
+        }
+
+        fLength = length;
+    }
+
+    ~ConvolverKernel()
+    {
+        delete[] fHead;
+        delete[] fBodyParts;
+        delete[] fTailParts;
+        delete fBodyFFT;
+        delete fTailFFT;
+    }
+
+    bool isValid() const noexcept
+    {
+        return fLength != 0;
+    }
+
+    uint32_t getLength() const noexcept
+    {
+        return fLength;
+    }
+
+private:
+    uint32_t fLength;
+    uint32_t fHeadSize;
+    uint32_t fTailSize;
+
+    float* fHead;
+
+    FFT*     fBodyFFT;
+    uint32_t fBodyCount;
+    float*   fBodyParts; // fBodyCount spectra of H+1 bins, real parts then imaginary parts
+
+    FFT*     fTailFFT;
+    uint32_t fTailCount;
+    float*   fTailParts; // same, with T+1 bins
+
+    // Overlap-save partitions: each one is the spectrum of 'size' IR samples padded with zeros to 2*size.
+    static float* makePartitions(const FFT& fft, const float* const ir, const uint32_t length, const uint32_t count, const uint32_t size)
+    {
+        const uint32_t bins(size + 1);
+
+        float* const parts(new float[count * bins * 2]);
+        float* const buf(new float[size * 2]);
+
+        for (uint32_t p=0; p < count; ++p)
+        {
+            const uint32_t offset(p * size);
+            const uint32_t n((length - offset < size) ? length - offset : size);
+
+            std::memset(buf, 0, sizeof(float)*size*2);
+            std::memcpy(buf, ir + offset, sizeof(float)*n);
+
+            fft.forward(buf, parts + p*bins*2, parts + p*bins*2 + bins);
+        }
+
+        delete[] buf;
+        return parts;
+    }
+
+    friend class Convolver;
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(ConvolverKernel)
+};
+
+// -----------------------------------------------------------------------
+// One mono convolution stream.
+// init() allocates all the buffers; after that process() is real-time safe.
+
+class Convolver
+{
+public:
+    typedef bool (*TailScheduler)(void* ptr);
+
+    Convolver() noexcept
+        : fKernel(nullptr),
+          fScheduler(nullptr),
+          fSchedulerPtr(nullptr),
+          fPool(nullptr),
+          fBodyIn(nullptr),
+          fBodyOut(nullptr),
+          fBodyFdl(nullptr),
+          fBodyAcc(nullptr),
+          fBodyTime(nullptr),
+          fBodyFdlPos(0),
+          fPos(0),
+          fTailIn(nullptr),
+          fTailJobIn(nullptr),
+          fTailBuf(nullptr),
+          fTailFdl(nullptr),
+          fTailAcc(nullptr),
+          fTailTime(nullptr),
+          fTailFdlPos(0),
+          fTailPos(0),
+          fTailReadIdx(0),
+          fTailState(kTailIdle),
+          fTailOverruns(0)
+    {
+        fTailOut[0] = fTailOut[1] = nullptr;
+    }
+
+    ~Convolver()
+    {
+        clear();
+    }
+
+    /*
+     * Allocate the buffers for @a kernel, which must stay alive until clear() or destruction.
+     * Call from the plugin constructor or d_activate(), not while a tail job may be running.
+     */
+    bool init(const ConvolverKernel* const kernel)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(kernel != nullptr && kernel->isValid(), false);
+
+        clear();
+
+        const uint32_t H(kernel->fHeadSize), T(kernel->fTailSize);
+
+        fBodyIn  = new float[2*H];
+        fBodyOut = new float[H];
+
+        if (kernel->fBodyCount != 0)
+        {
+            fBodyFdl  = new float[kernel->fBodyCount * (H+1) * 2];
+            fBodyAcc  = new float[(H+1) * 2];
+            fBodyTime = new float[2*H];
+        }
+
+        if (kernel->fTailCount != 0)
+        {
+            fTailIn     = new float[T];
+            fTailJobIn  = new float[T];
+            fTailBuf    = new float[2*T];
+            fTailFdl    = new float[kernel->fTailCount * (T+1) * 2];
+            fTailAcc    = new float[(T+1) * 2];
+            fTailTime   = new float[2*T];
+            fTailOut[0] = new float[T];
+            fTailOut[1] = new float[T];
+        }
+
+        fKernel = kernel;
+        reset();
+        return true;
+    }
+
+    /*
+     * Free all buffers.
+     */
+    void clear() noexcept
+    {
+        fKernel = nullptr;
+
+        delete[] fBodyIn;
+        delete[] fBodyOut;
+        delete[] fBodyFdl;
+        delete[] fBodyAcc;
+        delete[] fBodyTime;
+        delete[] fTailIn;
+        delete[] fTailJobIn;
+        delete[] fTailBuf;
+        delete[] fTailFdl;
+        delete[] fTailAcc;
+        delete[] fTailTime;
+        delete[] fTailOut[0];
+        delete[] fTailOut[1];
+
+        fBodyIn = fBodyOut = fBodyFdl = fBodyAcc = fBodyTime = nullptr;
+        fTailIn = fTailJobIn = fTailBuf = fTailFdl = fTailAcc = fTailTime = nullptr;
+        fTailOut[0] = fTailOut[1] = nullptr;
+    }
+
+    /*
+     * Silence all convolution state.
+     * Call from d_activate(), not while a tail job may be running.
+     */
+    void reset() noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fKernel != nullptr,);
+
+        const uint32_t H(fKernel->fHeadSize), T(fKernel->fTailSize);
+
+        std::memset(fBodyIn,  0, sizeof(float)*2*H);
+        std::memset(fBodyOut, 0, sizeof(float)*H);
+
+        if (fBodyFdl != nullptr)
+            std::memset(fBodyFdl, 0, sizeof(float) * fKernel->fBodyCount * (H+1) * 2);
+
+        if (fTailFdl != nullptr)
+        {
+            std::memset(fTailIn,     0, sizeof(float)*T);
+            std::memset(fTailBuf,    0, sizeof(float)*2*T);
+            std::memset(fTailFdl,    0, sizeof(float) * fKernel->fTailCount * (T+1) * 2);
+            std::memset(fTailOut[0], 0, sizeof(float)*T);
+            std::memset(fTailOut[1], 0, sizeof(float)*T);
+        }
+
+        fBodyFdlPos  = 0;
+        fPos         = 0;
+        fTailFdlPos  = 0;
+        fTailPos     = 0;
+        fTailReadIdx = 0;
+        fTailOverruns = 0;
+        __atomic_store_n(&fTailState, kTailIdle, __ATOMIC_RELEASE);
+    }
+
+    /*
+     * Set the function used to start tail jobs from process().
+     * It must arrange for processTail() to be called soon from a real-time priority thread, and return false if it can't.
+     * Not used while a tail thread pool is set.
+     */
+    void setTailScheduler(const TailScheduler scheduler, void* const ptr) noexcept
+    {
+        fScheduler    = scheduler;
+        fSchedulerPtr = ptr;
+    }
+
+    /*
+     * Compute tail jobs on @a pool, which should have been created with a real-time priority.
+     * The pool must outlive this convolver, or be unset (with null) first.
+     */
+    void setTailThreadPool(ThreadPool* const pool) noexcept
+    {
+        fPool = pool;
+    }
+
+    /*
+     * Convolve @a frames samples. @a in and @a out may be the same buffer.
+     */
+    void process(const float* in, float* out, uint32_t frames) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fKernel != nullptr,);
+
+        const uint32_t H(fKernel->fHeadSize);
+        const float* const head(fKernel->fHead);
+        const bool hasTail(fTailFdl != nullptr);
+
+        while (frames > 0)
+        {
+            const uint32_t n((frames < H - fPos) ? frames : H - fPos);
+
+            std::memcpy(fBodyIn + H + fPos, in, sizeof(float)*n);
+
+            if (hasTail)
+                std::memcpy(fTailIn + fTailPos, in, sizeof(float)*n);
+
+            const float* const tailOut(hasTail ? fTailOut[fTailReadIdx] + fTailPos : nullptr);
+
+            for (uint32_t i=0; i < n; ++i)
+            {
+                // head FIR over the last H input samples, 4 partial sums so it vectorizes
+                const float* const x(fBodyIn + fPos + i + 1);
+                float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+
+                for (uint32_t j=0; j < H; j += 4)
+                {
+                    s0 += head[j]   * x[j];
+                    s1 += head[j+1] * x[j+1];
+                    s2 += head[j+2] * x[j+2];
+                    s3 += head[j+3] * x[j+3];
+                }
+
+                out[i] = (s0 + s1) + (s2 + s3) + fBodyOut[fPos + i] + (hasTail ? tailOut[i] : 0.0f);
+            }
+
+            in     += n;
+            out    += n;
+            frames -= n;
+            fPos   += n;
+
+            if (fPos == H)
+            {
+                processBody();
+                fPos = 0;
+            }
+
+            if (hasTail && (fTailPos += n) == fKernel->fTailSize)
+            {
+                startTail();
+                fTailPos = 0;
+            }
+        }
+    }
+
+    /*
+     * Compute a pending tail job, if any.
+     * Call from the thread the scheduler wakes up (d_work() for the plugin worker).
+     */
+    void processTail() noexcept
+    {
+        if (__atomic_load_n(&fTailState, __ATOMIC_ACQUIRE) != kTailPending)
+            return;
+
+        const uint32_t T(fKernel->fTailSize);
+
+        std::memcpy(fTailBuf + T, fTailJobIn, sizeof(float)*T);
+
+        runPartitions(*fKernel->fTailFFT, fTailBuf, fTailFdl, fTailFdlPos, fKernel->fTailParts, fKernel->fTailCount,
+                      fTailAcc, fTailTime, T);
+
+        std::memcpy(fTailOut[1 - fTailReadIdx], fTailTime + T, sizeof(float)*T);
+        std::memcpy(fTailBuf, fTailBuf + T, sizeof(float)*T);
+
+        __atomic_store_n(&fTailState, kTailIdle, __ATOMIC_RELEASE);
+    }
+
+    /*
+     * Number of tail blocks dropped because a tail job did not finish in time.
+     */
+    uint32_t getTailOverruns() const noexcept
+    {
+        return fTailOverruns;
+    }
+
+private:
+    enum TailState {
+        kTailIdle    = 0,
+        kTailPending = 1
+    };
+
+    const ConvolverKernel* fKernel;
+
+    TailScheduler fScheduler;
+    void*         fSchedulerPtr;
+    ThreadPool*   fPool;
+
+    // body, audio thread only
+    float*   fBodyIn;   // previous and current H input samples
+    float*   fBodyOut;  // body output for the current H block
+    float*   fBodyFdl;  // spectra of the last fBodyCount input blocks
+    float*   fBodyAcc;
+    float*   fBodyTime;
+    uint32_t fBodyFdlPos;
+    uint32_t fPos;
+
+    // tail, fTailIn/fTailPos/fTailReadIdx are audio thread only, the rest belongs to whoever owns fTailState
+    float*   fTailIn;
+    float*   fTailJobIn;
+    float*   fTailBuf;
+    float*   fTailFdl;
+    float*   fTailAcc;
+    float*   fTailTime;
+    float*   fTailOut[2];
+    uint32_t fTailFdlPos;
+    uint32_t fTailPos;
+    uint32_t fTailReadIdx;
+    int      fTailState;
+    uint32_t fTailOverruns;
+
+    void processBody() noexcept
+    {
+        const uint32_t H(fKernel->fHeadSize);
+
+        if (fBodyFdl != nullptr)
+        {
+            runPartitions(*fKernel->fBodyFFT, fBodyIn, fBodyFdl, fBodyFdlPos, fKernel->fBodyParts, fKernel->fBodyCount,
+                          fBodyAcc, fBodyTime, H);
+
+            std::memcpy(fBodyOut, fBodyTime + H, sizeof(float)*H);
+        }
+
+        std::memcpy(fBodyIn, fBodyIn + H, sizeof(float)*H);
+    }
+
+    void startTail() noexcept
+    {
+        if (__atomic_load_n(&fTailState, __ATOMIC_ACQUIRE) != kTailIdle)
+        {
+            // the previous job is late, this input block is lost
+            ++fTailOverruns;
+            std::memset(fTailOut[fTailReadIdx], 0, sizeof(float)*fKernel->fTailSize);
+            return;
+        }
+
+        // output of the job that just finished is due now
+        fTailReadIdx = 1 - fTailReadIdx;
+        std::memcpy(fTailJobIn, fTailIn, sizeof(float)*fKernel->fTailSize);
+
+        __atomic_store_n(&fTailState, kTailPending, __ATOMIC_RELEASE);
+
+        if (fPool != nullptr)
+        {
+            if (fPool->addJob(_processTailJob, this))
+                return;
+        }
+        else if (fScheduler != nullptr && fScheduler(fSchedulerPtr))
+        {
+            return;
+        }
+
+        processTail();
+    }
+
+    static void _processTailJob(void* const ptr)
+    {
+        static_cast<Convolver*>(ptr)->processTail();
+    }
+
+    // Uniformly partitioned overlap-save: FFT the last 2*size input samples into the
+    // delay line, multiply-add against all partitions, and leave the result in 'time'.
+    // The valid output is time[size, 2*size).
+    static void runPartitions(const FFT& fft, const float* const in, float* const fdl, uint32_t& fdlPos,
+                              const float* const parts, const uint32_t count,
+                              float* const acc, float* const time, const uint32_t size) noexcept
+    {
+        const uint32_t bins(size + 1);
+        const uint32_t stride(bins * 2);
+
+        float* const spec(fdl + fdlPos * stride);
+        fft.forward(in, spec, spec + bins);
+
+        std::memset(acc, 0, sizeof(float)*stride);
+
+        for (uint32_t p=0; p < count; ++p)
+        {
+            const float* const x(fdl + ((fdlPos + count - p) % count) * stride);
+            const float* const h(parts + p * stride);
+
+            FFT::multiplyAdd(acc, acc + bins, x, x + bins, h, h + bins, bins);
+        }
+
+        fft.inverse(acc, acc + bins, time);
+
+        fdlPos = (fdlPos + 1) % count;
+    }
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(Convolver)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_CONVOLVER_HPP_INCLUDED
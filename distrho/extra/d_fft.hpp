@@ -0,0 +1,290 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_FFT_HPP_INCLUDED
+#define DISTRHO_FFT_HPP_INCLUDED
+
+#include "../DistrhoUtils.hpp"
+
+#include <cmath>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+// Real-input FFT of a power of 2 size.
+//
+// A size N transform is done as a N/2 complex radix-2 FFT plus a split step.
+// Spectra are kept as separate real and imaginary arrays of N/2+1 bins, and each
+// stage reads its own contiguous twiddle table, so the butterflies and the
+// spectrum multiply-add below are plain loops the compiler can vectorize.
+//
+// Tables are allocated in the constructor; all transforms are const, never allocate
+// and can be used from several threads at once, so a single FFT may be shared.
+
+class FFT
+{
+public:
+    FFT(const uint32_t size)
+        : fSize(0),
+          fHalf(0),
+          fBitRev(nullptr),
+          fTwRe(nullptr),
+          fTwIm(nullptr),
+          fSplitRe(nullptr),
+          fSplitIm(nullptr)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(size >= 4 && (size & (size-1)) == 0,);
+
+        fSize = size;
+        fHalf = size/2;
+
+        const uint32_t M(fHalf);
+
+        uint32_t bits = 0;
+        while ((1U << bits) < M)
+            ++bits;
+
+        fBitRev = new uint32_t[M];
+
+        for (uint32_t i=0; i < M; ++i)
+        {
+            uint32_t r = 0;
+
+            for (uint32_t b=0; b < bits; ++b)
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+
+            fBitRev[i] = r;
+        }
+
+        // stage with half-length h uses exp(-2*pi*i*j/(2h)), j < h, stored at offset h-1
+        fTwRe = new float[M];
+        fTwIm = new float[M];
+
+        for (uint32_t h=1; h < M; h <<= 1)
+        {
+            for (uint32_t j=0; j < h; ++j)
+            {
+                const double a(-M_PI * double(j) / double(h));
+                fTwRe[h-1+j] = static_cast<float>(std::cos(a));
+                fTwIm[h-1+j] = static_cast<float>(std::sin(a));
+            }
+        }
+
+        // split step uses exp(-2*pi*i*k/N), k < N/4
+        fSplitRe = new float[M/2];
+        fSplitIm = new float[M/2];
+
+        for (uint32_t k=0; k < M/2; ++k)
+        {
+            const double a(-2.0 * M_PI * double(k) / double(size));
+            fSplitRe[k] = static_cast<float>(std::cos(a));
+            fSplitIm[k] = static_cast<float>(std::sin(a));
+        }
+    }
+
+    ~FFT()
+    {
+        delete[] fBitRev;
+        delete[] fTwRe;
+        delete[] fTwIm;
+        delete[] fSplitRe;
+        delete[] fSplitIm;
+    }
+
+    bool isValid() const noexcept
+    {
+        return fSize != 0;
+    }
+
+    uint32_t getSize() const noexcept
+    {
+        return fSize;
+    }
+
+    /*
+     * Number of spectrum bins, size/2+1.
+     */
+    uint32_t getBinCount() const noexcept
+    {
+        return fHalf + 1;
+    }
+
+    /*
+     * Transform @a size real samples into getBinCount() complex bins.
+     * The imaginary parts of the first and last bins are always 0.
+     */
+    void forward(const float* const in, float* const re, float* const im) const noexcept
+    {
+        const uint32_t M(fHalf);
+
+        for (uint32_t n=0; n < M; ++n)
+        {
+            re[n] = in[2*n];
+            im[n] = in[2*n+1];
+        }
+
+        transform(re, im);
+
+        const float z0Re(re[0]), z0Im(im[0]);
+        re[0] = z0Re + z0Im;
+        im[0] = 0.0f;
+        re[M] = z0Re - z0Im;
+        im[M] = 0.0f;
+
+        for (uint32_t k=1; k < M/2; ++k)
+        {
+            // A = Z[k], B = conj(Z[M-k]), E = (A+B)/2, O = (A-B)/2i
+            const float aRe(re[k]),   aIm(im[k]);
+            const float bRe(re[M-k]), bIm(-im[M-k]);
+
+            const float eRe(0.5f * (aRe + bRe)), eIm(0.5f * (aIm + bIm));
+            const float oRe(0.5f * (aIm - bIm)), oIm(0.5f * (bRe - aRe));
+
+            const float wRe(fSplitRe[k]), wIm(fSplitIm[k]);
+            const float woRe(wRe*oRe - wIm*oIm), woIm(wRe*oIm + wIm*oRe);
+
+            re[k]   = eRe + woRe;
+            im[k]   = eIm + woIm;
+            re[M-k] = eRe - woRe;
+            im[M-k] = woIm - eIm;
+        }
+
+        im[M/2] = -im[M/2];
+    }
+
+    /*
+     * Transform getBinCount() complex bins back into @a size real samples, scaled so
+     * that inverse(forward(x)) == x.
+     * The spectrum arrays are used as scratch space and are overwritten.
+     */
+    void inverse(float* const re, float* const im, float* const out) const noexcept
+    {
+        const uint32_t M(fHalf);
+
+        const float x0(re[0]), xM(re[M]);
+        re[0] = 0.5f * (x0 + xM);
+        im[0] = 0.5f * (x0 - xM);
+
+        for (uint32_t k=1; k < M/2; ++k)
+        {
+            // X = X[k], Y = conj(X[M-k]), E = (X+Y)/2, O = conj(W)(X-Y)/2
+            const float xRe(re[k]),   xIm(im[k]);
+            const float yRe(re[M-k]), yIm(-im[M-k]);
+
+            const float eRe(0.5f * (xRe + yRe)), eIm(0.5f * (xIm + yIm));
+            const float dRe(0.5f * (xRe - yRe)), dIm(0.5f * (xIm - yIm));
+
+            const float wRe(fSplitRe[k]), wIm(fSplitIm[k]);
+            const float oRe(wRe*dRe + wIm*dIm), oIm(wRe*dIm - wIm*dRe);
+
+            // Z[k] = E + iO, Z[M-k] = conj(E - iO)
+            re[k]   = eRe - oIm;
+            im[k]   = eIm + oRe;
+            re[M-k] = eRe + oIm;
+            im[M-k] = oRe - eIm;
+        }
+
+        im[M/2] = -im[M/2];
+
+        // swapping real and imaginary parts turns the forward transform into the inverse
+        transform(im, re);
+
+        const float scale(1.0f / static_cast<float>(M));
+
+        for (uint32_t n=0; n < M; ++n)
+        {
+            out[2*n]   = re[n] * scale;
+            out[2*n+1] = im[n] * scale;
+        }
+    }
+
+    /*
+     * acc += a * b, over @a count complex bins.
+     */
+    static void multiplyAdd(float* const accRe, float* const accIm,
+                            const float* const aRe, const float* const aIm,
+                            const float* const bRe, const float* const bIm, const uint32_t count) noexcept
+    {
+        for (uint32_t i=0; i < count; ++i)
+        {
+            accRe[i] += aRe[i]*bRe[i] - aIm[i]*bIm[i];
+            accIm[i] += aRe[i]*bIm[i] + aIm[i]*bRe[i];
+        }
+    }
+
+private:
+    uint32_t fSize;
+    uint32_t fHalf;
+
+    uint32_t* fBitRev;
+    float* fTwRe;
+    float* fTwIm;
+    float* fSplitRe;
+    float* fSplitIm;
+
+    // in-place complex FFT of size N/2
+    void transform(float* const re, float* const im) const noexcept
+    {
+        const uint32_t M(fHalf);
+
+        for (uint32_t i=0; i < M; ++i)
+        {
+            const uint32_t j(fBitRev[i]);
+
+            if (j <= i)
+                continue;
+
+            const float tRe(re[i]), tIm(im[i]);
+            re[i] = re[j];
+            im[i] = im[j];
+            re[j] = tRe;
+            im[j] = tIm;
+        }
+
+        for (uint32_t h=1; h < M; h <<= 1)
+        {
+            const float* const twRe(fTwRe + h - 1);
+            const float* const twIm(fTwIm + h - 1);
+
+            for (uint32_t i=0; i < M; i += 2*h)
+            {
+                float* const aRe(re + i);
+                float* const aIm(im + i);
+                float* const bRe(re + i + h);
+                float* const bIm(im + i + h);
+
+                for (uint32_t j=0; j < h; ++j)
+                {
+                    const float tRe(bRe[j]*twRe[j] - bIm[j]*twIm[j]);
+                    const float tIm(bRe[j]*twIm[j] + bIm[j]*twRe[j]);
+
+                    bRe[j] = aRe[j] - tRe;
+                    bIm[j] = aIm[j] - tIm;
+                    aRe[j] += tRe;
+                    aIm[j] += tIm;
+                }
+            }
+        }
+    }
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(FFT)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_FFT_HPP_INCLUDED
@@ -17,17 +17,54 @@
 #ifndef DISTRHO_MUTEX_HPP_INCLUDED
 #define DISTRHO_MUTEX_HPP_INCLUDED
 
-#include "../DistrhoUtils.hpp"
+#include "d_atomic.hpp"
 
 #ifdef DISTRHO_OS_WINDOWS
 # include <winsock2.h>
 # include <windows.h>
 #endif
 
+#include <cerrno>
+#include <ctime>
+
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#ifdef DISTRHO_OS_MAC
+# include <dispatch/dispatch.h>
+#else
+# include <semaphore.h>
+#endif
+
+#if defined(_POSIX_THREAD_PRIO_INHERIT) && _POSIX_THREAD_PRIO_INHERIT > 0
+# define DISTRHO_MUTEX_PRIO_INHERIT 1
+#else
+# define DISTRHO_MUTEX_PRIO_INHERIT 0
+#endif
 
 START_NAMESPACE_DISTRHO
 
+// -----------------------------------------------------------------------
+// Set up mutex attributes, with priority inheritance if requested and supported.
+// A priority inheriting mutex boosts its owner to the priority of the highest
+// priority thread waiting for it, so a low priority thread holding a lock the
+// audio thread wants can't be preempted by unrelated work (priority inversion).
+
+static inline
+void d_initMutexAttributes(pthread_mutexattr_t& atts, const bool inheritPriority) noexcept
+{
+    pthread_mutexattr_init(&atts);
+
+#if DISTRHO_MUTEX_PRIO_INHERIT
+    if (inheritPriority)
+        pthread_mutexattr_setprotocol(&atts, PTHREAD_PRIO_INHERIT);
+#else
+    // not supported here
+    (void)inheritPriority;
+#endif
+}
+
 // -----------------------------------------------------------------------
 // Mutex class
 
@@ -36,10 +73,14 @@ class Mutex
 public:
     /*
      * Constructor.
+     * Use @a inheritPriority for locks shared between the audio thread and lower priority threads.
      */
-    Mutex() noexcept
+    explicit Mutex(const bool inheritPriority = false) noexcept
     {
-        pthread_mutex_init(&fMutex, nullptr);
+        pthread_mutexattr_t atts;
+        d_initMutexAttributes(atts, inheritPriority);
+        pthread_mutex_init(&fMutex, &atts);
+        pthread_mutexattr_destroy(&atts);
     }
 
     /*
@@ -90,14 +131,17 @@ class RecursiveMutex
 public:
     /*
      * Constructor.
+     * Use @a inheritPriority for locks shared between the audio thread and lower priority threads,
+     * ignored on Windows.
      */
-    RecursiveMutex() noexcept
+    explicit RecursiveMutex(const bool inheritPriority = false) noexcept
     {
 #ifdef DISTRHO_OS_WINDOWS
         InitializeCriticalSection(&fSection);
+        (void)inheritPriority;
 #else
         pthread_mutexattr_t atts;
-        pthread_mutexattr_init(&atts);
+        d_initMutexAttributes(atts, inheritPriority);
         pthread_mutexattr_settype(&atts, PTHREAD_MUTEX_RECURSIVE);
         pthread_mutex_init(&fMutex, &atts);
         pthread_mutexattr_destroy(&atts);
@@ -164,6 +208,272 @@ private:
     DISTRHO_DECLARE_NON_COPY_CLASS(RecursiveMutex)
 };
 
+// -----------------------------------------------------------------------
+// SpinLock class, for very short critical sections.
+// Spins for a bounded number of attempts, then yields the CPU between attempts,
+// so a preempted owner is never spun against indefinitely.
+// It never sleeps in the kernel, but it has no priority inheritance either:
+// keep the locked sections to a few instructions.
+
+class SpinLock
+{
+public:
+    /*
+     * Constructor.
+     */
+    SpinLock() noexcept
+        : fLocked(false) {}
+
+    /*
+     * Lock, spinning then yielding until available.
+     */
+    void lock() const noexcept
+    {
+        for (uint32_t i=0; ! tryLock(); ++i)
+        {
+            if (i < kSpinCount)
+            {
+#if defined(__i386__) || defined(__x86_64__)
+                __builtin_ia32_pause();
+#endif
+            }
+            else
+            {
+                sched_yield();
+            }
+        }
+    }
+
+    /*
+     * Try to lock.
+     * Returns true if successful.
+     */
+    bool tryLock() const noexcept
+    {
+        // test before test-and-set, waiters only read the shared line
+        return ! fLocked.load(__ATOMIC_RELAXED) && ! fLocked.exchange(true, __ATOMIC_ACQUIRE);
+    }
+
+    /*
+     * Unlock.
+     */
+    void unlock() const noexcept
+    {
+        fLocked.store(false, __ATOMIC_RELEASE);
+    }
+
+private:
+    static const uint32_t kSpinCount = 100;
+
+    mutable Atomic<bool> fLocked;
+
+    DISTRHO_PREVENT_HEAP_ALLOCATION
+    DISTRHO_DECLARE_NON_COPY_CLASS(SpinLock)
+};
+
+// -----------------------------------------------------------------------
+// Signal class, used by a thread to wait for an event triggered by another
+
+class Signal
+{
+public:
+    /*
+     * Constructor.
+     */
+    Signal() noexcept
+        : fTriggered(false)
+    {
+        pthread_cond_init(&fCondition, nullptr);
+
+        // the audio thread uses trySignal() and pool threads may be real-time
+        pthread_mutexattr_t atts;
+        d_initMutexAttributes(atts, true);
+        pthread_mutex_init(&fMutex, &atts);
+        pthread_mutexattr_destroy(&atts);
+    }
+
+    /*
+     * Destructor.
+     */
+    ~Signal() noexcept
+    {
+        pthread_cond_destroy(&fCondition);
+        pthread_mutex_destroy(&fMutex);
+    }
+
+    /*
+     * Wait until triggered, then reset the signal.
+     */
+    void wait() noexcept
+    {
+        pthread_mutex_lock(&fMutex);
+
+        for (; ! fTriggered;)
+            pthread_cond_wait(&fCondition, &fMutex);
+
+        fTriggered = false;
+
+        pthread_mutex_unlock(&fMutex);
+    }
+
+    /*
+     * Wait until triggered or until @a timeOutMilliseconds have passed, then reset the signal.
+     * Returns true if the signal was triggered.
+     */
+    bool wait(const uint timeOutMilliseconds) noexcept
+    {
+        timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+
+        timeout.tv_sec  += timeOutMilliseconds / 1000;
+        timeout.tv_nsec += long(timeOutMilliseconds % 1000) * 1000000L;
+
+        if (timeout.tv_nsec >= 1000000000L)
+        {
+            timeout.tv_sec  += 1;
+            timeout.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock(&fMutex);
+
+        for (; ! fTriggered;)
+        {
+            if (pthread_cond_timedwait(&fCondition, &fMutex, &timeout) == ETIMEDOUT)
+                break;
+        }
+
+        const bool triggered(fTriggered);
+        fTriggered = false;
+
+        pthread_mutex_unlock(&fMutex);
+
+        return triggered;
+    }
+
+    /*
+     * Trigger the signal, waking up the waiting thread.
+     */
+    void signal() noexcept
+    {
+        pthread_mutex_lock(&fMutex);
+
+        if (! fTriggered)
+        {
+            fTriggered = true;
+            pthread_cond_signal(&fCondition);
+        }
+
+        pthread_mutex_unlock(&fMutex);
+    }
+
+    /*
+     * Trigger the signal only if that can be done without blocking.
+     * Safe to call from the audio thread; the waiter must use a timed wait, as the trigger can be missed.
+     */
+    void trySignal() noexcept
+    {
+        if (pthread_mutex_trylock(&fMutex) != 0)
+            return;
+
+        if (! fTriggered)
+        {
+            fTriggered = true;
+            pthread_cond_signal(&fCondition);
+        }
+
+        pthread_mutex_unlock(&fMutex);
+    }
+
+private:
+    bool fTriggered;
+    pthread_cond_t  fCondition;
+    pthread_mutex_t fMutex;
+
+    DISTRHO_PREVENT_HEAP_ALLOCATION
+    DISTRHO_DECLARE_NON_COPY_CLASS(Signal)
+};
+
+// -----------------------------------------------------------------------
+// Counting semaphore.
+// post() never blocks and every post wakes a waiter, so unlike Signal::trySignal()
+// it can wake another thread from the audio thread without ever being missed.
+
+class Semaphore
+{
+public:
+    /*
+     * Constructor.
+     */
+    Semaphore() noexcept
+    {
+#ifdef DISTRHO_OS_MAC
+        fSemaphore = dispatch_semaphore_create(0);
+#else
+        sem_init(&fSemaphore, 0, 0);
+#endif
+    }
+
+    /*
+     * Destructor.
+     */
+    ~Semaphore() noexcept
+    {
+#ifdef DISTRHO_OS_MAC
+        dispatch_release(fSemaphore);
+#else
+        sem_destroy(&fSemaphore);
+#endif
+    }
+
+    /*
+     * Increment the count, waking one waiting thread.
+     * Safe to call from the audio thread.
+     */
+    void post() noexcept
+    {
+#ifdef DISTRHO_OS_MAC
+        dispatch_semaphore_signal(fSemaphore);
+#else
+        sem_post(&fSemaphore);
+#endif
+    }
+
+    /*
+     * Wait until the count is positive, then decrement it.
+     */
+    void wait() noexcept
+    {
+#ifdef DISTRHO_OS_MAC
+        dispatch_semaphore_wait(fSemaphore, DISPATCH_TIME_FOREVER);
+#else
+        for (; sem_wait(&fSemaphore) != 0 && errno == EINTR;) {}
+#endif
+    }
+
+    /*
+     * Decrement the count if it is positive, without blocking.
+     * Returns false if it was zero.
+     */
+    bool tryWait() noexcept
+    {
+#ifdef DISTRHO_OS_MAC
+        return dispatch_semaphore_wait(fSemaphore, DISPATCH_TIME_NOW) == 0;
+#else
+        return sem_trywait(&fSemaphore) == 0;
+#endif
+    }
+
+private:
+#ifdef DISTRHO_OS_MAC
+    dispatch_semaphore_t fSemaphore;
+#else
+    sem_t fSemaphore;
+#endif
+
+    DISTRHO_PREVENT_HEAP_ALLOCATION
+    DISTRHO_DECLARE_NON_COPY_CLASS(Semaphore)
+};
+
 // -----------------------------------------------------------------------
 // Helper class to lock&unlock a mutex during a function scope.
 
@@ -214,11 +524,56 @@ private:
     DISTRHO_DECLARE_NON_COPY_CLASS(ScopedUnlocker)
 };
 
+// -----------------------------------------------------------------------
+// Helper class to try to lock a mutex during a function scope, without blocking.
+// Meant for the audio thread: when the lock is busy, skip or defer the work
+// instead of waiting for it. Failed attempts are added to 'contention', if given,
+// so they can be reported later from a non real-time thread.
+
+template <class Mutex>
+class ScopedTryLocker
+{
+public:
+    ScopedTryLocker(const Mutex& mutex, Atomic<uint32_t>* const contention = nullptr) noexcept
+        : fMutex(mutex),
+          fLocked(mutex.tryLock())
+    {
+        if (! fLocked && contention != nullptr)
+            contention->fetchAdd(1, __ATOMIC_RELAXED);
+    }
+
+    ~ScopedTryLocker() noexcept
+    {
+        if (fLocked)
+            fMutex.unlock();
+    }
+
+    /*
+     * Check if the lock was taken. If not, the protected data must not be touched.
+     */
+    bool wasLocked() const noexcept
+    {
+        return fLocked;
+    }
+
+private:
+    const Mutex& fMutex;
+    const bool   fLocked;
+
+    DISTRHO_PREVENT_HEAP_ALLOCATION
+    DISTRHO_DECLARE_NON_COPY_CLASS(ScopedTryLocker)
+};
+
 // -----------------------------------------------------------------------
 // Define types
 
 typedef ScopedLocker<Mutex>          MutexLocker;
 typedef ScopedLocker<RecursiveMutex> RecursiveMutexLocker;
+typedef ScopedLocker<SpinLock>       SpinLockLocker;
+
+typedef ScopedTryLocker<Mutex>          MutexTryLocker;
+typedef ScopedTryLocker<RecursiveMutex> RecursiveMutexTryLocker;
+typedef ScopedTryLocker<SpinLock>       SpinLockTryLocker;
 
 typedef ScopedUnlocker<Mutex>          MutexUnlocker;
 typedef ScopedUnlocker<RecursiveMutex> RecursiveMutexUnlocker;
@@ -0,0 +1,423 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_PRESETS_HPP_INCLUDED
+#define DISTRHO_PRESETS_HPP_INCLUDED
+
+#include "../DistrhoUtils.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+// Compact table of presets, each one a name and a full set of parameter values.
+// All data lives in a single allocation, so applying a preset is a plain copy.
+//
+// Tables are built in the plugin constructor or loaded from disk with loadFromFile(),
+// which is not real-time safe; use it from Plugin::d_work() and hand the new table to
+// the audio thread with d_respondWork(), sending the replaced one back to be deleted.
+//
+// File format, in native byte order:
+//   "DPFP", uint32 version, uint32 presetCount, uint32 parameterCount,
+//   presetCount names of kNameSize bytes, then presetCount * parameterCount floats.
+
+class PresetTable
+{
+public:
+    static const uint32_t kNameSize = 32; // including null terminator
+
+    PresetTable(const uint32_t presetCount, const uint32_t parameterCount) noexcept
+        : fPresetCount(0),
+          fParameterCount(0),
+          fNames(nullptr),
+          fValues(nullptr)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(presetCount > 0 && parameterCount > 0,);
+
+        try {
+            fNames = new char[presetCount*kNameSize];
+        } DISTRHO_SAFE_EXCEPTION_RETURN("PresetTable::PresetTable",);
+
+        try {
+            fValues = new float[presetCount*parameterCount];
+        }
+        catch(...) {
+            d_safe_exception("PresetTable::PresetTable", __FILE__, __LINE__);
+            delete[] fNames;
+            fNames = nullptr;
+            return;
+        }
+
+        std::memset(fNames, 0, presetCount*kNameSize);
+        std::memset(fValues, 0, sizeof(float)*presetCount*parameterCount);
+
+        fPresetCount    = presetCount;
+        fParameterCount = parameterCount;
+    }
+
+    ~PresetTable() noexcept
+    {
+        if (fNames != nullptr)
+        {
+            delete[] fNames;
+            fNames = nullptr;
+        }
+
+        if (fValues != nullptr)
+        {
+            delete[] fValues;
+            fValues = nullptr;
+        }
+    }
+
+    bool isValid() const noexcept
+    {
+        return fValues != nullptr;
+    }
+
+    uint32_t getPresetCount() const noexcept
+    {
+        return fPresetCount;
+    }
+
+    uint32_t getParameterCount() const noexcept
+    {
+        return fParameterCount;
+    }
+
+    const char* getName(const uint32_t index) const noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(index < fPresetCount, "");
+
+        return fNames + index*kNameSize;
+    }
+
+    /*
+     * Values of a preset, getParameterCount() floats.
+     */
+    const float* getValues(const uint32_t index) const noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(index < fPresetCount, nullptr);
+
+        return fValues + index*fParameterCount;
+    }
+
+    /*
+     * Set a preset, @a values must have getParameterCount() floats.
+     * Names longer than kNameSize-1 are truncated.
+     */
+    void setPreset(const uint32_t index, const char* const name, const float* const values) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(index < fPresetCount,);
+        DISTRHO_SAFE_ASSERT_RETURN(name != nullptr,);
+        DISTRHO_SAFE_ASSERT_RETURN(values != nullptr,);
+
+        char* const dst(fNames + index*kNameSize);
+        std::strncpy(dst, name, kNameSize-1);
+        dst[kNameSize-1] = '\0';
+
+        std::memcpy(fValues + index*fParameterCount, values, sizeof(float)*fParameterCount);
+    }
+
+    // -------------------------------------------------------------------
+
+    /*
+     * Load a table from a file.
+     * Returns null on error, the caller owns the returned table.
+     * Not real-time safe.
+     */
+    static PresetTable* loadFromFile(const char* const filename)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(filename != nullptr && filename[0] != '\0', nullptr);
+
+        FILE* const file(std::fopen(filename, "rb"));
+
+        if (file == nullptr)
+        {
+            d_stderr("PresetTable::loadFromFile(\"%s\") - cannot open file", filename);
+            return nullptr;
+        }
+
+        Header header;
+        PresetTable* table = nullptr;
+
+        if (std::fread(&header, sizeof(Header), 1, file) == 1 && std::memcmp(header.magic, "DPFP", 4) == 0
+            && header.version == kVersion && header.presetCount > 0 && header.parameterCount > 0
+            && header.presetCount <= kMaxCount && header.parameterCount <= kMaxCount)
+        {
+            table = new PresetTable(header.presetCount, header.parameterCount);
+
+            if (! table->isValid()
+                || std::fread(table->fNames, kNameSize, header.presetCount, file) != header.presetCount
+                || std::fread(table->fValues, sizeof(float)*header.parameterCount, header.presetCount, file) != header.presetCount)
+            {
+                delete table;
+                table = nullptr;
+            }
+        }
+
+        std::fclose(file);
+
+        if (table == nullptr)
+        {
+            d_stderr("PresetTable::loadFromFile(\"%s\") - invalid file", filename);
+            return nullptr;
+        }
+
+        // never trust names from disk
+        for (uint32_t i=0; i < table->fPresetCount; ++i)
+            table->fNames[i*kNameSize + kNameSize-1] = '\0';
+
+        return table;
+    }
+
+    /*
+     * Save this table to a file.
+     * Not real-time safe.
+     */
+    bool saveToFile(const char* const filename) const
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(isValid(), false);
+        DISTRHO_SAFE_ASSERT_RETURN(filename != nullptr && filename[0] != '\0', false);
+
+        FILE* const file(std::fopen(filename, "wb"));
+
+        if (file == nullptr)
+        {
+            d_stderr("PresetTable::saveToFile(\"%s\") - cannot open file", filename);
+            return false;
+        }
+
+        Header header;
+        std::memcpy(header.magic, "DPFP", 4);
+        header.version        = kVersion;
+        header.presetCount    = fPresetCount;
+        header.parameterCount = fParameterCount;
+
+        const bool ok(std::fwrite(&header, sizeof(Header), 1, file) == 1
+                      && std::fwrite(fNames, kNameSize, fPresetCount, file) == fPresetCount
+                      && std::fwrite(fValues, sizeof(float)*fParameterCount, fPresetCount, file) == fPresetCount);
+
+        return (std::fclose(file) == 0 && ok);
+    }
+
+private:
+    uint32_t fPresetCount;
+    uint32_t fParameterCount;
+    char*    fNames;
+    float*   fValues;
+
+    struct Header {
+        char     magic[4];
+        uint32_t version;
+        uint32_t presetCount;
+        uint32_t parameterCount;
+    };
+
+    static const uint32_t kVersion  = 1;
+    static const uint32_t kMaxCount = 65536;
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(PresetTable)
+};
+
+// -----------------------------------------------------------------------
+// Glitch-free preset switching for the audio thread.
+// Instead of jumping to the new values, each parameter follows a linear ramp
+// over a fixed number of frames; stepped parameters (booleans, integers, anything
+// that changes the DSP structure) switch right away.
+// Allocates only in the constructor; start() and process() are real-time safe.
+//
+// Plugins using Plugin::d_setProgramTable() get this for free, the framework
+// runs the ramp in small sub-blocks. Use it directly only for custom morphing.
+
+class PresetMorph
+{
+public:
+    PresetMorph(const uint32_t parameterCount) noexcept
+        : fCount(0),
+          fCurrent(nullptr),
+          fTarget(nullptr),
+          fStep(nullptr),
+          fStepped(nullptr),
+          fRemaining(0)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(parameterCount > 0,);
+
+        try {
+            fCurrent = new float[parameterCount*3];
+            fStepped = new bool[parameterCount];
+        }
+        catch(...) {
+            d_safe_exception("PresetMorph::PresetMorph", __FILE__, __LINE__);
+            if (fCurrent != nullptr)
+            {
+                delete[] fCurrent;
+                fCurrent = nullptr;
+            }
+            return;
+        }
+
+        fTarget = fCurrent + parameterCount;
+        fStep   = fTarget  + parameterCount;
+        fCount  = parameterCount;
+
+        std::memset(fCurrent, 0, sizeof(float)*parameterCount*3);
+        std::memset(fStepped, 0, sizeof(bool)*parameterCount);
+    }
+
+    ~PresetMorph() noexcept
+    {
+        if (fCurrent != nullptr)
+        {
+            delete[] fCurrent;
+            fCurrent = nullptr;
+        }
+
+        if (fStepped != nullptr)
+        {
+            delete[] fStepped;
+            fStepped = nullptr;
+        }
+    }
+
+    /*
+     * Mark a parameter as stepped, it will never be ramped.
+     */
+    void setStepped(const uint32_t index, const bool stepped) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(index < fCount,);
+
+        fStepped[index] = stepped;
+    }
+
+    /*
+     * Jump to @a values, cancelling any ramp in progress.
+     */
+    void reset(const float* const values) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(values != nullptr && fCount > 0,);
+
+        std::memcpy(fCurrent, values, sizeof(float)*fCount);
+        std::memcpy(fTarget,  values, sizeof(float)*fCount);
+        fRemaining = 0;
+    }
+
+    /*
+     * Start a ramp from the current values to @a values, lasting @a frames.
+     * A ramp in progress continues from where it is.
+     */
+    void start(const float* const values, const uint32_t frames) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(values != nullptr && fCount > 0,);
+
+        if (frames == 0)
+            return reset(values);
+
+        const float invFrames(1.0f / float(frames));
+
+        for (uint32_t i=0; i < fCount; ++i)
+        {
+            fTarget[i] = values[i];
+
+            if (fStepped[i])
+            {
+                fCurrent[i] = values[i];
+                fStep[i]    = 0.0f;
+            }
+            else
+            {
+                fStep[i] = (values[i] - fCurrent[i]) * invFrames;
+            }
+        }
+
+        fRemaining = frames;
+    }
+
+    bool isRunning() const noexcept
+    {
+        return fRemaining != 0;
+    }
+
+    /*
+     * Advance the ramp by @a frames, returns the values to use for them.
+     * Advancing a whole d_run() block at once makes the values move in audible steps,
+     * call this for sub-blocks of a few dozen frames, or use getSteps() to interpolate per sample.
+     */
+    const float* process(const uint32_t frames) noexcept
+    {
+        if (fRemaining == 0)
+            return fCurrent;
+
+        if (frames >= fRemaining)
+        {
+            std::memcpy(fCurrent, fTarget, sizeof(float)*fCount);
+            fRemaining = 0;
+            return fCurrent;
+        }
+
+        const float amount(static_cast<float>(frames));
+
+        for (uint32_t i=0; i < fCount; ++i)
+            fCurrent[i] += fStep[i] * amount;
+
+        fRemaining -= frames;
+        return fCurrent;
+    }
+
+    /*
+     * Per-frame increments of the current ramp, zero for stepped parameters.
+     * Only meaningful while isRunning().
+     */
+    const float* getSteps() const noexcept
+    {
+        return fStep;
+    }
+
+    /*
+     * Current values, without advancing.
+     */
+    const float* getValues() const noexcept
+    {
+        return fCurrent;
+    }
+
+    /*
+     * Final values of the current ramp, same as getValues() when not running.
+     * This is what the host should see as the parameter values.
+     */
+    const float* getTargetValues() const noexcept
+    {
+        return fTarget;
+    }
+
+private:
+    uint32_t fCount;
+    float*   fCurrent;
+    float*   fTarget; // points inside fCurrent
+    float*   fStep;   // points inside fCurrent
+    bool*    fStepped;
+    uint32_t fRemaining;
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(PresetMorph)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_PRESETS_HPP_INCLUDED
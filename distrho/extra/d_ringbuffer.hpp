@@ -0,0 +1,308 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_RINGBUFFER_HPP_INCLUDED
+#define DISTRHO_RINGBUFFER_HPP_INCLUDED
+
+#include "d_atomic.hpp"
+
+#include <cstring>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+// Single-producer, single-consumer lock-free ring buffer.
+// The producer (usually the audio thread) calls write(), the consumer
+// (usually the UI thread) calls read(). No other synchronization is needed.
+// Storage is allocated once in the constructor and rounded up to a power of 2.
+
+template<typename T>
+class RingBuffer
+{
+public:
+    RingBuffer(const uint32_t minCapacity) noexcept
+        : fBuffer(nullptr),
+          fSize(1),
+          fMask(0),
+          fHead(0),
+          fTail(0)
+    {
+        while (fSize < minCapacity)
+            fSize <<= 1;
+
+        fMask = fSize - 1;
+
+        try {
+            fBuffer = new T[fSize];
+        } DISTRHO_SAFE_EXCEPTION_RETURN("RingBuffer::RingBuffer",);
+    }
+
+    ~RingBuffer() noexcept
+    {
+        if (fBuffer != nullptr)
+        {
+            delete[] fBuffer;
+            fBuffer = nullptr;
+        }
+    }
+
+    /*
+     * Maximum number of items the buffer can hold.
+     */
+    uint32_t getCapacity() const noexcept
+    {
+        return (fBuffer != nullptr) ? fSize : 0;
+    }
+
+    /*
+     * Number of items available for reading.
+     * Safe to call from the consumer thread.
+     */
+    uint32_t getReadableCount() const noexcept
+    {
+        const uint32_t head(__atomic_load_n(&fHead, __ATOMIC_ACQUIRE));
+        const uint32_t tail(__atomic_load_n(&fTail, __ATOMIC_RELAXED));
+
+        return head - tail;
+    }
+
+    /*
+     * Number of items that can be written without failing.
+     * Safe to call from the producer thread.
+     */
+    uint32_t getWritableCount() const noexcept
+    {
+        if (fBuffer == nullptr)
+            return 0;
+
+        const uint32_t head(__atomic_load_n(&fHead, __ATOMIC_RELAXED));
+        const uint32_t tail(__atomic_load_n(&fTail, __ATOMIC_ACQUIRE));
+
+        return fSize - (head - tail);
+    }
+
+    /*
+     * Write 'count' items, all or nothing.
+     * Returns false (and writes nothing) if there's not enough free space.
+     * Producer thread only.
+     */
+    bool write(const T* const data, const uint32_t count) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(data != nullptr, false);
+
+        if (count == 0)
+            return true;
+        if (count > getWritableCount())
+            return false;
+
+        const uint32_t head(__atomic_load_n(&fHead, __ATOMIC_RELAXED));
+        const uint32_t start(head & fMask);
+        const uint32_t first((count < fSize - start) ? count : fSize - start);
+
+        std::memcpy(fBuffer + start, data, sizeof(T)*first);
+
+        if (first < count)
+            std::memcpy(fBuffer, data + first, sizeof(T)*(count - first));
+
+        __atomic_store_n(&fHead, head + count, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /*
+     * Read up to 'maxCount' items.
+     * Returns the number of items actually read.
+     * Consumer thread only.
+     */
+    uint32_t read(T* const data, const uint32_t maxCount) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(data != nullptr, 0);
+
+        const uint32_t readable(getReadableCount());
+        const uint32_t count((maxCount < readable) ? maxCount : readable);
+
+        if (count == 0)
+            return 0;
+
+        const uint32_t tail(__atomic_load_n(&fTail, __ATOMIC_RELAXED));
+        const uint32_t start(tail & fMask);
+        const uint32_t first((count < fSize - start) ? count : fSize - start);
+
+        std::memcpy(data, fBuffer + start, sizeof(T)*first);
+
+        if (first < count)
+            std::memcpy(data + first, fBuffer, sizeof(T)*(count - first));
+
+        __atomic_store_n(&fTail, tail + count, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    /*
+     * Discard everything currently readable.
+     * Consumer thread only.
+     */
+    void clear() noexcept
+    {
+        __atomic_store_n(&fTail, __atomic_load_n(&fHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    }
+
+private:
+    T* fBuffer;
+    uint32_t fSize;
+    uint32_t fMask;
+
+    // head is written by the producer, tail by the consumer; keep them on separate cache lines
+    char     fPad0[DISTRHO_CACHE_LINE_SIZE];
+    uint32_t fHead;
+    char     fPad1[DISTRHO_CACHE_LINE_SIZE];
+    uint32_t fTail;
+    char     fPad2[DISTRHO_CACHE_LINE_SIZE];
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(RingBuffer)
+};
+
+// -----------------------------------------------------------------------
+// Multiple-producer, single-consumer lock-free queue of fixed-size items.
+// Any number of threads may push(), a single thread pop()s.
+// Each slot carries a sequence number telling whether it is free for the
+// producer at a given position or ready for the consumer, so producers only
+// contend on a single compare-and-swap of the write position.
+// Storage is allocated once in the constructor and rounded up to a power of 2.
+// T must be safe to copy with operator=, without allocating.
+
+template<typename T>
+class MpscRingBuffer
+{
+public:
+    MpscRingBuffer(const uint32_t minCapacity) noexcept
+        : fSlots(nullptr),
+          fSize(1),
+          fMask(0),
+          fWritePos(0),
+          fReadPos(0)
+    {
+        while (fSize < minCapacity)
+            fSize <<= 1;
+
+        fMask = fSize - 1;
+
+        try {
+            fSlots = new Slot[fSize];
+        } DISTRHO_SAFE_EXCEPTION_RETURN("MpscRingBuffer::MpscRingBuffer",);
+
+        for (uint32_t i=0; i < fSize; ++i)
+            fSlots[i].seq.store(i, __ATOMIC_RELAXED);
+    }
+
+    ~MpscRingBuffer() noexcept
+    {
+        if (fSlots != nullptr)
+        {
+            delete[] fSlots;
+            fSlots = nullptr;
+        }
+    }
+
+    uint32_t getCapacity() const noexcept
+    {
+        return (fSlots != nullptr) ? fSize : 0;
+    }
+
+    /*
+     * Queue an item.
+     * Returns false if the queue is full.
+     * Any thread.
+     */
+    bool push(const T& item) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fSlots != nullptr, false);
+
+        uint32_t pos(fWritePos.load(__ATOMIC_RELAXED));
+        Slot* slot;
+
+        for (;;)
+        {
+            slot = &fSlots[pos & fMask];
+
+            const int32_t diff(static_cast<int32_t>(slot->seq.load() - pos));
+
+            if (diff == 0)
+            {
+                if (fWritePos.compareExchange(pos, pos + 1, __ATOMIC_RELAXED))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                // slot still holds an item from the previous lap
+                return false;
+            }
+            else
+            {
+                pos = fWritePos.load(__ATOMIC_RELAXED);
+            }
+        }
+
+        slot->item = item;
+        slot->seq.store(pos + 1);
+        return true;
+    }
+
+    /*
+     * Take the oldest item.
+     * Returns false if the queue is empty.
+     * Consumer thread only.
+     */
+    bool pop(T& item) noexcept
+    {
+        if (fSlots == nullptr)
+            return false;
+
+        const uint32_t pos(fReadPos);
+        Slot& slot(fSlots[pos & fMask]);
+
+        if (slot.seq.load() != pos + 1)
+            return false;
+
+        item = slot.item;
+        slot.seq.store(pos + fSize);
+        fReadPos = pos + 1;
+        return true;
+    }
+
+private:
+    struct Slot {
+        Atomic<uint32_t> seq;
+        T item;
+    };
+
+    Slot* fSlots;
+    uint32_t fSize;
+    uint32_t fMask;
+
+    // write position is shared by the producers, read position belongs to the consumer
+    char             fPad0[DISTRHO_CACHE_LINE_SIZE];
+    Atomic<uint32_t> fWritePos;
+    char             fPad1[DISTRHO_CACHE_LINE_SIZE];
+    uint32_t         fReadPos;
+    char             fPad2[DISTRHO_CACHE_LINE_SIZE];
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(MpscRingBuffer)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_RINGBUFFER_HPP_INCLUDED
@@ -0,0 +1,116 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_SEQLOCK_HPP_INCLUDED
+#define DISTRHO_SEQLOCK_HPP_INCLUDED
+
+#include "../DistrhoUtils.hpp"
+
+#include <cstring>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+// Single-writer, multiple-reader sequence lock for small plain structs
+// (transport info, a set of meter values, an envelope).
+//
+// The writer never waits. A reader copies the value and retries if a write
+// happened meanwhile, which the sequence counter tells: odd while a write is
+// in progress, bumped by 2 for every completed write.
+// T must be safe to copy with memcpy.
+
+template<typename T>
+class SeqLock
+{
+public:
+    SeqLock() noexcept
+        : fSeq(0)
+    {
+        std::memset(&fValue, 0, sizeof(T));
+    }
+
+    /*
+     * Publish a new value.
+     * Writer thread only.
+     */
+    void write(const T& value) noexcept
+    {
+        const uint32_t seq(__atomic_load_n(&fSeq, __ATOMIC_RELAXED));
+
+        __atomic_store_n(&fSeq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        std::memcpy(&fValue, &value, sizeof(T));
+
+        __atomic_store_n(&fSeq, seq + 2, __ATOMIC_RELEASE);
+    }
+
+    /*
+     * Try to copy the current value, once.
+     * Returns false if a write was in progress, leaving @a value undefined.
+     * Suitable for real-time readers, which should keep their previous copy on failure.
+     */
+    bool tryRead(T& value) const noexcept
+    {
+        const uint32_t seq(__atomic_load_n(&fSeq, __ATOMIC_ACQUIRE));
+
+        if (seq & 1)
+            return false;
+
+        std::memcpy(&value, &fValue, sizeof(T));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        return __atomic_load_n(&fSeq, __ATOMIC_RELAXED) == seq;
+    }
+
+    /*
+     * Copy the current value, retrying until a consistent copy is made.
+     * Not for real-time readers, as it spins while the writer is busy.
+     */
+    T read() const noexcept
+    {
+        T value;
+
+        while (! tryRead(value))
+        {
+#if defined(__i386__) || defined(__x86_64__)
+            __builtin_ia32_pause();
+#endif
+        }
+
+        return value;
+    }
+
+    /*
+     * Number of completed writes, useful to check for a new value without copying it.
+     */
+    uint32_t getVersion() const noexcept
+    {
+        return __atomic_load_n(&fSeq, __ATOMIC_ACQUIRE) / 2;
+    }
+
+private:
+    uint32_t fSeq;
+    T        fValue;
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(SeqLock)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_SEQLOCK_HPP_INCLUDED
@@ -23,6 +23,10 @@ START_NAMESPACE_DISTRHO
 
 // -----------------------------------------------------------------------
 // d_string class
+//
+// Short strings are kept in an inline buffer and never touch the heap.
+// Longer ones grow geometrically, so repeated appends are amortized O(1);
+// reserve() + append() can be used to build large strings with a single allocation.
 
 class d_string
 {
@@ -182,9 +186,20 @@ public:
     d_string(const d_string& str) noexcept
     {
         _init();
-        _dup(str.fBuffer);
+        _dup(str.fBuffer, str.fBufferLen);
     }
 
+#ifdef DISTRHO_PROPER_CPP11_SUPPORT
+    /*
+     * Move constructor, takes over the heap buffer of 'str' if it has one.
+     */
+    d_string(d_string&& str) noexcept
+    {
+        _init();
+        _move(str);
+    }
+#endif
+
     // -------------------------------------------------------------------
     // destructor
 
@@ -195,13 +210,12 @@ public:
     {
         DISTRHO_SAFE_ASSERT_RETURN(fBuffer != nullptr,);
 
-        if (fBuffer == _null())
-            return;
-
-        std::free(fBuffer);
+        if (fBuffer != fSmall)
+            std::free(fBuffer);
 
         fBuffer    = nullptr;
         fBufferLen = 0;
+        fBufferCap = 0;
     }
 
     // -------------------------------------------------------------------
@@ -246,7 +260,7 @@ public:
             d_string tmp1(fBuffer), tmp2(strBuf);
 
             // memory allocation failed or empty string(s)
-            if (tmp1.fBuffer == _null() || tmp2.fBuffer == _null())
+            if (tmp1.isEmpty() || tmp2.isEmpty())
                 return false;
 
             tmp1.toLower();
@@ -446,12 +460,153 @@ public:
 
     /*
      * Clear the string.
+     * Allocated memory is kept, see reserve().
      */
     void clear() noexcept
     {
         truncate(0);
     }
 
+    /*
+     * Get how many characters fit in the string without reallocating.
+     */
+    size_t capacity() const noexcept
+    {
+        return fBufferCap;
+    }
+
+    /*
+     * Make room for at least 'size' characters, not counting the null terminator.
+     * Returns false if memory allocation failed, in which case the string is left untouched.
+     */
+    bool reserve(const size_t size) noexcept
+    {
+        if (size <= fBufferCap)
+            return true;
+
+        size_t newCap = fBufferCap * 2;
+
+        if (newCap < size)
+            newCap = size;
+
+        char* newBuf;
+
+        if (fBuffer == fSmall)
+        {
+            newBuf = (char*)std::malloc(newCap+1);
+
+            if (newBuf != nullptr)
+                std::memcpy(newBuf, fSmall, fBufferLen+1);
+        }
+        else
+        {
+            newBuf = (char*)std::realloc(fBuffer, newCap+1);
+        }
+
+        DISTRHO_SAFE_ASSERT_RETURN(newBuf != nullptr, false);
+
+        fBuffer    = newBuf;
+        fBufferCap = newCap;
+        return true;
+    }
+
+    /*
+     * Append the first 'size' characters of 'strBuf'.
+     * 'strBuf' may point inside this string.
+     */
+    d_string& append(const char* strBuf, const size_t size) noexcept
+    {
+        if (strBuf == nullptr || size == 0)
+            return *this;
+
+        // keep pointers into our own buffer valid across reallocation
+        if (strBuf >= fBuffer && strBuf < fBuffer + fBufferLen)
+        {
+            const size_t offset(static_cast<size_t>(strBuf - fBuffer));
+
+            if (! reserve(fBufferLen + size))
+                return *this;
+
+            strBuf = fBuffer + offset;
+        }
+        else if (! reserve(fBufferLen + size))
+        {
+            return *this;
+        }
+
+        std::memmove(fBuffer + fBufferLen, strBuf, size);
+        fBufferLen += size;
+        fBuffer[fBufferLen] = '\0';
+
+        return *this;
+    }
+
+    /*
+     * Append a null-terminated string.
+     */
+    d_string& append(const char* const strBuf) noexcept
+    {
+        if (strBuf == nullptr)
+            return *this;
+
+        return append(strBuf, std::strlen(strBuf));
+    }
+
+    /*
+     * Append a single character.
+     */
+    d_string& append(const char c) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(c != '\0', *this);
+
+        if (! reserve(fBufferLen + 1))
+            return *this;
+
+        fBuffer[fBufferLen++] = c;
+        fBuffer[fBufferLen]   = '\0';
+
+        return *this;
+    }
+
+    /*
+     * Append printf-style formatted text, written directly into the string buffer.
+     * Arguments must not point inside this string.
+     */
+    d_string& appendFormat(const char* const format, ...) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(format != nullptr, *this);
+
+        ::va_list args;
+        ::va_start(args, format);
+        const int ret = std::vsnprintf(fBuffer + fBufferLen, fBufferCap - fBufferLen + 1, format, args);
+        ::va_end(args);
+
+        if (ret < 0)
+        {
+            d_safe_assert("ret >= 0", __FILE__, __LINE__);
+            fBuffer[fBufferLen] = '\0';
+            return *this;
+        }
+
+        const size_t size(static_cast<size_t>(ret));
+
+        if (size > fBufferCap - fBufferLen)
+        {
+            if (! reserve(fBufferLen + size))
+            {
+                fBuffer[fBufferLen] = '\0';
+                return *this;
+            }
+
+            ::va_start(args, format);
+            std::vsnprintf(fBuffer + fBufferLen, size + 1, format, args);
+            ::va_end(args);
+        }
+
+        fBufferLen += size;
+        return *this;
+    }
+
     /*
      * Replace all occurrences of character 'before' with character 'after'.
      */
@@ -474,9 +629,7 @@ public:
         if (n >= fBufferLen)
             return;
 
-        for (size_t i=n; i < fBufferLen; ++i)
-            fBuffer[i] = '\0';
-
+        fBuffer[n] = '\0';
         fBufferLen = n;
     }
 
@@ -597,46 +750,44 @@ public:
 
     d_string& operator=(const d_string& str) noexcept
     {
-        _dup(str.fBuffer);
+        _dup(str.fBuffer, str.fBufferLen);
 
         return *this;
     }
 
-    d_string& operator+=(const char* const strBuf) noexcept
+#ifdef DISTRHO_PROPER_CPP11_SUPPORT
+    d_string& operator=(d_string&& str) noexcept
     {
-        if (strBuf == nullptr)
-            return *this;
-
-        const size_t newBufSize = fBufferLen + std::strlen(strBuf) + 1;
-        char         newBuf[newBufSize];
-
-        std::strcpy(newBuf, fBuffer);
-        std::strcat(newBuf, strBuf);
-
-        _dup(newBuf, newBufSize-1);
+        if (&str != this)
+            _move(str);
 
         return *this;
     }
+#endif
 
-    d_string& operator+=(const d_string& str) noexcept
+    d_string& operator+=(const char* const strBuf) noexcept
     {
-        return operator+=(str.fBuffer);
+        return append(strBuf);
     }
 
-    d_string operator+(const char* const strBuf) noexcept
+    d_string& operator+=(const d_string& str) noexcept
     {
-        const size_t newBufSize = fBufferLen + ((strBuf != nullptr) ? std::strlen(strBuf) : 0) + 1;
-        char         newBuf[newBufSize];
+        return append(str.fBuffer, str.fBufferLen);
+    }
 
-        std::strcpy(newBuf, fBuffer);
+    d_string operator+(const char* const strBuf) const noexcept
+    {
+        const size_t strBufLen((strBuf != nullptr) ? std::strlen(strBuf) : 0);
 
-        if (strBuf != nullptr)
-            std::strcat(newBuf, strBuf);
+        d_string newString;
+        newString.reserve(fBufferLen + strBufLen);
+        newString.append(fBuffer, fBufferLen);
+        newString.append(strBuf, strBufLen);
 
-        return d_string(newBuf);
+        return newString;
     }
 
-    d_string operator+(const d_string& str) noexcept
+    d_string operator+(const d_string& str) const noexcept
     {
         return operator+(str.fBuffer);
     }
@@ -644,18 +795,12 @@ public:
     // -------------------------------------------------------------------
 
 private:
-    char*  fBuffer;    // the actual string buffer
-    size_t fBufferLen; // string length
+    static const size_t kSmallSize = 32;
 
-    /*
-     * Static null string.
-     * Prevents allocation for new and/or empty strings.
-     */
-    static char* _null() noexcept
-    {
-        static char sNull = '\0';
-        return &sNull;
-    }
+    char*  fBuffer;    // the actual string buffer, either fSmall or allocated
+    size_t fBufferLen; // string length
+    size_t fBufferCap; // usable buffer size, not counting the null terminator
+    char   fSmall[kSmallSize]; // inline storage for short strings
 
     /*
      * Shared init function.
@@ -663,53 +808,92 @@ private:
      */
     void _init() noexcept
     {
-        fBuffer    = _null();
+        fBuffer    = fSmall;
         fBufferLen = 0;
+        fBufferCap = kSmallSize-1;
+        fSmall[0]  = '\0';
     }
 
     /*
      * Helper function.
-     * Called whenever the string needs to be allocated.
+     * Called whenever the string contents are replaced.
      *
      * Notes:
-     * - Allocates string only if 'strBuf' is not null and new string contents are different
-     * - If 'strBuf' is null, 'size' must be 0
+     * - Reuses the current buffer if 'strBuf' fits, allocating only to grow it
+     * - 'strBuf' may point inside this string
+     * - If 'strBuf' is null the string is cleared and 'size' must be 0
      */
     void _dup(const char* const strBuf, const size_t size = 0) noexcept
     {
-        if (strBuf != nullptr)
+        if (strBuf == nullptr)
         {
-            // don't recreate string if contents match
-            if (std::strcmp(fBuffer, strBuf) == 0)
-                return;
+            DISTRHO_SAFE_ASSERT(size == 0);
 
-            if (fBuffer != _null())
-                std::free(fBuffer);
+            truncate(0);
+            return;
+        }
 
-            fBufferLen = (size > 0) ? size : std::strlen(strBuf);
-            fBuffer    = (char*)std::malloc(fBufferLen+1);
+        if (strBuf == fBuffer)
+            return;
 
-            if (fBuffer == nullptr)
-                return _init();
+        const size_t strBufLen((size > 0) ? size : std::strlen(strBuf));
 
-            std::strcpy(fBuffer, strBuf);
+        // memory allocation failed, keep the old contents
+        if (strBufLen > fBufferCap && ! _grow(strBufLen))
+            return;
 
-            fBuffer[fBufferLen] = '\0';
-        }
-        else
-        {
-            DISTRHO_SAFE_ASSERT(size == 0);
+        std::memmove(fBuffer, strBuf, strBufLen);
+        fBufferLen = strBufLen;
+        fBuffer[fBufferLen] = '\0';
+    }
 
-            // don't recreate null string
-            if (fBuffer == _null())
-                return;
+    /*
+     * Allocate a bigger buffer when the old contents are going to be replaced.
+     * Unlike reserve(), nothing is copied over.
+     */
+    bool _grow(const size_t size) noexcept
+    {
+        size_t newCap = fBufferCap * 2;
 
-            DISTRHO_SAFE_ASSERT(fBuffer != nullptr);
+        if (newCap < size)
+            newCap = size;
+
+        char* const newBuf((char*)std::malloc(newCap+1));
+        DISTRHO_SAFE_ASSERT_RETURN(newBuf != nullptr, false);
+
+        if (fBuffer != fSmall)
             std::free(fBuffer);
 
-            _init();
+        fBuffer    = newBuf;
+        fBufferLen = 0;
+        fBufferCap = newCap;
+        fBuffer[0] = '\0';
+        return true;
+    }
+
+#ifdef DISTRHO_PROPER_CPP11_SUPPORT
+    /*
+     * Take over the contents of 'str', leaving it empty.
+     */
+    void _move(d_string& str) noexcept
+    {
+        if (str.fBuffer == str.fSmall)
+        {
+            _dup(str.fBuffer, str.fBufferLen);
+            str.truncate(0);
+            return;
         }
+
+        if (fBuffer != fSmall)
+            std::free(fBuffer);
+
+        fBuffer    = str.fBuffer;
+        fBufferLen = str.fBufferLen;
+        fBufferCap = str.fBufferCap;
+
+        str._init();
     }
+#endif
 
     DISTRHO_LEAK_DETECTOR(d_string)
     DISTRHO_PREVENT_HEAP_ALLOCATION
@@ -717,30 +901,17 @@ private:
 
 // -----------------------------------------------------------------------
 
-static inline
-d_string operator+(const d_string& strBefore, const char* const strBufAfter) noexcept
-{
-    const char* const strBufBefore = strBefore.buffer();
-    const size_t      newBufSize   = strBefore.length() + ((strBufAfter != nullptr) ? std::strlen(strBufAfter) : 0) + 1;
-    char newBuf[newBufSize];
-
-    std::strcpy(newBuf, strBufBefore);
-    std::strcat(newBuf, strBufAfter);
-
-    return d_string(newBuf);
-}
-
 static inline
 d_string operator+(const char* const strBufBefore, const d_string& strAfter) noexcept
 {
-    const char* const strBufAfter = strAfter.buffer();
-    const size_t      newBufSize  = ((strBufBefore != nullptr) ? std::strlen(strBufBefore) : 0) + strAfter.length() + 1;
-    char newBuf[newBufSize];
+    const size_t strBufBeforeLen((strBufBefore != nullptr) ? std::strlen(strBufBefore) : 0);
 
-    std::strcpy(newBuf, strBufBefore);
-    std::strcat(newBuf, strBufAfter);
+    d_string newString;
+    newString.reserve(strBufBeforeLen + strAfter.length());
+    newString.append(strBufBefore, strBufBeforeLen);
+    newString.append(strAfter.buffer(), strAfter.length());
 
-    return d_string(newBuf);
+    return newString;
 }
 
 // -----------------------------------------------------------------------
@@ -18,6 +18,7 @@
 #define DISTRHO_THREAD_HPP_INCLUDED
 
 #include "d_mutex.hpp"
+#include "d_ringbuffer.hpp"
 #include "d_sleep.hpp"
 #include "d_string.hpp"
 
@@ -27,6 +28,20 @@
 # include <sys/prctl.h>
 #endif
 
+#ifdef DISTRHO_OS_LINUX
+# include <sys/resource.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+#ifdef DISTRHO_OS_WINDOWS
+# include <malloc.h>
+#else
+# include <alloca.h>
+#endif
+
+#include <sched.h>
+
 START_NAMESPACE_DISTRHO
 
 // -----------------------------------------------------------------------
@@ -40,13 +55,20 @@ protected:
      */
     Thread(const char* const threadName = nullptr) noexcept
         : fLock(),
+          fStarted(),
+          fFinished(),
           fName(threadName),
 #ifdef PTW32_DLLPORT
           fHandle({nullptr, 0}),
 #else
           fHandle(0),
 #endif
-          fShouldExit(false) {}
+          fRunning(false),
+          fShouldExit(false),
+          fPriority(0),
+          fAffinity(0),
+          fStackSize(0),
+          fStackPrefault(0) {}
 
     /*
      * Destructor.
@@ -71,11 +93,7 @@ public:
      */
     bool isThreadRunning() const noexcept
     {
-#ifdef PTW32_DLLPORT
-        return (fHandle.p != nullptr);
-#else
-        return (fHandle != 0);
-#endif
+        return fRunning.load();
     }
 
     /*
@@ -83,9 +101,52 @@ public:
      */
     bool shouldThreadExit() const noexcept
     {
-        return fShouldExit;
+        return fShouldExit.load();
+    }
+
+    // -------------------------------------------------------------------
+    // Options, used by the next startThread() call
+
+    /*
+     * Run with SCHED_FIFO at @a priority (1 to 99), for threads doing audio work.
+     * 0 (the default) means normal scheduling.
+     * If the process is not allowed to use real-time scheduling the thread still starts, with normal scheduling.
+     */
+    void setThreadPriority(const int priority) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(priority >= 0 && priority <= 99,);
+
+        fPriority = priority;
+    }
+
+    /*
+     * Restrict the thread to a set of CPUs, bit N meaning CPU N.
+     * 0 (the default) means any CPU. Only supported on Linux, ignored elsewhere.
+     */
+    void setThreadAffinity(const uint32_t cpuMask) noexcept
+    {
+        fAffinity = cpuMask;
+    }
+
+    /*
+     * Stack size in bytes, 0 (the default) for the system default.
+     */
+    void setThreadStackSize(const size_t bytes) noexcept
+    {
+        fStackSize = bytes;
     }
 
+    /*
+     * Touch this many bytes of stack when the thread starts,
+     * so that real-time code running later does not page-fault on it.
+     */
+    void setThreadStackPrefault(const size_t bytes) noexcept
+    {
+        fStackPrefault = bytes;
+    }
+
+    // -------------------------------------------------------------------
+
     /*
      * Start the thread.
      */
@@ -96,27 +157,55 @@ public:
 
         const MutexLocker cml(fLock);
 
-        fShouldExit = false;
+        // a previous run that ended by itself is still joinable
+        _join();
+
+        fShouldExit.store(false);
+        fRunning.store(true);
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+
+        if (fStackSize != 0)
+            pthread_attr_setstacksize(&attr, fStackSize);
+
+        bool realtime = false;
+
+        if (fPriority > 0)
+        {
+            sched_param param;
+            param.sched_priority = fPriority;
+
+            realtime = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED) == 0 &&
+                       pthread_attr_setschedpolicy(&attr, SCHED_FIFO) == 0 &&
+                       pthread_attr_setschedparam(&attr, &param) == 0;
+        }
 
         pthread_t handle;
+        int ret = pthread_create(&handle, &attr, _entryPoint, this);
 
-        if (pthread_create(&handle, nullptr, _entryPoint, this) == 0)
+        if (ret == EPERM && realtime)
         {
-#ifdef PTW32_DLLPORT
-            DISTRHO_SAFE_ASSERT_RETURN(handle.p != nullptr, false);
-#else
-            DISTRHO_SAFE_ASSERT_RETURN(handle != 0, false);
-#endif
-            pthread_detach(handle);
-            _copyFrom(handle);
+            d_stderr("Thread \"%s\": not allowed to use real-time priority %i, using normal scheduling", fName.buffer(), fPriority);
 
-            // wait for thread to start
-            fLock.lock();
+            pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+            ret = pthread_create(&handle, &attr, _entryPoint, this);
+        }
 
-            return true;
+        pthread_attr_destroy(&attr);
+
+        if (ret != 0)
+        {
+            fRunning.store(false);
+            return false;
         }
 
-        return false;
+        _copyFrom(handle);
+
+        // wait for thread to start
+        fStarted.wait();
+
+        return true;
     }
 
     /*
@@ -134,23 +223,15 @@ public:
         {
             signalThreadShouldExit();
 
-            if (timeOutMilliseconds != 0)
+            // Wait for the thread to stop
+            if (timeOutMilliseconds < 0)
             {
-                // Wait for the thread to stop
-                int timeOutCheck = (timeOutMilliseconds == 1 || timeOutMilliseconds == -1) ? timeOutMilliseconds : timeOutMilliseconds/2;
-
                 for (; isThreadRunning();)
-                {
-                    d_msleep(2);
-
-                    if (timeOutCheck < 0)
-                        continue;
-
-                    if (timeOutCheck > 0)
-                        timeOutCheck -= 1;
-                    else
-                        break;
-                }
+                    fFinished.wait();
+            }
+            else if (timeOutMilliseconds > 0)
+            {
+                for (; isThreadRunning() && fFinished.wait(static_cast<uint>(timeOutMilliseconds));) {}
             }
 
             if (isThreadRunning())
@@ -162,15 +243,18 @@ public:
                 pthread_t threadId;
                 _copyTo(threadId);
                 _init();
+                fRunning.store(false);
 
                 try {
                     pthread_cancel(threadId);
+                    pthread_detach(threadId);
                 } DISTRHO_SAFE_EXCEPTION("pthread_cancel");
 
                 return false;
             }
         }
 
+        _join();
         return true;
     }
 
@@ -179,7 +263,7 @@ public:
      */
     void signalThreadShouldExit() noexcept
     {
-        fShouldExit = true;
+        fShouldExit.store(true);
     }
 
     // -------------------------------------------------------------------
@@ -207,13 +291,43 @@ public:
 #endif
     }
 
+    /*
+     * Move the caller thread to background scheduling, for non real-time work that
+     * must not compete with audio or UI threads. Threads inherit the policy of their
+     * creator, so this also drops SCHED_FIFO when started from an audio thread.
+     * On Linux the thread uses SCHED_BATCH with a nice value of 10.
+     */
+    static void setCurrentThreadLowPriority() noexcept
+    {
+        sched_param param;
+        param.sched_priority = 0;
+
+#ifdef DISTRHO_OS_LINUX
+        pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+
+        // nice values are per thread on Linux
+        setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), 10);
+#else
+        param.sched_priority = sched_get_priority_min(SCHED_OTHER);
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+#endif
+    }
+
     // -------------------------------------------------------------------
 
 private:
-    Mutex              fLock;       // Thread lock
-    const d_string     fName;       // Thread name
-    volatile pthread_t fHandle;     // Handle for this thread
-    volatile bool      fShouldExit; // true if thread should exit
+    Mutex          fLock;       // Thread lock, serializes start and stop
+    Signal         fStarted;    // triggered by the thread when it starts
+    Signal         fFinished;   // triggered by the thread when run() returns
+    const d_string fName;       // Thread name
+    pthread_t      fHandle;     // Handle for this thread, kept until joined
+    Atomic<bool>   fRunning;    // true from startThread() until run() returns
+    Atomic<bool>   fShouldExit; // true if thread should exit
+
+    int      fPriority;
+    uint32_t fAffinity;
+    size_t   fStackSize;
+    size_t   fStackPrefault;
 
     /*
      * Init pthread type.
@@ -228,6 +342,18 @@ private:
 #endif
     }
 
+    /*
+     * Check if we have a handle to join.
+     */
+    bool _hasHandle() const noexcept
+    {
+#ifdef PTW32_DLLPORT
+        return (fHandle.p != nullptr);
+#else
+        return (fHandle != 0);
+#endif
+    }
+
     /*
      * Copy our pthread type from another var.
      */
@@ -244,7 +370,7 @@ private:
     /*
      * Copy our pthread type to another var.
      */
-    void _copyTo(volatile pthread_t& handle) const noexcept
+    void _copyTo(pthread_t& handle) const noexcept
     {
 #ifdef PTW32_DLLPORT
         handle.p = fHandle.p;
@@ -254,22 +380,78 @@ private:
 #endif
     }
 
+    /*
+     * Release the handle of a finished thread.
+     */
+    void _join() noexcept
+    {
+        if (! _hasHandle())
+            return;
+
+        pthread_t threadId;
+        _copyTo(threadId);
+        _init();
+
+        // a thread can't join itself
+        if (pthread_equal(threadId, pthread_self()))
+            pthread_detach(threadId);
+        else
+            pthread_join(threadId, nullptr);
+    }
+
     /*
      * Thread entry point.
      */
     void _runEntryPoint() noexcept
     {
-        // report ready
-        fLock.unlock();
+        if (fName.isNotEmpty())
+            setCurrentThreadName(fName);
+
+#ifdef DISTRHO_OS_LINUX
+        if (fAffinity != 0)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+
+            for (uint32_t i=0; i < 32; ++i)
+            {
+                if (fAffinity & (1U << i))
+                    CPU_SET(i, &cpus);
+            }
+
+            if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) != 0)
+                d_stderr("Thread \"%s\": failed to set CPU affinity", fName.buffer());
+        }
+#endif
 
-        setCurrentThreadName(fName);
+        if (fStackPrefault != 0)
+            _prefaultStack(fStackPrefault);
+
+        // report ready
+        fStarted.signal();
 
         try {
             run();
         } catch(...) {}
 
         // done
-        _init();
+        fRunning.store(false);
+        fFinished.signal();
+    }
+
+    /*
+     * Write to each page of the next 'size' bytes of stack.
+     */
+    static void __attribute__((noinline)) _prefaultStack(const size_t size) noexcept
+    {
+#ifdef DISTRHO_OS_WINDOWS
+        volatile char* const stack((volatile char*)_alloca(size));
+#else
+        volatile char* const stack((volatile char*)alloca(size));
+#endif
+
+        for (size_t i=0; i < size; i += 4096)
+            stack[i] = 0;
     }
 
     /*
@@ -284,6 +466,209 @@ private:
     DISTRHO_DECLARE_NON_COPY_CLASS(Thread)
 };
 
+// -----------------------------------------------------------------------
+// Fixed-size pool of threads running jobs from work queues.
+//
+// Each pool thread has its own queue. addJob() never blocks nor allocates, so it
+// can be used from the audio thread; jobs are spread over the queues in turn,
+// skipping full ones. A job is a plain function and pointer, the pointed data
+// must stay valid until the job has run.
+// Threads are woken through a Semaphore, one post per job, so they sleep without
+// timeouts and a job added from the audio thread starts right away.
+
+class ThreadPool
+{
+public:
+    typedef void (*JobFunc)(void* ptr);
+
+    /*
+     * Start @a threadCount threads, each with a queue of @a queueSize jobs.
+     * See Thread::setThreadPriority() for @a priority.
+     */
+    ThreadPool(const char* const name, const uint32_t threadCount, const uint32_t queueSize = 256, const int priority = 0)
+        : fThreads(nullptr),
+          fThreadCount(0),
+          fNextThread(0),
+          fPendingJobs(0),
+          fIdle()
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(threadCount > 0,);
+
+        fThreads = new PoolThread*[threadCount];
+
+        for (uint32_t i=0; i < threadCount; ++i)
+        {
+            PoolThread* const thread(new PoolThread(this, name, queueSize));
+            thread->setThreadPriority(priority);
+
+            if (! thread->startThread())
+            {
+                d_stderr("ThreadPool: failed to start thread %u, using %u threads", i+1, i);
+                delete thread;
+                break;
+            }
+
+            fThreads[fThreadCount++] = thread;
+        }
+    }
+
+    /*
+     * Stop all threads. Jobs still queued are dropped, running ones are waited for.
+     */
+    ~ThreadPool()
+    {
+        for (uint32_t i=0; i < fThreadCount; ++i)
+        {
+            fThreads[i]->stop();
+            fThreads[i]->dropJobs();
+            delete fThreads[i];
+        }
+
+        delete[] fThreads;
+    }
+
+    uint32_t getThreadCount() const noexcept
+    {
+        return fThreadCount;
+    }
+
+    /*
+     * Queue a job.
+     * Returns false if all queues are full.
+     * Any thread, real-time safe.
+     */
+    bool addJob(const JobFunc func, void* const ptr) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(func != nullptr, false);
+
+        if (fThreadCount == 0)
+            return false;
+
+        const Job job = { func, ptr };
+        const uint32_t first(fNextThread.fetchAdd(1, __ATOMIC_RELAXED));
+
+        fPendingJobs.fetchAdd(1);
+
+        for (uint32_t i=0; i < fThreadCount; ++i)
+        {
+            PoolThread* const thread(fThreads[(first + i) % fThreadCount]);
+
+            if (thread->push(job))
+                return true;
+        }
+
+        jobDone();
+        return false;
+    }
+
+    /*
+     * Number of jobs queued or running.
+     */
+    uint32_t getPendingJobCount() const noexcept
+    {
+        return fPendingJobs.load();
+    }
+
+    /*
+     * Block until all queued jobs have run.
+     * Not for the audio thread, and only from one thread at a time.
+     */
+    void waitForJobs() noexcept
+    {
+        // forget wake-ups from earlier batches nobody waited for
+        for (; fIdle.tryWait();) {}
+
+        for (; fPendingJobs.load() != 0;)
+            fIdle.wait();
+    }
+
+private:
+    struct Job {
+        JobFunc func;
+        void*   ptr;
+    };
+
+    class PoolThread : public Thread
+    {
+    public:
+        PoolThread(ThreadPool* const pool, const char* const name, const uint32_t queueSize) noexcept
+            : Thread(name),
+              fPool(pool),
+              fQueue(queueSize),
+              fSemaphore() {}
+
+        bool push(const Job& job) noexcept
+        {
+            if (! fQueue.push(job))
+                return false;
+
+            fSemaphore.post();
+            return true;
+        }
+
+        void stop() noexcept
+        {
+            signalThreadShouldExit();
+            fSemaphore.post();
+            stopThread(-1);
+        }
+
+        /*
+         * Forget jobs still queued, only after stop().
+         */
+        void dropJobs() noexcept
+        {
+            Job job;
+
+            for (; fQueue.pop(job);)
+                fPool->jobDone();
+        }
+
+    protected:
+        void run() override
+        {
+            Job job;
+
+            // one post per queued job, plus one from stop()
+            for (;;)
+            {
+                fSemaphore.wait();
+
+                if (shouldThreadExit())
+                    return;
+
+                if (fQueue.pop(job))
+                {
+                    job.func(job.ptr);
+                    fPool->jobDone();
+                }
+            }
+        }
+
+    private:
+        ThreadPool* const    fPool;
+        MpscRingBuffer<Job>  fQueue;
+        Semaphore            fSemaphore;
+
+        DISTRHO_DECLARE_NON_COPY_CLASS(PoolThread)
+    };
+
+    PoolThread**     fThreads;
+    uint32_t         fThreadCount;
+    Atomic<uint32_t> fNextThread;
+    Atomic<uint32_t> fPendingJobs;
+    Semaphore        fIdle;
+
+    // may be called from the audio thread, by addJob()
+    void jobDone() noexcept
+    {
+        if (fPendingJobs.fetchSub(1) == 1)
+            fIdle.post();
+    }
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(ThreadPool)
+};
+
 // -----------------------------------------------------------------------
 
 END_NAMESPACE_DISTRHO
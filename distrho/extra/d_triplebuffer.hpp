@@ -0,0 +1,183 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_TRIPLEBUFFER_HPP_INCLUDED
+#define DISTRHO_TRIPLEBUFFER_HPP_INCLUDED
+
+#include "../DistrhoUtils.hpp"
+
+#include <cstring>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+// Single-writer, single-reader triple buffer of raw bytes.
+// The writer always has a private slot to fill, the reader always has a
+// private slot to copy from, and the third slot is swapped between them
+// atomically. Neither side ever waits for the other and the reader never
+// sees a partially written block.
+
+class TripleBuffer
+{
+public:
+    TripleBuffer(const uint32_t capacity) noexcept
+        : fData(nullptr),
+          fCapacity(0),
+          fBack(0),
+          fMiddle(1),
+          fFront(2)
+    {
+        for (int i=0; i<3; ++i)
+            fSizes[i] = 0;
+
+        DISTRHO_SAFE_ASSERT_RETURN(capacity > 0,);
+
+        try {
+            fData = new uint8_t[capacity*3];
+        } DISTRHO_SAFE_EXCEPTION_RETURN("TripleBuffer::TripleBuffer",);
+
+        fCapacity = capacity;
+        std::memset(fData, 0, capacity*3);
+    }
+
+    ~TripleBuffer() noexcept
+    {
+        if (fData != nullptr)
+        {
+            delete[] fData;
+            fData = nullptr;
+        }
+    }
+
+    /*
+     * Maximum size of a block, in bytes.
+     */
+    uint32_t getCapacity() const noexcept
+    {
+        return fCapacity;
+    }
+
+    /*
+     * Publish a new block, replacing any previous one not yet read.
+     * Writer thread only.
+     */
+    bool write(const void* const data, const uint32_t size) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(data != nullptr, false);
+        DISTRHO_SAFE_ASSERT_RETURN(size > 0 && size <= fCapacity, false);
+
+        std::memcpy(fData + fBack*fCapacity, data, size);
+        fSizes[fBack] = size;
+
+        // swap back and middle, marking middle as fresh
+        fBack = __atomic_exchange_n(&fMiddle, fBack|kFreshFlag, __ATOMIC_ACQ_REL) & kIndexMask;
+        return true;
+    }
+
+    /*
+     * Copy the latest published block into @a data, which must be exactly @a size bytes.
+     * Returns false if nothing was published yet or the published block has a different size.
+     * Reader thread only.
+     */
+    bool read(void* const data, const uint32_t size) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(data != nullptr, false);
+
+        // take the middle slot if something new is there
+        if (__atomic_load_n(&fMiddle, __ATOMIC_RELAXED) & kFreshFlag)
+            fFront = __atomic_exchange_n(&fMiddle, fFront, __ATOMIC_ACQ_REL) & kIndexMask;
+
+        if (fSizes[fFront] != size)
+            return false;
+
+        std::memcpy(data, fData + fFront*fCapacity, size);
+        return true;
+    }
+
+    /*
+     * Check if a block was published since the last read().
+     * Reader thread only.
+     */
+    bool isFresh() const noexcept
+    {
+        return (__atomic_load_n(&fMiddle, __ATOMIC_RELAXED) & kFreshFlag) != 0;
+    }
+
+private:
+    static const uint32_t kFreshFlag = 0x4;
+    static const uint32_t kIndexMask = 0x3;
+
+    uint8_t* fData;
+    uint32_t fCapacity;
+    uint32_t fSizes[3];
+
+    uint32_t fBack;   // owned by the writer
+    uint32_t fMiddle; // shared, slot index plus fresh flag
+    uint32_t fFront;  // owned by the reader
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(TripleBuffer)
+};
+
+// -----------------------------------------------------------------------
+// Same as above, for a single plain struct type.
+// T must be safe to copy with memcpy.
+
+template<typename T>
+class TypedTripleBuffer
+{
+public:
+    TypedTripleBuffer() noexcept
+        : fBuffer(sizeof(T)) {}
+
+    /*
+     * Publish a new value, replacing any previous one not yet read.
+     * Writer thread only.
+     */
+    void write(const T& value) noexcept
+    {
+        fBuffer.write(&value, sizeof(T));
+    }
+
+    /*
+     * Copy the latest published value.
+     * Returns false, leaving @a value untouched, if nothing was published yet.
+     * Reader thread only.
+     */
+    bool read(T& value) noexcept
+    {
+        return fBuffer.read(&value, sizeof(T));
+    }
+
+    /*
+     * Check if a value was published since the last read().
+     * Reader thread only.
+     */
+    bool isFresh() const noexcept
+    {
+        return fBuffer.isFresh();
+    }
+
+private:
+    TripleBuffer fBuffer;
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(TypedTripleBuffer)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_TRIPLEBUFFER_HPP_INCLUDED
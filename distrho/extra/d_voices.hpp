@@ -0,0 +1,376 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_VOICES_HPP_INCLUDED
+#define DISTRHO_VOICES_HPP_INCLUDED
+
+#include "../DistrhoPlugin.hpp"
+
+#include <cmath>
+#include <cstring>
+
+// -----------------------------------------------------------------------
+// Polyphonic voice manager for synth plugins.
+//
+// Takes the MidiEvent list given to d_run() and handles note on/off, sustain pedal,
+// pitch bend, all-notes-off and voice stealing. The block is split at each event
+// frame, and for every sub-block the plugin renders its voices in groups of
+// DISTRHO_VOICE_LANE_WIDTH, reading per-voice state from flat arrays
+// (structure-of-arrays), so the inner loops can be vectorized by the compiler.
+//
+// Usage:
+//   struct MySynth : Plugin, VoiceRenderer { VoiceManager<64> fVoices; ... };
+//   d_run(): clear the outputs, then fVoices.process(midiEvents, midiEventCount, frames, *this);
+//   renderVoices(): loop over samples, and inside over the group voices, using
+//                   the VoiceState arrays plus your own per-voice arrays of the same size.
+//   When a released voice has faded out, call fVoices.finishVoice(voice).
+
+#if defined(__AVX__)
+# define DISTRHO_VOICE_LANE_WIDTH 8
+#else
+# define DISTRHO_VOICE_LANE_WIDTH 4
+#endif
+
+#define DISTRHO_VOICE_ALIGN __attribute__((aligned(32)))
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+// Per-voice state, one array entry per voice.
+// Values are only meaningful for voices where active is 1.
+
+template<uint32_t kVoiceCount>
+struct VoiceState {
+    float frequency[kVoiceCount] DISTRHO_VOICE_ALIGN; // Hz, includes pitch bend
+    float velocity[kVoiceCount]  DISTRHO_VOICE_ALIGN; // 0 to 1
+    float gate[kVoiceCount]      DISTRHO_VOICE_ALIGN; // 1 while held or sustained, 0 once released
+    float active[kVoiceCount]    DISTRHO_VOICE_ALIGN; // 1 while sounding, 0 when free
+
+    uint8_t  note[kVoiceCount];
+    uint8_t  channel[kVoiceCount];
+    uint8_t  sustained[kVoiceCount]; // key is up, but the sustain pedal holds it
+    uint32_t age[kVoiceCount];       // start order, used for stealing
+};
+
+// -----------------------------------------------------------------------
+// Callbacks from VoiceManager::process(), implemented by the plugin.
+
+class VoiceRenderer
+{
+public:
+    virtual ~VoiceRenderer() {}
+
+    /*
+     * A voice was (re)started by a note on.
+     * @a stolen is true if it was still sounding, reset your per-voice data for it here.
+     */
+    virtual void voiceStarted(uint32_t voice, bool stolen) = 0;
+
+    /*
+     * Render voices [firstVoice, firstVoice + DISTRHO_VOICE_LANE_WIDTH) for @a frames,
+     * starting at frame @a offset of the d_run() block.
+     * Only called for groups with at least one active voice; check the active array for the others.
+     */
+    virtual void renderVoices(uint32_t firstVoice, uint32_t offset, uint32_t frames) = 0;
+};
+
+// -----------------------------------------------------------------------
+
+template<uint32_t kVoiceCount>
+class VoiceManager
+{
+public:
+    static const uint32_t kGroupCount = kVoiceCount / DISTRHO_VOICE_LANE_WIDTH;
+
+    VoiceManager() noexcept
+        : fPitchBendRange(2.0f),
+          fAgeCounter(0)
+    {
+        // the voice count must fill whole groups of the widest lane
+        typedef char VoiceCountMustBeMultipleOf8[(kVoiceCount > 0 && kVoiceCount % 8 == 0) ? 1 : -1];
+        (void)sizeof(VoiceCountMustBeMultipleOf8);
+
+        reset();
+    }
+
+    /*
+     * Stop all voices and forget controller state.
+     * Call from d_activate().
+     */
+    void reset() noexcept
+    {
+        std::memset(&fState, 0, sizeof(fState));
+
+        for (uint32_t c=0; c < 16; ++c)
+        {
+            fSustain[c]   = false;
+            fPitchBend[c] = 0.0f;
+        }
+    }
+
+    /*
+     * Pitch bend range in semitones, 2 by default.
+     */
+    void setPitchBendRange(const float semitones) noexcept
+    {
+        fPitchBendRange = semitones;
+    }
+
+    const VoiceState<kVoiceCount>& getState() const noexcept
+    {
+        return fState;
+    }
+
+    /*
+     * Free a released voice once it is silent.
+     */
+    void finishVoice(const uint32_t voice) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(voice < kVoiceCount,);
+
+        fState.active[voice]    = 0.0f;
+        fState.gate[voice]      = 0.0f;
+        fState.sustained[voice] = 0;
+    }
+
+    uint32_t getActiveVoiceCount() const noexcept
+    {
+        uint32_t count = 0;
+
+        for (uint32_t v=0; v < kVoiceCount; ++v)
+        {
+            if (fState.active[v] != 0.0f)
+                ++count;
+        }
+
+        return count;
+    }
+
+    /*
+     * Handle a d_run() block: apply each event at its frame, rendering the voices in between.
+     * Events must be sorted by frame, as given by the plugin wrappers.
+     */
+    void process(const MidiEvent* const events, const uint32_t eventCount, const uint32_t frames, VoiceRenderer& renderer)
+    {
+        uint32_t pos = 0;
+
+        for (uint32_t i=0; i < eventCount; ++i)
+        {
+            const MidiEvent& event(events[i]);
+            const uint32_t frame((event.frame < frames) ? event.frame : frames);
+
+            if (frame > pos)
+            {
+                render(renderer, pos, frame - pos);
+                pos = frame;
+            }
+
+            handleEvent(event, renderer);
+        }
+
+        if (pos < frames)
+            render(renderer, pos, frames - pos);
+    }
+
+private:
+    VoiceState<kVoiceCount> fState;
+
+    bool     fSustain[16];
+    float    fPitchBend[16]; // -1 to 1
+    float    fPitchBendRange;
+    uint32_t fAgeCounter;
+
+    void render(VoiceRenderer& renderer, const uint32_t offset, const uint32_t frames)
+    {
+        for (uint32_t g=0; g < kGroupCount; ++g)
+        {
+            const uint32_t first(g * DISTRHO_VOICE_LANE_WIDTH);
+
+            // branch-free "any active" over the group
+            float anyActive = 0.0f;
+
+            for (uint32_t v=0; v < DISTRHO_VOICE_LANE_WIDTH; ++v)
+                anyActive += fState.active[first + v];
+
+            if (anyActive != 0.0f)
+                renderer.renderVoices(first, offset, frames);
+        }
+    }
+
+    void handleEvent(const MidiEvent& event, VoiceRenderer& renderer) noexcept
+    {
+        // sysex and other long messages are not for us
+        if (event.size == 0 || event.size > MidiEvent::kDataSize)
+            return;
+
+        const uint8_t status(event.data[0] & 0xF0);
+        const uint8_t channel(event.data[0] & 0x0F);
+        const uint8_t data1((event.size > 1) ? event.data[1] & 0x7F : 0);
+        const uint8_t data2((event.size > 2) ? event.data[2] & 0x7F : 0);
+
+        switch (status)
+        {
+        case 0x90:
+            // velocity 0 is note off
+            if (data2 != 0)
+                noteOn(channel, data1, data2, renderer);
+            else
+                noteOff(channel, data1);
+            break;
+
+        case 0x80:
+            noteOff(channel, data1);
+            break;
+
+        case 0xB0:
+            if (data1 == 64)
+                setSustain(channel, data2 >= 64);
+            else if (data1 == 120 || data1 == 123)
+                allNotesOff(channel, data1 == 120);
+            break;
+
+        case 0xE0:
+            fPitchBend[channel] = static_cast<float>((data2 << 7 | data1) - 8192) / 8192.0f;
+            updateFrequencies(channel);
+            break;
+        }
+    }
+
+    void noteOn(const uint8_t channel, const uint8_t note, const uint8_t velocity, VoiceRenderer& renderer) noexcept
+    {
+        const uint32_t voice(findVoice(channel, note));
+        const bool stolen(fState.active[voice] != 0.0f);
+
+        fState.note[voice]      = note;
+        fState.channel[voice]   = channel;
+        fState.velocity[voice]  = static_cast<float>(velocity) / 127.0f;
+        fState.gate[voice]      = 1.0f;
+        fState.active[voice]    = 1.0f;
+        fState.sustained[voice] = 0;
+        fState.age[voice]       = ++fAgeCounter;
+        fState.frequency[voice] = noteFrequency(note, channel);
+
+        renderer.voiceStarted(voice, stolen);
+    }
+
+    void noteOff(const uint8_t channel, const uint8_t note) noexcept
+    {
+        for (uint32_t v=0; v < kVoiceCount; ++v)
+        {
+            if (fState.active[v] == 0.0f || fState.gate[v] == 0.0f || fState.sustained[v] != 0)
+                continue;
+            if (fState.note[v] != note || fState.channel[v] != channel)
+                continue;
+
+            if (fSustain[channel])
+                fState.sustained[v] = 1;
+            else
+                fState.gate[v] = 0.0f;
+        }
+    }
+
+    void setSustain(const uint8_t channel, const bool on) noexcept
+    {
+        fSustain[channel] = on;
+
+        if (on)
+            return;
+
+        for (uint32_t v=0; v < kVoiceCount; ++v)
+        {
+            if (fState.sustained[v] != 0 && fState.channel[v] == channel)
+            {
+                fState.sustained[v] = 0;
+                fState.gate[v] = 0.0f;
+            }
+        }
+    }
+
+    // all sound off also frees the voices, all notes off only releases them
+    void allNotesOff(const uint8_t channel, const bool hard) noexcept
+    {
+        for (uint32_t v=0; v < kVoiceCount; ++v)
+        {
+            if (fState.channel[v] != channel)
+                continue;
+
+            if (hard)
+                finishVoice(v);
+            else
+            {
+                fState.gate[v] = 0.0f;
+                fState.sustained[v] = 0;
+            }
+        }
+
+        fSustain[channel] = false;
+    }
+
+    // Picks, in order: the voice already playing this note, a free voice,
+    // the oldest released voice, the oldest voice.
+    uint32_t findVoice(const uint8_t channel, const uint8_t note) const noexcept
+    {
+        uint32_t freeVoice = kVoiceCount, releasedVoice = kVoiceCount, oldestVoice = 0;
+
+        for (uint32_t v=0; v < kVoiceCount; ++v)
+        {
+            if (fState.active[v] == 0.0f)
+            {
+                if (freeVoice == kVoiceCount)
+                    freeVoice = v;
+                continue;
+            }
+
+            if (fState.note[v] == note && fState.channel[v] == channel)
+                return v;
+
+            if (fState.gate[v] == 0.0f && (releasedVoice == kVoiceCount || fState.age[v] < fState.age[releasedVoice]))
+                releasedVoice = v;
+
+            if (fState.age[v] < fState.age[oldestVoice])
+                oldestVoice = v;
+        }
+
+        if (freeVoice != kVoiceCount)
+            return freeVoice;
+        if (releasedVoice != kVoiceCount)
+            return releasedVoice;
+        return oldestVoice;
+    }
+
+    float noteFrequency(const uint8_t note, const uint8_t channel) const noexcept
+    {
+        const float semitones(static_cast<float>(note) - 69.0f + fPitchBend[channel] * fPitchBendRange);
+        return 440.0f * std::pow(2.0f, semitones / 12.0f);
+    }
+
+    void updateFrequencies(const uint8_t channel) noexcept
+    {
+        for (uint32_t v=0; v < kVoiceCount; ++v)
+        {
+            if (fState.active[v] != 0.0f && fState.channel[v] == channel)
+                fState.frequency[v] = noteFrequency(fState.note[v], channel);
+        }
+    }
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(VoiceManager)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_VOICES_HPP_INCLUDED
@@ -0,0 +1,362 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_DSSI_SHM_HPP_INCLUDED
+#define DISTRHO_DSSI_SHM_HPP_INCLUDED
+
+#include "../DistrhoUtils.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// -----------------------------------------------------------------------
+// Shared memory transport between a DSSI plugin and its out-of-process UI.
+//
+// The UI creates the segment and sends its name to the plugin through the
+// regular OSC "/configure" channel, using a reserved key. The host forwards
+// it to the plugin's configure(), which maps the segment and flags it as
+// attached. An empty value detaches.
+//
+// A single-producer, single-consumer ring lives in the segment, written by the
+// audio thread and carrying the UI stream data. States don't use it, hosts can
+// only save what goes through configure (see DistrhoDSSIState.hpp).
+//
+// Hosts remember every configure key and replay it when a project is loaded.
+// The DSSI: prefix can't be used to avoid that, hosts refuse it from UIs.
+// Instead a segment can only be attached once: a replayed name either does
+// not exist anymore or was already claimed, and the plugin ignores it.
+
+#define DISTRHO_DSSI_USE_SHM DISTRHO_PLUGIN_WANT_UI_STREAM
+
+#define DISTRHO_DSSI_SHM_CONFIGURE_KEY "__dpf_shm__"
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+enum DssiShmMessageType {
+    kDssiShmMessageNull   = 0,
+    kDssiShmMessageStream = 1  // float data for the UI stream
+};
+
+// Biggest stream message, in floats.
+static const uint32_t kDssiShmStreamChunk = 1024;
+
+// -----------------------------------------------------------------------
+// Byte ring stored inside the shared segment.
+// It keeps no pointers, so both processes can use it at different addresses.
+// Messages are a {type, size} header followed by 'size' bytes, written all or nothing.
+
+struct DssiShmRing {
+    static const uint32_t kSize = 256*1024; // must be power of 2
+    static const uint32_t kMask = kSize - 1;
+
+    // head is written by the producer, tail by the consumer; keep them on separate cache lines
+    uint32_t head;
+    char     pad1[60];
+    uint32_t tail;
+    char     pad2[60];
+    uint8_t  data[kSize];
+
+    bool writeMessage(const uint32_t type, const void* const payload, const uint32_t size) noexcept
+    {
+        const uint32_t hdr[2] = { type, size };
+        const uint32_t total  = sizeof(hdr) + size;
+
+        const uint32_t h(__atomic_load_n(&head, __ATOMIC_RELAXED));
+        const uint32_t t(__atomic_load_n(&tail, __ATOMIC_ACQUIRE));
+
+        if (total > kSize - (h - t))
+            return false;
+
+        copyIn(h, hdr, sizeof(hdr));
+        copyIn(h + sizeof(hdr), payload, size);
+
+        __atomic_store_n(&head, h + total, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /*
+     * Check if a message is ready to be read, and get its type and payload size.
+     */
+    bool peekMessage(uint32_t& type, uint32_t& size) const noexcept
+    {
+        const uint32_t h(__atomic_load_n(&head, __ATOMIC_ACQUIRE));
+        const uint32_t t(__atomic_load_n(&tail, __ATOMIC_RELAXED));
+
+        uint32_t hdr[2];
+
+        if (h - t < sizeof(hdr))
+            return false;
+
+        copyOut(t, hdr, sizeof(hdr));
+
+        // the producer is a different process, never trust it blindly
+        DISTRHO_SAFE_ASSERT_RETURN(hdr[1] <= h - t - sizeof(hdr), false);
+
+        type = hdr[0];
+        size = hdr[1];
+        return true;
+    }
+
+    /*
+     * Consume the message reported by peekMessage().
+     * 'payload' must have room for its full size, or be null to skip it.
+     */
+    void readMessage(void* const payload) noexcept
+    {
+        uint32_t type, size;
+        DISTRHO_SAFE_ASSERT_RETURN(peekMessage(type, size),);
+
+        const uint32_t t(__atomic_load_n(&tail, __ATOMIC_RELAXED));
+
+        if (payload != nullptr)
+            copyOut(t + sizeof(uint32_t)*2, payload, size);
+
+        __atomic_store_n(&tail, t + sizeof(uint32_t)*2 + size, __ATOMIC_RELEASE);
+    }
+
+private:
+    void copyIn(const uint32_t pos, const void* const src, const uint32_t size) noexcept
+    {
+        const uint32_t start(pos & kMask);
+        const uint32_t first((size < kSize - start) ? size : kSize - start);
+
+        std::memcpy(data + start, src, first);
+
+        if (first < size)
+            std::memcpy(data, (const uint8_t*)src + first, size - first);
+    }
+
+    void copyOut(const uint32_t pos, void* const dst, const uint32_t size) const noexcept
+    {
+        const uint32_t start(pos & kMask);
+        const uint32_t first((size < kSize - start) ? size : kSize - start);
+
+        std::memcpy(dst, data + start, first);
+
+        if (first < size)
+            std::memcpy((uint8_t*)dst + first, data, size - first);
+    }
+};
+
+// -----------------------------------------------------------------------
+
+struct DssiShmData {
+    static const uint32_t kMagic   = 0x44504653; // "DPFS"
+    static const uint32_t kVersion = 2;
+
+    // values of 'attached'
+    enum {
+        kPeerNone     = 0,
+        kPeerAttached = 1, // set by the plugin once mapped
+        kPeerDetached = 2  // set by the plugin when done, the segment can't be attached again
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t attached;
+    uint32_t reserved;
+
+    DssiShmRing dspToUi;
+};
+
+// -----------------------------------------------------------------------
+// Owner of a mapping of the segment above.
+// The UI side uses create(), which also unlinks the name on close.
+// The plugin side uses attach() with the name received from the UI.
+
+class DssiShm
+{
+public:
+    DssiShm() noexcept
+        : fData(nullptr),
+          fOwner(false)
+    {
+        fName[0] = '\0';
+    }
+
+    ~DssiShm() noexcept
+    {
+        close();
+    }
+
+    bool create() noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData == nullptr, false);
+
+        static int sCounter = 0;
+        std::snprintf(fName, sizeof(fName), "/dpf-dssi-%i-%i", (int)::getpid(), ++sCounter);
+
+        const int fd(::shm_open(fName, O_CREAT|O_EXCL|O_RDWR, 0600));
+
+        if (fd < 0)
+        {
+            d_stderr("DssiShm::create() - shm_open failed: %s", std::strerror(errno));
+            fName[0] = '\0';
+            return false;
+        }
+
+        if (::ftruncate(fd, sizeof(DssiShmData)) != 0)
+        {
+            d_stderr("DssiShm::create() - ftruncate failed: %s", std::strerror(errno));
+            ::close(fd);
+            ::shm_unlink(fName);
+            fName[0] = '\0';
+            return false;
+        }
+
+        if (! map(fd))
+        {
+            ::shm_unlink(fName);
+            fName[0] = '\0';
+            return false;
+        }
+
+        std::memset(fData, 0, sizeof(DssiShmData));
+        fData->magic   = DssiShmData::kMagic;
+        fData->version = DssiShmData::kVersion;
+
+        fOwner = true;
+        return true;
+    }
+
+    bool attach(const char* const name) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData == nullptr, false);
+        DISTRHO_SAFE_ASSERT_RETURN(name != nullptr && name[0] == '/', false);
+
+        const int fd(::shm_open(name, O_RDWR, 0));
+
+        if (fd < 0)
+        {
+            d_stderr("DssiShm::attach(\"%s\") - shm_open failed: %s", name, std::strerror(errno));
+            return false;
+        }
+
+        // mapping past the end of a smaller object would raise SIGBUS on first access
+        struct stat st;
+
+        if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(DssiShmData)))
+        {
+            d_stderr("DssiShm::attach(\"%s\") - segment too small or not accessible", name);
+            ::close(fd);
+            return false;
+        }
+
+        if (! map(fd))
+            return false;
+
+        if (fData->magic != DssiShmData::kMagic || fData->version != DssiShmData::kVersion)
+        {
+            d_stderr("DssiShm::attach(\"%s\") - incompatible segment", name);
+            unmap();
+            return false;
+        }
+
+        // claim it, stale names replayed by the host must not take over a segment
+        uint32_t expected = DssiShmData::kPeerNone;
+
+        if (! __atomic_compare_exchange_n(&fData->attached, &expected, static_cast<uint32_t>(DssiShmData::kPeerAttached),
+                                          false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            d_stderr("DssiShm::attach(\"%s\") - segment already used, ignored", name);
+            unmap();
+            return false;
+        }
+
+        std::strncpy(fName, name, sizeof(fName)-1);
+        fName[sizeof(fName)-1] = '\0';
+        return true;
+    }
+
+    void close() noexcept
+    {
+        if (fData != nullptr)
+        {
+            if (! fOwner)
+                __atomic_store_n(&fData->attached, static_cast<uint32_t>(DssiShmData::kPeerDetached), __ATOMIC_RELEASE);
+
+            unmap();
+        }
+
+        if (fOwner)
+        {
+            ::shm_unlink(fName);
+            fOwner = false;
+        }
+
+        fName[0] = '\0';
+    }
+
+    /*
+     * Check if the other side has mapped the segment (UI side only).
+     */
+    bool isPeerAttached() const noexcept
+    {
+        return fData != nullptr && __atomic_load_n(&fData->attached, __ATOMIC_ACQUIRE) == DssiShmData::kPeerAttached;
+    }
+
+    DssiShmData* getData() const noexcept
+    {
+        return fData;
+    }
+
+    const char* getName() const noexcept
+    {
+        return fName;
+    }
+
+private:
+    DssiShmData* fData;
+    bool fOwner;
+    char fName[64];
+
+    bool map(const int fd) noexcept
+    {
+        void* const ptr(::mmap(nullptr, sizeof(DssiShmData), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0));
+        ::close(fd);
+
+        if (ptr == MAP_FAILED)
+        {
+            d_stderr("DssiShm - mmap failed: %s", std::strerror(errno));
+            return false;
+        }
+
+        fData = (DssiShmData*)ptr;
+        return true;
+    }
+
+    void unmap() noexcept
+    {
+        ::munmap(fData, sizeof(DssiShmData));
+        fData = nullptr;
+    }
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(DssiShm)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_DSSI_SHM_HPP_INCLUDED
@@ -0,0 +1,278 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_DSSI_STATE_HPP_INCLUDED
+#define DISTRHO_DSSI_STATE_HPP_INCLUDED
+
+#include "../extra/d_string.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <list>
+
+// -----------------------------------------------------------------------
+// State values between the DSSI UI and plugin, sent as OSC "/configure" messages.
+//
+// Hosts store the last value of every configure key and replay them when a project
+// is loaded, so everything needed to restore a state goes through configure.
+// Values that don't fit a datagram are split into chunks, each one sent with its own
+// "__dpf_chunk__:<index>:<key>" key and a "<generation>:<piece of the value>" value.
+// After the last chunk the state key itself is set to a reference to them,
+// ESC "chunks:<generation>:<count>". Values really starting with ESC get another one in front.
+//
+// The receiver applies a chunked value once it has the reference and all chunks it names,
+// whatever the order they arrive in, so a replayed project restores it as well.
+// Chunks end on UTF-8 character boundaries, for hosts that keep values as text.
+
+#define DISTRHO_DSSI_STATE_CHUNK_PREFIX "__dpf_chunk__:"
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+// Biggest OSC message we send over UDP.
+// Anything larger does not fit a single datagram, even on loopback.
+static const uint32_t kDssiOscMaxMessageSize = 60000;
+
+// Biggest piece of a value in a chunk, and how many chunks the UI sends per idle.
+static const uint32_t kDssiStateChunkSize     = 32768;
+static const uint32_t kDssiStateChunksPerIdle = 4;
+
+static const char kDssiStateEscape = '\x1b';
+
+/*
+ * Check if a value is too big for a single configure message.
+ */
+static inline
+bool d_dssiStateNeedsChunks(const char* const key, const char* const value) noexcept
+{
+    return std::strlen(key) + std::strlen(value) + 32 > kDssiOscMaxMessageSize;
+}
+
+/*
+ * Size of the chunk of 'value' starting at 'offset', never splitting a UTF-8 character.
+ */
+static inline
+size_t d_dssiStateChunkLength(const char* const value, const size_t valueSize, const size_t offset) noexcept
+{
+    size_t size(valueSize - offset);
+
+    if (size <= kDssiStateChunkSize)
+        return size;
+
+    size = kDssiStateChunkSize;
+
+    // continuation bytes look like 10xxxxxx, a character has at most 3 of them
+    for (int i=0; i < 3 && (value[offset+size] & 0xC0) == 0x80; ++i)
+        --size;
+
+    return size;
+}
+
+// -----------------------------------------------------------------------
+// Turns received configure messages back into state values (plugin configure() or UI).
+// Regular values pass through, chunks are kept until their reference completes them.
+
+class DssiStateReceiver
+{
+public:
+    DssiStateReceiver()
+        : fKey(),
+          fValue(),
+          fTransfers() {}
+
+    /*
+     * Feed a configure message.
+     * Returns true when a state value is ready, getKey() and getValue() are then valid until the next call.
+     */
+    bool receive(const char* const key, const char* const value)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(key != nullptr && value != nullptr, false);
+
+        const size_t prefixLen(std::strlen(DISTRHO_DSSI_STATE_CHUNK_PREFIX));
+
+        if (std::strncmp(key, DISTRHO_DSSI_STATE_CHUNK_PREFIX, prefixLen) == 0)
+            return receiveChunk(key + prefixLen, value);
+
+        if (value[0] != kDssiStateEscape)
+            return setResult(key, value);
+
+        if (value[1] == kDssiStateEscape)
+            return setResult(key, value+1);
+
+        // reference to chunks, ESC "chunks:<generation>:<count>"
+        DISTRHO_SAFE_ASSERT_RETURN(std::strncmp(value+1, "chunks:", std::strlen("chunks:")) == 0, false);
+
+        const char* const generation(value+1 + std::strlen("chunks:"));
+        const char* const sep(std::strchr(generation, ':'));
+        DISTRHO_SAFE_ASSERT_RETURN(sep != nullptr && sep != generation, false);
+
+        Transfer& transfer(getTransfer(key));
+        transfer.generation.clear();
+        transfer.generation.append(generation, static_cast<size_t>(sep - generation));
+        transfer.count = static_cast<uint32_t>(std::strtoul(sep+1, nullptr, 10));
+
+        return tryComplete(key);
+    }
+
+    const char* getKey() const noexcept
+    {
+        return fKey;
+    }
+
+    const char* getValue() const noexcept
+    {
+        return fValue;
+    }
+
+private:
+    struct Piece {
+        uint32_t index;
+        d_string generation;
+        d_string data;
+    };
+
+    struct Transfer {
+        d_string key;
+        d_string generation; // from the reference, empty until it arrives
+        uint32_t count;
+        std::list<Piece> pieces;
+    };
+
+    d_string fKey;
+    d_string fValue;
+    std::list<Transfer> fTransfers;
+
+    // "<index>:<key>" with a "<generation>:<data>" value
+    bool receiveChunk(const char* const indexAndKey, const char* const value)
+    {
+        char* end;
+        const ulong index(std::strtoul(indexAndKey, &end, 10));
+
+        DISTRHO_SAFE_ASSERT_RETURN(end != indexAndKey && end[0] == ':' && end[1] != '\0', false);
+
+        const char* const key(end+1);
+        const char* const sep(std::strchr(value, ':'));
+        DISTRHO_SAFE_ASSERT_RETURN(sep != nullptr && sep != value, false);
+
+        Transfer& transfer(getTransfer(key));
+        Piece* piece = nullptr;
+
+        for (std::list<Piece>::iterator it=transfer.pieces.begin(), ite=transfer.pieces.end(); it != ite; ++it)
+        {
+            if (it->index == index)
+            {
+                piece = &(*it);
+                break;
+            }
+        }
+
+        if (piece == nullptr)
+        {
+            transfer.pieces.push_back(Piece());
+            piece = &transfer.pieces.back();
+            piece->index = static_cast<uint32_t>(index);
+        }
+
+        piece->generation.clear();
+        piece->generation.append(value, static_cast<size_t>(sep - value));
+        piece->data = sep+1;
+
+        return tryComplete(key);
+    }
+
+    Transfer& getTransfer(const char* const key)
+    {
+        for (std::list<Transfer>::iterator it=fTransfers.begin(), ite=fTransfers.end(); it != ite; ++it)
+        {
+            if (it->key == key)
+                return *it;
+        }
+
+        fTransfers.push_back(Transfer());
+
+        Transfer& transfer(fTransfers.back());
+        transfer.key   = key;
+        transfer.count = 0;
+        return transfer;
+    }
+
+    // a regular value replaces any transfer of the same key
+    bool setResult(const char* const key, const char* const value)
+    {
+        for (std::list<Transfer>::iterator it=fTransfers.begin(), ite=fTransfers.end(); it != ite; ++it)
+        {
+            if (it->key == key)
+            {
+                fTransfers.erase(it);
+                break;
+            }
+        }
+
+        fKey   = key;
+        fValue = value;
+        return true;
+    }
+
+    bool tryComplete(const char* const key)
+    {
+        for (std::list<Transfer>::iterator it=fTransfers.begin(), ite=fTransfers.end(); it != ite; ++it)
+        {
+            if (it->key != key)
+                continue;
+
+            const Transfer& transfer(*it);
+
+            if (transfer.generation.isEmpty())
+                return false;
+
+            d_string value;
+
+            for (uint32_t i=0; i < transfer.count; ++i)
+            {
+                const Piece* piece = nullptr;
+
+                for (std::list<Piece>::const_iterator pit=transfer.pieces.begin(), pite=transfer.pieces.end(); pit != pite; ++pit)
+                {
+                    if (pit->index == i && pit->generation == transfer.generation)
+                    {
+                        piece = &(*pit);
+                        break;
+                    }
+                }
+
+                // not here yet, or only an older one
+                if (piece == nullptr)
+                    return false;
+
+                value += piece->data;
+            }
+
+            fKey   = key;
+            fValue = value;
+            fTransfers.erase(it);
+            return true;
+        }
+
+        return false;
+    }
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_DSSI_STATE_HPP_INCLUDED
@@ -0,0 +1,203 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_LV2_STATE_HPP_INCLUDED
+#define DISTRHO_LV2_STATE_HPP_INCLUDED
+
+#include "../DistrhoUtils.hpp"
+
+#include "lv2/atom-util.h"
+
+#include <cstring>
+
+// -----------------------------------------------------------------------
+// State messages between the LV2 UI and DSP, sent as "urn:distrho:keyValueState" atoms.
+//
+// Small values go in a single "key\0value\0" message.
+// Values that don't fit DISTRHO_LV2_STATE_CHUNK_SIZE are split into chunks,
+// each one starting with a Lv2StateChunk header followed by the key and a piece of the value.
+// The header starts with a zero word, so chunks can never be mistaken for a regular message.
+// Chunks of a value are sent in order, and each side limits how many bytes it sends per cycle.
+// The UI sends up to DISTRHO_LV2_STATE_CHUNKS_PER_IDLE chunks per idle call, the DSP events
+// input port is made big enough to take all of them in a single cycle.
+
+#define DISTRHO_LV2_STATE_CHUNK_SIZE 4096
+#define DISTRHO_LV2_STATE_CHUNKS_PER_IDLE 4
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+struct Lv2StateChunk {
+    uint32_t zero;      // always 0
+    uint32_t keySize;   // including null terminator
+    uint32_t valueSize; // full value, without null terminator
+    uint32_t offset;    // of this chunk within the value
+    uint32_t size;      // of this chunk
+};
+
+/*
+ * Size of a chunk message, for a given key size and chunk size.
+ */
+static inline
+uint32_t d_lv2StateChunkMessageSize(const uint32_t keySize, const uint32_t size) noexcept
+{
+    return uint32_t(sizeof(Lv2StateChunk)) + keySize + size;
+}
+
+/*
+ * Space taken by a full size chunk event in an atom sequence, for a given key size.
+ */
+static inline
+uint32_t d_lv2StateChunkEventSize(const uint32_t keySize) noexcept
+{
+    return lv2_atom_pad_size(uint32_t(sizeof(LV2_Atom_Event)) + d_lv2StateChunkMessageSize(keySize, DISTRHO_LV2_STATE_CHUNK_SIZE));
+}
+
+/*
+ * Write a chunk message into 'buf', which must have d_lv2StateChunkMessageSize() bytes.
+ * Does not allocate, safe to use in the audio thread.
+ */
+static inline
+void d_lv2StateChunkWrite(void* const buf, const char* const key, const uint32_t keySize,
+                          const char* const value, const uint32_t valueSize, const uint32_t offset, const uint32_t size) noexcept
+{
+    Lv2StateChunk chunk;
+    chunk.zero      = 0;
+    chunk.keySize   = keySize;
+    chunk.valueSize = valueSize;
+    chunk.offset    = offset;
+    chunk.size      = size;
+
+    uint8_t* const bytes((uint8_t*)buf);
+    std::memcpy(bytes, &chunk, sizeof(Lv2StateChunk));
+    std::memcpy(bytes + sizeof(Lv2StateChunk), key, keySize);
+    std::memcpy(bytes + sizeof(Lv2StateChunk) + keySize, value + offset, size);
+}
+
+// -----------------------------------------------------------------------
+// Reassembles chunked values on the receiving side (UI thread or LV2 worker).
+// Only one value is in flight at a time; a chunk out of order drops the current one.
+
+class Lv2StateChunkReceiver
+{
+public:
+    Lv2StateChunkReceiver() noexcept
+        : fKey(nullptr),
+          fValue(nullptr),
+          fValueSize(0),
+          fReceived(0) {}
+
+    ~Lv2StateChunkReceiver() noexcept
+    {
+        clear();
+    }
+
+    /*
+     * Check if a message is a chunk, as opposed to a regular "key\0value\0" message.
+     */
+    static bool isChunk(const void* const data, const uint32_t size) noexcept
+    {
+        return size >= sizeof(Lv2StateChunk) && ((const char*)data)[0] == '\0';
+    }
+
+    /*
+     * Feed a chunk message.
+     * Returns true when a value is complete, getKey() and getValue() are then valid until the next call.
+     */
+    bool receive(const void* const data, const uint32_t size)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(isChunk(data, size), false);
+
+        Lv2StateChunk chunk;
+        std::memcpy(&chunk, data, sizeof(Lv2StateChunk));
+
+        DISTRHO_SAFE_ASSERT_RETURN(chunk.keySize > 1, false);
+        DISTRHO_SAFE_ASSERT_RETURN(size >= d_lv2StateChunkMessageSize(chunk.keySize, chunk.size), false);
+        DISTRHO_SAFE_ASSERT_RETURN(chunk.size <= chunk.valueSize && chunk.offset <= chunk.valueSize - chunk.size, false);
+
+        const char* const key((const char*)data + sizeof(Lv2StateChunk));
+        DISTRHO_SAFE_ASSERT_RETURN(key[chunk.keySize-1] == '\0', false);
+
+        if (chunk.offset == 0)
+        {
+            clear();
+
+            fKey   = new char[chunk.keySize];
+            fValue = new char[chunk.valueSize+1];
+            std::memcpy(fKey, key, chunk.keySize);
+            fValueSize = chunk.valueSize;
+        }
+        else if (fKey == nullptr || chunk.offset != fReceived || chunk.valueSize != fValueSize || std::strcmp(fKey, key) != 0)
+        {
+            d_stderr("Lv2StateChunkReceiver: lost part of state \"%s\", dropping it", key);
+            clear();
+            return false;
+        }
+
+        std::memcpy(fValue + chunk.offset, key + chunk.keySize, chunk.size);
+        fReceived += chunk.size;
+
+        if (fReceived != fValueSize)
+            return false;
+
+        fValue[fValueSize] = '\0';
+        fReceived = 0;
+        return true;
+    }
+
+    const char* getKey() const noexcept
+    {
+        return fKey;
+    }
+
+    const char* getValue() const noexcept
+    {
+        return fValue;
+    }
+
+    void clear() noexcept
+    {
+        if (fKey != nullptr)
+        {
+            delete[] fKey;
+            fKey = nullptr;
+        }
+
+        if (fValue != nullptr)
+        {
+            delete[] fValue;
+            fValue = nullptr;
+        }
+
+        fValueSize = 0;
+        fReceived  = 0;
+    }
+
+private:
+    char* fKey;
+    char* fValue;
+    uint32_t fValueSize;
+    uint32_t fReceived;
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(Lv2StateChunkReceiver)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_LV2_STATE_HPP_INCLUDED
@@ -62,6 +62,18 @@ Plugin::Plugin(const uint32_t parameterCount, const uint32_t programCount, const
 #else
     DISTRHO_SAFE_ASSERT(stateCount == 0);
 #endif
+
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+    pData->uiStream = new RingBuffer<float>(DISTRHO_PLUGIN_UI_STREAM_SIZE);
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+    pData->snapshot = new TripleBuffer(DISTRHO_PLUGIN_SNAPSHOT_SIZE);
+#endif
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+    pData->worker = new PluginWorker();
+#endif
 }
 
 Plugin::~Plugin()
@@ -77,11 +89,41 @@ uint32_t Plugin::d_getBufferSize() const noexcept
     return pData->bufferSize;
 }
 
+uint32_t Plugin::d_getMinBufferSize() const noexcept
+{
+    return pData->minBufferSize;
+}
+
+uint32_t Plugin::d_getNominalBufferSize() const noexcept
+{
+    return (pData->nominalBufferSize != 0) ? pData->nominalBufferSize : pData->bufferSize;
+}
+
+uint32_t Plugin::d_getSequenceSize() const noexcept
+{
+    return pData->sequenceSize;
+}
+
 double Plugin::d_getSampleRate() const noexcept
 {
     return pData->sampleRate;
 }
 
+bool Plugin::d_isOffline() const noexcept
+{
+    return pData->isOffline;
+}
+
+const float* Plugin::d_getParameterCV(const uint32_t index) const noexcept
+{
+    DISTRHO_SAFE_ASSERT_RETURN(index < pData->parameterCount, nullptr);
+
+    if (pData->parameterCVs == nullptr)
+        return nullptr;
+
+    return pData->parameterCVs[index];
+}
+
 #if DISTRHO_PLUGIN_WANT_TIMEPOS
 const TimePosition& Plugin::d_getTimePosition() const noexcept
 {
@@ -96,6 +138,56 @@ void Plugin::d_setLatency(const uint32_t frames) noexcept
 }
 #endif
 
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+bool Plugin::d_writeStreamData(const float* const data, const uint32_t count) noexcept
+{
+    DISTRHO_SAFE_ASSERT_RETURN(pData->uiStream != nullptr, false);
+
+    return pData->uiStream->write(data, count);
+}
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+void Plugin::d_publishSnapshot(const void* const data, const uint32_t size) noexcept
+{
+    DISTRHO_SAFE_ASSERT_RETURN(pData->snapshot != nullptr,);
+
+    pData->snapshot->write(data, size);
+}
+#endif
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+bool Plugin::d_scheduleWork(const void* const data, const uint32_t size) noexcept
+{
+    if (pData->hostScheduleWork != nullptr)
+        return pData->hostScheduleWork(pData->hostWorkerPtr, data, size);
+
+    DISTRHO_SAFE_ASSERT_RETURN(pData->worker != nullptr, false);
+
+    return pData->worker->scheduleWork(data, size);
+}
+
+bool Plugin::d_respondWork(const void* const data, const uint32_t size) noexcept
+{
+    if (pData->hostRespondWork != nullptr)
+        return pData->hostRespondWork(pData->hostWorkerPtr, data, size);
+
+    DISTRHO_SAFE_ASSERT_RETURN(pData->worker != nullptr, false);
+
+    return pData->worker->respond(data, size);
+}
+#endif
+
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+void Plugin::d_setProgramTable(const PresetTable* const table, const uint32_t rampFrames) noexcept
+{
+    DISTRHO_SAFE_ASSERT_RETURN(table == nullptr || (table->isValid() && table->getParameterCount() == pData->parameterCount),);
+
+    pData->programTable      = table;
+    pData->programRampFrames = rampFrames;
+}
+#endif
+
 #if DISTRHO_PLUGIN_HAS_MIDI_OUTPUT
 bool Plugin::d_writeMidiEvent(const MidiEvent& /*midiEvent*/) noexcept
 {
@@ -109,6 +201,15 @@ bool Plugin::d_writeMidiEvent(const MidiEvent& /*midiEvent*/) noexcept
 
 void Plugin::d_bufferSizeChanged(uint32_t) {}
 void Plugin::d_sampleRateChanged(double)   {}
+void Plugin::d_offlineChanged(bool)        {}
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+/* ------------------------------------------------------------------------------------------------------------
+ * Process */
+
+void Plugin::d_workCompleted(const void*, uint32_t) {}
+void Plugin::d_workResponsesDone() {}
+#endif
 
 // -----------------------------------------------------------------------------------------------------------
 
@@ -0,0 +1,307 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_PLUGIN_BYPASS_HPP_INCLUDED
+#define DISTRHO_PLUGIN_BYPASS_HPP_INCLUDED
+
+#include "../DistrhoUtils.hpp"
+
+#include <cstring>
+
+// -----------------------------------------------------------------------
+// Framework-managed soft bypass, see DISTRHO_PLUGIN_WANT_BYPASS.
+//
+// The inputs of every block are kept in a delay line, so the dry signal can be
+// aligned with the plugin latency. Toggling crossfades between wet and dry over
+// kFadeTimeMs; once fully bypassed d_run() is skipped. When coming back, the plugin
+// runs for its latency (and the crossfade) before its output is used again, so
+// stale internal buffers are never heard.
+// Output channels without a matching input get silence as dry signal.
+//
+// The delay line is sized when activating, from the buffer size and the current latency
+// (at least DISTRHO_PLUGIN_BYPASS_MAX_LATENCY). Blocks or latencies that outgrow it while
+// running cannot be aligned, so bypass is refused until the next activation, which logs
+// the problem and grows the delay line to fit.
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+class PluginBypass
+{
+public:
+    PluginBypass() noexcept
+        : fRequested(false),
+          fSkipped(false),
+          fGain(1.0f),
+          fFadeStep(1.0f),
+          fHoldFrames(0),
+          fBlockStart(0),
+          fBufferSize(0),
+          fMaxLatency(0),
+          fOversizeFrames(0),
+          fOversizeLatency(0),
+          fDelaySize(0),
+          fDelayMask(0),
+          fDelayPos(0)
+    {
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+            fDelay[i] = nullptr;
+#endif
+    }
+
+    ~PluginBypass() noexcept
+    {
+        freeBuffers();
+    }
+
+    /*
+     * Prepare for processing blocks up to @a bufferSize frames with @a latency.
+     * Not real-time safe, only call while the plugin is not running (when activating).
+     */
+    void init(uint32_t bufferSize, const double sampleRate, uint32_t latency)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(bufferSize > 0,);
+        DISTRHO_SAFE_ASSERT_RETURN(sampleRate > 0.0,);
+
+        if (fOversizeFrames != 0 || fOversizeLatency != 0)
+        {
+            d_stderr("Bypass was unavailable for blocks of %u frames with %u frames of latency, growing its delay line",
+                     fOversizeFrames, fOversizeLatency);
+
+            if (bufferSize < fOversizeFrames)
+                bufferSize = fOversizeFrames;
+            if (latency < fOversizeLatency)
+                latency = fOversizeLatency;
+
+            fOversizeFrames  = 0;
+            fOversizeLatency = 0;
+        }
+
+        if (latency < DISTRHO_PLUGIN_BYPASS_MAX_LATENCY)
+            latency = DISTRHO_PLUGIN_BYPASS_MAX_LATENCY;
+
+        const uint32_t fadeFrames(static_cast<uint32_t>(sampleRate * kFadeTimeMs / 1000.0) + 1);
+        fFadeStep = 1.0f / static_cast<float>(fadeFrames);
+
+        uint32_t size = 1;
+        while (size < bufferSize + latency)
+            size <<= 1;
+
+        fBufferSize = bufferSize;
+
+        if (size <= fDelaySize)
+        {
+            fMaxLatency = fDelaySize - bufferSize;
+            return;
+        }
+
+        freeBuffers();
+
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+        {
+            fDelay[i] = new float[size];
+            std::memset(fDelay[i], 0, sizeof(float)*size);
+        }
+#endif
+
+        fDelaySize  = size;
+        fDelayMask  = size - 1;
+        fDelayPos   = 0;
+        fMaxLatency = size - bufferSize;
+    }
+
+    /*
+     * Request bypass on or off, can be called from any thread.
+     */
+    void setBypassed(const bool bypassed) noexcept
+    {
+        __atomic_store_n(&fRequested, bypassed, __ATOMIC_RELAXED);
+    }
+
+    bool isBypassed() const noexcept
+    {
+        return __atomic_load_n(&fRequested, __ATOMIC_RELAXED);
+    }
+
+    /*
+     * Store this block's inputs and decide if the plugin must run.
+     * Must be called before d_run(), in the audio thread.
+     */
+    bool preRun(const float** const inputs, const uint32_t frames, const uint32_t latency) noexcept
+    {
+        if (frames > fBufferSize || latency > fMaxLatency || fDelaySize == 0)
+        {
+            // the dry signal cannot be aligned, run the plugin as if there was no bypass
+            if (frames > fOversizeFrames && frames > fBufferSize)
+                fOversizeFrames = frames;
+            if (latency > fOversizeLatency && latency > fMaxLatency)
+                fOversizeLatency = latency;
+
+            fBlockStart = kInvalidBlock;
+            fSkipped    = false;
+            fGain       = 1.0f;
+            fHoldFrames = 0;
+            return true;
+        }
+
+        fBlockStart = fDelayPos;
+
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+        const uint32_t start(fDelayPos & fDelayMask);
+        const uint32_t first((frames < fDelaySize - start) ? frames : fDelaySize - start);
+
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+        {
+            std::memcpy(fDelay[i] + start, inputs[i], sizeof(float)*first);
+
+            if (first < frames)
+                std::memcpy(fDelay[i], inputs[i] + first, sizeof(float)*(frames - first));
+        }
+#else
+        // unused
+        (void)inputs;
+#endif
+
+        fDelayPos += frames;
+
+        if (! isBypassed())
+        {
+            // leaving full bypass, wait for the plugin latency to be filled with fresh audio
+            if (fSkipped)
+            {
+                fSkipped    = false;
+                fHoldFrames = latency;
+            }
+
+            return true;
+        }
+
+        fHoldFrames = 0;
+
+        // fully bypassed, skip the plugin
+        if (fGain == 0.0f)
+            fSkipped = true;
+
+        return ! fSkipped;
+    }
+
+    /*
+     * Crossfade the plugin output with the delayed dry signal, or write only the dry signal
+     * if the plugin did not run. Must be called after d_run(), in the audio thread.
+     */
+    void postRun(float** const outputs, const uint32_t frames, const uint32_t latency, const bool ran) noexcept
+    {
+        if (fBlockStart == kInvalidBlock)
+            return;
+
+        const float target(isBypassed() ? 0.0f : 1.0f);
+
+        // nothing to do when fully active
+        if (ran && fGain == 1.0f && target == 1.0f)
+            return;
+
+        // preRun() made sure the delay line is long enough
+        const uint32_t readPos(fBlockStart - latency);
+
+        float gain = fGain;
+        uint32_t hold = fHoldFrames;
+
+        for (uint32_t j=0; j < DISTRHO_PLUGIN_NUM_OUTPUTS; ++j)
+        {
+            float* const out(outputs[j]);
+
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+            const float* const dry((j < DISTRHO_PLUGIN_NUM_INPUTS) ? fDelay[j] : nullptr);
+#else
+            static const float* const dry = nullptr;
+#endif
+
+            gain = fGain;
+            hold = fHoldFrames;
+
+            for (uint32_t i=0; i < frames; ++i)
+            {
+                if (hold > 0)
+                    --hold;
+                else if (gain < target)
+                    gain = (gain + fFadeStep < target) ? gain + fFadeStep : target;
+                else if (gain > target)
+                    gain = (gain - fFadeStep > target) ? gain - fFadeStep : target;
+
+                const float drySample((dry != nullptr) ? dry[(readPos + i) & fDelayMask] : 0.0f);
+
+                if (ran)
+                    out[i] = out[i] * gain + drySample * (1.0f - gain);
+                else
+                    out[i] = drySample;
+            }
+        }
+
+        fGain       = gain;
+        fHoldFrames = hold;
+    }
+
+private:
+    static const uint32_t kInvalidBlock = 0xffffffff;
+    static const uint32_t kFadeTimeMs   = 5;
+
+    bool     fRequested;
+    bool     fSkipped;    // d_run() was skipped, audio thread only
+    float    fGain;       // 1 is fully active, 0 fully bypassed
+    float    fFadeStep;
+    uint32_t fHoldFrames; // frames to keep dry before fading in again
+    uint32_t fBlockStart;
+    uint32_t fBufferSize;
+    uint32_t fMaxLatency;
+
+    // biggest block and latency that did not fit, audio thread only, reported by init()
+    uint32_t fOversizeFrames;
+    uint32_t fOversizeLatency;
+
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+    float*   fDelay[DISTRHO_PLUGIN_NUM_INPUTS];
+#endif
+    uint32_t fDelaySize;
+    uint32_t fDelayMask;
+    uint32_t fDelayPos;
+
+    void freeBuffers() noexcept
+    {
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+        {
+            if (fDelay[i] != nullptr)
+            {
+                delete[] fDelay[i];
+                fDelay[i] = nullptr;
+            }
+        }
+#endif
+        fDelaySize = 0;
+        fDelayMask = 0;
+    }
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(PluginBypass)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_PLUGIN_BYPASS_HPP_INCLUDED
@@ -47,6 +47,13 @@ public:
     {
         fUI.setTitle(host->uiName);
 
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+        fUI.setUIStream(plugin->getUIStream());
+#endif
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+        fUI.setSnapshot(plugin->getSnapshot());
+#endif
+
         if (host->uiParentId != 0)
             fUI.setTransientWinId(host->uiParentId);
     }
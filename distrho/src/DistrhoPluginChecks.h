@@ -89,6 +89,42 @@
 # define DISTRHO_PLUGIN_WANT_DIRECT_ACCESS 0
 #endif
 
+#ifndef DISTRHO_PLUGIN_WANT_UI_STREAM
+# define DISTRHO_PLUGIN_WANT_UI_STREAM 0
+#endif
+
+#ifndef DISTRHO_PLUGIN_UI_STREAM_SIZE
+# define DISTRHO_PLUGIN_UI_STREAM_SIZE 16384
+#endif
+
+#ifndef DISTRHO_PLUGIN_WANT_SNAPSHOT
+# define DISTRHO_PLUGIN_WANT_SNAPSHOT 0
+#endif
+
+#ifndef DISTRHO_PLUGIN_SNAPSHOT_SIZE
+# define DISTRHO_PLUGIN_SNAPSHOT_SIZE 1024
+#endif
+
+#ifndef DISTRHO_PLUGIN_WANT_WORKER
+# define DISTRHO_PLUGIN_WANT_WORKER 0
+#endif
+
+#ifndef DISTRHO_PLUGIN_WORKER_MESSAGE_SIZE
+# define DISTRHO_PLUGIN_WORKER_MESSAGE_SIZE 1024
+#endif
+
+#ifndef DISTRHO_PLUGIN_PROGRAM_RAMP_BLOCK
+# define DISTRHO_PLUGIN_PROGRAM_RAMP_BLOCK 32
+#endif
+
+#ifndef DISTRHO_PLUGIN_WANT_BYPASS
+# define DISTRHO_PLUGIN_WANT_BYPASS 0
+#endif
+
+#ifndef DISTRHO_PLUGIN_BYPASS_MAX_LATENCY
+# define DISTRHO_PLUGIN_BYPASS_MAX_LATENCY 8192
+#endif
+
 // -----------------------------------------------------------------------
 // Define DISTRHO_UI_URI if needed
 
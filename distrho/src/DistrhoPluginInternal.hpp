@@ -18,6 +18,23 @@
 #define DISTRHO_PLUGIN_INTERNAL_HPP_INCLUDED
 
 #include "../DistrhoPlugin.hpp"
+#include "../extra/d_atomic.hpp"
+
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+# include "../extra/d_presets.hpp"
+#endif
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+# include "../extra/d_ringbuffer.hpp"
+#endif
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+# include "../extra/d_triplebuffer.hpp"
+#endif
+#if DISTRHO_PLUGIN_WANT_WORKER
+# include "DistrhoPluginWorker.hpp"
+#endif
+#if DISTRHO_PLUGIN_WANT_BYPASS
+# include "DistrhoPluginBypass.hpp"
+#endif
 
 START_NAMESPACE_DISTRHO
 
@@ -37,13 +54,21 @@ extern double   d_lastSampleRate;
 
 struct Plugin::PrivateData {
     bool isProcessing;
+    bool isOffline;
 
     uint32_t   parameterCount;
     Parameter* parameters;
 
+    // per-sample values of kParameterIsCV inputs for the current run, null if there are none
+    const float** parameterCVs;
+
 #if DISTRHO_PLUGIN_WANT_PROGRAMS
     uint32_t  programCount;
     d_string* programNames;
+
+    // set by d_setProgramTable(), owned by the plugin
+    const PresetTable* programTable;
+    uint32_t           programRampFrames;
 #endif
 
 #if DISTRHO_PLUGIN_WANT_STATE
@@ -60,16 +85,40 @@ struct Plugin::PrivateData {
     TimePosition timePosition;
 #endif
 
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+    RingBuffer<float>* uiStream;
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+    TripleBuffer* snapshot;
+#endif
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+    // framework thread, used unless the wrapper sets the host worker callbacks below
+    PluginWorker* worker;
+    typedef bool (*WorkFunc)(void* ptr, const void* data, uint32_t size);
+    void*    hostWorkerPtr;
+    WorkFunc hostScheduleWork;
+    WorkFunc hostRespondWork;
+#endif
+
     uint32_t bufferSize;
+    uint32_t minBufferSize;
+    uint32_t nominalBufferSize;
+    uint32_t sequenceSize;
     double   sampleRate;
 
     PrivateData() noexcept
         : isProcessing(false),
+          isOffline(false),
           parameterCount(0),
           parameters(nullptr),
+          parameterCVs(nullptr),
 #if DISTRHO_PLUGIN_WANT_PROGRAMS
           programCount(0),
           programNames(nullptr),
+          programTable(nullptr),
+          programRampFrames(0),
 #endif
 #if DISTRHO_PLUGIN_WANT_STATE
           stateCount(0),
@@ -78,8 +127,23 @@ struct Plugin::PrivateData {
 #endif
 #if DISTRHO_PLUGIN_WANT_LATENCY
           latency(0),
+#endif
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+          uiStream(nullptr),
+#endif
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+          snapshot(nullptr),
+#endif
+#if DISTRHO_PLUGIN_WANT_WORKER
+          worker(nullptr),
+          hostWorkerPtr(nullptr),
+          hostScheduleWork(nullptr),
+          hostRespondWork(nullptr),
 #endif
           bufferSize(d_lastBufferSize),
+          minBufferSize(0),
+          nominalBufferSize(0),
+          sequenceSize(0),
           sampleRate(d_lastSampleRate)
     {
         DISTRHO_SAFE_ASSERT(bufferSize != 0);
@@ -94,6 +158,12 @@ struct Plugin::PrivateData {
             parameters = nullptr;
         }
 
+        if (parameterCVs != nullptr)
+        {
+            delete[] parameterCVs;
+            parameterCVs = nullptr;
+        }
+
 #if DISTRHO_PLUGIN_WANT_PROGRAMS
         if (programNames != nullptr)
         {
@@ -115,6 +185,30 @@ struct Plugin::PrivateData {
             stateDefValues = nullptr;
         }
 #endif
+
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+        if (uiStream != nullptr)
+        {
+            delete uiStream;
+            uiStream = nullptr;
+        }
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+        if (snapshot != nullptr)
+        {
+            delete snapshot;
+            snapshot = nullptr;
+        }
+#endif
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+        if (worker != nullptr)
+        {
+            delete worker;
+            worker = nullptr;
+        }
+#endif
     }
 };
 
@@ -127,17 +221,43 @@ public:
     PluginExporter()
         : fPlugin(createPlugin()),
           fData((fPlugin != nullptr) ? fPlugin->pData : nullptr),
-          fIsActive(false)
+          fIsActive(false),
+          fIsOfflineRequested(false),
+          fCVBuffers(nullptr),
+          fCVHostBuffers(nullptr),
+          fCVBufferSize(0)
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+        , fPendingProgram(-1),
+          fProgramMorph(nullptr),
+          fProgramValues(nullptr)
+# if DISTRHO_PLUGIN_IS_SYNTH
+        , fProgramMidiEvents(nullptr)
+# endif
+#endif
     {
         DISTRHO_SAFE_ASSERT_RETURN(fPlugin != nullptr,);
         DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
 
+        bool hasCVs = false;
+
         for (uint32_t i=0, count=fData->parameterCount; i < count; ++i)
+        {
             fPlugin->d_initParameter(i, fData->parameters[i]);
 
+            if (isParameterCV(i))
+                hasCVs = true;
+        }
+
+        if (hasCVs)
+            allocateCVBuffers();
+
 #if DISTRHO_PLUGIN_WANT_PROGRAMS
         for (uint32_t i=0, count=fData->programCount; i < count; ++i)
             fPlugin->d_initProgramName(i, fData->programNames[i]);
+
+        // the plugin may set a program table at any time, so always be ready to ramp
+        if (fData->parameterCount > 0)
+            allocateProgramRamp();
 #endif
 
 #if DISTRHO_PLUGIN_WANT_STATE
@@ -148,6 +268,15 @@ public:
 
     ~PluginExporter()
     {
+#if DISTRHO_PLUGIN_WANT_WORKER
+        // d_work() must not run while the plugin is destroyed
+        if (fData != nullptr && fData->worker != nullptr)
+            fData->worker->stop();
+#endif
+        freeCVBuffers();
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+        freeProgramRamp();
+#endif
         delete fPlugin;
     }
 
@@ -211,6 +340,24 @@ public:
     }
 #endif
 
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+    RingBuffer<float>* getUIStream() const noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr, nullptr);
+
+        return fData->uiStream;
+    }
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+    TripleBuffer* getSnapshot() const noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr, nullptr);
+
+        return fData->snapshot;
+    }
+#endif
+
     uint32_t getParameterCount() const noexcept
     {
         DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr, 0);
@@ -230,6 +377,12 @@ public:
         return (getParameterHints(index) & kParameterIsOutput);
     }
 
+    // CV is ignored for outputs
+    bool isParameterCV(const uint32_t index) const noexcept
+    {
+        return (getParameterHints(index) & (kParameterIsCV|kParameterIsOutput)) == kParameterIsCV;
+    }
+
     const d_string& getParameterName(const uint32_t index) const noexcept
     {
         DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr && index < fData->parameterCount, sFallbackString);
@@ -289,12 +442,40 @@ public:
         return fData->programNames[index];
     }
 
+    // With a program table the change is picked up by the next run() and ramped there,
+    // otherwise d_setProgram() is called right away.
+    // Must be called from the same thread as run(), or while inactive.
     void setProgram(const uint32_t index)
     {
         DISTRHO_SAFE_ASSERT_RETURN(fPlugin != nullptr,);
         DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr && index < fData->programCount,);
 
-        fPlugin->d_setProgram(index);
+        if (fData->programTable == nullptr || fProgramMorph == nullptr)
+            return fPlugin->d_setProgram(index);
+
+        if (fIsActive)
+            return fPendingProgram.store(static_cast<int32_t>(index));
+
+        // nothing to ramp, jump right away
+        if (const float* const values = getProgramValues(index))
+        {
+            readProgramValues();
+            applyProgramValues(values);
+            fProgramMorph->reset(values);
+        }
+    }
+
+    // values a program switches to when using a program table, null otherwise
+    const float* getProgramValues(const uint32_t index) const noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr, nullptr);
+
+        const PresetTable* const table(fData->programTable);
+
+        if (table == nullptr || index >= table->getPresetCount())
+            return nullptr;
+
+        return table->getValues(index);
     }
 #endif
 
@@ -361,6 +542,16 @@ public:
 
         fIsActive = true;
         fPlugin->d_activate();
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        // the only place the delay line is allocated, latency is known after d_activate()
+        fBypass.init(fData->bufferSize, fData->sampleRate, getLatencyForBypass());
+#endif
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+        if (fData->hostScheduleWork == nullptr && fData->worker != nullptr)
+            fData->worker->start(_workCallback, this);
+#endif
     }
 
     void deactivate()
@@ -369,6 +560,12 @@ public:
 
         fIsActive = false;
         fPlugin->d_deactivate();
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+        // started by activate(), pending requests are handled after the next one
+        if (fData->worker != nullptr)
+            fData->worker->stop();
+#endif
     }
 
 #if DISTRHO_PLUGIN_IS_SYNTH
@@ -378,9 +575,36 @@ public:
         DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
         DISTRHO_SAFE_ASSERT_RETURN(fPlugin != nullptr,);
 
-        fData->isProcessing = true;
-        fPlugin->d_run(inputs, outputs, frames, midiEvents, midiEventCount);
-        fData->isProcessing = false;
+        if (fData->isOffline != fIsOfflineRequested.load(__ATOMIC_RELAXED))
+            updateOffline();
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+        if (fData->worker != nullptr && fData->worker->deliverResponses(_workCompletedCallback, this) != 0)
+            fPlugin->d_workResponsesDone();
+#endif
+
+        if (fCVBuffers != nullptr)
+            updateCVBuffers(frames);
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        const bool needsRun(fBypass.preRun(inputs, frames, getLatencyForBypass()));
+
+        if (needsRun)
+#endif
+        {
+            fData->isProcessing = true;
+# if DISTRHO_PLUGIN_WANT_PROGRAMS
+            if (fProgramMorph != nullptr && startProgramRamp())
+                runProgramRamp(inputs, outputs, frames, midiEvents, midiEventCount);
+            else
+# endif
+                fPlugin->d_run(inputs, outputs, frames, midiEvents, midiEventCount);
+            fData->isProcessing = false;
+        }
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        fBypass.postRun(outputs, frames, getLatencyForBypass(), needsRun);
+#endif
     }
 #else
     void run(const float** const inputs, float** const outputs, const uint32_t frames)
@@ -388,9 +612,36 @@ public:
         DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
         DISTRHO_SAFE_ASSERT_RETURN(fPlugin != nullptr,);
 
-        fData->isProcessing = true;
-        fPlugin->d_run(inputs, outputs, frames);
-        fData->isProcessing = false;
+        if (fData->isOffline != fIsOfflineRequested.load(__ATOMIC_RELAXED))
+            updateOffline();
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+        if (fData->worker != nullptr && fData->worker->deliverResponses(_workCompletedCallback, this) != 0)
+            fPlugin->d_workResponsesDone();
+#endif
+
+        if (fCVBuffers != nullptr)
+            updateCVBuffers(frames);
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        const bool needsRun(fBypass.preRun(inputs, frames, getLatencyForBypass()));
+
+        if (needsRun)
+#endif
+        {
+            fData->isProcessing = true;
+# if DISTRHO_PLUGIN_WANT_PROGRAMS
+            if (fProgramMorph != nullptr && startProgramRamp())
+                runProgramRamp(inputs, outputs, frames);
+            else
+# endif
+                fPlugin->d_run(inputs, outputs, frames);
+            fData->isProcessing = false;
+        }
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        fBypass.postRun(outputs, frames, getLatencyForBypass(), needsRun);
+#endif
     }
 #endif
 
@@ -419,6 +670,9 @@ public:
 
         fData->bufferSize = bufferSize;
 
+        if (fCVBuffers != nullptr && bufferSize > fCVBufferSize)
+            allocateCVBuffers();
+
         if (doCallback)
         {
             if (fIsActive) fPlugin->d_deactivate();
@@ -427,6 +681,37 @@ public:
         }
     }
 
+    // hints only, the plugin reads them when needed
+    void setMinBufferSize(const uint32_t minBufferSize) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
+        fData->minBufferSize = minBufferSize;
+    }
+
+    void setNominalBufferSize(const uint32_t nominalBufferSize) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
+        fData->nominalBufferSize = nominalBufferSize;
+    }
+
+    void setSequenceSize(const uint32_t sequenceSize) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
+        fData->sequenceSize = sequenceSize;
+    }
+
+    bool isOffline() const noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr, false);
+        return fData->isOffline;
+    }
+
+    // can be called from any thread, the plugin is told about the change on the next run()
+    void setOffline(const bool offline) noexcept
+    {
+        fIsOfflineRequested.store(offline, __ATOMIC_RELAXED);
+    }
+
     void setSampleRate(const double sampleRate, const bool doCallback = false)
     {
         DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
@@ -446,6 +731,68 @@ public:
         }
     }
 
+#if DISTRHO_PLUGIN_WANT_BYPASS
+    // -------------------------------------------------------------------
+
+    // can be called from any thread, takes effect on the next run()
+    void setBypassed(const bool bypassed) noexcept
+    {
+        fBypass.setBypassed(bypassed);
+    }
+
+    bool isBypassed() const noexcept
+    {
+        return fBypass.isBypassed();
+    }
+#endif
+
+    // -------------------------------------------------------------------
+
+    // audio-rate data for a kParameterIsCV input, only used for the next run()
+    void setParameterCV(const uint32_t index, const float* const buffer) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr && index < fData->parameterCount,);
+        DISTRHO_SAFE_ASSERT_RETURN(fCVHostBuffers != nullptr,);
+
+        fCVHostBuffers[index] = buffer;
+    }
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+    // -------------------------------------------------------------------
+
+    // used by wrappers with a host worker, must be called before activate()
+    void setHostWorker(void* const ptr, const Plugin::PrivateData::WorkFunc scheduleWork,
+                                        const Plugin::PrivateData::WorkFunc respondWork) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
+
+        fData->hostWorkerPtr    = ptr;
+        fData->hostScheduleWork = scheduleWork;
+        fData->hostRespondWork  = respondWork;
+    }
+
+    void work(const void* const data, const uint32_t size)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fPlugin != nullptr,);
+
+        fPlugin->d_work(data, size);
+    }
+
+    void workCompleted(const void* const data, const uint32_t size)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fPlugin != nullptr,);
+
+        fPlugin->d_workCompleted(data, size);
+    }
+
+    void workResponsesDone()
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fPlugin != nullptr,);
+
+        fPlugin->d_workResponsesDone();
+    }
+#endif
+
 private:
     // -------------------------------------------------------------------
     // Plugin and DistrhoPlugin data
@@ -453,6 +800,280 @@ private:
     Plugin* const fPlugin;
     Plugin::PrivateData* const fData;
     bool fIsActive;
+    Atomic<bool> fIsOfflineRequested;
+
+    // kParameterIsCV inputs, null for other parameters.
+    // Used when the host has no audio-rate data, filled with the current value.
+    float**       fCVBuffers;
+    const float** fCVHostBuffers;
+    uint32_t      fCVBufferSize;
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+    PluginBypass fBypass;
+
+    uint32_t getLatencyForBypass() const noexcept
+    {
+# if DISTRHO_PLUGIN_WANT_LATENCY
+        return fData->latency;
+# else
+        return 0;
+# endif
+    }
+#endif
+
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+    // program table changes, ramped in sub-blocks of DISTRHO_PLUGIN_PROGRAM_RAMP_BLOCK frames
+    Atomic<int32_t> fPendingProgram; // -1 for none
+    PresetMorph*    fProgramMorph;
+    float*          fProgramValues;  // last values given to the plugin
+# if DISTRHO_PLUGIN_IS_SYNTH
+    MidiEvent*      fProgramMidiEvents;
+# endif
+#endif
+
+    void updateOffline()
+    {
+        fData->isOffline = fIsOfflineRequested.load(__ATOMIC_RELAXED);
+        fPlugin->d_offlineChanged(fData->isOffline);
+    }
+
+    // -------------------------------------------------------------------
+
+    void allocateCVBuffers()
+    {
+        const uint32_t count(fData->parameterCount);
+
+        if (fCVBuffers == nullptr)
+        {
+            fCVBuffers       = new float*[count];
+            fCVHostBuffers   = new const float*[count];
+            fData->parameterCVs = new const float*[count];
+
+            for (uint32_t i=0; i < count; ++i)
+            {
+                fCVBuffers[i]          = nullptr;
+                fCVHostBuffers[i]      = nullptr;
+                fData->parameterCVs[i] = nullptr;
+            }
+        }
+
+        fCVBufferSize = fData->bufferSize;
+
+        for (uint32_t i=0; i < count; ++i)
+        {
+            if (! isParameterCV(i))
+                continue;
+
+            if (fCVBuffers[i] != nullptr)
+                delete[] fCVBuffers[i];
+
+            fCVBuffers[i] = new float[fCVBufferSize];
+        }
+    }
+
+    void freeCVBuffers()
+    {
+        if (fCVBuffers == nullptr)
+            return;
+
+        for (uint32_t i=0, count=fData->parameterCount; i < count; ++i)
+        {
+            if (fCVBuffers[i] != nullptr)
+                delete[] fCVBuffers[i];
+        }
+
+        delete[] fCVBuffers;
+        delete[] fCVHostBuffers;
+        fCVBuffers     = nullptr;
+        fCVHostBuffers = nullptr;
+    }
+
+    void updateCVBuffers(const uint32_t frames) noexcept
+    {
+        for (uint32_t i=0, count=fData->parameterCount; i < count; ++i)
+        {
+            float* const buffer(fCVBuffers[i]);
+
+            if (buffer == nullptr)
+                continue;
+
+            if (fCVHostBuffers[i] != nullptr)
+            {
+                fData->parameterCVs[i] = fCVHostBuffers[i];
+                fCVHostBuffers[i] = nullptr;
+                continue;
+            }
+
+            if (frames > fCVBufferSize)
+            {
+                fData->parameterCVs[i] = nullptr;
+                continue;
+            }
+
+            const float value(fPlugin->d_getParameterValue(i));
+
+            for (uint32_t j=0; j < frames; ++j)
+                buffer[j] = value;
+
+            fData->parameterCVs[i] = buffer;
+        }
+    }
+
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+    // -------------------------------------------------------------------
+
+    void allocateProgramRamp()
+    {
+        const uint32_t count(fData->parameterCount);
+
+        fProgramMorph  = new PresetMorph(count);
+        fProgramValues = new float[count];
+# if DISTRHO_PLUGIN_IS_SYNTH
+        fProgramMidiEvents = new MidiEvent[kMaxMidiEvents];
+# endif
+
+        for (uint32_t i=0; i < count; ++i)
+        {
+            fProgramValues[i] = 0.0f;
+            fProgramMorph->setStepped(i, getParameterHints(i) & (kParameterIsBoolean|kParameterIsInteger));
+        }
+    }
+
+    void freeProgramRamp()
+    {
+        if (fProgramMorph == nullptr)
+            return;
+
+        delete fProgramMorph;
+        delete[] fProgramValues;
+        fProgramMorph  = nullptr;
+        fProgramValues = nullptr;
+# if DISTRHO_PLUGIN_IS_SYNTH
+        delete[] fProgramMidiEvents;
+        fProgramMidiEvents = nullptr;
+# endif
+    }
+
+    void readProgramValues()
+    {
+        for (uint32_t i=0, count=fData->parameterCount; i < count; ++i)
+            fProgramValues[i] = fPlugin->d_getParameterValue(i);
+    }
+
+    void applyProgramValues(const float* const values)
+    {
+        for (uint32_t i=0, count=fData->parameterCount; i < count; ++i)
+        {
+            if (isParameterOutput(i) || fProgramValues[i] == values[i])
+                continue;
+
+            fProgramValues[i] = values[i];
+            fPlugin->d_setParameterValue(i, values[i]);
+        }
+    }
+
+    // takes a pending program change, returns true while a ramp is running
+    bool startProgramRamp()
+    {
+        const int32_t program(fPendingProgram.exchange(-1));
+
+        if (program >= 0)
+        {
+            if (const float* const values = getProgramValues(static_cast<uint32_t>(program)))
+            {
+                // start from what the plugin has now, the host may have changed things since the last ramp
+                if (! fProgramMorph->isRunning())
+                {
+                    readProgramValues();
+                    fProgramMorph->reset(fProgramValues);
+                }
+
+                fProgramMorph->start(values, fData->programRampFrames);
+
+                if (! fProgramMorph->isRunning())
+                    applyProgramValues(values);
+            }
+        }
+
+        return fProgramMorph->isRunning();
+    }
+
+# if DISTRHO_PLUGIN_IS_SYNTH
+    void runProgramRamp(const float** const inputs, float** const outputs, const uint32_t frames,
+                        const MidiEvent* const midiEvents, const uint32_t midiEventCount)
+# else
+    void runProgramRamp(const float** const inputs, float** const outputs, const uint32_t frames)
+# endif
+    {
+        const float* subInputs[DISTRHO_PLUGIN_NUM_INPUTS+1];
+        float*       subOutputs[DISTRHO_PLUGIN_NUM_OUTPUTS+1];
+# if DISTRHO_PLUGIN_IS_SYNTH
+        uint32_t midiIndex = 0;
+# endif
+
+        for (uint32_t offset=0, subFrames; offset < frames; offset += subFrames)
+        {
+            subFrames = frames - offset;
+
+            if (fProgramMorph->isRunning())
+            {
+                if (subFrames > DISTRHO_PLUGIN_PROGRAM_RAMP_BLOCK)
+                    subFrames = DISTRHO_PLUGIN_PROGRAM_RAMP_BLOCK;
+
+                applyProgramValues(fProgramMorph->process(subFrames));
+            }
+
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+                subInputs[i] = inputs[i] + offset;
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+                subOutputs[i] = outputs[i] + offset;
+
+# if DISTRHO_PLUGIN_IS_SYNTH
+            // events past the end of the block go into the last one
+            const bool lastBlock(offset + subFrames == frames);
+            uint32_t subEventCount = 0;
+
+            for (; midiIndex < midiEventCount && subEventCount < kMaxMidiEvents; ++midiIndex)
+            {
+                const MidiEvent& event(midiEvents[midiIndex]);
+
+                if (event.frame >= offset + subFrames && ! lastBlock)
+                    break;
+
+                MidiEvent& subEvent(fProgramMidiEvents[subEventCount++]);
+                subEvent = event;
+                subEvent.frame = (event.frame > offset) ? event.frame - offset : 0;
+            }
+
+            fPlugin->d_run(subInputs, subOutputs, subFrames, fProgramMidiEvents, subEventCount);
+# else
+            fPlugin->d_run(subInputs, subOutputs, subFrames);
+# endif
+
+            // CV data follows the audio, updateCVBuffers() resets it for the next run()
+            if (fData->parameterCVs != nullptr && offset + subFrames < frames)
+            {
+                for (uint32_t i=0, count=fData->parameterCount; i < count; ++i)
+                {
+                    if (fData->parameterCVs[i] != nullptr)
+                        fData->parameterCVs[i] += subFrames;
+                }
+            }
+        }
+    }
+#endif
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+    static void _workCallback(void* const ptr, const void* const data, const uint32_t size)
+    {
+        ((PluginExporter*)ptr)->work(data, size);
+    }
+
+    static void _workCompletedCallback(void* const ptr, const void* const data, const uint32_t size)
+    {
+        ((PluginExporter*)ptr)->workCompleted(data, size);
+    }
+#endif
 
     // -------------------------------------------------------------------
     // Static fallback data, see DistrhoPlugin.cpp
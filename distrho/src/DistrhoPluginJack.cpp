@@ -22,128 +22,1090 @@
 
 #include "DistrhoUIInternal.hpp"
 
+#include "../extra/d_atomic.hpp"
+
 #include "jack/jack.h"
 #include "jack/midiport.h"
+#include "jack/thread.h"
 #include "jack/transport.h"
 
+#include <algorithm>
+#include <new>
+
+#include <semaphore.h>
+#include <unistd.h>
+
+// -----------------------------------------------------------------------
+
+START_NAMESPACE_DISTRHO
+
+#if ! DISTRHO_PLUGIN_WANT_STATE
+static const setStateFunc setStateCallback = nullptr;
+#endif
+
+// -----------------------------------------------------------------------
+// Maximum values
+
+static const uint32_t kMaxJackInstances = 256;
+static const uint32_t kMaxJackWorkers   = 64;
+
 // -----------------------------------------------------------------------
+// A single plugin instance together with its JACK ports
+
+struct PluginJackInstance {
+    PluginExporter plugin;
+
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+    jack_port_t* portAudioIns[DISTRHO_PLUGIN_NUM_INPUTS];
+#endif
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+    jack_port_t* portAudioOuts[DISTRHO_PLUGIN_NUM_OUTPUTS];
+#endif
+#if DISTRHO_PLUGIN_IS_SYNTH
+    jack_port_t* portMidiIn;
+    MidiEvent    midiEvents[2][kMaxMidiEvents];
+    uint32_t     midiEventCount[2];
+#endif
+#if DISTRHO_PLUGIN_WANT_BYPASS
+    // JACK has no host controls, bypass follows this audio input like a CV port
+    jack_port_t* portBypass;
+#endif
+
+    // audio inputs for kParameterIsCV parameters, indexed by parameter; null if there are none
+    jack_port_t** portCVs;
+
+    // pipelined mode, one side is used by the JACK thread while the other is being processed
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+    float* pipelineIns[2][DISTRHO_PLUGIN_NUM_INPUTS];
+#endif
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+    float* pipelineOuts[2][DISTRHO_PLUGIN_NUM_OUTPUTS];
+#endif
+    float** pipelineCVs[2];        // only for connected CV ports
+    bool*   pipelineCVConnected[2];
+
+    PluginJackInstance()
+        : plugin(),
+          portCVs(nullptr)
+    {
+        for (uint32_t i=0, count=plugin.getParameterCount(); i < count; ++i)
+        {
+            if (! plugin.isParameterCV(i))
+                continue;
+
+            portCVs = new jack_port_t*[count];
+            std::memset(portCVs, 0, sizeof(jack_port_t*)*count);
+
+            for (uint32_t s=0; s < 2; ++s)
+            {
+                pipelineCVs[s] = new float*[count];
+                pipelineCVConnected[s] = new bool[count];
+                std::memset(pipelineCVs[s], 0, sizeof(float*)*count);
+                std::memset(pipelineCVConnected[s], 0, sizeof(bool)*count);
+            }
+            break;
+        }
+
+        if (portCVs == nullptr)
+        {
+            pipelineCVs[0] = pipelineCVs[1] = nullptr;
+            pipelineCVConnected[0] = pipelineCVConnected[1] = nullptr;
+        }
+
+        for (uint32_t s=0; s < 2; ++s)
+        {
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+                pipelineIns[s][i] = nullptr;
+#endif
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+                pipelineOuts[s][i] = nullptr;
+#endif
+#if DISTRHO_PLUGIN_IS_SYNTH
+            midiEventCount[s] = 0;
+#endif
+        }
+
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+            portAudioIns[i] = nullptr;
+#endif
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+            portAudioOuts[i] = nullptr;
+#endif
+#if DISTRHO_PLUGIN_IS_SYNTH
+        portMidiIn = nullptr;
+#endif
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        portBypass = nullptr;
+#endif
+    }
+
+    ~PluginJackInstance()
+    {
+        freePipelineBuffers();
+
+        if (portCVs != nullptr)
+        {
+            delete[] portCVs;
+            portCVs = nullptr;
+
+            for (uint32_t s=0; s < 2; ++s)
+            {
+                delete[] pipelineCVs[s];
+                delete[] pipelineCVConnected[s];
+                pipelineCVs[s] = nullptr;
+                pipelineCVConnected[s] = nullptr;
+            }
+        }
+    }
+
+   /*
+    * Register the JACK ports of this instance.
+    * 'number' is 0 when this is the only instance, in which case ports are not prefixed.
+    */
+    void registerPorts(jack_client_t* const client, const uint32_t number)
+    {
+        char strBuf[0xff+1];
+        strBuf[0xff] = '\0';
+
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+        {
+            if (number == 0)
+                std::snprintf(strBuf, 0xff, "in%i", i+1);
+            else
+                std::snprintf(strBuf, 0xff, "%i.in%i", number, i+1);
+
+            portAudioIns[i] = jack_port_register(client, strBuf, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+        }
+#endif
+
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+        {
+            if (number == 0)
+                std::snprintf(strBuf, 0xff, "out%i", i+1);
+            else
+                std::snprintf(strBuf, 0xff, "%i.out%i", number, i+1);
+
+            portAudioOuts[i] = jack_port_register(client, strBuf, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+        }
+#endif
+
+#if DISTRHO_PLUGIN_IS_SYNTH
+        if (number == 0)
+            std::strcpy(strBuf, "midi-in");
+        else
+            std::snprintf(strBuf, 0xff, "%i.midi-in", number);
+
+        portMidiIn = jack_port_register(client, strBuf, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+#endif
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        if (number == 0)
+            std::strcpy(strBuf, "bypass-cv");
+        else
+            std::snprintf(strBuf, 0xff, "%i.bypass-cv", number);
+
+        portBypass = jack_port_register(client, strBuf, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+#endif
+
+        if (portCVs != nullptr)
+        {
+            for (uint32_t i=0, count=plugin.getParameterCount(); i < count; ++i)
+            {
+                if (! plugin.isParameterCV(i))
+                    continue;
+
+                const d_string& symbol(plugin.getParameterSymbol(i));
+
+                if (number == 0)
+                    std::snprintf(strBuf, 0xff, "cv-%s", symbol.buffer());
+                else
+                    std::snprintf(strBuf, 0xff, "%i.cv-%s", number, symbol.buffer());
+
+                portCVs[i] = jack_port_register(client, strBuf, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+            }
+        }
+
+        return;
+
+        // unused
+        (void)client;
+        (void)number;
+    }
+
+    void unregisterPorts(jack_client_t* const client)
+    {
+        if (portCVs != nullptr)
+        {
+            for (uint32_t i=0, count=plugin.getParameterCount(); i < count; ++i)
+            {
+                if (portCVs[i] == nullptr)
+                    continue;
+
+                jack_port_unregister(client, portCVs[i]);
+                portCVs[i] = nullptr;
+            }
+        }
+
+#if DISTRHO_PLUGIN_IS_SYNTH
+        jack_port_unregister(client, portMidiIn);
+        portMidiIn = nullptr;
+#endif
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        if (portBypass != nullptr)
+        {
+            jack_port_unregister(client, portBypass);
+            portBypass = nullptr;
+        }
+#endif
+
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+        {
+            jack_port_unregister(client, portAudioIns[i]);
+            portAudioIns[i] = nullptr;
+        }
+#endif
+
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+        {
+            jack_port_unregister(client, portAudioOuts[i]);
+            portAudioOuts[i] = nullptr;
+        }
+#endif
+
+        return;
+
+        // unused
+        (void)client;
+    }
+
+   /*
+    * Process one JACK cycle directly on the JACK port buffers.
+    * May be called from any of the process pool threads.
+    */
+    void process(const jack_nframes_t nframes)
+    {
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+        const float* audioIns[DISTRHO_PLUGIN_NUM_INPUTS];
+
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+            audioIns[i] = (const float*)jack_port_get_buffer(portAudioIns[i], nframes);
+#else
+        static const float** audioIns = nullptr;
+#endif
+
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+        float* audioOuts[DISTRHO_PLUGIN_NUM_OUTPUTS];
+
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+            audioOuts[i] = (float*)jack_port_get_buffer(portAudioOuts[i], nframes);
+#else
+        static float** audioOuts = nullptr;
+#endif
+
+        // unconnected CV ports leave the parameter at its block-rate value
+        if (portCVs != nullptr)
+        {
+            for (uint32_t i=0, count=plugin.getParameterCount(); i < count; ++i)
+            {
+                if (portCVs[i] != nullptr && jack_port_connected(portCVs[i]) > 0)
+                    plugin.setParameterCV(i, (const float*)jack_port_get_buffer(portCVs[i], nframes));
+            }
+        }
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        readBypassPort(nframes);
+#endif
+
+#if DISTRHO_PLUGIN_IS_SYNTH
+        readMidiEvents(0, nframes, true);
+
+        plugin.run(audioIns, audioOuts, nframes, midiEvents[0], midiEventCount[0]);
+#else
+        plugin.run(audioIns, audioOuts, nframes);
+#endif
+    }
+
+    // -------------------------------------------------------------------
+    // Pipelined mode
+
+    bool allocPipelineBuffers(const jack_nframes_t nframes)
+    {
+        freePipelineBuffers();
+
+        for (uint32_t s=0; s < 2; ++s)
+        {
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+            {
+                pipelineIns[s][i] = new float[nframes];
+                std::memset(pipelineIns[s][i], 0, sizeof(float)*nframes);
+            }
+#endif
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+            {
+                pipelineOuts[s][i] = new float[nframes];
+                std::memset(pipelineOuts[s][i], 0, sizeof(float)*nframes);
+            }
+#endif
+#if DISTRHO_PLUGIN_IS_SYNTH
+            midiEventCount[s] = 0;
+#endif
+            if (portCVs != nullptr)
+            {
+                for (uint32_t i=0, count=plugin.getParameterCount(); i < count; ++i)
+                {
+                    if (portCVs[i] == nullptr)
+                        continue;
+
+                    pipelineCVs[s][i] = new float[nframes];
+                    pipelineCVConnected[s][i] = false;
+                }
+            }
+        }
+
+        return true;
+
+        // might be unused
+        (void)nframes;
+    }
+
+    void freePipelineBuffers()
+    {
+        for (uint32_t s=0; s < 2; ++s)
+        {
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+            {
+                if (pipelineIns[s][i] != nullptr)
+                {
+                    delete[] pipelineIns[s][i];
+                    pipelineIns[s][i] = nullptr;
+                }
+            }
+#endif
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+            {
+                if (pipelineOuts[s][i] != nullptr)
+                {
+                    delete[] pipelineOuts[s][i];
+                    pipelineOuts[s][i] = nullptr;
+                }
+            }
+#endif
+            if (portCVs != nullptr)
+            {
+                for (uint32_t i=0, count=plugin.getParameterCount(); i < count; ++i)
+                {
+                    if (pipelineCVs[s][i] != nullptr)
+                    {
+                        delete[] pipelineCVs[s][i];
+                        pipelineCVs[s][i] = nullptr;
+                    }
+                }
+            }
+        }
+    }
+
+   /*
+    * Copy the outputs of the last processed side into the JACK ports,
+    * then capture this cycle's inputs into the other side.
+    * Called from the JACK process thread while the pipeline thread is idle.
+    */
+    void pipelineExchange(const uint32_t processedSide, const uint32_t nextSide, const jack_nframes_t nframes)
+    {
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+            std::memcpy(jack_port_get_buffer(portAudioOuts[i], nframes), pipelineOuts[processedSide][i], sizeof(float)*nframes);
+#endif
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+            std::memcpy(pipelineIns[nextSide][i], jack_port_get_buffer(portAudioIns[i], nframes), sizeof(float)*nframes);
+#endif
+#if DISTRHO_PLUGIN_IS_SYNTH
+        readMidiEvents(nextSide, nframes, false);
+#endif
+
+        if (portCVs != nullptr)
+        {
+            for (uint32_t i=0, count=plugin.getParameterCount(); i < count; ++i)
+            {
+                if (portCVs[i] == nullptr)
+                    continue;
+
+                pipelineCVConnected[nextSide][i] = jack_port_connected(portCVs[i]) > 0;
+
+                if (pipelineCVConnected[nextSide][i])
+                    std::memcpy(pipelineCVs[nextSide][i], jack_port_get_buffer(portCVs[i], nframes), sizeof(float)*nframes);
+            }
+        }
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        // the pipeline thread is idle, so this applies to the side captured above
+        readBypassPort(nframes);
+#endif
+
+        return;
+
+        // might be unused
+        (void)processedSide;
+        (void)nextSide;
+    }
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+   /*
+    * Follow the bypass port when something is connected to it, a value above 0.5 bypasses.
+    * Only the first frame of the cycle is used, the plugin crossfades on its own.
+    */
+    void readBypassPort(const jack_nframes_t nframes)
+    {
+        if (portBypass == nullptr || jack_port_connected(portBypass) <= 0)
+            return;
+
+        const float* const buffer((const float*)jack_port_get_buffer(portBypass, nframes));
+
+        plugin.setBypassed(buffer[0] > 0.5f);
+    }
+#endif
+
+   /*
+    * Write silence to the JACK ports.
+    * Used by the JACK process thread when the pipeline thread did not finish in time.
+    */
+    void pipelineSilence(const jack_nframes_t nframes)
+    {
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+            std::memset(jack_port_get_buffer(portAudioOuts[i], nframes), 0, sizeof(float)*nframes);
+#else
+        // unused
+        (void)nframes;
+#endif
+    }
+
+   /*
+    * Process one side of the pipeline buffers.
+    * May be called from the pipeline thread or any of the process pool threads.
+    */
+    void pipelineProcess(const uint32_t side, const jack_nframes_t nframes)
+    {
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+        const float** const audioIns = (const float**)pipelineIns[side];
+#else
+        static const float** audioIns = nullptr;
+#endif
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+        float** const audioOuts = pipelineOuts[side];
+#else
+        static float** audioOuts = nullptr;
+#endif
+
+        if (portCVs != nullptr)
+        {
+            for (uint32_t i=0, count=plugin.getParameterCount(); i < count; ++i)
+            {
+                if (pipelineCVConnected[side][i])
+                    plugin.setParameterCV(i, pipelineCVs[side][i]);
+            }
+        }
+
+#if DISTRHO_PLUGIN_IS_SYNTH
+        plugin.run(audioIns, audioOuts, nframes, midiEvents[side], midiEventCount[side]);
+#else
+        plugin.run(audioIns, audioOuts, nframes);
+        // unused
+        (void)side;
+#endif
+    }
+
+   /*
+    * Report the latency added by the pipeline to the JACK graph.
+    * Inputs and outputs of the same instance are connected, with 'extra' frames in between.
+    */
+    void updateLatency(const jack_latency_callback_mode_t mode, const jack_nframes_t extra)
+    {
+        jack_latency_range_t range;
+        range.min = range.max = 0;
+
+        if (mode == JackCaptureLatency)
+        {
+            bool first = true;
+
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+                mergeLatencyRange(portAudioIns[i], mode, range, first);
+#endif
+#if DISTRHO_PLUGIN_IS_SYNTH
+            mergeLatencyRange(portMidiIn, mode, range, first);
+#endif
+
+            range.min += extra;
+            range.max += extra;
+            (void)first;
+
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+                jack_port_set_latency_range(portAudioOuts[i], mode, &range);
+#endif
+        }
+        else
+        {
+            bool first = true;
+
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+                mergeLatencyRange(portAudioOuts[i], mode, range, first);
+#endif
+
+            range.min += extra;
+            range.max += extra;
+            (void)first;
+
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+            for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+                jack_port_set_latency_range(portAudioIns[i], mode, &range);
+#endif
+#if DISTRHO_PLUGIN_IS_SYNTH
+            jack_port_set_latency_range(portMidiIn, mode, &range);
+#endif
+        }
+    }
+
+    static void mergeLatencyRange(jack_port_t* const port, const jack_latency_callback_mode_t mode, jack_latency_range_t& range, bool& first)
+    {
+        jack_latency_range_t portRange;
+        jack_port_get_latency_range(port, mode, &portRange);
+
+        if (first)
+        {
+            range = portRange;
+            first = false;
+            return;
+        }
+
+        if (portRange.min < range.min)
+            range.min = portRange.min;
+        if (portRange.max > range.max)
+            range.max = portRange.max;
+    }
+
+    // -------------------------------------------------------------------
+
+#if DISTRHO_PLUGIN_IS_SYNTH
+   /*
+    * Read this cycle's MIDI events into 'midiEvents[side]'.
+    * When 'allowExtData' is false the events must outlive the JACK cycle,
+    * so events too big to be stored inline are dropped.
+    */
+    void readMidiEvents(const uint32_t side, const jack_nframes_t nframes, const bool allowExtData)
+    {
+        void* const midiBuf = jack_port_get_buffer(portMidiIn, nframes);
+
+        MidiEvent* const events(midiEvents[side]);
+        uint32_t count = 0;
+
+        if (const uint32_t eventCount = jack_midi_get_event_count(midiBuf))
+        {
+            jack_midi_event_t jevent;
+
+            for (uint32_t i=0; i < eventCount && count < kMaxMidiEvents; ++i)
+            {
+                if (jack_midi_event_get(&jevent, midiBuf, i) != 0)
+                    break;
+
+                if (jevent.size > MidiEvent::kDataSize && ! allowExtData)
+                    continue;
+
+                MidiEvent& midiEvent(events[count++]);
+
+                midiEvent.frame = jevent.time;
+                midiEvent.size  = jevent.size;
+
+                if (midiEvent.size > MidiEvent::kDataSize)
+                    midiEvent.dataExt = jevent.buffer;
+                else
+                    std::memcpy(midiEvent.data, jevent.buffer, midiEvent.size);
+            }
+        }
+
+        midiEventCount[side] = count;
+    }
+#endif
+
+    DISTRHO_DECLARE_NON_COPY_STRUCT(PluginJackInstance)
+};
+
+// -----------------------------------------------------------------------
+// Pool of real-time threads used to process independent instances in parallel.
+//
+// Each cycle the task range [0, taskCount) is split in one contiguous queue per participant.
+// The JACK process thread is participant 0, the pool workers are the others.
+// Every participant first drains its own queue, then steals from the other queues until all are empty.
+// process() only returns after all tasks are done.
+//
+// A queue is a single 64-bit word holding the cycle number, its end and its next index.
+// Taking a task is a compare-and-swap on that word, so owner and thieves never block, and
+// a worker that wakes up late from a previous cycle can never claim a task it wasn't meant to:
+// its swap fails as soon as the word belongs to a different cycle.
+
+class PluginJackProcessPool
+{
+public:
+    typedef void (*TaskFunc)(void* ptr, uint32_t index);
+
+    PluginJackProcessPool(jack_client_t* const client, const uint32_t workerCount, const TaskFunc func, void* const ptr)
+        : fTaskFunc(func),
+          fTaskPtr(ptr),
+          fPendingTasks(0),
+          fEpoch(0),
+          fWorkerCount(0),
+          fQueues(nullptr),
+          fWorkers(nullptr)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(client != nullptr,);
+        DISTRHO_SAFE_ASSERT_RETURN(func != nullptr,);
+        DISTRHO_SAFE_ASSERT_RETURN(workerCount > 0 && workerCount <= kMaxJackWorkers,);
+
+        // new[] does not honor the alignment of Queue
+        void* queueMem = nullptr;
+        DISTRHO_SAFE_ASSERT_RETURN(posix_memalign(&queueMem, DISTRHO_CACHE_LINE_SIZE, sizeof(Queue)*(workerCount+1)) == 0,);
+
+        fQueues = (Queue*)queueMem;
+
+        for (uint32_t i=0; i <= workerCount; ++i)
+            new (&fQueues[i]) Queue();
+
+        fWorkers = new Worker[workerCount];
+
+        const int priority(jack_client_real_time_priority(client));
+        const int realtime(jack_is_realtime(client));
+
+        for (uint32_t i=0; i < workerCount; ++i)
+        {
+            Worker& worker(fWorkers[i]);
+            worker.pool = this;
+            worker.queue = i+1;
+            worker.shouldExit.store(false);
+
+            sem_init(&worker.sem, 0, 0);
+
+            if (jack_client_create_thread(client, &worker.thread, priority, realtime, _workerEntryPoint, &worker) != 0)
+            {
+                d_stderr("Failed to create JACK worker thread %i, using %i workers", i+1, i);
+                sem_destroy(&worker.sem);
+                break;
+            }
+
+            ++fWorkerCount;
+        }
+    }
+
+    ~PluginJackProcessPool()
+    {
+        for (uint32_t i=0; i < fWorkerCount; ++i)
+        {
+            Worker& worker(fWorkers[i]);
+            worker.shouldExit.store(true);
+            sem_post(&worker.sem);
+            pthread_join(worker.thread, nullptr);
+            sem_destroy(&worker.sem);
+        }
+
+        if (fWorkers != nullptr)
+        {
+            delete[] fWorkers;
+            fWorkers = nullptr;
+        }
+
+        if (fQueues != nullptr)
+        {
+            std::free(fQueues);
+            fQueues = nullptr;
+        }
+    }
+
+    uint32_t getWorkerCount() const noexcept
+    {
+        return fWorkerCount;
+    }
+
+   /*
+    * Run 'taskCount' tasks, blocking until all of them are done.
+    * Must only be called from a single real-time thread, usually the JACK process thread.
+    */
+    void process(const uint32_t taskCount)
+    {
+        if (fWorkerCount == 0 || taskCount <= 1)
+        {
+            for (uint32_t i=0; i < taskCount; ++i)
+                fTaskFunc(fTaskPtr, i);
+            return;
+        }
+
+        DISTRHO_SAFE_ASSERT_RETURN(taskCount <= kMaxTasks,);
+
+        const uint32_t participants(fWorkerCount+1);
+        const uint64_t epoch(++fEpoch);
+
+        // pending count first, anyone who manages to claim a task of this cycle must see it
+        fPendingTasks.store(taskCount, __ATOMIC_RELAXED);
+
+        for (uint32_t i=0; i < participants; ++i)
+            fQueues[i].state.store(packQueue(epoch, taskCount * i / participants, taskCount * (i+1) / participants));
+
+        // sem_post is a full memory barrier, the workers see the queues above
+        for (uint32_t i=0; i < fWorkerCount; ++i)
+            sem_post(&fWorkers[i].sem);
+
+        runTasks(0);
+
+        // join: wait for the tasks that were taken by the other threads
+        for (; fPendingTasks.load() != 0;)
+        {
+#if defined(__i386__) || defined(__x86_64__)
+            __builtin_ia32_pause();
+#endif
+        }
+    }
+
+private:
+    static const uint32_t kMaxTasks = 0xffff;
+
+    // keep each queue on its own cache line
+    struct Queue {
+        Atomic<uint64_t> state; // epoch << 32 | end << 16 | next
+    } __attribute__((aligned(DISTRHO_CACHE_LINE_SIZE)));
+
+    struct Worker {
+        PluginJackProcessPool* pool;
+        uint32_t queue;
+        Atomic<bool> shouldExit;
+        jack_native_thread_t thread;
+        sem_t sem;
+    };
+
+    const TaskFunc fTaskFunc;
+    void* const    fTaskPtr;
+
+    Atomic<uint32_t> fPendingTasks;
+    uint32_t fEpoch; // only touched by the process thread
+    uint32_t fWorkerCount;
+    Queue*   fQueues;
+    Worker*  fWorkers;
+
+    static uint64_t packQueue(const uint64_t epoch, const uint32_t next, const uint32_t end) noexcept
+    {
+        return (epoch << 32) | (uint64_t(end) << 16) | uint64_t(next);
+    }
+
+    // drain our own queue first, then steal from the others
+    void runTasks(const uint32_t ownQueue)
+    {
+        const uint32_t participants(fWorkerCount+1);
+
+        // the cycle of the first queue we look at, a late worker won't touch the following one
+        const uint64_t epoch(fQueues[ownQueue].state.load() >> 32);
+
+        for (uint32_t i=0; i < participants; ++i)
+        {
+            Queue& queue(fQueues[(ownQueue+i) % participants]);
+            uint64_t state(queue.state.load());
+
+            for (;;)
+            {
+                // nothing left in this cycle, don't spin through the other queues
+                if (fPendingTasks.load() == 0)
+                    return;
+
+                const uint32_t next(uint32_t(state & 0xffff));
+                const uint32_t end(uint32_t((state >> 16) & 0xffff));
+
+                if ((state >> 32) != epoch || next >= end)
+                    break;
+
+                if (! queue.state.compareExchange(state, state+1))
+                    continue;
+
+                fTaskFunc(fTaskPtr, next);
+                fPendingTasks.fetchSub(1);
+            }
+        }
+    }
+
+    static void* _workerEntryPoint(void* const userData)
+    {
+        Worker* const worker((Worker*)userData);
+
+        for (;;)
+        {
+            sem_wait(&worker->sem);
+
+            if (worker->shouldExit.load())
+                break;
+
+            worker->pool->runTasks(worker->queue);
+        }
+
+        return nullptr;
+    }
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(PluginJackProcessPool)
+};
+
+// -----------------------------------------------------------------------
+// The window of a single instance.
+// Each instance has its own parameters and state, an editor only controls its own instance.
+
+class PluginJackEditor
+{
+public:
+    PluginJackEditor(PluginJackInstance& instance, const char* const title)
+        : fPlugin(instance.plugin),
+          fNotifier(instance.plugin.getParameterCount()),
+          fUI(this, 0, nullptr, setParameterValueCallback, setStateCallback, nullptr, setSizeCallback, instance.plugin.getInstancePointer()),
+          fTitle(title),
+#if DISTRHO_PLUGIN_WANT_BYPASS
+          fLastBypassed(false),
+#endif
+          fClosed(false)
+    {
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+        if (fPlugin.getProgramCount() > 0)
+            fUI.programChanged(0);
+#endif
+
+        for (uint32_t i=0, count=fPlugin.getParameterCount(); i < count; ++i)
+            fNotifier.setValue(i, fPlugin.getParameterValue(i));
+
+        fUI.setParameterNotifier(&fNotifier);
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+        fUI.setUIStream(fPlugin.getUIStream());
+#endif
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+        fUI.setSnapshot(fPlugin.getSnapshot());
+#endif
+
+        updateWindowTitle();
+    }
+
+    void show()
+    {
+        fUI.setWindowVisible(true);
+    }
+
+    void quit()
+    {
+        fUI.quit();
+    }
 
-START_NAMESPACE_DISTRHO
+   /*
+    * Returns false once the window was closed.
+    */
+    bool idle()
+    {
+        if (fClosed)
+            return false;
 
-#if ! DISTRHO_PLUGIN_WANT_STATE
-static const setStateFunc setStateCallback = nullptr;
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        // the UI has no bypass control of its own, show the state in the title
+        if (fLastBypassed != fPlugin.isBypassed())
+        {
+            fLastBypassed = ! fLastBypassed;
+            updateWindowTitle();
+        }
 #endif
 
-// -----------------------------------------------------------------------
+        if (! fUI.idle())
+            fClosed = true;
 
-class PluginJack
-{
-public:
-    PluginJack(jack_client_t* const client)
-        : fPlugin(),
-          fUI(this, 0, nullptr, setParameterValueCallback, setStateCallback, nullptr, setSizeCallback, fPlugin.getInstancePointer()),
-          fClient(client)
+        return ! fClosed;
+    }
+
+   /*
+    * Report the output parameters of the instance, called from the audio thread after processing.
+    */
+    void notifyOutputParameters(const uint32_t* const indexes, const uint32_t count) noexcept
     {
-        char strBuf[0xff+1];
-        strBuf[0xff] = '\0';
+        for (uint32_t i=0; i < count; ++i)
+            fNotifier.setValueIfChanged(indexes[i], fPlugin.getParameterValue(indexes[i]));
+    }
 
-#if DISTRHO_PLUGIN_NUM_INPUTS > 0
-        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
-        {
-            std::snprintf(strBuf, 0xff, "in%i", i+1);
-            fPortAudioIns[i] = jack_port_register(fClient, strBuf, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
-        }
+private:
+    PluginExporter&   fPlugin;
+    ParameterNotifier fNotifier;
+    UIExporter        fUI;
+    const d_string    fTitle;
+#if DISTRHO_PLUGIN_WANT_BYPASS
+    // last bypass state shown in the window title
+    bool fLastBypassed;
 #endif
+    bool fClosed;
 
-#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
-        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
-        {
-            std::snprintf(strBuf, 0xff, "out%i", i+1);
-            fPortAudioOuts[i] = jack_port_register(fClient, strBuf, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
-        }
+    void updateWindowTitle()
+    {
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        if (fLastBypassed)
+            return fUI.setWindowTitle(fTitle + " (bypassed)");
 #endif
+        fUI.setWindowTitle(fTitle);
+    }
 
-#if DISTRHO_PLUGIN_IS_SYNTH
-        fPortMidiIn = jack_port_register(fClient, "midi-in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+    // -------------------------------------------------------------------
+    // Callbacks
+
+    #define editorPtr ((PluginJackEditor*)ptr)
+
+    static void setParameterValueCallback(void* ptr, uint32_t index, float value)
+    {
+        editorPtr->fPlugin.setParameterValue(index, value);
+    }
+
+#if DISTRHO_PLUGIN_WANT_STATE
+    static void setStateCallback(void* ptr, const char* key, const char* value)
+    {
+        editorPtr->fPlugin.setState(key, value);
+    }
 #endif
 
+    static void setSizeCallback(void* ptr, uint width, uint height)
+    {
+        editorPtr->fUI.setWindowSize(width, height);
+    }
+
+    #undef editorPtr
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(PluginJackEditor)
+};
+
+// -----------------------------------------------------------------------
+
+class PluginJack
+{
+public:
+    PluginJack(jack_client_t* const client, const uint32_t instanceCount, const uint32_t workerCount, const bool pipelined)
+        : fInstanceCount(instanceCount),
+          fInstanceList(instanceCount),
+          fInstances(fInstanceList.instances),
+          fEditors(new PluginJackEditor*[instanceCount]),
+          fClient(client),
+          fProcessPool(nullptr),
+          fPipelined(false),
+          fPipelineShouldExit(false),
+          fPipelineSide(0),
+          fPipelineFrames(0),
+          fPipelineOverruns(0),
+          fPipelineReportedOverruns(0),
+          fCurrentFrames(0),
+          fOutputParameterCount(0),
+          fOutputParameters(nullptr)
+    {
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            fInstances[i].registerPorts(fClient, (fInstanceCount > 1) ? i+1 : 0);
+
+        // all instances share the same layout
+        const PluginExporter& plugin(fInstances[0].plugin);
+
 #if DISTRHO_PLUGIN_WANT_PROGRAMS
-        if (fPlugin.getProgramCount() > 0)
+        if (plugin.getProgramCount() > 0)
         {
-            fPlugin.setProgram(0);
-            fUI.programChanged(0);
+            for (uint32_t i=0; i < fInstanceCount; ++i)
+                fInstances[i].plugin.setProgram(0);
         }
 #endif
 
-        if (const uint32_t count = fPlugin.getParameterCount())
+        if (const uint32_t count = plugin.getParameterCount())
         {
-            fLastOutputValues = new float[count];
+            fOutputParameters = new uint32_t[count];
 
             for (uint32_t i=0; i < count; ++i)
             {
-                if (fPlugin.isParameterOutput(i))
-                {
-                    fLastOutputValues[i] = fPlugin.getParameterValue(i);
-                }
-                else
-                {
-                    fLastOutputValues[i] = 0.0f;
-                    fUI.parameterChanged(i, fPlugin.getParameterValue(i));
-                }
+                if (plugin.isParameterOutput(i))
+                    fOutputParameters[fOutputParameterCount++] = i;
             }
         }
-        else
+
         {
-            fLastOutputValues = nullptr;
+            d_string clientName;
+
+            if (const char* const name = jack_get_client_name(fClient))
+                clientName = name;
+            else
+                clientName = plugin.getName();
+
+            for (uint32_t i=0; i < fInstanceCount; ++i)
+            {
+                d_string title(clientName);
+
+                if (fInstanceCount > 1)
+                    title.appendFormat(" (%u)", i+1);
+
+                fEditors[i] = new PluginJackEditor(fInstances[i], title);
+            }
         }
 
+        if (fInstanceCount > 1 && workerCount > 0)
+            fProcessPool = new PluginJackProcessPool(fClient, workerCount, processInstanceCallback, this);
+
+        if (pipelined)
+            startPipeline();
+
         jack_set_buffer_size_callback(fClient, jackBufferSizeCallback, this);
+        jack_set_freewheel_callback(fClient, jackFreewheelCallback, this);
         jack_set_sample_rate_callback(fClient, jackSampleRateCallback, this);
         jack_set_process_callback(fClient, jackProcessCallback, this);
         jack_on_shutdown(fClient, jackShutdownCallback, this);
 
         jack_activate(fClient);
-
-        if (const char* const name = jack_get_client_name(fClient))
-            fUI.setWindowTitle(name);
-        else
-            fUI.setWindowTitle(fPlugin.getName());
     }
 
     ~PluginJack()
     {
-        if (fClient == nullptr)
-            return;
+        if (fClient != nullptr)
+            jack_deactivate(fClient);
 
-        jack_deactivate(fClient);
-
-#if DISTRHO_PLUGIN_IS_SYNTH
-        jack_port_unregister(fClient, fPortMidiIn);
-        fPortMidiIn = nullptr;
-#endif
+        // the pipeline thread uses the process pool, stop it first
+        stopPipeline();
 
-#if DISTRHO_PLUGIN_NUM_INPUTS > 0
-        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+        if (fProcessPool != nullptr)
         {
-            jack_port_unregister(fClient, fPortAudioIns[i]);
-            fPortAudioIns[i] = nullptr;
+            delete fProcessPool;
+            fProcessPool = nullptr;
         }
-#endif
 
-#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
-        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            delete fEditors[i];
+
+        delete[] fEditors;
+
+        if (fOutputParameters != nullptr)
         {
-            jack_port_unregister(fClient, fPortAudioOuts[i]);
-            fPortAudioOuts[i] = nullptr;
+            delete[] fOutputParameters;
+            fOutputParameters = nullptr;
         }
-#endif
 
-        jack_client_close(fClient);
+        if (fClient != nullptr)
+        {
+            for (uint32_t i=0; i < fInstanceCount; ++i)
+                fInstances[i].unregisterPorts(fClient);
+
+            jack_client_close(fClient);
+        }
     }
 
     void exec()
     {
-        fUI.setWindowVisible(true);
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            fEditors[i]->show();
 
         for (; idle();) { d_msleep(30); }
     }
@@ -153,55 +1115,62 @@ public:
 protected:
     bool idle()
     {
-        float value;
-
-        for (uint32_t i=0, count=fPlugin.getParameterCount(); i < count; ++i)
+        if (fPipelined)
         {
-            if (! fPlugin.isParameterOutput(i))
-                continue;
+            const uint32_t overruns(fPipelineOverruns.load());
 
-            value = fPlugin.getParameterValue(i);
+            if (fPipelineReportedOverruns != overruns)
+            {
+                d_stderr("Pipeline thread missed %u JACK cycles", overruns - fPipelineReportedOverruns);
+                fPipelineReportedOverruns = overruns;
+            }
+        }
 
-            if (fLastOutputValues[i] == value)
-                continue;
+        // keep running while any window is open
+        bool running = false;
 
-            fLastOutputValues[i] = value;
-            fUI.parameterChanged(i, value);
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+        {
+            if (fEditors[i]->idle())
+                running = true;
         }
 
-        return fUI.idle();
+        return running;
     }
 
     void jackBufferSize(const jack_nframes_t nframes)
     {
-        fPlugin.setBufferSize(nframes, true);
+        if (fPipelined)
+        {
+            // wait for the pipeline thread to finish the cycle in progress, taking its idle token
+            for (; sem_wait(&fPipelineIdleSem) != 0;) {}
+
+            for (uint32_t i=0; i < fInstanceCount; ++i)
+                fInstances[i].allocPipelineBuffers(nframes);
+
+            fPipelineSide = 0;
+
+            sem_post(&fPipelineIdleSem);
+        }
+
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            fInstances[i].plugin.setBufferSize(nframes, true);
+    }
+
+    void jackFreewheel(const bool starting)
+    {
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            fInstances[i].plugin.setOffline(starting);
     }
 
     void jackSampleRate(const jack_nframes_t nframes)
     {
-        fPlugin.setSampleRate(nframes, true);
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            fInstances[i].plugin.setSampleRate(nframes, true);
     }
 
     void jackProcess(const jack_nframes_t nframes)
     {
-#if DISTRHO_PLUGIN_NUM_INPUTS > 0
-        const float* audioIns[DISTRHO_PLUGIN_NUM_INPUTS];
-
-        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
-            audioIns[i] = (const float*)jack_port_get_buffer(fPortAudioIns[i], nframes);
-#else
-        static const float** audioIns = nullptr;
-#endif
-
-#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
-        float* audioOuts[DISTRHO_PLUGIN_NUM_OUTPUTS];
-
-        for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
-            audioOuts[i] = (float*)jack_port_get_buffer(fPortAudioOuts[i], nframes);
-#else
-        static float** audioOuts = nullptr;
-#endif
-
 #if DISTRHO_PLUGIN_WANT_TIMEPOS
         jack_position_t pos;
         fTimePosition.playing = (jack_transport_query(fClient, &pos) == JackTransportRolling);
@@ -234,95 +1203,206 @@ protected:
             fTimePosition.frame = 0;
         }
 
-        fPlugin.setTimePosition(fTimePosition);
+        if (! fPipelined)
+        {
+            for (uint32_t i=0; i < fInstanceCount; ++i)
+                fInstances[i].plugin.setTimePosition(fTimePosition);
+        }
 #endif
 
-#if DISTRHO_PLUGIN_IS_SYNTH
-        void* const midiBuf = jack_port_get_buffer(fPortMidiIn, nframes);
+        if (fPipelined)
+            return jackProcessPipelined(nframes);
 
-        if (const uint32_t eventCount = jack_midi_get_event_count(midiBuf))
+        fCurrentFrames = nframes;
+
+        if (fProcessPool != nullptr)
+        {
+            fProcessPool->process(fInstanceCount);
+        }
+        else
         {
-            uint32_t  midiEventCount = 0;
-            MidiEvent midiEvents[eventCount];
+            for (uint32_t i=0; i < fInstanceCount; ++i)
+                fInstances[i].process(nframes);
+        }
 
-            jack_midi_event_t jevent;
+        notifyOutputParameters();
+    }
 
-            for (uint32_t i=0; i < eventCount; ++i)
-            {
-                if (jack_midi_event_get(&jevent, midiBuf, i) != 0)
-                    break;
+    void notifyOutputParameters() noexcept
+    {
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            fEditors[i]->notifyOutputParameters(fOutputParameters, fOutputParameterCount);
+    }
+
+    // Pipelined mode: exchange buffers with the pipeline thread, which processes them during the next period
+    void jackProcessPipelined(const jack_nframes_t nframes)
+    {
+        if (sem_trywait(&fPipelineIdleSem) != 0)
+        {
+            // still processing the previous period, there is nothing to output
+            for (uint32_t i=0; i < fInstanceCount; ++i)
+                fInstances[i].pipelineSilence(nframes);
 
-                MidiEvent& midiEvent(midiEvents[midiEventCount++]);
+            fPipelineOverruns.fetchAdd(1);
+            return;
+        }
 
-                midiEvent.frame = jevent.time;
-                midiEvent.size  = jevent.size;
+        const uint32_t nextSide(fPipelineSide ^ 1);
 
-                if (midiEvent.size > MidiEvent::kDataSize)
-                    midiEvent.dataExt = jevent.buffer;
-                else
-                    std::memcpy(midiEvent.data, jevent.buffer, midiEvent.size);
-            }
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            fInstances[i].pipelineExchange(fPipelineSide, nextSide, nframes);
 
-            fPlugin.run(audioIns, audioOuts, nframes, midiEvents, midiEventCount);
-        }
-        else
-        {
-            fPlugin.run(audioIns, audioOuts, nframes, nullptr, 0);
-        }
-#else
-        fPlugin.run(audioIns, audioOuts, nframes);
+#if DISTRHO_PLUGIN_WANT_TIMEPOS
+        fPipelineTimePosition = fTimePosition;
 #endif
+
+        fPipelineSide   = nextSide;
+        fPipelineFrames = nframes;
+
+        sem_post(&fPipelineSem);
+    }
+
+    void jackLatency(const jack_latency_callback_mode_t mode)
+    {
+        const jack_nframes_t extra(jack_get_buffer_size(fClient));
+
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            fInstances[i].updateLatency(mode, extra);
     }
 
     void jackShutdown()
     {
         d_stderr("jack has shutdown, quitting now...");
         fClient = nullptr;
-        fUI.quit();
+
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            fEditors[i]->quit();
     }
 
     // -------------------------------------------------------------------
+    // Pipelined mode
 
-    void setParameterValue(const uint32_t index, const float value)
+    void startPipeline()
     {
-        fPlugin.setParameterValue(index, value);
+        const jack_nframes_t bufferSize(jack_get_buffer_size(fClient));
+
+        for (uint32_t i=0; i < fInstanceCount; ++i)
+            fInstances[i].allocPipelineBuffers(bufferSize);
+
+        sem_init(&fPipelineSem, 0, 0);
+        sem_init(&fPipelineIdleSem, 0, 1);
+
+        if (jack_client_create_thread(fClient, &fPipelineThread, jack_client_real_time_priority(fClient),
+                                      jack_is_realtime(fClient), pipelineThreadEntryPoint, this) != 0)
+        {
+            d_stderr("Failed to create pipeline thread, using regular processing");
+            sem_destroy(&fPipelineSem);
+            sem_destroy(&fPipelineIdleSem);
+
+            for (uint32_t i=0; i < fInstanceCount; ++i)
+                fInstances[i].freePipelineBuffers();
+            return;
+        }
+
+        fPipelined = true;
+
+        jack_set_latency_callback(fClient, jackLatencyCallback, this);
     }
 
-#if DISTRHO_PLUGIN_WANT_STATE
-    void setState(const char* const key, const char* const value)
+    void stopPipeline()
     {
-        fPlugin.setState(key, value);
+        if (! fPipelined)
+            return;
+
+        fPipelineShouldExit.store(true);
+        sem_post(&fPipelineSem);
+        pthread_join(fPipelineThread, nullptr);
+        sem_destroy(&fPipelineSem);
+        sem_destroy(&fPipelineIdleSem);
+
+        fPipelined = false;
     }
-#endif
 
-    void setSize(const uint width, const uint height)
+    void pipelineRun()
     {
-        fUI.setWindowSize(width, height);
+        for (;;)
+        {
+            sem_wait(&fPipelineSem);
+
+            if (fPipelineShouldExit.load())
+                break;
+
+#if DISTRHO_PLUGIN_WANT_TIMEPOS
+            for (uint32_t i=0; i < fInstanceCount; ++i)
+                fInstances[i].plugin.setTimePosition(fPipelineTimePosition);
+#endif
+
+            fCurrentFrames = fPipelineFrames;
+
+            if (fProcessPool != nullptr)
+            {
+                fProcessPool->process(fInstanceCount);
+            }
+            else
+            {
+                for (uint32_t i=0; i < fInstanceCount; ++i)
+                    fInstances[i].pipelineProcess(fPipelineSide, fCurrentFrames);
+            }
+
+            notifyOutputParameters();
+
+            sem_post(&fPipelineIdleSem);
+        }
     }
 
     // -------------------------------------------------------------------
 
 private:
-    PluginExporter fPlugin;
-    UIExporter     fUI;
+    // owns the instances, declared first so they get destroyed after the editors
+    struct InstanceList {
+        PluginJackInstance* const instances;
+
+        InstanceList(const uint32_t count)
+            : instances(new PluginJackInstance[count]) {}
+
+        ~InstanceList()
+        {
+            delete[] instances;
+        }
+
+        DISTRHO_DECLARE_NON_COPY_STRUCT(InstanceList)
+    };
+
+    const uint32_t            fInstanceCount;
+    InstanceList              fInstanceList;
+    PluginJackInstance* const fInstances;
+    PluginJackEditor** const  fEditors;
 
     jack_client_t* fClient;
+    PluginJackProcessPool* fProcessPool;
 
-#if DISTRHO_PLUGIN_NUM_INPUTS > 0
-    jack_port_t* fPortAudioIns[DISTRHO_PLUGIN_NUM_INPUTS];
-#endif
-#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
-    jack_port_t* fPortAudioOuts[DISTRHO_PLUGIN_NUM_OUTPUTS];
-#endif
-#if DISTRHO_PLUGIN_IS_SYNTH
-    jack_port_t* fPortMidiIn;
-#endif
 #if DISTRHO_PLUGIN_WANT_TIMEPOS
     TimePosition fTimePosition;
 #endif
 
+    // Pipelined mode
+    bool fPipelined;
+    Atomic<bool> fPipelineShouldExit;
+    uint32_t fPipelineSide;
+    jack_nframes_t fPipelineFrames;
+    Atomic<uint32_t> fPipelineOverruns;
+    uint32_t fPipelineReportedOverruns;
+    jack_native_thread_t fPipelineThread;
+    sem_t fPipelineSem;     // posted by the JACK thread to start a cycle
+    sem_t fPipelineIdleSem; // holds one token while the pipeline thread is idle
+#if DISTRHO_PLUGIN_WANT_TIMEPOS
+    TimePosition fPipelineTimePosition;
+#endif
+
     // Temporary data
-    float* fLastOutputValues;
+    jack_nframes_t fCurrentFrames;
+    uint32_t  fOutputParameterCount;
+    uint32_t* fOutputParameters;
 
     // -------------------------------------------------------------------
     // Callbacks
@@ -335,6 +1415,11 @@ private:
         return 0;
     }
 
+    static void jackFreewheelCallback(int starting, void* ptr)
+    {
+        uiPtr->jackFreewheel(starting != 0);
+    }
+
     static int jackSampleRateCallback(jack_nframes_t nframes, void* ptr)
     {
         uiPtr->jackSampleRate(nframes);
@@ -347,26 +1432,28 @@ private:
         return 0;
     }
 
-    static void jackShutdownCallback(void* ptr)
+    static void jackLatencyCallback(jack_latency_callback_mode_t mode, void* ptr)
     {
-        uiPtr->jackShutdown();
+        uiPtr->jackLatency(mode);
     }
 
-    static void setParameterValueCallback(void* ptr, uint32_t index, float value)
+    static void jackShutdownCallback(void* ptr)
     {
-        uiPtr->setParameterValue(index, value);
+        uiPtr->jackShutdown();
     }
 
-#if DISTRHO_PLUGIN_WANT_STATE
-    static void setStateCallback(void* ptr, const char* key, const char* value)
+    static void* pipelineThreadEntryPoint(void* ptr)
     {
-        uiPtr->setState(key, value);
+        uiPtr->pipelineRun();
+        return nullptr;
     }
-#endif
 
-    static void setSizeCallback(void* ptr, uint width, uint height)
+    static void processInstanceCallback(void* ptr, uint32_t index)
     {
-        uiPtr->setSize(width, height);
+        if (uiPtr->fPipelined)
+            uiPtr->fInstances[index].pipelineProcess(uiPtr->fPipelineSide, uiPtr->fCurrentFrames);
+        else
+            uiPtr->fInstances[index].process(uiPtr->fCurrentFrames);
     }
 
     #undef uiPtr
@@ -376,10 +1463,79 @@ END_NAMESPACE_DISTRHO
 
 // -----------------------------------------------------------------------
 
-int main()
+static void printUsage(const char* const argv0)
+{
+    d_stdout("Usage: %s [-n instances] [-t threads] [-p]", argv0);
+    d_stdout("  -n instances  number of plugin instances to run inside this client (default 1),");
+    d_stdout("                each one has its own parameters, state, ports and window");
+    d_stdout("  -t threads    number of extra real-time threads used to process the instances in parallel");
+    d_stdout("                (default: one less than the number of instances, limited by the number of CPU cores)");
+    d_stdout("  -p            pipelined processing: run the plugin on its own real-time thread one period behind JACK,");
+    d_stdout("                giving it nearly a full period of compute time at the cost of one period of extra latency");
+#if DISTRHO_PLUGIN_WANT_BYPASS
+    d_stdout("Bypass follows the bypass-cv input port, a value above 0.5 bypasses the plugin.");
+#endif
+}
+
+int main(int argc, char* argv[])
 {
     USE_NAMESPACE_DISTRHO;
 
+    uint32_t instanceCount = 1;
+    int      workerCount   = -1;
+    bool     pipelined     = false;
+
+    for (int i=1; i < argc; ++i)
+    {
+        const char* const arg(argv[i]);
+
+        if (std::strcmp(arg, "-n") == 0 && i+1 < argc)
+        {
+            const int value(std::atoi(argv[++i]));
+
+            if (value < 1 || value > static_cast<int>(kMaxJackInstances))
+            {
+                d_stderr("Invalid number of instances '%s', must be between 1 and %i", argv[i], kMaxJackInstances);
+                return 1;
+            }
+
+            instanceCount = static_cast<uint32_t>(value);
+        }
+        else if (std::strcmp(arg, "-p") == 0)
+        {
+            pipelined = true;
+        }
+        else if (std::strcmp(arg, "-t") == 0 && i+1 < argc)
+        {
+            workerCount = std::atoi(argv[++i]);
+
+            if (workerCount < 0 || workerCount > static_cast<int>(kMaxJackWorkers))
+            {
+                d_stderr("Invalid number of threads '%s', must be between 0 and %i", argv[i], kMaxJackWorkers);
+                return 1;
+            }
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return (std::strcmp(arg, "-h") == 0 || std::strcmp(arg, "--help") == 0) ? 0 : 1;
+        }
+    }
+
+    if (workerCount < 0)
+    {
+        // the JACK process thread also takes part in the processing
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (cores < 1)
+            cores = 1;
+
+        workerCount = static_cast<int>(std::min<long>(instanceCount, cores)) - 1;
+
+        if (workerCount > static_cast<int>(kMaxJackWorkers))
+            workerCount = kMaxJackWorkers;
+    }
+
     jack_status_t  status = jack_status_t(0x0);
     jack_client_t* client = jack_client_open(DISTRHO_PLUGIN_NAME, JackNoStartServer, &status);
 
@@ -431,7 +1587,7 @@ int main()
     d_lastSampleRate = jack_get_sample_rate(client);
     d_lastUiSampleRate = d_lastSampleRate;
 
-    PluginJack p(client);
+    PluginJack p(client, instanceCount, static_cast<uint32_t>(workerCount), pipelined);
     p.exec();
 
     return 0;
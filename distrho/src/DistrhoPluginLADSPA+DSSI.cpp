@@ -22,6 +22,12 @@
 
 #ifdef DISTRHO_PLUGIN_TARGET_DSSI
 # include "dssi/dssi.h"
+# include "DistrhoDSSIShm.hpp"
+# include "DistrhoDSSIState.hpp"
+# if DISTRHO_DSSI_USE_SHM
+#  include "../extra/d_sleep.hpp"
+# endif
+# define DISTRHO_DSSI_USE_CONFIGURE (DISTRHO_PLUGIN_WANT_STATE || DISTRHO_DSSI_USE_SHM)
 #else
 # include "ladspa/ladspa.h"
 # if DISTRHO_PLUGIN_HAS_MIDI_INPUT
@@ -81,6 +87,12 @@ public:
 #if DISTRHO_PLUGIN_WANT_LATENCY
         fPortLatency = nullptr;
 #endif
+
+#if defined(DISTRHO_PLUGIN_TARGET_DSSI) && DISTRHO_DSSI_USE_SHM
+        fShm = nullptr;
+        fShmData = nullptr;
+        fShmInUse = 0;
+#endif
     }
 
     ~PluginLadspaDssi() noexcept
@@ -96,6 +108,14 @@ public:
             delete[] fLastControlValues;
             fLastControlValues = nullptr;
         }
+
+#if defined(DISTRHO_PLUGIN_TARGET_DSSI) && DISTRHO_DSSI_USE_SHM
+        if (fShm != nullptr)
+        {
+            delete fShm;
+            fShm = nullptr;
+        }
+#endif
     }
 
     // -------------------------------------------------------------------
@@ -271,6 +291,10 @@ public:
 
         updateParameterOutputs();
 
+#if defined(DISTRHO_PLUGIN_TARGET_DSSI) && DISTRHO_PLUGIN_WANT_UI_STREAM
+        writeShmStream();
+#endif
+
 #if defined(DISTRHO_PLUGIN_TARGET_DSSI) && ! DISTRHO_PLUGIN_HAS_MIDI_INPUT
         return; // unused
         (void)events; (void)eventCount;
@@ -280,15 +304,27 @@ public:
     // -------------------------------------------------------------------
 
 #ifdef DISTRHO_PLUGIN_TARGET_DSSI
-# if DISTRHO_PLUGIN_WANT_STATE
+# if DISTRHO_DSSI_USE_CONFIGURE
     char* dssi_configure(const char* const key, const char* const value)
     {
-        if (std::strncmp(key, DSSI_RESERVED_CONFIGURE_PREFIX, std::strlen(DSSI_RESERVED_CONFIGURE_PREFIX) == 0))
+        if (std::strncmp(key, DSSI_RESERVED_CONFIGURE_PREFIX, std::strlen(DSSI_RESERVED_CONFIGURE_PREFIX)) == 0)
             return nullptr;
-        if (std::strncmp(key, DSSI_GLOBAL_CONFIGURE_PREFIX, std::strlen(DSSI_GLOBAL_CONFIGURE_PREFIX) == 0))
+        if (std::strncmp(key, DSSI_GLOBAL_CONFIGURE_PREFIX, std::strlen(DSSI_GLOBAL_CONFIGURE_PREFIX)) == 0)
             return nullptr;
 
-        fPlugin.setState(key, value);
+        if (std::strcmp(key, DISTRHO_DSSI_SHM_CONFIGURE_KEY) == 0)
+        {
+#  if DISTRHO_DSSI_USE_SHM
+            attachShm(value);
+#  endif
+            return nullptr;
+        }
+
+#  if DISTRHO_PLUGIN_WANT_STATE
+        // big values arrive in chunks, see DistrhoDSSIState.hpp
+        if (fStateReceiver.receive(key, value))
+            fPlugin.setState(fStateReceiver.getKey(), fStateReceiver.getValue());
+#  endif
         return nullptr;
     }
 # endif
@@ -316,13 +352,17 @@ public:
 
         fPlugin.setProgram(realProgram);
 
+        // With a program table the plugin only ramps to these values in the next run(),
+        // report the targets instead of asking the plugin for every parameter.
+        const float* const programValues(fPlugin.getProgramValues(realProgram));
+
         // Update control inputs
         for (uint32_t i=0, count=fPlugin.getParameterCount(); i < count; ++i)
         {
             if (fPlugin.isParameterOutput(i))
                 continue;
 
-            fLastControlValues[i] = fPlugin.getParameterValue(i);
+            fLastControlValues[i] = (programValues != nullptr) ? programValues[i] : fPlugin.getParameterValue(i);
 
             if (fPortControls[i] != nullptr)
                 *fPortControls[i] = fLastControlValues[i];
@@ -355,6 +395,20 @@ private:
     // Temporary data
     LADSPA_Data* fLastControlValues;
 
+#if defined(DISTRHO_PLUGIN_TARGET_DSSI) && DISTRHO_PLUGIN_WANT_STATE
+    DssiStateReceiver fStateReceiver;
+#endif
+
+#if defined(DISTRHO_PLUGIN_TARGET_DSSI) && DISTRHO_DSSI_USE_SHM
+    // Shared memory with the UI, see DistrhoDSSIShm.hpp
+    DssiShm* fShm;
+    DssiShmData* fShmData; // read by the audio thread
+    int fShmInUse;         // set by the audio thread while using fShmData
+# if DISTRHO_PLUGIN_WANT_UI_STREAM
+    float fShmStreamBuffer[kDssiShmStreamChunk];
+# endif
+#endif
+
     // -------------------------------------------------------------------
 
     void updateParameterOutputs()
@@ -375,6 +429,65 @@ private:
             *fPortLatency = fPlugin.getLatency();
 #endif
     }
+
+#if defined(DISTRHO_PLUGIN_TARGET_DSSI) && DISTRHO_DSSI_USE_SHM
+    // called from configure(), an empty name detaches
+    void attachShm(const char* const name)
+    {
+        DssiShm* newShm = nullptr;
+
+        if (name[0] != '\0')
+        {
+            newShm = new DssiShm();
+
+            // stale or foreign names are ignored, keep the current segment
+            if (! newShm->attach(name))
+            {
+                delete newShm;
+                return;
+            }
+        }
+
+        DssiShm* const oldShm(fShm);
+        fShm = newShm;
+        __atomic_store_n(&fShmData, (newShm != nullptr) ? newShm->getData() : nullptr, __ATOMIC_SEQ_CST);
+
+        // the audio thread might still be writing into the old segment
+        while (__atomic_load_n(&fShmInUse, __ATOMIC_SEQ_CST) != 0)
+            d_msleep(1);
+
+        if (oldShm != nullptr)
+            delete oldShm;
+    }
+
+# if DISTRHO_PLUGIN_WANT_UI_STREAM
+    // moves this cycle's stream data into the segment, dropping it when the UI is not there or too slow
+    void writeShmStream() noexcept
+    {
+        RingBuffer<float>* const stream(fPlugin.getUIStream());
+
+        if (stream == nullptr)
+            return;
+
+        __atomic_store_n(&fShmInUse, 1, __ATOMIC_SEQ_CST);
+
+        if (DssiShmData* const shmData = __atomic_load_n(&fShmData, __ATOMIC_SEQ_CST))
+        {
+            for (uint32_t count; (count = stream->read(fShmStreamBuffer, kDssiShmStreamChunk)) != 0;)
+            {
+                if (! shmData->dspToUi.writeMessage(kDssiShmMessageStream, fShmStreamBuffer, count*sizeof(float)))
+                    break;
+            }
+        }
+        else
+        {
+            stream->clear();
+        }
+
+        __atomic_store_n(&fShmInUse, 0, __ATOMIC_RELEASE);
+    }
+# endif
+#endif
 };
 
 // -----------------------------------------------------------------------
@@ -416,7 +529,7 @@ static void ladspa_cleanup(LADSPA_Handle instance)
 }
 
 #ifdef DISTRHO_PLUGIN_TARGET_DSSI
-# if DISTRHO_PLUGIN_WANT_STATE
+# if DISTRHO_DSSI_USE_CONFIGURE
 static char* dssi_configure(LADSPA_Handle instance, const char* key, const char* value)
 {
     return instancePtr->dssi_configure(key, value);
@@ -477,7 +590,7 @@ static LADSPA_Descriptor sLadspaDescriptor = {
 static DSSI_Descriptor sDssiDescriptor = {
     1,
     &sLadspaDescriptor,
-# if DISTRHO_PLUGIN_WANT_STATE
+# if DISTRHO_DSSI_USE_CONFIGURE
     dssi_configure,
 # else
     /* configure                    */ nullptr,
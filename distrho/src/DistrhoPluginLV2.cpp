@@ -15,6 +15,9 @@
  */
 
 #include "DistrhoPluginInternal.hpp"
+#include "DistrhoLV2State.hpp"
+
+#include "../extra/d_mutex.hpp"
 
 #include "lv2/atom.h"
 #include "lv2/atom-util.h"
@@ -46,6 +49,16 @@
 
 #define DISTRHO_LV2_USE_EVENTS_IN  (DISTRHO_PLUGIN_HAS_MIDI_INPUT || DISTRHO_PLUGIN_WANT_TIMEPOS || (DISTRHO_PLUGIN_WANT_STATE && DISTRHO_PLUGIN_HAS_UI))
 #define DISTRHO_LV2_USE_EVENTS_OUT (DISTRHO_PLUGIN_HAS_MIDI_OUTPUT || (DISTRHO_PLUGIN_WANT_STATE && DISTRHO_PLUGIN_HAS_UI))
+#define DISTRHO_LV2_USE_UI_STREAM_PORT (DISTRHO_PLUGIN_WANT_UI_STREAM && DISTRHO_PLUGIN_HAS_UI && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS)
+#define DISTRHO_LV2_USE_WORKER (DISTRHO_PLUGIN_WANT_STATE || DISTRHO_PLUGIN_WANT_WORKER)
+
+// first byte of plugin jobs sent through the LV2 worker, never valid in UTF-8 state messages
+#define DISTRHO_LV2_WORKER_JOB_BYTE 0xff
+
+// not in our copy of buf-size.h yet
+#ifndef LV2_BUF_SIZE__nominalBlockLength
+# define LV2_BUF_SIZE__nominalBlockLength LV2_BUF_SIZE_PREFIX "nominalBlockLength"
+#endif
 
 START_NAMESPACE_DISTRHO
 
@@ -56,19 +69,22 @@ typedef std::map<const d_string,d_string> StringMap;
 class PluginLv2
 {
 public:
-    PluginLv2(const double sampleRate, const LV2_URID_Map* const uridMap, const LV2_Worker_Schedule* const worker)
+    PluginLv2(const double sampleRate, const LV2_URID_Map* const uridMap, const LV2_Worker_Schedule* const worker, const LV2_Options_Option* const options)
         : fPortControls(nullptr),
           fLastControlValues(nullptr),
           fSampleRate(sampleRate),
-#if DISTRHO_LV2_USE_EVENTS_IN || DISTRHO_LV2_USE_EVENTS_OUT
-# if DISTRHO_PLUGIN_WANT_TIMEPOS
+#if DISTRHO_PLUGIN_WANT_TIMEPOS
           fLastTimeSpeed(0.0),
-# endif
-          fURIDs(uridMap),
 #endif
+          fURIDs(uridMap),
           fUridMap(uridMap),
           fWorker(worker)
     {
+        fOptions.minBlockLength     = 0;
+        fOptions.maxBlockLength     = static_cast<int32_t>(d_lastBufferSize);
+        fOptions.nominalBlockLength = 0;
+        fOptions.sequenceSize       = 0;
+
 #if DISTRHO_PLUGIN_NUM_INPUTS > 0
         for (uint32_t i=0; i < DISTRHO_PLUGIN_NUM_INPUTS; ++i)
             fPortAudioIns[i] = nullptr;
@@ -109,11 +125,24 @@ public:
 #if DISTRHO_PLUGIN_WANT_LATENCY
         fPortLatency = nullptr;
 #endif
+        fPortFreewheel = nullptr;
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        fPortEnabled = nullptr;
+#endif
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+        fPortUIStream = nullptr;
+#endif
 
 #if DISTRHO_PLUGIN_WANT_STATE
         if (const uint32_t count = fPlugin.getStateCount())
         {
             fNeededUiSends = new bool[count];
+# if DISTRHO_PLUGIN_HAS_UI
+            fStateUiValues  = new StateUiValue*[count];
+            fStateUiPending = new Atomic<StateUiValue*>[count];
+            fStateUiRetired = new Atomic<StateUiValue*>[count];
+            fStateUiNotify  = new Atomic<bool>[count];
+# endif
 
             for (uint32_t i=0; i < count; ++i)
             {
@@ -121,13 +150,37 @@ public:
 
                 const d_string& d_key(fPlugin.getStateKey(i));
                 fStateMap[d_key] = fPlugin.getStateDefaultValue(i);
+# if DISTRHO_PLUGIN_HAS_UI
+                fStateUiValues[i] = new StateUiValue(fPlugin.getStateDefaultValue(i));
+# endif
             }
         }
         else
         {
             fNeededUiSends = nullptr;
+# if DISTRHO_PLUGIN_HAS_UI
+            fStateUiValues  = nullptr;
+            fStateUiPending = nullptr;
+            fStateUiRetired = nullptr;
+            fStateUiNotify  = nullptr;
+# endif
         }
-#else
+# if DISTRHO_PLUGIN_HAS_UI
+        fStateSendIndex  = kNoStateSend;
+        fStateSendOffset = 0;
+# endif
+#endif
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+        fWorkRespond       = nullptr;
+        fWorkRespondHandle = nullptr;
+
+        // hosts without worker:schedule get the framework worker thread instead
+        if (fWorker != nullptr)
+            fPlugin.setHostWorker(this, _scheduleWork, _respondWork);
+#endif
+
+#if ! DISTRHO_LV2_USE_WORKER
         // unused
         (void)fWorker;
 #endif
@@ -144,6 +197,8 @@ public:
         fTimePosition.bbt.ticksPerBeat = 960.0;
         fTimePosition.bbt.beatsPerMinute = 120.0;
 #endif
+
+        lv2_set_options(options);
     }
 
     ~PluginLv2()
@@ -167,6 +222,27 @@ public:
             fNeededUiSends = nullptr;
         }
 
+# if DISTRHO_PLUGIN_HAS_UI
+        if (fStateUiValues != nullptr)
+        {
+            for (uint32_t i=0, count=fPlugin.getStateCount(); i < count; ++i)
+            {
+                delete fStateUiValues[i];
+                delete fStateUiPending[i].exchange(nullptr);
+                deleteStateUiValues(fStateUiRetired[i].exchange(nullptr));
+            }
+
+            delete[] fStateUiValues;
+            delete[] fStateUiPending;
+            delete[] fStateUiRetired;
+            delete[] fStateUiNotify;
+            fStateUiValues  = nullptr;
+            fStateUiPending = nullptr;
+            fStateUiRetired = nullptr;
+            fStateUiNotify  = nullptr;
+        }
+# endif
+
         fStateMap.clear();
 #endif
     }
@@ -243,6 +319,29 @@ public:
                 return;
             }
         }
+
+        // framework ports go after the parameters, so their indexes never change
+        if (port == index++)
+        {
+            fPortFreewheel = (const float*)dataLocation;
+            return;
+        }
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        if (port == index++)
+        {
+            fPortEnabled = (const float*)dataLocation;
+            return;
+        }
+#endif
+
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+        if (port == index++)
+        {
+            fPortUIStream = (LV2_Atom_Sequence*)dataLocation;
+            return;
+        }
+#endif
     }
 
     // -------------------------------------------------------------------
@@ -253,6 +352,15 @@ public:
         if (sampleCount == 0)
             return updateParameterOutputs();
 
+        // Check for freewheel mode
+        if (fPortFreewheel != nullptr)
+            fPlugin.setOffline(*fPortFreewheel > 0.5f);
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        if (fPortEnabled != nullptr)
+            fPlugin.setBypassed(*fPortEnabled < 0.5f);
+#endif
+
         // Check for updated parameters
         float curValue;
 
@@ -261,6 +369,10 @@ public:
             if (fPortControls[i] == nullptr)
                 continue;
 
+            // CV ports are sample buffers, the first value is used as the block-rate one
+            if (fPlugin.isParameterCV(i))
+                fPlugin.setParameterCV(i, fPortControls[i]);
+
             curValue = *fPortControls[i];
 
             if (fLastControlValues[i] != curValue && ! fPlugin.isParameterOutput(i))
@@ -460,6 +572,10 @@ public:
                 {
                     for (uint32_t i=0, count=fPlugin.getStateCount(); i < count; ++i)
                         fNeededUiSends[i] = true;
+
+                    // a new UI can't resume an old transfer
+                    fStateSendIndex  = kNoStateSend;
+                    fStateSendOffset = 0;
                 }
                 else
                 // no, send to DSP as usual
@@ -522,119 +638,143 @@ public:
 
         updateParameterOutputs();
 
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+        writeUIStream();
+#endif
+
 #if DISTRHO_LV2_USE_EVENTS_OUT
+        if (fPortEventsOut == nullptr)
+            return;
+
         const uint32_t capacity = fPortEventsOut->atom.size;
 
-        bool needsInit = true;
-        uint32_t size, offset = 0;
-        LV2_Atom_Event* aev;
+        fPortEventsOut->atom.size = sizeof(LV2_Atom_Sequence_Body);
+        fPortEventsOut->atom.type = fURIDs.atomSequence;
+        fPortEventsOut->body.unit = 0;
+        fPortEventsOut->body.pad  = 0;
 
 # if DISTRHO_PLUGIN_HAS_MIDI_OUTPUT
         // TODO
 # endif
 # if (DISTRHO_PLUGIN_WANT_STATE && DISTRHO_PLUGIN_HAS_UI)
-        for (uint32_t i=0, count=fPlugin.getStateCount(); i < count; ++i)
-        {
-            if (! fNeededUiSends[i])
-                continue;
-
-            const d_string& key = fPlugin.getStateKey(i);
-
-            for (StringMap::const_iterator cit=fStateMap.begin(), cite=fStateMap.end(); cit != cite; ++cit)
-            {
-                const d_string& curKey = cit->first;
-
-                if (curKey != key)
-                    continue;
-
-                const d_string& value = cit->second;
-
-                // set msg size (key + value + separator + 2x null terminator)
-                const size_t msgSize(key.length()+value.length()+3);
-
-                if (sizeof(LV2_Atom_Event) + msgSize > capacity - offset)
-                    break;
+        writeStatesToUI(capacity);
+# endif
+#endif
+    }
 
-                if (needsInit)
-                {
-                    fPortEventsOut->atom.size = 0;
-                    fPortEventsOut->atom.type = fURIDs.atomSequence;
-                    fPortEventsOut->body.unit = 0;
-                    fPortEventsOut->body.pad  = 0;
-                    needsInit = false;
-                }
+    // -------------------------------------------------------------------
 
-                // reserve msg space
-                char msgBuf[msgSize];
-                std::memset(msgBuf, 0, msgSize);
+    uint32_t lv2_get_options(LV2_Options_Option* const options)
+    {
+        uint32_t status = LV2_OPTIONS_SUCCESS;
 
-                // write key and value in atom bufer
-                std::memcpy(msgBuf, key.buffer(), key.length());
-                std::memcpy(msgBuf+(key.length()+1), value.buffer(), value.length());
+        for (int i=0; options[i].key != 0; ++i)
+        {
+            LV2_Options_Option& option(options[i]);
 
-                // put data
-                aev = (LV2_Atom_Event*)(LV2_ATOM_CONTENTS(LV2_Atom_Sequence, fPortEventsOut) + offset);
-                aev->time.frames = 0;
-                aev->body.type   = fURIDs.distrhoState;
-                aev->body.size   = msgSize;
-                std::memcpy(LV2_ATOM_BODY(&aev->body), msgBuf, msgSize-1);
+            if (option.context != LV2_OPTIONS_INSTANCE)
+            {
+                status |= LV2_OPTIONS_ERR_BAD_SUBJECT;
+                continue;
+            }
 
-                size    = lv2_atom_pad_size(sizeof(LV2_Atom_Event) + msgSize);
-                offset += size;
-                fPortEventsOut->atom.size += size;
+            const int32_t* value = nullptr;
+
+            if (option.key == fURIDs.bufSizeMaxBlockLength)
+                value = &fOptions.maxBlockLength;
+            else if (option.key == fURIDs.bufSizeMinBlockLength)
+                value = &fOptions.minBlockLength;
+            else if (option.key == fURIDs.bufSizeNominalBlockLength)
+                value = &fOptions.nominalBlockLength;
+            else if (option.key == fURIDs.bufSizeSequenceSize)
+                value = &fOptions.sequenceSize;
+            else if (option.key == fURIDs.coreSampleRate)
+            {
+                option.size  = sizeof(double);
+                option.type  = fURIDs.atomDouble;
+                option.value = &fSampleRate;
+                continue;
+            }
 
-                fNeededUiSends[i] = false;
-                break;
+            // unknown, or never told by the host
+            if (value == nullptr || *value == 0)
+            {
+                status |= LV2_OPTIONS_ERR_BAD_KEY;
+                continue;
             }
-        }
-# endif
-#endif
-    }
 
-    // -------------------------------------------------------------------
+            option.size  = sizeof(int32_t);
+            option.type  = fURIDs.atomInt;
+            option.value = value;
+        }
 
-    uint32_t lv2_get_options(LV2_Options_Option* const /*options*/)
-    {
-        // currently unused
-        return LV2_OPTIONS_ERR_UNKNOWN;
+        return status;
     }
 
     uint32_t lv2_set_options(const LV2_Options_Option* const options)
     {
+        uint32_t status = LV2_OPTIONS_SUCCESS;
+
         for (int i=0; options[i].key != 0; ++i)
         {
-            if (options[i].key == fUridMap->map(fUridMap->handle, LV2_BUF_SIZE__maxBlockLength))
+            const LV2_Options_Option& option(options[i]);
+
+            if (option.key == fURIDs.coreSampleRate)
             {
-                if (options[i].type == fUridMap->map(fUridMap->handle, LV2_ATOM__Int))
-                {
-                    const int bufferSize(*(const int*)options[i].value);
-                    fPlugin.setBufferSize(bufferSize);
-                    continue;
-                }
-                else
+                if (option.type != fURIDs.atomDouble)
                 {
-                    d_stderr("Host changed maxBlockLength but with wrong value type");
+                    d_stderr("Host changed sampleRate but with wrong value type");
+                    status |= LV2_OPTIONS_ERR_BAD_VALUE;
                     continue;
                 }
+
+                const double sampleRate(*(const double*)option.value);
+                fSampleRate = sampleRate;
+                fPlugin.setSampleRate(sampleRate, true);
+                continue;
             }
-            else if (options[i].key == fUridMap->map(fUridMap->handle, LV2_CORE__sampleRate))
+
+            int32_t* target;
+
+            if (option.key == fURIDs.bufSizeMaxBlockLength)
+                target = &fOptions.maxBlockLength;
+            else if (option.key == fURIDs.bufSizeMinBlockLength)
+                target = &fOptions.minBlockLength;
+            else if (option.key == fURIDs.bufSizeNominalBlockLength)
+                target = &fOptions.nominalBlockLength;
+            else if (option.key == fURIDs.bufSizeSequenceSize)
+                target = &fOptions.sequenceSize;
+            else
+                continue;
+
+            if (option.type != fURIDs.atomInt)
             {
-                if (options[i].type == fUridMap->map(fUridMap->handle, LV2_ATOM__Double))
-                {
-                    const double sampleRate(*(const double*)options[i].value);
-                    fSampleRate = sampleRate;
-                    fPlugin.setSampleRate(sampleRate);
-                    continue;
-                }
-                else
-                {
-                    d_stderr("Host changed sampleRate but with wrong value type");
-                    continue;
-                }
+                d_stderr("Host changed a block length option but with wrong value type");
+                status |= LV2_OPTIONS_ERR_BAD_VALUE;
+                continue;
+            }
+
+            const int32_t value(*(const int32_t*)option.value);
+
+            if (value < 0)
+            {
+                status |= LV2_OPTIONS_ERR_BAD_VALUE;
+                continue;
             }
+
+            *target = value;
+
+            if (target == &fOptions.maxBlockLength)
+                fPlugin.setBufferSize(static_cast<uint32_t>(value), true);
+            else if (target == &fOptions.minBlockLength)
+                fPlugin.setMinBufferSize(static_cast<uint32_t>(value));
+            else if (target == &fOptions.nominalBlockLength)
+                fPlugin.setNominalBufferSize(static_cast<uint32_t>(value));
+            else if (target == &fOptions.sequenceSize)
+                fPlugin.setSequenceSize(static_cast<uint32_t>(value));
         }
 
-        return LV2_OPTIONS_SUCCESS;
+        return status;
     }
 
     // -------------------------------------------------------------------
@@ -663,15 +803,20 @@ public:
 
         fPlugin.setProgram(realProgram);
 
+        // With a program table the plugin only ramps to these values in the next run(),
+        // report the targets instead of asking the plugin for every parameter.
+        const float* const programValues(fPlugin.getProgramValues(realProgram));
+
         // Update control inputs
         for (uint32_t i=0, count=fPlugin.getParameterCount(); i < count; ++i)
         {
             if (fPlugin.isParameterOutput(i))
                 continue;
 
-            fLastControlValues[i] = fPlugin.getParameterValue(i);
+            fLastControlValues[i] = (programValues != nullptr) ? programValues[i] : fPlugin.getParameterValue(i);
 
-            if (fPortControls[i] != nullptr)
+            // CV ports belong to the host
+            if (fPortControls[i] != nullptr && ! fPlugin.isParameterCV(i))
                 *fPortControls[i] = fLastControlValues[i];
         }
     }
@@ -682,12 +827,20 @@ public:
 #if DISTRHO_PLUGIN_WANT_STATE
     LV2_State_Status lv2_save(const LV2_State_Store_Function store, const LV2_State_Handle handle)
     {
+        // reused for every key, only reallocates for keys longer than the previous ones
+        d_string urnKey("urn:distrho:");
+        const std::size_t urnPrefixLen(urnKey.length());
+
+        // the worker might be changing a value
+        const MutexLocker cml(fStateMutex);
+
         for (StringMap::const_iterator cit=fStateMap.begin(), cite=fStateMap.end(); cit != cite; ++cit)
         {
             const d_string& key   = cit->first;
             const d_string& value = cit->second;
 
-            const d_string urnKey("urn:distrho:" + key);
+            urnKey.truncate(urnPrefixLen);
+            urnKey += key;
 
             // some hosts need +1 for the null terminator, even though the type is string
             store(handle, fUridMap->map(fUridMap->handle, urnKey.buffer()), value.buffer(), value.length()+1, fURIDs.atomString, LV2_STATE_IS_POD|LV2_STATE_IS_PORTABLE);
@@ -701,10 +854,15 @@ public:
         size_t   size;
         uint32_t type, flags;
 
+        d_string urnKey("urn:distrho:");
+        const std::size_t urnPrefixLen(urnKey.length());
+
         for (uint32_t i=0, count=fPlugin.getStateCount(); i < count; ++i)
         {
             const d_string& key(fPlugin.getStateKey(i));
-            const d_string urnKey("urn:distrho:" + key);
+
+            urnKey.truncate(urnPrefixLen);
+            urnKey += key;
 
             size  = 0;
             type  = 0;
@@ -720,12 +878,8 @@ public:
             const std::size_t length(std::strlen(value));
             DISTRHO_SAFE_ASSERT_CONTINUE(length == size || length+1 == size);
 
-            setState(key, value);
-
-#if DISTRHO_LV2_USE_EVENTS_OUT
             // signal msg needed for UI
-            fNeededUiSends[i] = true;
-#endif
+            setState(key, value, true);
         }
 
         return LV2_STATE_SUCCESS;
@@ -733,12 +887,70 @@ public:
 
     // -------------------------------------------------------------------
 
-    LV2_Worker_Status lv2_work(const void* const data)
+#endif
+
+    // -------------------------------------------------------------------
+
+#if DISTRHO_LV2_USE_WORKER
+    LV2_Worker_Status lv2_work(const LV2_Worker_Respond_Function respond, const LV2_Worker_Respond_Handle handle,
+                               const uint32_t size, const void* const data)
     {
+# if DISTRHO_PLUGIN_WANT_WORKER
+        // job scheduled by the plugin
+        if (size > 0 && ((const uint8_t*)data)[0] == DISTRHO_LV2_WORKER_JOB_BYTE)
+        {
+            fWorkRespond       = respond;
+            fWorkRespondHandle = handle;
+
+            fPlugin.work((const uint8_t*)data + 1, size - 1);
+
+            fWorkRespond       = nullptr;
+            fWorkRespondHandle = nullptr;
+
+            return LV2_WORKER_SUCCESS;
+        }
+# else
+        // unused
+        (void)respond;
+        (void)handle;
+# endif
+
+# if DISTRHO_PLUGIN_WANT_STATE
+#  if DISTRHO_PLUGIN_HAS_UI
+        // part of a big value from the UI, apply it once complete
+        if (Lv2StateChunkReceiver::isChunk(data, size))
+        {
+            if (fStateChunkReceiver.receive(data, size))
+                setState(fStateChunkReceiver.getKey(), fStateChunkReceiver.getValue());
+
+            return LV2_WORKER_SUCCESS;
+        }
+#  endif
+
         const char* const key((const char*)data);
         const char* const value(key+std::strlen(key)+1);
 
         setState(key, value);
+# endif
+
+        return LV2_WORKER_SUCCESS;
+
+        // might be unused
+        (void)size;
+    }
+#endif
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+    LV2_Worker_Status lv2_work_response(const uint32_t size, const void* const data)
+    {
+        fPlugin.workCompleted(data, size);
+
+        return LV2_WORKER_SUCCESS;
+    }
+
+    LV2_Worker_Status lv2_work_end_run()
+    {
+        fPlugin.workResponsesDone();
 
         return LV2_WORKER_SUCCESS;
     }
@@ -751,6 +963,20 @@ public:
     {
         return fPlugin.getInstancePointer();
     }
+
+# if DISTRHO_PLUGIN_WANT_UI_STREAM
+    void* lv2_get_ui_stream()
+    {
+        return fPlugin.getUIStream();
+    }
+# endif
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+    void* lv2_get_snapshot()
+    {
+        return fPlugin.getSnapshot();
+    }
 #endif
 
     // -------------------------------------------------------------------
@@ -779,6 +1005,13 @@ private:
 #if DISTRHO_PLUGIN_WANT_LATENCY
     float* fPortLatency;
 #endif
+    const float* fPortFreewheel;
+#if DISTRHO_PLUGIN_WANT_BYPASS
+    const float* fPortEnabled;
+#endif
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+    LV2_Atom_Sequence* fPortUIStream;
+#endif
 
     // Temporary data
     float* fLastControlValues;
@@ -791,8 +1024,7 @@ private:
     double       fLastTimeSpeed;
 #endif
 
-    // LV2 URIDs
-#if DISTRHO_LV2_USE_EVENTS_IN || DISTRHO_LV2_USE_EVENTS_OUT
+    // LV2 URIDs, mapped once
     struct URIDs {
         LV2_URID atomBlank;
         LV2_URID atomObject;
@@ -802,6 +1034,12 @@ private:
         LV2_URID atomLong;
         LV2_URID atomSequence;
         LV2_URID atomString;
+        LV2_URID atomVector;
+        LV2_URID bufSizeMaxBlockLength;
+        LV2_URID bufSizeMinBlockLength;
+        LV2_URID bufSizeNominalBlockLength;
+        LV2_URID bufSizeSequenceSize;
+        LV2_URID coreSampleRate;
         LV2_URID distrhoState;
         LV2_URID midiEvent;
         LV2_URID timePosition;
@@ -824,6 +1062,12 @@ private:
               atomLong(uridMap->map(uridMap->handle, LV2_ATOM__Long)),
               atomSequence(uridMap->map(uridMap->handle, LV2_ATOM__Sequence)),
               atomString(uridMap->map(uridMap->handle, LV2_ATOM__String)),
+              atomVector(uridMap->map(uridMap->handle, LV2_ATOM__Vector)),
+              bufSizeMaxBlockLength(uridMap->map(uridMap->handle, LV2_BUF_SIZE__maxBlockLength)),
+              bufSizeMinBlockLength(uridMap->map(uridMap->handle, LV2_BUF_SIZE__minBlockLength)),
+              bufSizeNominalBlockLength(uridMap->map(uridMap->handle, LV2_BUF_SIZE__nominalBlockLength)),
+              bufSizeSequenceSize(uridMap->map(uridMap->handle, LV2_BUF_SIZE__sequenceSize)),
+              coreSampleRate(uridMap->map(uridMap->handle, LV2_CORE__sampleRate)),
               distrhoState(uridMap->map(uridMap->handle, "urn:distrho:keyValueState")),
               midiEvent(uridMap->map(uridMap->handle, LV2_MIDI__MidiEvent)),
               timePosition(uridMap->map(uridMap->handle, LV2_TIME__Position)),
@@ -837,17 +1081,283 @@ private:
               timeFrame(uridMap->map(uridMap->handle, LV2_TIME__frame)),
               timeSpeed(uridMap->map(uridMap->handle, LV2_TIME__speed)) {}
     } fURIDs;
-#endif
 
     // LV2 features
     const LV2_URID_Map* const fUridMap;
     const LV2_Worker_Schedule* const fWorker;
 
+#if DISTRHO_PLUGIN_WANT_WORKER
+    // job being scheduled, with its DISTRHO_LV2_WORKER_JOB_BYTE prefix (audio thread)
+    uint8_t fWorkBuffer[1 + DISTRHO_PLUGIN_WORKER_MESSAGE_SIZE];
+
+    // valid while a plugin job runs in lv2_work() (worker thread)
+    LV2_Worker_Respond_Function fWorkRespond;
+    LV2_Worker_Respond_Handle   fWorkRespondHandle;
+
+    static bool _scheduleWork(void* const ptr, const void* const data, const uint32_t size)
+    {
+        PluginLv2* const self((PluginLv2*)ptr);
+
+        DISTRHO_SAFE_ASSERT_RETURN(data != nullptr || size == 0, false);
+        DISTRHO_SAFE_ASSERT_RETURN(size <= DISTRHO_PLUGIN_WORKER_MESSAGE_SIZE, false);
+
+        // the host copies the job, so the buffer can be reused right away
+        self->fWorkBuffer[0] = DISTRHO_LV2_WORKER_JOB_BYTE;
+
+        if (size > 0)
+            std::memcpy(self->fWorkBuffer + 1, data, size);
+
+        return self->fWorker->schedule_work(self->fWorker->handle, size + 1, self->fWorkBuffer) == LV2_WORKER_SUCCESS;
+    }
+
+    static bool _respondWork(void* const ptr, const void* const data, const uint32_t size)
+    {
+        PluginLv2* const self((PluginLv2*)ptr);
+
+        DISTRHO_SAFE_ASSERT_RETURN(self->fWorkRespond != nullptr, false);
+
+        return self->fWorkRespond(self->fWorkRespondHandle, size, data) == LV2_WORKER_SUCCESS;
+    }
+#endif
+
+    // values reported by lv2_get_options(), must stay valid after the call
+    struct Options {
+        int32_t minBlockLength;
+        int32_t maxBlockLength;
+        int32_t nominalBlockLength;
+        int32_t sequenceSize;
+    } fOptions;
+
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+    // drain the plugin UI stream into a single atom:Vector event, read directly from the ring
+    void writeUIStream()
+    {
+        if (fPortUIStream == nullptr)
+            return;
+
+        const uint32_t capacity = fPortUIStream->atom.size;
+
+        fPortUIStream->atom.size = sizeof(LV2_Atom_Sequence_Body);
+        fPortUIStream->atom.type = fURIDs.atomSequence;
+        fPortUIStream->body.unit = 0;
+        fPortUIStream->body.pad  = 0;
+
+        RingBuffer<float>* const stream(fPlugin.getUIStream());
+        DISTRHO_SAFE_ASSERT_RETURN(stream != nullptr,);
+
+        static const uint32_t kHeaderSize = sizeof(LV2_Atom_Sequence_Body) + sizeof(LV2_Atom_Event) + sizeof(LV2_Atom_Vector_Body);
+
+        if (capacity <= kHeaderSize)
+            return;
+
+        const uint32_t available = stream->getReadableCount();
+
+        if (available == 0)
+            return;
+
+        const uint32_t maxCount = (capacity - kHeaderSize) / sizeof(float);
+
+        LV2_Atom_Event* const aev((LV2_Atom_Event*)LV2_ATOM_CONTENTS(LV2_Atom_Sequence, fPortUIStream));
+        LV2_Atom_Vector* const vec((LV2_Atom_Vector*)&aev->body);
+        float* const data((float*)(vec + 1));
+
+        const uint32_t count = stream->read(data, (available < maxCount) ? available : maxCount);
+
+        aev->time.frames = 0;
+        vec->atom.type = fURIDs.atomVector;
+        vec->atom.size = sizeof(LV2_Atom_Vector_Body) + count*sizeof(float);
+        vec->body.child_size = sizeof(float);
+        vec->body.child_type = fURIDs.atomFloat;
+
+        fPortUIStream->atom.size += lv2_atom_pad_size(sizeof(LV2_Atom_Event) + vec->atom.size);
+    }
+#endif
+
 #if DISTRHO_PLUGIN_WANT_STATE
     StringMap fStateMap;
+    Mutex fStateMutex; // fStateMap is written by the worker while lv2_save() may read it
     bool* fNeededUiSends;
 
-    void setState(const char* const key, const char* const newValue)
+# if DISTRHO_PLUGIN_HAS_UI
+    // ongoing transfer of a big value to the UI, resumed on each run
+    static const uint32_t kNoStateSend = 0xffffffff;
+    uint32_t fStateSendIndex;
+    uint32_t fStateSendOffset;
+
+    // big values from the UI, used in the worker
+    Lv2StateChunkReceiver fStateChunkReceiver;
+
+    // Values sent to the UI, owned and only read by the audio thread, as is the transfer cursor above.
+    // New values are handed over through fStateUiPending; the ones they replace are pushed onto the
+    // fStateUiRetired list until the next change deletes them, so the audio thread never allocates or frees.
+    struct StateUiValue {
+        d_string value;
+        StateUiValue* next; // in fStateUiRetired
+
+        StateUiValue(const char* const v)
+            : value(v),
+              next(nullptr) {}
+    };
+
+    StateUiValue** fStateUiValues;
+    Atomic<StateUiValue*>* fStateUiPending;
+    Atomic<StateUiValue*>* fStateUiRetired;
+    Atomic<bool>* fStateUiNotify; // the pending value must be sent to the UI, not just kept
+
+    // worker or restore: give the audio thread its own copy of a new value
+    void publishStateUiValue(const uint32_t index, const char* const value, const bool sendToUi)
+    {
+        if (sendToUi)
+            fStateUiNotify[index].store(true);
+
+        // a value the audio thread did not take yet is simply replaced
+        delete fStateUiPending[index].exchange(new StateUiValue(value));
+
+        // free the values the audio thread has let go of
+        deleteStateUiValues(fStateUiRetired[index].exchange(nullptr));
+    }
+
+    static void deleteStateUiValues(StateUiValue* value)
+    {
+        for (; value != nullptr;)
+        {
+            StateUiValue* const next(value->next);
+            delete value;
+            value = next;
+        }
+    }
+
+    // audio thread: take the new values, restarting a transfer whose value changed
+    void adoptStateUiValues() noexcept
+    {
+        for (uint32_t i=0, count=fPlugin.getStateCount(); i < count; ++i)
+        {
+            StateUiValue* const value(fStateUiPending[i].exchange(nullptr));
+
+            if (value == nullptr)
+                continue;
+
+            // never waits for the publisher, a failed exchange means it just took the list
+            StateUiValue* const old(fStateUiValues[i]);
+            old->next = fStateUiRetired[i].load();
+
+            for (; ! fStateUiRetired[i].compareExchange(old->next, old);) {}
+
+            fStateUiValues[i] = value;
+
+            if (fStateUiNotify[i].exchange(false))
+                fNeededUiSends[i] = true;
+
+            if (fStateSendIndex == i)
+            {
+                fNeededUiSends[i] = true;
+                fStateSendOffset  = 0;
+            }
+        }
+    }
+
+    // Sends pending states to the UI, at most DISTRHO_LV2_STATE_CHUNK_SIZE bytes per run.
+    // Values bigger than that are split into chunks, continuing where the previous run stopped.
+    void writeStatesToUI(const uint32_t capacity)
+    {
+        const uint32_t count(fPlugin.getStateCount());
+
+        adoptStateUiValues();
+
+        for (uint32_t budget = DISTRHO_LV2_STATE_CHUNK_SIZE; budget > 0;)
+        {
+            if (fStateSendIndex == kNoStateSend)
+            {
+                for (uint32_t i=0; i < count; ++i)
+                {
+                    if (fNeededUiSends[i])
+                    {
+                        fStateSendIndex  = i;
+                        fStateSendOffset = 0;
+                        break;
+                    }
+                }
+
+                if (fStateSendIndex == kNoStateSend)
+                    return;
+            }
+
+            const uint32_t i(fStateSendIndex);
+            const d_string& key(fPlugin.getStateKey(i));
+            const d_string& value(fStateUiValues[i]->value);
+
+            const uint32_t keySize(key.length()+1);
+            const uint32_t valueSize(value.length());
+            const uint32_t used(fPortEventsOut->atom.size);
+
+            // never read past the value, whatever happened to it
+            if (fStateSendOffset > valueSize)
+                fStateSendOffset = 0;
+
+            if (used + sizeof(LV2_Atom_Event) >= capacity)
+                return;
+
+            const uint32_t offset(used - sizeof(LV2_Atom_Sequence_Body));
+            const uint32_t room(capacity - used);
+
+            LV2_Atom_Event* const aev((LV2_Atom_Event*)(LV2_ATOM_CONTENTS(LV2_Atom_Sequence, fPortEventsOut) + offset));
+            uint32_t msgSize;
+
+            if (fStateSendOffset == 0 && keySize + valueSize + 1 <= DISTRHO_LV2_STATE_CHUNK_SIZE)
+            {
+                // small enough, key + value + 2x null terminator
+                msgSize = keySize + valueSize + 1;
+
+                if (msgSize > budget || sizeof(LV2_Atom_Event) + msgSize > room)
+                    return;
+
+                char* const msg((char*)LV2_ATOM_BODY(&aev->body));
+                std::memcpy(msg, key.buffer(), keySize);
+                std::memcpy(msg+keySize, value.buffer(), valueSize+1);
+
+                fStateSendOffset = valueSize;
+                budget -= msgSize;
+            }
+            else
+            {
+                const uint32_t headerSize(d_lv2StateChunkMessageSize(keySize, 0));
+
+                if (sizeof(LV2_Atom_Event) + headerSize >= room)
+                    return;
+
+                uint32_t size(valueSize - fStateSendOffset);
+
+                if (size > budget)
+                    size = budget;
+                if (size > room - sizeof(LV2_Atom_Event) - headerSize)
+                    size = room - sizeof(LV2_Atom_Event) - headerSize;
+
+                msgSize = headerSize + size;
+
+                d_lv2StateChunkWrite(LV2_ATOM_BODY(&aev->body), key.buffer(), keySize, value.buffer(), valueSize, fStateSendOffset, size);
+
+                fStateSendOffset += size;
+                budget -= size;
+            }
+
+            aev->time.frames = 0;
+            aev->body.type   = fURIDs.distrhoState;
+            aev->body.size   = msgSize;
+
+            fPortEventsOut->atom.size += lv2_atom_pad_size(sizeof(LV2_Atom_Event) + msgSize);
+
+            if (fStateSendOffset == valueSize)
+            {
+                fNeededUiSends[i] = false;
+                fStateSendIndex   = kNoStateSend;
+                fStateSendOffset  = 0;
+            }
+        }
+    }
+# endif
+
+    // called from the worker or lv2_restore(), never from the audio thread
+    void setState(const char* const key, const char* const newValue, const bool sendToUi = false)
     {
         fPlugin.setState(key, newValue);
 
@@ -855,6 +1365,22 @@ private:
         if (! fPlugin.wantStateKey(key))
             return;
 
+# if DISTRHO_PLUGIN_HAS_UI
+        for (uint32_t i=0, count=fPlugin.getStateCount(); i < count; ++i)
+        {
+            if (fPlugin.getStateKey(i) == key)
+            {
+                publishStateUiValue(i, newValue, sendToUi);
+                break;
+            }
+        }
+# else
+        // unused
+        (void)sendToUi;
+# endif
+
+        const MutexLocker cml(fStateMutex);
+
         // check if key already exists
         for (StringMap::iterator it=fStateMap.begin(), ite=fStateMap.end(); it != ite; ++it)
         {
@@ -931,28 +1457,48 @@ static LV2_Handle lv2_instantiate(const LV2_Descriptor*, double sampleRate, cons
 
     d_lastBufferSize = 0;
 
+    // the buffer size is needed before creating the plugin, the instance takes care of the other options
+    const LV2_URID uridMaxBlockLength(uridMap->map(uridMap->handle, LV2_BUF_SIZE__maxBlockLength));
+    const LV2_URID uridNominalBlockLength(uridMap->map(uridMap->handle, LV2_BUF_SIZE__nominalBlockLength));
+    const LV2_URID uridAtomInt(uridMap->map(uridMap->handle, LV2_ATOM__Int));
+
+    uint32_t nominalBlockLength = 0;
+
     for (int i=0; options[i].key != 0; ++i)
     {
-        if (options[i].key == uridMap->map(uridMap->handle, LV2_BUF_SIZE__maxBlockLength))
+        if (options[i].key == uridMaxBlockLength)
         {
-            if (options[i].type == uridMap->map(uridMap->handle, LV2_ATOM__Int))
+            if (options[i].type == uridAtomInt)
                 d_lastBufferSize = *(const int*)options[i].value;
             else
                 d_stderr("Host provides maxBlockLength but has wrong value type");
-
-            break;
+        }
+        else if (options[i].key == uridNominalBlockLength)
+        {
+            if (options[i].type == uridAtomInt)
+                nominalBlockLength = *(const int*)options[i].value;
+            else
+                d_stderr("Host provides nominalBlockLength but has wrong value type");
         }
     }
 
     if (d_lastBufferSize == 0)
     {
-        d_stderr("Host does not provide maxBlockLength option");
-        d_lastBufferSize = 2048;
+        if (nominalBlockLength != 0)
+        {
+            d_stderr("Host does not provide maxBlockLength option, using nominalBlockLength instead");
+            d_lastBufferSize = nominalBlockLength;
+        }
+        else
+        {
+            d_stderr("Host does not provide maxBlockLength option");
+            d_lastBufferSize = 2048;
+        }
     }
 
     d_lastSampleRate = sampleRate;
 
-    return new PluginLv2(sampleRate, uridMap, worker);
+    return new PluginLv2(sampleRate, uridMap, worker, options);
 }
 
 #define instancePtr ((PluginLv2*)instance)
@@ -1021,9 +1567,24 @@ static LV2_State_Status lv2_restore(LV2_Handle instance, LV2_State_Retrieve_Func
     return instancePtr->lv2_restore(retrieve, handle);
 }
 
-LV2_Worker_Status lv2_work(LV2_Handle instance, LV2_Worker_Respond_Function, LV2_Worker_Respond_Handle, uint32_t, const void* data)
+#endif
+
+#if DISTRHO_LV2_USE_WORKER
+LV2_Worker_Status lv2_work(LV2_Handle instance, LV2_Worker_Respond_Function respond, LV2_Worker_Respond_Handle handle, uint32_t size, const void* data)
+{
+    return instancePtr->lv2_work(respond, handle, size, data);
+}
+#endif
+
+#if DISTRHO_PLUGIN_WANT_WORKER
+LV2_Worker_Status lv2_work_response(LV2_Handle instance, uint32_t size, const void* body)
 {
-    return instancePtr->lv2_work(data);
+    return instancePtr->lv2_work_response(size, body);
+}
+
+LV2_Worker_Status lv2_work_end_run(LV2_Handle instance)
+{
+    return instancePtr->lv2_work_end_run();
 }
 #endif
 
@@ -1034,6 +1595,20 @@ static void* lv2_get_instance_pointer(LV2_Handle instance)
 {
     return instancePtr->lv2_get_instance_pointer();
 }
+
+# if DISTRHO_PLUGIN_WANT_UI_STREAM
+static void* lv2_get_ui_stream(LV2_Handle instance)
+{
+    return instancePtr->lv2_get_ui_stream();
+}
+# endif
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+static void* lv2_get_snapshot(LV2_Handle instance)
+{
+    return instancePtr->lv2_get_snapshot();
+}
 #endif
 
 // -----------------------------------------------------------------------
@@ -1054,10 +1629,18 @@ static const void* lv2_extension_data(const char* uri)
 
 #if DISTRHO_PLUGIN_WANT_STATE
     static const LV2_State_Interface state = { lv2_save, lv2_restore };
-    static const LV2_Worker_Interface worker = { lv2_work, nullptr, nullptr };
 
     if (std::strcmp(uri, LV2_STATE__interface) == 0)
         return &state;
+#endif
+
+#if DISTRHO_LV2_USE_WORKER
+# if DISTRHO_PLUGIN_WANT_WORKER
+    static const LV2_Worker_Interface worker = { lv2_work, lv2_work_response, lv2_work_end_run };
+# else
+    static const LV2_Worker_Interface worker = { lv2_work, nullptr, nullptr };
+# endif
+
     if (std::strcmp(uri, LV2_WORKER__interface) == 0)
         return &worker;
 #endif
@@ -1067,14 +1650,34 @@ static const void* lv2_extension_data(const char* uri)
 
     struct LV2_DirectAccess_Interface {
         void* (*get_instance_pointer)(LV2_Handle handle);
+# if DISTRHO_PLUGIN_WANT_UI_STREAM
+        void* (*get_ui_stream)(LV2_Handle handle);
+# endif
     };
 
+# if DISTRHO_PLUGIN_WANT_UI_STREAM
+    static const LV2_DirectAccess_Interface directaccess = { lv2_get_instance_pointer, lv2_get_ui_stream };
+# else
     static const LV2_DirectAccess_Interface directaccess = { lv2_get_instance_pointer };
+# endif
 
     if (std::strcmp(uri, DISTRHO_DIRECT_ACCESS_URI) == 0)
         return &directaccess;
 #endif
 
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+# define DISTRHO_SNAPSHOT_URI "urn:distrho:snapshot"
+
+    struct LV2_Snapshot_Interface {
+        void* (*get_snapshot)(LV2_Handle handle);
+    };
+
+    static const LV2_Snapshot_Interface snapshot = { lv2_get_snapshot };
+
+    if (std::strcmp(uri, DISTRHO_SNAPSHOT_URI) == 0)
+        return &snapshot;
+#endif
+
     return nullptr;
 }
 
@@ -15,8 +15,10 @@
  */
 
 #include "DistrhoPluginInternal.hpp"
+#include "DistrhoLV2State.hpp"
 
 #include "lv2/atom.h"
+#include "lv2/atom-util.h"
 #include "lv2/buf-size.h"
 #include "lv2/data-access.h"
 #include "lv2/instance-access.h"
@@ -46,6 +48,34 @@
 
 #define DISTRHO_LV2_USE_EVENTS_IN  (DISTRHO_PLUGIN_HAS_MIDI_INPUT || DISTRHO_PLUGIN_WANT_TIMEPOS || (DISTRHO_PLUGIN_WANT_STATE && DISTRHO_PLUGIN_HAS_UI))
 #define DISTRHO_LV2_USE_EVENTS_OUT (DISTRHO_PLUGIN_HAS_MIDI_OUTPUT || (DISTRHO_PLUGIN_WANT_STATE && DISTRHO_PLUGIN_HAS_UI))
+#define DISTRHO_LV2_USE_UI_STREAM_PORT (DISTRHO_PLUGIN_WANT_UI_STREAM && DISTRHO_PLUGIN_HAS_UI && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS)
+
+// -----------------------------------------------------------------------
+
+#if DISTRHO_LV2_USE_EVENTS_IN || DISTRHO_LV2_USE_EVENTS_OUT
+static uint32_t lv2_get_events_port_size(const DISTRHO_NAMESPACE::PluginExporter& plugin)
+{
+    uint32_t size = DISTRHO_PLUGIN_MINIMUM_BUFFER_SIZE;
+
+# if (DISTRHO_PLUGIN_WANT_STATE && DISTRHO_PLUGIN_HAS_UI)
+    // room for the state chunks the UI sends per idle with the longest key, on top of regular events
+    uint32_t keySize = 0;
+
+    for (uint32_t i=0, count=plugin.getStateCount(); i < count; ++i)
+    {
+        if (plugin.getStateKey(i).length()+1 > keySize)
+            keySize = plugin.getStateKey(i).length()+1;
+    }
+
+    size += sizeof(LV2_Atom_Sequence) + DISTRHO_LV2_STATE_CHUNKS_PER_IDLE * DISTRHO_NAMESPACE::d_lv2StateChunkEventSize(keySize);
+# else
+    // unused
+    (void)plugin;
+# endif
+
+    return size;
+}
+#endif
 
 // -----------------------------------------------------------------------
 
@@ -80,8 +110,8 @@ void lv2_generate_ttl(const char* const basename)
 
         manifestString += "<" DISTRHO_PLUGIN_URI ">\n";
         manifestString += "    a lv2:Plugin ;\n";
-        manifestString += "    lv2:binary <" + pluginDLL + "." DISTRHO_DLL_EXTENSION "> ;\n";
-        manifestString += "    rdfs:seeAlso <" + pluginTTL + "> .\n";
+        manifestString.appendFormat("    lv2:binary <%s." DISTRHO_DLL_EXTENSION "> ;\n", pluginDLL.buffer());
+        manifestString.appendFormat("    rdfs:seeAlso <%s> .\n", pluginTTL.buffer());
         manifestString += "\n";
 
 #if DISTRHO_PLUGIN_HAS_UI
@@ -100,9 +130,9 @@ void lv2_generate_ttl(const char* const basename)
         pluginUI.truncate(pluginDLL.rfind("_dsp"));
         pluginUI += "_ui";
 
-        manifestString += "    ui:binary <" + pluginUI + "." DISTRHO_DLL_EXTENSION "> ;\n";
+        manifestString.appendFormat("    ui:binary <%s." DISTRHO_DLL_EXTENSION "> ;\n", pluginUI.buffer());
 # else
-        manifestString += "    ui:binary <" + pluginDLL + "." DISTRHO_DLL_EXTENSION "> ;\n";
+        manifestString.appendFormat("    ui:binary <%s." DISTRHO_DLL_EXTENSION "> ;\n", pluginDLL.buffer());
 #endif
         manifestString += "    lv2:extensionData ui:idleInterface ,\n";
 # if DISTRHO_PLUGIN_WANT_PROGRAMS
@@ -113,7 +143,14 @@ void lv2_generate_ttl(const char* const basename)
 # endif
         manifestString += "    lv2:optionalFeature ui:noUserResize ,\n";
         manifestString += "                        ui:resize ,\n";
+        manifestString += "                        ui:portMap ,\n";
+# if DISTRHO_PLUGIN_WANT_SNAPSHOT && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+        manifestString += "                        ui:touch ,\n";
+        manifestString += "                        <" LV2_DATA_ACCESS_URI "> ,\n";
+        manifestString += "                        <" LV2_INSTANCE_ACCESS_URI "> ;\n";
+# else
         manifestString += "                        ui:touch ;\n";
+# endif
 # if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
         manifestString += "    lv2:requiredFeature <" LV2_DATA_ACCESS_URI "> ,\n";
         manifestString += "                        <" LV2_INSTANCE_ACCESS_URI "> ,\n";
@@ -121,7 +158,16 @@ void lv2_generate_ttl(const char* const basename)
 # else
         manifestString += "    lv2:requiredFeature <" LV2_OPTIONS__options "> ,\n";
 # endif
+# if DISTRHO_LV2_USE_UI_STREAM_PORT
+        manifestString += "                        <" LV2_URID__map "> ;\n";
+        manifestString += "    ui:portNotification [\n";
+        manifestString += "        ui:plugin <" DISTRHO_PLUGIN_URI "> ;\n";
+        manifestString += "        lv2:symbol \"lv2_ui_stream\" ;\n";
+        manifestString += "        ui:protocol <" LV2_ATOM__eventTransfer "> ;\n";
+        manifestString += "    ] .\n";
+# else
         manifestString += "                        <" LV2_URID__map "> .\n";
+# endif
 #endif
 
         manifestFile << manifestString << std::endl;
@@ -144,6 +190,7 @@ void lv2_generate_ttl(const char* const basename)
         pluginString += "@prefix doap: <http://usefulinc.com/ns/doap#> .\n";
         pluginString += "@prefix foaf: <http://xmlns.com/foaf/0.1/> .\n";
         pluginString += "@prefix lv2:  <" LV2_CORE_PREFIX "> .\n";
+        pluginString += "@prefix opts: <" LV2_OPTIONS_PREFIX "> .\n";
         pluginString += "@prefix rsz:  <" LV2_RESIZE_PORT_PREFIX "> .\n";
 #if DISTRHO_PLUGIN_HAS_UI
         pluginString += "@prefix ui:   <" LV2_UI_PREFIX "> .\n";
@@ -162,8 +209,8 @@ void lv2_generate_ttl(const char* const basename)
 
         // extensionData
         pluginString += "    lv2:extensionData <" LV2_STATE__interface "> ";
-#if DISTRHO_PLUGIN_WANT_STATE
         pluginString += ",\n                      <" LV2_OPTIONS__interface "> ";
+#if (DISTRHO_PLUGIN_WANT_STATE || DISTRHO_PLUGIN_WANT_WORKER)
         pluginString += ",\n                      <" LV2_WORKER__interface "> ";
 #endif
 #if DISTRHO_PLUGIN_WANT_PROGRAMS
@@ -174,10 +221,22 @@ void lv2_generate_ttl(const char* const basename)
         // optionalFeatures
 #if DISTRHO_PLUGIN_IS_RT_SAFE
         pluginString += "    lv2:optionalFeature <" LV2_CORE__hardRTCapable "> ,\n";
-        pluginString += "                        <" LV2_BUF_SIZE__boundedBlockLength "> ;\n";
+        pluginString += "                        <" LV2_BUF_SIZE__boundedBlockLength "> ";
 #else
-        pluginString += "    lv2:optionalFeature <" LV2_BUF_SIZE__boundedBlockLength "> ;\n";
+        pluginString += "    lv2:optionalFeature <" LV2_BUF_SIZE__boundedBlockLength "> ";
 #endif
+#if (DISTRHO_PLUGIN_WANT_WORKER && ! DISTRHO_PLUGIN_WANT_STATE)
+        // plugin jobs can use the framework worker thread instead
+        pluginString += ",\n                        <" LV2_WORKER__schedule "> ";
+#endif
+        pluginString += ";\n\n";
+
+        // supportedOptions
+        pluginString += "    opts:supportedOption <" LV2_BUF_SIZE__maxBlockLength "> ,\n";
+        pluginString += "                         <" LV2_BUF_SIZE__minBlockLength "> ,\n";
+        pluginString += "                         <" LV2_BUF_SIZE_PREFIX "nominalBlockLength> ,\n";
+        pluginString += "                         <" LV2_BUF_SIZE__sequenceSize "> ,\n";
+        pluginString += "                         <" LV2_CORE__sampleRate "> ;\n";
         pluginString += "\n";
 
         // requiredFeatures
@@ -206,9 +265,9 @@ void lv2_generate_ttl(const char* const basename)
                     pluginString += "    [\n";
 
                 pluginString += "        a lv2:InputPort, lv2:AudioPort ;\n";
-                pluginString += "        lv2:index " + d_string(portIndex) + " ;\n";
-                pluginString += "        lv2:symbol \"lv2_audio_in_" + d_string(i+1) + "\" ;\n";
-                pluginString += "        lv2:name \"Audio Input " + d_string(i+1) + "\" ;\n";
+                pluginString.appendFormat("        lv2:index %u ;\n", portIndex);
+                pluginString.appendFormat("        lv2:symbol \"lv2_audio_in_%u\" ;\n", i+1);
+                pluginString.appendFormat("        lv2:name \"Audio Input %u\" ;\n", i+1);
 
                 if (i+1 == DISTRHO_PLUGIN_NUM_INPUTS)
                     pluginString += "    ] ;\n\n";
@@ -227,9 +286,9 @@ void lv2_generate_ttl(const char* const basename)
                     pluginString += "    [\n";
 
                 pluginString += "        a lv2:OutputPort, lv2:AudioPort ;\n";
-                pluginString += "        lv2:index " + d_string(portIndex) + " ;\n";
-                pluginString += "        lv2:symbol \"lv2_audio_out_" + d_string(i+1) + "\" ;\n";
-                pluginString += "        lv2:name \"Audio Output " + d_string(i+1) + "\" ;\n";
+                pluginString.appendFormat("        lv2:index %u ;\n", portIndex);
+                pluginString.appendFormat("        lv2:symbol \"lv2_audio_out_%u\" ;\n", i+1);
+                pluginString.appendFormat("        lv2:name \"Audio Output %u\" ;\n", i+1);
 
                 if (i+1 == DISTRHO_PLUGIN_NUM_OUTPUTS)
                     pluginString += "    ] ;\n\n";
@@ -242,10 +301,10 @@ void lv2_generate_ttl(const char* const basename)
 #if DISTRHO_LV2_USE_EVENTS_IN
             pluginString += "    lv2:port [\n";
             pluginString += "        a lv2:InputPort, atom:AtomPort ;\n";
-            pluginString += "        lv2:index " + d_string(portIndex) + " ;\n";
+            pluginString.appendFormat("        lv2:index %u ;\n", portIndex);
             pluginString += "        lv2:name \"Events Input\" ;\n";
             pluginString += "        lv2:symbol \"lv2_events_in\" ;\n";
-            pluginString += "        rsz:minimumSize " + d_string(DISTRHO_PLUGIN_MINIMUM_BUFFER_SIZE) + " ;\n";
+            pluginString.appendFormat("        rsz:minimumSize %u ;\n", lv2_get_events_port_size(plugin));
             pluginString += "        atom:bufferType atom:Sequence ;\n";
 # if (DISTRHO_PLUGIN_WANT_STATE && DISTRHO_PLUGIN_HAS_UI)
             pluginString += "        atom:supports <" LV2_ATOM__String "> ;\n";
@@ -263,10 +322,10 @@ void lv2_generate_ttl(const char* const basename)
 #if DISTRHO_LV2_USE_EVENTS_OUT
             pluginString += "    lv2:port [\n";
             pluginString += "        a lv2:OutputPort, atom:AtomPort ;\n";
-            pluginString += "        lv2:index " + d_string(portIndex) + " ;\n";
+            pluginString.appendFormat("        lv2:index %u ;\n", portIndex);
             pluginString += "        lv2:name \"Events Output\" ;\n";
             pluginString += "        lv2:symbol \"lv2_events_out\" ;\n";
-            pluginString += "        rsz:minimumSize " + d_string(DISTRHO_PLUGIN_MINIMUM_BUFFER_SIZE) + " ;\n";
+            pluginString.appendFormat("        rsz:minimumSize %u ;\n", lv2_get_events_port_size(plugin));
             pluginString += "        atom:bufferType atom:Sequence ;\n";
 # if (DISTRHO_PLUGIN_WANT_STATE && DISTRHO_PLUGIN_HAS_UI)
             pluginString += "        atom:supports <" LV2_ATOM__String "> ;\n";
@@ -281,7 +340,7 @@ void lv2_generate_ttl(const char* const basename)
 #if DISTRHO_PLUGIN_WANT_LATENCY
             pluginString += "    lv2:port [\n";
             pluginString += "        a lv2:OutputPort, lv2:ControlPort ;\n";
-            pluginString += "        lv2:index " + d_string(portIndex) + " ;\n";
+            pluginString.appendFormat("        lv2:index %u ;\n", portIndex);
             pluginString += "        lv2:name \"Latency\" ;\n";
             pluginString += "        lv2:symbol \"lv2_latency\" ;\n";
             pluginString += "        lv2:designation lv2:latency ;\n";
@@ -299,11 +358,13 @@ void lv2_generate_ttl(const char* const basename)
 
                 if (plugin.isParameterOutput(i))
                     pluginString += "        a lv2:OutputPort, lv2:ControlPort ;\n";
+                else if (plugin.isParameterCV(i))
+                    pluginString += "        a lv2:InputPort, lv2:CVPort ;\n";
                 else
                     pluginString += "        a lv2:InputPort, lv2:ControlPort ;\n";
 
-                pluginString += "        lv2:index " + d_string(portIndex) + " ;\n";
-                pluginString += "        lv2:name \"" + plugin.getParameterName(i) + "\" ;\n";
+                pluginString.appendFormat("        lv2:index %u ;\n", portIndex);
+                pluginString.appendFormat("        lv2:name \"%s\" ;\n", plugin.getParameterName(i).buffer());
 
                 // symbol
                 {
@@ -312,7 +373,7 @@ void lv2_generate_ttl(const char* const basename)
                     if (symbol.isEmpty())
                         symbol = "lv2_port_" + d_string(portIndex-1);
 
-                    pluginString += "        lv2:symbol \"" + symbol + "\" ;\n";
+                    pluginString.appendFormat("        lv2:symbol \"%s\" ;\n", symbol.buffer());
                 }
 
                 // ranges
@@ -321,15 +382,15 @@ void lv2_generate_ttl(const char* const basename)
 
                     if (plugin.getParameterHints(i) & kParameterIsInteger)
                     {
-                        pluginString += "        lv2:default " + d_string(int(plugin.getParameterValue(i))) + " ;\n";
-                        pluginString += "        lv2:minimum " + d_string(int(ranges.min)) + " ;\n";
-                        pluginString += "        lv2:maximum " + d_string(int(ranges.max)) + " ;\n";
+                        pluginString.appendFormat("        lv2:default %d ;\n", int(plugin.getParameterValue(i)));
+                        pluginString.appendFormat("        lv2:minimum %d ;\n", int(ranges.min));
+                        pluginString.appendFormat("        lv2:maximum %d ;\n", int(ranges.max));
                     }
                     else
                     {
-                        pluginString += "        lv2:default " + d_string(plugin.getParameterValue(i)) + " ;\n";
-                        pluginString += "        lv2:minimum " + d_string(ranges.min) + " ;\n";
-                        pluginString += "        lv2:maximum " + d_string(ranges.max) + " ;\n";
+                        pluginString.appendFormat("        lv2:default %f ;\n", plugin.getParameterValue(i));
+                        pluginString.appendFormat("        lv2:minimum %f ;\n", ranges.min);
+                        pluginString.appendFormat("        lv2:maximum %f ;\n", ranges.max);
                     }
                 }
 
@@ -363,9 +424,9 @@ void lv2_generate_ttl(const char* const basename)
                         {
                             pluginString += "        unit:unit [\n";
                             pluginString += "            a unit:Unit ;\n";
-                            pluginString += "            unit:name   \"" + unit + "\" ;\n";
-                            pluginString += "            unit:symbol \"" + unit + "\" ;\n";
-                            pluginString += "            unit:render \"%f " + unit + "\" ;\n";
+                            pluginString.appendFormat("            unit:name   \"%s\" ;\n", unit.buffer());
+                            pluginString.appendFormat("            unit:symbol \"%s\" ;\n", unit.buffer());
+                            pluginString.appendFormat("            unit:render \"%%f %s\" ;\n", unit.buffer());
                             pluginString += "        ] ;\n";
                         }
                     }
@@ -393,10 +454,52 @@ void lv2_generate_ttl(const char* const basename)
                 else
                     pluginString += "    ] ,\n";
             }
+
+            // framework ports go after the parameters, so their indexes never change
+            pluginString += "    lv2:port [\n";
+            pluginString += "        a lv2:InputPort, lv2:ControlPort ;\n";
+            pluginString.appendFormat("        lv2:index %u ;\n", portIndex);
+            pluginString += "        lv2:name \"Freewheel\" ;\n";
+            pluginString += "        lv2:symbol \"lv2_freewheel\" ;\n";
+            pluginString += "        lv2:default 0 ;\n";
+            pluginString += "        lv2:minimum 0 ;\n";
+            pluginString += "        lv2:maximum 1 ;\n";
+            pluginString += "        lv2:designation lv2:freeWheeling ;\n";
+            pluginString += "        lv2:portProperty lv2:toggled, <" LV2_PORT_PROPS__notOnGUI "> ;\n";
+            pluginString += "    ] ;\n\n";
+            ++portIndex;
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+            pluginString += "    lv2:port [\n";
+            pluginString += "        a lv2:InputPort, lv2:ControlPort ;\n";
+            pluginString.appendFormat("        lv2:index %u ;\n", portIndex);
+            pluginString += "        lv2:name \"Enabled\" ;\n";
+            pluginString += "        lv2:symbol \"lv2_enabled\" ;\n";
+            pluginString += "        lv2:default 1 ;\n";
+            pluginString += "        lv2:minimum 0 ;\n";
+            pluginString += "        lv2:maximum 1 ;\n";
+            pluginString += "        lv2:designation lv2:enabled ;\n";
+            pluginString += "        lv2:portProperty lv2:toggled ;\n";
+            pluginString += "    ] ;\n\n";
+            ++portIndex;
+#endif
+
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+            pluginString += "    lv2:port [\n";
+            pluginString += "        a lv2:OutputPort, atom:AtomPort ;\n";
+            pluginString.appendFormat("        lv2:index %u ;\n", portIndex);
+            pluginString += "        lv2:name \"UI Stream\" ;\n";
+            pluginString += "        lv2:symbol \"lv2_ui_stream\" ;\n";
+            pluginString.appendFormat("        rsz:minimumSize %u ;\n", uint32_t(DISTRHO_PLUGIN_UI_STREAM_SIZE*sizeof(float) + 64));
+            pluginString += "        atom:bufferType atom:Sequence ;\n";
+            pluginString += "        atom:supports <" LV2_ATOM__Vector "> ;\n";
+            pluginString += "    ] ;\n\n";
+            ++portIndex;
+#endif
         }
 
-        pluginString += "    doap:name \"" + d_string(plugin.getName()) + "\" ;\n";
-        pluginString += "    doap:maintainer [ foaf:name \"" + d_string(plugin.getMaker()) + "\" ] .\n";
+        pluginString.appendFormat("    doap:name \"%s\" ;\n", plugin.getName());
+        pluginString.appendFormat("    doap:maintainer [ foaf:name \"%s\" ] .\n", plugin.getMaker());
 
         pluginFile << pluginString << std::endl;
         pluginFile.close();
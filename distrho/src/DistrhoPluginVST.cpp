@@ -46,7 +46,9 @@
 #define effCanBeAutomated 26
 #define effGetProgramNameIndexed 29
 #define effGetPlugCategory 35
+#define effSetBypass 44
 #define effIdle 53
+#define kVstProcessLevelOffline 4
 #define kPlugCategEffect 1
 #define kPlugCategSynth 2
 #define kVstVersion 2400
@@ -82,25 +84,18 @@ class UiHelper
 {
 public:
     UiHelper()
-        : parameterChecks(nullptr),
-          parameterValues(nullptr) {}
+        : parameterNotifier(nullptr) {}
 
     virtual ~UiHelper()
     {
-        if (parameterChecks != nullptr)
+        if (parameterNotifier != nullptr)
         {
-            delete[] parameterChecks;
-            parameterChecks = nullptr;
-        }
-        if (parameterValues != nullptr)
-        {
-            delete[] parameterValues;
-            parameterValues = nullptr;
+            delete parameterNotifier;
+            parameterNotifier = nullptr;
         }
     }
 
-    bool*   parameterChecks;
-    float*  parameterValues;
+    ParameterNotifier* parameterNotifier;
 
 #if DISTRHO_PLUGIN_WANT_STATE
     virtual void setStateFromUI(const char* const newKey, const char* const newValue) = 0;
@@ -119,21 +114,19 @@ public:
           fPlugin(plugin),
           fUI(this, winId, editParameterCallback, setParameterCallback, setStateCallback, sendNoteCallback, setSizeCallback, plugin->getInstancePointer())
     {
+        fUI.setParameterNotifier(uiHelper->parameterNotifier);
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+        fUI.setUIStream(plugin->getUIStream());
+#endif
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+        fUI.setSnapshot(plugin->getSnapshot());
+#endif
     }
 
     // -------------------------------------------------------------------
 
     void idle()
     {
-        for (uint32_t i=0, count = fPlugin->getParameterCount(); i < count; ++i)
-        {
-            if (fUiHelper->parameterChecks[i])
-            {
-                fUiHelper->parameterChecks[i] = false;
-                fUI.parameterChanged(i, fUiHelper->parameterValues[i]);
-            }
-        }
-
         fUI.idle();
     }
 
@@ -284,17 +277,21 @@ public:
         fVstRect.bottom = 0;
         fVstRect.right  = 0;
 
+        parameterNotifier     = new ParameterNotifier(fPlugin.getParameterCount());
+        fOutputParameterCount = 0;
+        fOutputParameters     = nullptr;
+
         if (const uint32_t paramCount = fPlugin.getParameterCount())
         {
-            parameterChecks = new bool[paramCount];
-            parameterValues = new float[paramCount];
+            fOutputParameters = new uint32_t[paramCount];
 
             for (uint32_t i=0; i < paramCount; ++i)
             {
-                parameterChecks[i] = false;
-                parameterValues[i] = 0.0f;
+                if (fPlugin.isParameterOutput(i))
+                    fOutputParameters[fOutputParameterCount++] = i;
             }
         }
+
 # if DISTRHO_OS_MAC
 #  ifdef __LP64__
         fUsingNsView = true;
@@ -318,6 +315,14 @@ public:
 
     ~PluginVst()
     {
+#if DISTRHO_PLUGIN_HAS_UI
+        if (fOutputParameters != nullptr)
+        {
+            delete[] fOutputParameters;
+            fOutputParameters = nullptr;
+        }
+#endif
+
 #if DISTRHO_PLUGIN_WANT_STATE
         if (fStateChunk != nullptr)
         {
@@ -461,6 +466,7 @@ public:
 
 #if DISTRHO_PLUGIN_WANT_STATE
         case effGetChunk:
+        {
             if (ptr == nullptr)
                 return 0;
 
@@ -474,44 +480,36 @@ public:
             {
                 fStateChunk    = new char[1];
                 fStateChunk[0] = '\0';
+                *(void**)ptr   = fStateChunk;
                 return 1;
             }
-            else
-            {
-                d_string chunkStr;
 
-                for (StringMap::const_iterator cit=fStateMap.begin(), cite=fStateMap.end(); cit != cite; ++cit)
-                {
-                    const d_string& key   = cit->first;
-                    const d_string& value = cit->second;
+            // "key\0value\0" pairs, ending with an empty key
+            std::size_t chunkSize = 1;
 
-                    // join key and value
-                    d_string tmpStr;
-                    tmpStr  = key;
-                    tmpStr += "\xff";
-                    tmpStr += value;
-                    tmpStr += "\xff";
-
-                    chunkStr += tmpStr;
-                }
+            for (StringMap::const_iterator cit=fStateMap.begin(), cite=fStateMap.end(); cit != cite; ++cit)
+                chunkSize += cit->first.length() + cit->second.length() + 2;
 
-                const std::size_t chunkSize(chunkStr.length()+1);
+            fStateChunk = new char[chunkSize];
+            char* chunkPtr = fStateChunk;
 
-                fStateChunk = new char[chunkSize];
-                std::memcpy(fStateChunk, chunkStr.buffer(), chunkStr.length());
-                fStateChunk[chunkSize] = '\0';
+            for (StringMap::const_iterator cit=fStateMap.begin(), cite=fStateMap.end(); cit != cite; ++cit)
+            {
+                const d_string& key   = cit->first;
+                const d_string& value = cit->second;
 
-                for (std::size_t i=0; i<chunkSize; ++i)
-                {
-                    if (fStateChunk[i] == '\xff')
-                        fStateChunk[i] = '\0';
-                }
+                std::memcpy(chunkPtr, key.buffer(), key.length()+1);
+                chunkPtr += key.length()+1;
 
-                return chunkSize;
+                std::memcpy(chunkPtr, value.buffer(), value.length()+1);
+                chunkPtr += value.length()+1;
             }
 
+            *chunkPtr = '\0';
+
             *(void**)ptr = fStateChunk;
-            break;
+            return chunkSize;
+        }
 
         case effSetChunk:
         {
@@ -579,7 +577,13 @@ public:
             }
             break;
 
-#if DISTRHO_PLUGIN_HAS_MIDI_INPUT || DISTRHO_PLUGIN_HAS_MIDI_OUTPUT || DISTRHO_PLUGIN_WANT_TIMEPOS || DISTRHO_OS_MAC
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        case effSetBypass:
+            fPlugin.setBypassed(value != 0);
+            return 1;
+#endif
+
+#if DISTRHO_PLUGIN_HAS_MIDI_INPUT || DISTRHO_PLUGIN_HAS_MIDI_OUTPUT || DISTRHO_PLUGIN_WANT_TIMEPOS || DISTRHO_PLUGIN_WANT_BYPASS || DISTRHO_OS_MAC
         case effCanDo:
             if (const char* const canDo = (const char*)ptr)
             {
@@ -605,6 +609,10 @@ public:
 # if DISTRHO_PLUGIN_WANT_TIMEPOS
                 if (std::strcmp(canDo, "receiveVstTimeInfo") == 0)
                     return 1;
+# endif
+# if DISTRHO_PLUGIN_WANT_BYPASS
+                if (std::strcmp(canDo, "bypass") == 0)
+                    return 1;
 # endif
             }
             break;
@@ -639,6 +647,8 @@ public:
 
     void vst_processReplacing(const float** const inputs, float** const outputs, const int32_t sampleFrames)
     {
+        fPlugin.setOffline(fAudioMaster(fEffect, audioMasterGetCurrentProcessLevel, 0, 0, nullptr, 0.0f) == kVstProcessLevelOffline);
+
 #if DISTRHO_PLUGIN_WANT_TIMEPOS
         static const int kWantVstTimeFlags(kVstTransportPlaying|kVstPpqPosValid|kVstTempoValid|kVstTimeSigValid);
 
@@ -691,13 +701,10 @@ public:
 #endif
 
 #if DISTRHO_PLUGIN_HAS_UI
-        if (fVstUI == nullptr)
-            return;
-
-        for (uint32_t i=0, count=fPlugin.getParameterCount(); i < count; ++i)
+        for (uint32_t i=0; i < fOutputParameterCount; ++i)
         {
-            if (fPlugin.isParameterOutput(i))
-                setParameterValueFromPlugin(i, fPlugin.getParameterValue(i));
+            const uint32_t index(fOutputParameters[i]);
+            parameterNotifier->setValueIfChanged(index, fPlugin.getParameterValue(index));
         }
 #endif
     }
@@ -730,6 +737,8 @@ private:
 #if DISTRHO_PLUGIN_HAS_UI
     UIVst* fVstUI;
     ERect  fVstRect;
+    uint32_t  fOutputParameterCount;
+    uint32_t* fOutputParameters;
 # if DISTRHO_OS_MAC
     bool fUsingNsView;
 # endif
@@ -746,8 +755,7 @@ private:
 #if DISTRHO_PLUGIN_HAS_UI
     void setParameterValueFromPlugin(const uint32_t index, const float realValue)
     {
-        parameterValues[index] = realValue;
-        parameterChecks[index] = true;
+        parameterNotifier->setValue(index, realValue);
     }
 #endif
 
@@ -0,0 +1,188 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_PLUGIN_WORKER_HPP_INCLUDED
+#define DISTRHO_PLUGIN_WORKER_HPP_INCLUDED
+
+#include "../extra/d_mutex.hpp"
+#include "../extra/d_ringbuffer.hpp"
+#include "../extra/d_thread.hpp"
+
+// -----------------------------------------------------------------------
+// Framework-owned worker thread, used for Plugin::d_scheduleWork() in formats
+// without a host worker (everything but LV2, or LV2 hosts without worker:schedule).
+// It runs with background scheduling, see Thread::setCurrentThreadLowPriority().
+//
+// Requests go from the audio thread to the worker, responses come back the other way.
+// Both directions are single-producer, single-consumer rings, so the audio thread
+// never blocks nor allocates. Messages are a uint32_t size followed by the data,
+// written all or nothing.
+//
+// The audio thread wakes the worker with Semaphore::post(), which never blocks and
+// is never missed, so the worker sleeps without a timeout between requests.
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+class PluginWorker : public Thread
+{
+public:
+    typedef void (*MessageFunc)(void* ptr, const void* data, uint32_t size);
+
+    PluginWorker() noexcept
+        : Thread("DPF Worker"),
+          fRequests(kRingSize),
+          fResponses(kRingSize),
+          fWorkFunc(nullptr),
+          fWorkPtr(nullptr) {}
+
+    ~PluginWorker() override
+    {
+        stop();
+    }
+
+    /*
+     * Start the worker thread, which calls @a workFunc for each request.
+     * Does nothing if already running.
+     */
+    void start(const MessageFunc workFunc, void* const ptr) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(workFunc != nullptr,);
+
+        if (isThreadRunning())
+            return;
+
+        fWorkFunc = workFunc;
+        fWorkPtr  = ptr;
+        startThread();
+    }
+
+    /*
+     * Stop the worker thread, waiting for the current request to finish.
+     * Pending requests are kept and handled on the next start().
+     */
+    void stop() noexcept
+    {
+        if (! isThreadRunning())
+            return;
+
+        signalThreadShouldExit();
+        fSemaphore.post();
+        stopThread(-1);
+    }
+
+    /*
+     * Queue a request for the worker thread.
+     * Audio thread only.
+     */
+    bool scheduleWork(const void* const data, const uint32_t size) noexcept
+    {
+        if (! writeMessage(fRequests, fRequestBuffer, data, size))
+            return false;
+
+        fSemaphore.post();
+        return true;
+    }
+
+    /*
+     * Queue a response for the audio thread.
+     * Worker thread only, while handling a request.
+     */
+    bool respond(const void* const data, const uint32_t size) noexcept
+    {
+        return writeMessage(fResponses, fResponseBuffer, data, size);
+    }
+
+    /*
+     * Call @a func for each pending response, returns how many there were.
+     * Audio thread only.
+     */
+    uint32_t deliverResponses(const MessageFunc func, void* const ptr) noexcept
+    {
+        uint32_t count = 0;
+
+        for (uint32_t size; readMessage(fResponses, fDeliverBuffer, size); ++count)
+            func(ptr, fDeliverBuffer, size);
+
+        return count;
+    }
+
+protected:
+    void run() override
+    {
+        setCurrentThreadLowPriority();
+
+        // requests kept from before a stop() are handled first, they had their wake-up already
+        for (uint32_t size; ! shouldThreadExit();)
+        {
+            for (; ! shouldThreadExit() && readMessage(fRequests, fWorkBuffer, size);)
+                fWorkFunc(fWorkPtr, fWorkBuffer, size);
+
+            fSemaphore.wait();
+        }
+    }
+
+private:
+    static const uint32_t kMaxMessageSize = DISTRHO_PLUGIN_WORKER_MESSAGE_SIZE;
+    static const uint32_t kRingSize       = (uint32_t(sizeof(uint32_t)) + kMaxMessageSize) * 8;
+
+    RingBuffer<uint8_t> fRequests;
+    RingBuffer<uint8_t> fResponses;
+    Semaphore fSemaphore;
+
+    MessageFunc fWorkFunc;
+    void*       fWorkPtr;
+
+    // one scratch buffer per thread and direction, so each message is a single ring write
+    uint8_t fRequestBuffer[sizeof(uint32_t) + kMaxMessageSize];  // audio thread
+    uint8_t fResponseBuffer[sizeof(uint32_t) + kMaxMessageSize]; // worker thread
+    uint8_t fWorkBuffer[kMaxMessageSize];                        // worker thread
+    uint8_t fDeliverBuffer[kMaxMessageSize];                     // audio thread
+
+    static bool writeMessage(RingBuffer<uint8_t>& ring, uint8_t* const buffer, const void* const data, const uint32_t size) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(data != nullptr || size == 0, false);
+        DISTRHO_SAFE_ASSERT_RETURN(size <= kMaxMessageSize, false);
+
+        std::memcpy(buffer, &size, sizeof(uint32_t));
+
+        if (size > 0)
+            std::memcpy(buffer + sizeof(uint32_t), data, size);
+
+        return ring.write(buffer, uint32_t(sizeof(uint32_t)) + size);
+    }
+
+    static bool readMessage(RingBuffer<uint8_t>& ring, uint8_t* const buffer, uint32_t& size) noexcept
+    {
+        if (ring.getReadableCount() < sizeof(uint32_t))
+            return false;
+
+        // messages are written in one go, so the data is always complete
+        ring.read((uint8_t*)&size, sizeof(uint32_t));
+        DISTRHO_SAFE_ASSERT_RETURN(size <= kMaxMessageSize, false);
+
+        return ring.read(buffer, size) == size;
+    }
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(PluginWorker)
+};
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // DISTRHO_PLUGIN_WORKER_HPP_INCLUDED
@@ -47,12 +47,17 @@ double NtkUI::d_getSampleRate() const noexcept
 
 void NtkUI::d_editParameter(const uint32_t index, const bool started)
 {
+    // the final value must reach the host before the gesture ends
+    if (! started)
+        pData->flushParameterValue(index);
+
+    pData->setParameterEditing(index, started);
     pData->editParamCallback(index + pData->parameterOffset, started);
 }
 
 void NtkUI::d_setParameterValue(const uint32_t index, const float value)
 {
-    pData->setParamCallback(index + pData->parameterOffset, value);
+    pData->queueParameterValue(index, value);
 }
 
 #if DISTRHO_PLUGIN_WANT_STATE
@@ -69,6 +74,26 @@ void NtkUI::d_sendNote(const uint8_t channel, const uint8_t note, const uint8_t
 }
 #endif
 
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+uint32_t NtkUI::d_readStreamData(float* const data, const uint32_t maxCount) noexcept
+{
+    if (pData->uiStream == nullptr)
+        return 0;
+
+    return pData->uiStream->read(data, maxCount);
+}
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+bool NtkUI::d_readSnapshot(void* const data, const uint32_t size) noexcept
+{
+    if (pData->snapshot == nullptr)
+        return false;
+
+    return pData->snapshot->read(data, size);
+}
+#endif
+
 #if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
 /* ------------------------------------------------------------------------------------------------------------
  * Direct DSP access */
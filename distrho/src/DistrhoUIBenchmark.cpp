@@ -0,0 +1,487 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "DistrhoPluginInternal.hpp"
+
+#if ! DISTRHO_PLUGIN_HAS_UI
+# error UI benchmark requires a plugin with UI
+#endif
+
+#include "DistrhoUIInternal.hpp"
+
+#include "../extra/d_sleep.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <time.h>
+
+using DGL::NtkRedrawScheduler;
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+// Timing samples, reported in milliseconds
+
+struct BenchSamples {
+    std::vector<double> values;
+
+    BenchSamples()
+        : values()
+    {
+        values.reserve(65536);
+    }
+
+    void add(const double seconds)
+    {
+        values.push_back(seconds * 1000.0);
+    }
+
+    void writeJson(FILE* const file, const char* const name, const bool last) const
+    {
+        std::vector<double> sorted(values);
+        std::sort(sorted.begin(), sorted.end());
+
+        double total = 0.0;
+
+        for (std::vector<double>::const_iterator cit = sorted.begin(), cite = sorted.end(); cit != cite; ++cit)
+            total += *cit;
+
+        const size_t count(sorted.size());
+
+        std::fprintf(file, "    \"%s\": { \"count\": %lu", name, static_cast<ulong>(count));
+
+        if (count != 0)
+        {
+            std::fprintf(file, ", \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f",
+                         total/double(count), percentile(sorted, 0.50), percentile(sorted, 0.95), percentile(sorted, 0.99), sorted.back());
+        }
+
+        std::fprintf(file, " }%s\n", last ? "" : ",");
+    }
+
+    static double percentile(const std::vector<double>& sorted, const double p)
+    {
+        const size_t index(static_cast<size_t>(p * double(sorted.size()-1) + 0.5));
+        return sorted[index];
+    }
+};
+
+// -----------------------------------------------------------------------
+// Write @a str as a quoted JSON string
+
+static void writeJsonString(FILE* const file, const char* str)
+{
+    std::fputc('"', file);
+
+    for (; *str != '\0'; ++str)
+    {
+        const unsigned char c(static_cast<unsigned char>(*str));
+
+        if (c == '"' || c == '\\')
+            std::fprintf(file, "\\%c", c);
+        else if (c < 0x20)
+            std::fprintf(file, "\\u%04x", c);
+        else
+            std::fputc(c, file);
+    }
+
+    std::fputc('"', file);
+}
+
+// -----------------------------------------------------------------------
+
+class UIBenchmark
+{
+public:
+    UIBenchmark(const bool coalesce)
+        : fPlugin(),
+          fApp(),
+          fNotifier(fPlugin.getParameterCount()),
+          fUI(this, 0, editParameterCallback, setParameterCallback, setStateCallback, sendNoteCallback, setSizeCallback, fPlugin.getInstancePointer()),
+          fCoalesce(coalesce),
+          fFramePending(false),
+          fFrameStart(0.0),
+          fFrameEnd(0.0),
+          fLastFrameEnd(0.0),
+          fCpuTime(0.0),
+          fRoundTrip(0.0),
+          fMaxRedrawRate(0),
+          fUIChanges(0)
+    {
+        fUI.setWindowTitle(DISTRHO_PLUGIN_NAME " (benchmark)");
+
+        for (uint32_t i=0, count=fPlugin.getParameterCount(); i < count; ++i)
+            fNotifier.setValue(i, fPlugin.getParameterValue(i));
+
+        if (fCoalesce)
+            fUI.setParameterNotifier(&fNotifier);
+    }
+
+    ~UIBenchmark()
+    {
+        fUI.setParameterNotifier(nullptr);
+        fUI.quit();
+    }
+
+    int run(const double duration, const uint paramRate, const uint stateRate, const int maxRedrawRate, FILE* const output)
+    {
+        if (! fUI.setWindowVisible(true))
+        {
+            d_stderr("Failed to show the UI window");
+            return 1;
+        }
+
+        if (maxRedrawRate >= 0)
+        {
+            fApp.setMaxRedrawRate(static_cast<uint>(maxRedrawRate));
+            fApp.postSync(_syncCallback, nullptr);
+        }
+
+        // let the window settle before measuring
+        for (int i=0; i < 20; ++i)
+        {
+            fUI.idle();
+            d_msleep(25);
+        }
+
+        fApp.postSync(_startCallback, this);
+
+        const uint32_t paramCount(fPlugin.getParameterCount());
+#if DISTRHO_PLUGIN_WANT_STATE
+        const uint32_t stateCount(fPlugin.getStateCount());
+#endif
+        const double start(NtkRedrawScheduler::getTime());
+
+        uint64_t paramChanges = 0, stateChanges = 0;
+        double lastIdle = start, lastRoundTrip = start;
+        char stateValue[64];
+
+        for (double now = start; now - start < duration; now = NtkRedrawScheduler::getTime())
+        {
+            const double elapsed(now - start);
+
+            // parameter storm, all parameters swept through their ranges
+            if (paramCount != 0)
+            {
+                for (const uint64_t target = static_cast<uint64_t>(elapsed * paramRate); paramChanges < target; ++paramChanges)
+                {
+                    const uint32_t index(static_cast<uint32_t>(paramChanges % paramCount));
+                    const ParameterRanges& ranges(fPlugin.getParameterRanges(index));
+                    const float phase(0.5f + 0.5f * std::sin(static_cast<float>(elapsed) * 2.0f + static_cast<float>(index)));
+                    const float value(ranges.min + (ranges.max - ranges.min) * phase);
+
+                    if (fCoalesce)
+                        fNotifier.setValue(index, value);
+                    else
+                        fUI.parameterChanged(index, value);
+                }
+            }
+
+            // state changes, synchronous like in the plugin formats
+#if DISTRHO_PLUGIN_WANT_STATE
+            if (stateCount != 0)
+            {
+                for (const uint64_t target = static_cast<uint64_t>(elapsed * stateRate); stateChanges < target; ++stateChanges)
+                {
+                    const uint32_t index(static_cast<uint32_t>(stateChanges % stateCount));
+                    std::snprintf(stateValue, 64, "%lu", static_cast<ulong>(stateChanges));
+                    fUI.stateChanged(fPlugin.getStateKey(index), stateValue);
+                }
+            }
+#else
+            (void)stateRate;
+            (void)stateValue;
+#endif
+
+            // host idle rate
+            if (now - lastIdle >= 0.030)
+            {
+                lastIdle = now;
+                fUI.idle();
+            }
+
+            if (now - lastRoundTrip >= 0.100)
+            {
+                lastRoundTrip = now;
+                fApp.postSync(_roundTripCallback, this);
+                fRoundTrips.add(fRoundTrip);
+            }
+
+            d_msleep(1);
+        }
+
+        fApp.postSync(_stopCallback, this);
+
+        const double elapsed(NtkRedrawScheduler::getTime() - start);
+
+        std::fprintf(output, "{\n");
+        std::fprintf(output, "  \"plugin\": ");
+        writeJsonString(output, fPlugin.getName());
+        std::fprintf(output, ",\n");
+        std::fprintf(output, "  \"config\": { \"duration\": %.3f, \"param_rate\": %u, \"state_rate\": %u, \"max_redraw_rate\": %u, \"coalesce\": %s },\n",
+                     elapsed, paramRate, stateRate, fMaxRedrawRate, fCoalesce ? "true" : "false");
+        std::fprintf(output, "  \"events\": { \"parameters\": %lu, \"states\": %lu, \"ui_changes\": %lu },\n",
+                     static_cast<ulong>(paramChanges), static_cast<ulong>(stateChanges), static_cast<ulong>(fUIChanges));
+        std::fprintf(output, "  \"frames\": { \"count\": %lu, \"fps\": %.2f, \"paints\": %lu },\n",
+                     static_cast<ulong>(fFlushTimes.values.size()), double(fFlushTimes.values.size())/elapsed,
+                     static_cast<ulong>(fPaintTimes.values.size()));
+        std::fprintf(output, "  \"timings_ms\": {\n");
+        fFrameTimes.writeJson(output, "frame_interval", false);
+        fFlushTimes.writeJson(output, "flush", false);
+        fPaintTimes.writeJson(output, "paint", false);
+        fRoundTrips.writeJson(output, "x_round_trip", true);
+        std::fprintf(output, "  },\n");
+        std::fprintf(output, "  \"ui_thread_cpu\": { \"seconds\": %.4f, \"percent\": %.2f }\n", fCpuTime, 100.0 * fCpuTime / elapsed);
+        std::fprintf(output, "}\n");
+        std::fflush(output);
+
+        return 0;
+    }
+
+private:
+    PluginExporter    fPlugin;
+    NtkApp            fApp;
+    ParameterNotifier fNotifier;
+    UIExporter        fUI;
+
+    const bool fCoalesce;
+
+    // written on the NTK thread, read after _stopCallback
+    // a frame is one NTK flush pass, which paints every damaged NtkWidget window once
+    BenchSamples fFrameTimes;
+    BenchSamples fFlushTimes;
+    BenchSamples fPaintTimes;
+    BenchSamples fRoundTrips;
+    bool         fFramePending;
+    double       fFrameStart;
+    double       fFrameEnd;
+    double       fLastFrameEnd;
+    double       fCpuTime;
+    double       fRoundTrip;
+    uint         fMaxRedrawRate;
+    uint64_t     fUIChanges;
+
+    static double getThreadCpuTime() noexcept
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return double(ts.tv_sec) + double(ts.tv_nsec)/1000000000.0;
+    }
+
+    // -------------------------------------------------------------------
+    // NTK thread callbacks
+
+    #define benchPtr ((UIBenchmark*)ptr)
+
+    static void _syncCallback(void*) {}
+
+    static void _startCallback(void* ptr)
+    {
+        benchPtr->fCpuTime = getThreadCpuTime();
+        benchPtr->fApp.getRedrawScheduler().setPaintCallback(_paintCallback, ptr);
+    }
+
+    static void _stopCallback(void* ptr)
+    {
+        benchPtr->fApp.getRedrawScheduler().setPaintCallback(nullptr, nullptr);
+
+        if (benchPtr->fFramePending)
+        {
+            Fl::remove_timeout(_frameEndCallback, ptr);
+            _frameEndCallback(ptr);
+        }
+
+        benchPtr->fCpuTime = getThreadCpuTime() - benchPtr->fCpuTime;
+
+        // the scheduler belongs to the NTK thread
+        benchPtr->fMaxRedrawRate = benchPtr->fApp.getRedrawScheduler().getMaxRate();
+    }
+
+    static void _paintCallback(void* ptr, Fl_Widget*, double start, double end)
+    {
+        benchPtr->fPaintTimes.add(end - start);
+
+        // timeouts run on the next loop iteration, once this flush pass is over
+        if (! benchPtr->fFramePending)
+        {
+            benchPtr->fFramePending = true;
+            benchPtr->fFrameStart   = start;
+            Fl::add_timeout(0.0, _frameEndCallback, ptr);
+        }
+
+        benchPtr->fFrameEnd = end;
+    }
+
+    static void _frameEndCallback(void* ptr)
+    {
+        benchPtr->fFramePending = false;
+        benchPtr->fFlushTimes.add(benchPtr->fFrameEnd - benchPtr->fFrameStart);
+
+        if (benchPtr->fLastFrameEnd != 0.0)
+            benchPtr->fFrameTimes.add(benchPtr->fFrameEnd - benchPtr->fLastFrameEnd);
+
+        benchPtr->fLastFrameEnd = benchPtr->fFrameEnd;
+    }
+
+    static void _roundTripCallback(void* ptr)
+    {
+        const double start(NtkRedrawScheduler::getTime());
+        XSync(fl_display, False);
+        benchPtr->fRoundTrip = NtkRedrawScheduler::getTime() - start;
+    }
+
+    #undef benchPtr
+
+    // -------------------------------------------------------------------
+    // UI to DSP callbacks, only counted
+
+    #define uiPtr ((UIBenchmark*)ptr)
+
+    static void editParameterCallback(void*, uint32_t, bool) {}
+
+    static void setParameterCallback(void* ptr, uint32_t, float)
+    {
+        ++uiPtr->fUIChanges;
+    }
+
+    static void setStateCallback(void* ptr, const char*, const char*)
+    {
+        ++uiPtr->fUIChanges;
+    }
+
+    static void sendNoteCallback(void* ptr, uint8_t, uint8_t, uint8_t)
+    {
+        ++uiPtr->fUIChanges;
+    }
+
+    static void setSizeCallback(void* ptr, uint width, uint height)
+    {
+        uiPtr->fUI.setWindowSize(width, height);
+    }
+
+    #undef uiPtr
+};
+
+END_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+static void printUsage(const char* const argv0)
+{
+    d_stdout("Usage: %s [-d seconds] [-r rate] [-s rate] [-f rate] [-c] [-o file]", argv0);
+    d_stdout("  -d seconds  benchmark duration (default 10)");
+    d_stdout("  -r rate     parameter changes per second sent to the UI (default 1000)");
+    d_stdout("  -s rate     state changes per second sent to the UI (default 0)");
+    d_stdout("  -f rate     maximum redraw rate, 0 for unlimited (default %i)", DGL_NTK_MAX_REDRAW_RATE);
+    d_stdout("  -c          coalesce parameter changes per idle, like the JACK and VST formats do");
+    d_stdout("  -o file     write the JSON report to a file instead of stdout");
+    d_stdout("A X server is required, for headless machines run this under Xvfb, for example:");
+    d_stdout("  xvfb-run -a %s -r 5000", argv0);
+}
+
+int main(int argc, char* argv[])
+{
+    USE_NAMESPACE_DISTRHO;
+
+    double      duration  = 10.0;
+    int         paramRate = 1000;
+    int         stateRate = 0;
+    int         maxRedrawRate = -1;
+    bool        coalesce  = false;
+    const char* filename  = nullptr;
+
+    for (int i=1; i < argc; ++i)
+    {
+        const char* const arg(argv[i]);
+
+        if (std::strcmp(arg, "-d") == 0 && i+1 < argc)
+        {
+            duration = std::atof(argv[++i]);
+        }
+        else if (std::strcmp(arg, "-r") == 0 && i+1 < argc)
+        {
+            paramRate = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(arg, "-s") == 0 && i+1 < argc)
+        {
+            stateRate = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(arg, "-f") == 0 && i+1 < argc)
+        {
+            maxRedrawRate = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(arg, "-c") == 0)
+        {
+            coalesce = true;
+        }
+        else if (std::strcmp(arg, "-o") == 0 && i+1 < argc)
+        {
+            filename = argv[++i];
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return (std::strcmp(arg, "-h") == 0 || std::strcmp(arg, "--help") == 0) ? 0 : 1;
+        }
+    }
+
+    if (duration <= 0.0 || paramRate < 0 || stateRate < 0)
+    {
+        d_stderr("Invalid duration or rate");
+        return 1;
+    }
+
+    if (std::getenv("DISPLAY") == nullptr)
+    {
+        d_stderr("DISPLAY is not set, run this under a X server or Xvfb");
+        return 1;
+    }
+
+    FILE* output = stdout;
+
+    if (filename != nullptr)
+    {
+        output = std::fopen(filename, "w");
+
+        if (output == nullptr)
+        {
+            d_stderr("Failed to open '%s' for writing", filename);
+            return 1;
+        }
+    }
+
+    d_lastBufferSize   = 512;
+    d_lastSampleRate   = 44100.0;
+    d_lastUiSampleRate = 44100.0;
+
+    int ret;
+
+    {
+        UIBenchmark bench(coalesce);
+        ret = bench.run(duration, static_cast<uint>(paramRate), static_cast<uint>(stateRate), maxRedrawRate, output);
+    }
+
+    if (output != stdout)
+        std::fclose(output);
+
+    return ret;
+}
+
+// -----------------------------------------------------------------------
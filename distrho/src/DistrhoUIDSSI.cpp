@@ -20,8 +20,13 @@
 # error DSSI UIs do not support direct access!
 #endif
 
+#include "DistrhoDSSIShm.hpp"
+#include "DistrhoDSSIState.hpp"
+
+#include "../extra/d_mutex.hpp"
 #include "../extra/d_sleep.hpp"
 
+#include <ctime>
 #include <lo/lo.h>
 
 START_NAMESPACE_DISTRHO
@@ -36,38 +41,87 @@ struct OscData {
     OscData()
         : addr(nullptr),
           path(nullptr),
-          server(nullptr) {}
+          server(nullptr),
+          pathConfigure(nullptr),
+          pathControl(nullptr),
+          pathMidi(nullptr),
+          pendingCount(0),
+          pendingSize(0) {}
+
+    void init(const lo_address a, const char* const p, const lo_server s)
+    {
+        addr   = a;
+        path   = p;
+        server = s;
+
+        pathConfigure = makePath("/configure");
+        pathControl   = makePath("/control");
+        pathMidi      = makePath("/midi");
+    }
+
+    void cleanup()
+    {
+        flush();
+
+        std::free(pathConfigure);
+        std::free(pathControl);
+        std::free(pathMidi);
+        pathConfigure = pathControl = pathMidi = nullptr;
+    }
 
-    void idle() const
+    /*
+     * Wait up to 'timeoutInMs' for host messages, then handle everything received.
+     */
+    void idle(const int timeoutInMs) const
     {
         if (server == nullptr)
+            return d_msleep(timeoutInMs);
+
+        if (lo_server_recv_noblock(server, timeoutInMs) == 0)
             return;
 
         while (lo_server_recv_noblock(server, 0) != 0) {}
     }
 
-    void send_configure(const char* const key, const char* const value) const
+    // -------------------------------------------------------------------
+    // Messages for the host are queued and sent once per idle cycle,
+    // in a single bundle when there's more than one.
+
+    void queue_configure(const char* const key, const char* const value)
     {
-        char targetPath[std::strlen(path)+11];
-        std::strcpy(targetPath, path);
-        std::strcat(targetPath, "/configure");
-        lo_send(addr, targetPath, "ss", key, value);
+        const lo_message msg(lo_message_new());
+        lo_message_add_string(msg, key);
+        lo_message_add_string(msg, value);
+        queue(pathConfigure, msg, std::strlen(key) + std::strlen(value) + 32);
     }
 
-    void send_control(const int32_t index, const float value) const
+    void queue_control(const int32_t index, const float value)
     {
-        char targetPath[std::strlen(path)+9];
-        std::strcpy(targetPath, path);
-        std::strcat(targetPath, "/control");
-        lo_send(addr, targetPath, "if", index, value);
+        const lo_message msg(lo_message_new());
+        lo_message_add_int32(msg, index);
+        lo_message_add_float(msg, value);
+        queue(pathControl, msg, 32);
+    }
+
+    void queue_midi(uchar data[4])
+    {
+        const lo_message msg(lo_message_new());
+        lo_message_add_midi(msg, data);
+        queue(pathMidi, msg, 32);
+    }
+
+    void flush()
+    {
+        const MutexLocker cml(mutex);
+        flush_locked();
     }
 
-    void send_midi(uchar data[4]) const
+    void send_configure(const char* const key, const char* const value) const
     {
-        char targetPath[std::strlen(path)+6];
+        char targetPath[std::strlen(path)+11];
         std::strcpy(targetPath, path);
-        std::strcat(targetPath, "/midi");
-        lo_send(addr, targetPath, "m", data);
+        std::strcat(targetPath, "/configure");
+        lo_send(addr, targetPath, "ss", key, value);
     }
 
     void send_update(const char* const url) const
@@ -85,6 +139,70 @@ struct OscData {
         std::strcat(targetPath, "/exiting");
         lo_send(addr, targetPath, "");
     }
+
+private:
+    // full paths, bundles keep pointers to these
+    char* pathConfigure;
+    char* pathControl;
+    char* pathMidi;
+
+    struct PendingMessage {
+        const char* path;
+        lo_message  msg;
+    };
+
+    static const uint32_t kMaxPending = 64;
+
+    Mutex mutex;
+    PendingMessage pending[kMaxPending];
+    uint32_t pendingCount;
+    size_t   pendingSize;
+
+    char* makePath(const char* const suffix) const
+    {
+        char* const targetPath((char*)std::malloc(std::strlen(path)+std::strlen(suffix)+1));
+        std::strcpy(targetPath, path);
+        std::strcat(targetPath, suffix);
+        return targetPath;
+    }
+
+    void queue(const char* const targetPath, const lo_message msg, const size_t size)
+    {
+        const MutexLocker cml(mutex);
+
+        if (pendingCount == kMaxPending || pendingSize + size > kDssiOscMaxMessageSize)
+            flush_locked();
+
+        pending[pendingCount].path = targetPath;
+        pending[pendingCount].msg  = msg;
+        ++pendingCount;
+        pendingSize += size;
+    }
+
+    void flush_locked()
+    {
+        if (pendingCount == 0)
+            return;
+
+        if (pendingCount == 1)
+        {
+            lo_send_message(addr, pending[0].path, pending[0].msg);
+            lo_message_free(pending[0].msg);
+        }
+        else
+        {
+            const lo_bundle bundle(lo_bundle_new(LO_TT_IMMEDIATE));
+
+            for (uint32_t i=0; i < pendingCount; ++i)
+                lo_bundle_add_message(bundle, pending[i].path, pending[i].msg);
+
+            lo_send_bundle(addr, bundle);
+            lo_bundle_free_messages(bundle);
+        }
+
+        pendingCount = 0;
+        pendingSize  = 0;
+    }
 };
 
 // -----------------------------------------------------------------------
@@ -92,30 +210,56 @@ struct OscData {
 class UIDssi
 {
 public:
-    UIDssi(const OscData& oscData, const char* const uiTitle)
-        : fUI(this, 0, nullptr, setParameterCallback, setStateCallback, sendNoteCallback, setSizeCallback),
+    UIDssi(OscData& oscData, const char* const uiTitle)
+        :
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+          fUIStream(DISTRHO_PLUGIN_UI_STREAM_SIZE),
+#endif
+          fUI(this, 0, nullptr, setParameterCallback, setStateCallback, sendNoteCallback, setSizeCallback),
           fHostClosed(false),
           fOscData(oscData)
     {
         fUI.setWindowTitle(uiTitle);
+
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+        fUI.setUIStream(&fUIStream);
+#endif
+
+#if DISTRHO_DSSI_USE_SHM
+        if (fOscData.server != nullptr && fShm.create())
+            fOscData.send_configure(DISTRHO_DSSI_SHM_CONFIGURE_KEY, fShm.getName());
+#endif
     }
 
     ~UIDssi()
     {
         if (fOscData.server != nullptr && ! fHostClosed)
+        {
+            fOscData.flush();
+#if DISTRHO_DSSI_USE_SHM
+            if (fShm.getData() != nullptr)
+                fOscData.send_configure(DISTRHO_DSSI_SHM_CONFIGURE_KEY, "");
+#endif
             fOscData.send_exiting();
+        }
     }
 
     void exec()
     {
         for (;;)
         {
-            fOscData.idle();
+            fOscData.idle(30);
+#if DISTRHO_PLUGIN_WANT_STATE
+            sendPendingStates();
+#endif
+            fOscData.flush();
+
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+            readShmStream();
+#endif
 
             if (fHostClosed || ! fUI.idle())
                 break;
-
-            d_msleep(30);
         }
     }
 
@@ -124,7 +268,9 @@ public:
 #if DISTRHO_PLUGIN_WANT_STATE
     void dssiui_configure(const char* key, const char* value)
     {
-        fUI.stateChanged(key, value);
+        // hosts send back what they stored, big values included
+        if (fStateReceiver.receive(key, value))
+            fUI.stateChanged(fStateReceiver.getKey(), fStateReceiver.getValue());
     }
 #endif
 
@@ -169,7 +315,7 @@ protected:
         if (fOscData.server == nullptr)
             return;
 
-        fOscData.send_control(rindex, value);
+        fOscData.queue_control(rindex, value);
     }
 
     void setState(const char* const key, const char* const value)
@@ -177,7 +323,46 @@ protected:
         if (fOscData.server == nullptr)
             return;
 
-        fOscData.send_configure(key, value);
+#if DISTRHO_PLUGIN_WANT_STATE
+        // everything goes through configure, in order, so the host can save it
+        const MutexLocker cml(fPendingStatesMutex);
+
+        // a new value replaces any unfinished transfer of the same key
+        for (std::list<PendingState>::iterator it=fPendingStates.begin(), ite=fPendingStates.end(); it != ite; ++it)
+        {
+            if (it->key == key)
+            {
+                fPendingStates.erase(it);
+                break;
+            }
+        }
+
+        // too big for a single message, send it in chunks from idle
+        if (d_dssiStateNeedsChunks(key, value))
+        {
+            static uint sGeneration = 0;
+
+            PendingState pending;
+            pending.key    = key;
+            pending.value  = value;
+            pending.offset = 0;
+            pending.index  = 0;
+            pending.generation.appendFormat("%x.%lx.%x", (uint)::getpid(), (ulong)std::time(nullptr), ++sGeneration);
+            fPendingStates.push_back(pending);
+            return;
+        }
+
+        if (value[0] == kDssiStateEscape)
+        {
+            d_string escaped;
+            escaped.append(kDssiStateEscape);
+            escaped.append(value);
+            fOscData.queue_configure(key, escaped);
+            return;
+        }
+#endif
+
+        fOscData.queue_configure(key, value);
     }
 
     void sendNote(const uint8_t channel, const uint8_t note, const uint8_t velocity)
@@ -190,7 +375,7 @@ protected:
         uint8_t mdata[4] = { 0, channel, note, velocity };
         mdata[1] += (velocity != 0) ? 0x90 : 0x80;
 
-        fOscData.send_midi(mdata);
+        fOscData.queue_midi(mdata);
     }
 
     void setSize(const uint width, const uint height)
@@ -199,10 +384,99 @@ protected:
     }
 
 private:
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+    // filled from shared memory, read by the UI
+    RingBuffer<float> fUIStream;
+    float fShmStreamBuffer[kDssiShmStreamChunk];
+#endif
+
     UIExporter fUI;
     bool fHostClosed;
 
-    const OscData& fOscData;
+    OscData& fOscData;
+
+#if DISTRHO_DSSI_USE_SHM
+    DssiShm fShm;
+#endif
+
+#if DISTRHO_PLUGIN_WANT_STATE
+    // big values waiting to be sent in chunks, oldest first
+    struct PendingState {
+        d_string key;
+        d_string value;
+        d_string generation;
+        size_t   offset;
+        uint32_t index;
+    };
+
+    std::list<PendingState> fPendingStates;
+    Mutex fPendingStatesMutex;
+
+    // values coming back from the host
+    DssiStateReceiver fStateReceiver;
+
+    // Sends the next chunks of the pending values, then the reference that completes each one.
+    // Limited per idle so the host's socket buffer never overflows.
+    void sendPendingStates()
+    {
+        const MutexLocker cml(fPendingStatesMutex);
+
+        for (uint32_t sent=0; sent < kDssiStateChunksPerIdle && ! fPendingStates.empty(); ++sent)
+        {
+            PendingState& pending(fPendingStates.front());
+
+            const size_t valueSize(pending.value.length());
+            const size_t size(d_dssiStateChunkLength(pending.value.buffer(), valueSize, pending.offset));
+
+            d_string chunkKey(DISTRHO_DSSI_STATE_CHUNK_PREFIX);
+            chunkKey.appendFormat("%u:", pending.index);
+            chunkKey += pending.key;
+
+            d_string chunkValue(pending.generation);
+            chunkValue.append(':');
+            chunkValue.append(pending.value.buffer() + pending.offset, size);
+
+            fOscData.queue_configure(chunkKey, chunkValue);
+
+            pending.offset += size;
+            ++pending.index;
+
+            if (pending.offset < valueSize)
+                continue;
+
+            d_string reference;
+            reference.append(kDssiStateEscape);
+            reference.appendFormat("chunks:%s:%u", pending.generation.buffer(), pending.index);
+            fOscData.queue_configure(pending.key, reference);
+
+            fPendingStates.pop_front();
+        }
+    }
+#endif
+
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+    void readShmStream()
+    {
+        DssiShmData* const shmData(fShm.getData());
+
+        if (shmData == nullptr)
+            return;
+
+        DssiShmRing& ring(shmData->dspToUi);
+
+        for (uint32_t type, size; ring.peekMessage(type, size);)
+        {
+            if (type != kDssiShmMessageStream || size > sizeof(fShmStreamBuffer))
+            {
+                ring.readMessage(nullptr);
+                continue;
+            }
+
+            ring.readMessage(fShmStreamBuffer);
+            fUIStream.write(fShmStreamBuffer, size/sizeof(float));
+        }
+    }
+#endif
 
     // -------------------------------------------------------------------
     // Callbacks
@@ -274,6 +548,10 @@ int osc_configure_handler(const char*, const char*, lo_arg** argv, int, lo_messa
     const char* const value = &argv[1]->s;
     d_debug("osc_configure_handler(\"%s\", \"%s\")", key, value);
 
+    // hosts might store and send back our reserved keys
+    if (std::strcmp(key, DISTRHO_DSSI_SHM_CONFIGURE_KEY) == 0)
+        return 0;
+
     initUiIfNeeded();
 
     globalUI->dssiui_configure(key, value);
@@ -456,9 +734,7 @@ int main(int argc, char* argv[])
 
     gUiTitle = uiTitle;
 
-    gOscData.addr   = oscAddr;
-    gOscData.path   = oscPath;
-    gOscData.server = oscServer;
+    gOscData.init(oscAddr, oscPath, oscServer);
     gOscData.send_update(pluginPath);
 
     // wait for init
@@ -499,6 +775,8 @@ int main(int argc, char* argv[])
     lo_server_del_method(oscServer, oscPathQuit, "");
     lo_server_del_method(oscServer, nullptr, nullptr);
 
+    gOscData.cleanup();
+
     std::free(oscServerPath);
     std::free(oscHost);
     std::free(oscPort);
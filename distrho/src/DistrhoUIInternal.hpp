@@ -18,12 +18,25 @@
 #define DISTRHO_UI_INTERNAL_HPP_INCLUDED
 
 #include "../DistrhoUI.hpp"
+#include "../extra/d_atomic.hpp"
 
 #include "../../dgl/NtkApp.hpp"
 #include "../../dgl/NtkWindow.hpp"
 using DGL::NtkApp;
+using DGL::NtkRedrawScheduler;
 using DGL::NtkWindow;
 
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+# include "../extra/d_ringbuffer.hpp"
+#endif
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+# include "../extra/d_triplebuffer.hpp"
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 START_NAMESPACE_DISTRHO
 
 // -----------------------------------------------------------------------
@@ -52,6 +65,12 @@ struct NtkUI::PrivateData {
 #if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
     void*    dspPtr;
 #endif
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+    RingBuffer<float>* uiStream;
+#endif
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+    TripleBuffer* snapshot;
+#endif
 
     // Callbacks
     editParamFunc editParamCallbackFunc;
@@ -61,18 +80,42 @@ struct NtkUI::PrivateData {
     setSizeFunc   setSizeCallbackFunc;
     void*         ptr;
 
+    // Outgoing parameter changes, coalesced per parameter until the next idle, flush timer or the end of a gesture
+    std::vector<float>    pendingValues;
+    std::vector<bool>     pendingFlags;
+    std::vector<uint32_t> pendingList;
+    std::vector<float>    sentValues;
+    std::vector<bool>     editingFlags;
+
+    // Fallback flush for hosts that never call idle, runs at the redraw rate
+    const NtkRedrawScheduler* flushScheduler;
+    bool flushTimerActive;
+
     PrivateData() noexcept
         : sampleRate(d_lastUiSampleRate),
           parameterOffset(0),
 #if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
           dspPtr(d_lastUiDspPtr),
+#endif
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+          uiStream(nullptr),
+#endif
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+          snapshot(nullptr),
 #endif
           editParamCallbackFunc(nullptr),
           setParamCallbackFunc(nullptr),
           setStateCallbackFunc(nullptr),
           sendNoteCallbackFunc(nullptr),
           setSizeCallbackFunc(nullptr),
-          ptr(nullptr)
+          ptr(nullptr),
+          pendingValues(),
+          pendingFlags(),
+          pendingList(),
+          sentValues(),
+          editingFlags(),
+          flushScheduler(nullptr),
+          flushTimerActive(false)
     {
         DISTRHO_SAFE_ASSERT(sampleRate != 0.0);
 
@@ -93,6 +136,12 @@ struct NtkUI::PrivateData {
 #endif
     }
 
+    ~PrivateData()
+    {
+        if (flushTimerActive)
+            Fl::remove_timeout(_flushTimerCallback, this);
+    }
+
     void editParamCallback(const uint32_t rindex, const bool started)
     {
         if (editParamCallbackFunc != nullptr)
@@ -105,6 +154,118 @@ struct NtkUI::PrivateData {
             setParamCallbackFunc(ptr, rindex, value);
     }
 
+    void reserveParameterValues(const uint32_t index)
+    {
+        if (index < pendingValues.size())
+            return;
+
+        pendingValues.resize(index+1, 0.0f);
+        pendingFlags.resize(index+1, false);
+        sentValues.resize(index+1, NAN);
+        editingFlags.resize(index+1, false);
+    }
+
+    void setParameterEditing(const uint32_t index, const bool editing)
+    {
+        reserveParameterValues(index);
+        editingFlags[index] = editing;
+    }
+
+    void queueParameterValue(const uint32_t index, const float value)
+    {
+        reserveParameterValues(index);
+
+        pendingValues[index] = value;
+
+        if (pendingFlags[index])
+            return;
+
+        pendingFlags[index] = true;
+        pendingList.push_back(index);
+
+        if (flushTimerActive)
+            return;
+
+        const uint rate((flushScheduler != nullptr) ? flushScheduler->getMaxRate() : 0);
+
+        flushTimerActive = true;
+        Fl::add_timeout((rate != 0) ? 1.0/double(rate) : 0.0, _flushTimerCallback, this);
+    }
+
+    void flushParameterValue(const uint32_t index)
+    {
+        if (index >= pendingFlags.size() || ! pendingFlags[index])
+            return;
+
+        cancelParameterValue(index);
+        sendParameterValue(index);
+    }
+
+   /*
+    * Called for every value coming from the host.
+    * A queued value is dropped if the host changed the parameter after it was queued,
+    * the host echoing our own last write or a running gesture do not count.
+    */
+    void hostParameterValue(const uint32_t index, const float value)
+    {
+        if (index >= pendingFlags.size() || ! pendingFlags[index])
+            return;
+        if (editingFlags[index] || value == sentValues[index])
+            return;
+
+        cancelParameterValue(index);
+    }
+
+    void flushParameterValues()
+    {
+        if (pendingList.size() == 0)
+            return;
+
+        // swap first, the host might call back into the UI
+        std::vector<uint32_t> indexes;
+        indexes.swap(pendingList);
+
+        for (std::vector<uint32_t>::const_iterator cit = indexes.begin(), cite = indexes.end(); cit != cite; ++cit)
+        {
+            const uint32_t index(*cit);
+
+            if (! pendingFlags[index])
+                continue;
+
+            pendingFlags[index] = false;
+            sendParameterValue(index);
+        }
+
+        // keep the allocated space around
+        indexes.clear();
+        if (pendingList.size() == 0)
+            pendingList.swap(indexes);
+    }
+
+    void cancelParameterValue(const uint32_t index)
+    {
+        pendingFlags[index] = false;
+
+        // might not be in the list while flushParameterValues() runs
+        const std::vector<uint32_t>::iterator it(std::find(pendingList.begin(), pendingList.end(), index));
+
+        if (it != pendingList.end())
+            pendingList.erase(it);
+    }
+
+    void sendParameterValue(const uint32_t index)
+    {
+        sentValues[index] = pendingValues[index];
+        setParamCallback(index + parameterOffset, pendingValues[index]);
+    }
+
+    static void _flushTimerCallback(void* ptr)
+    {
+        PrivateData* const self((PrivateData*)ptr);
+        self->flushTimerActive = false;
+        self->flushParameterValues();
+    }
+
     void setStateCallback(const char* const key, const char* const value)
     {
         if (setStateCallbackFunc != nullptr)
@@ -138,6 +299,119 @@ NtkUI* createUiWrapper(NtkApp& app, NtkWindow& window, void* const dspPtr)
     return ret;
 }
 
+// -----------------------------------------------------------------------
+// Parameter changes from the plugin side to the UI.
+// Writers store the value in an atomic slot and set its dirty bit, which is safe to do from the audio thread.
+// The UI takes all dirty bits at once and only gets the latest value of the parameters that changed,
+// coalescing any number of changes in between UI frames.
+
+class ParameterNotifier
+{
+public:
+    typedef void (*FlushFunc)(void* ptr, uint32_t index, float value);
+
+    ParameterNotifier(const uint32_t count)
+        : fCount(count),
+          fValues(nullptr),
+          fLastValues(nullptr),
+          fDirty(nullptr)
+    {
+        if (count == 0)
+            return;
+
+        const uint32_t dirtyCount((count+31)/32);
+
+        fValues     = new AtomicFloat[count];
+        fLastValues = new float[count];
+        fDirty      = new uint32_t[dirtyCount];
+
+        for (uint32_t i=0; i < count; ++i)
+            fLastValues[i] = 0.0f;
+
+        for (uint32_t i=0; i < dirtyCount; ++i)
+            fDirty[i] = 0;
+    }
+
+    ~ParameterNotifier()
+    {
+        if (fValues != nullptr)
+        {
+            delete[] fValues;
+            fValues = nullptr;
+        }
+
+        if (fLastValues != nullptr)
+        {
+            delete[] fLastValues;
+            fLastValues = nullptr;
+        }
+
+        if (fDirty != nullptr)
+        {
+            delete[] fDirty;
+            fDirty = nullptr;
+        }
+    }
+
+    uint32_t getCount() const noexcept
+    {
+        return fCount;
+    }
+
+   /*
+    * Set a new value and mark it as changed.
+    * Each index must only be written by one thread at a time.
+    */
+    void setValue(const uint32_t index, const float value) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(index < fCount,);
+
+        fLastValues[index] = value;
+        fValues[index].store(value);
+
+        __atomic_fetch_or(&fDirty[index/32], 1U << (index%32), __ATOMIC_RELEASE);
+    }
+
+   /*
+    * Same as setValue(), but does nothing if the value did not change since the last call.
+    */
+    void setValueIfChanged(const uint32_t index, const float value) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(index < fCount,);
+
+        if (fLastValues[index] != value)
+            setValue(index, value);
+    }
+
+   /*
+    * Call @a func for each parameter that changed since the last flush.
+    * Must only be called by one thread at a time, usually the UI thread.
+    */
+    void flush(const FlushFunc func, void* const ptr)
+    {
+        for (uint32_t i=0, dirtyCount=(fCount+31)/32; i < dirtyCount; ++i)
+        {
+            if (__atomic_load_n(&fDirty[i], __ATOMIC_RELAXED) == 0)
+                continue;
+
+            for (uint32_t dirty = __atomic_exchange_n(&fDirty[i], 0U, __ATOMIC_ACQUIRE); dirty != 0; dirty &= dirty-1)
+            {
+                const uint32_t index(i*32 + static_cast<uint32_t>(__builtin_ctz(dirty)));
+
+                func(ptr, index, fValues[index].load());
+            }
+        }
+    }
+
+private:
+    const uint32_t fCount;
+    AtomicFloat* fValues;
+    float*       fLastValues; // writer side only
+    uint32_t*    fDirty;      // one bit per parameter
+
+    DISTRHO_DECLARE_NON_COPY_CLASS(ParameterNotifier)
+};
+
 // -----------------------------------------------------------------------
 // UI exporter class
 
@@ -150,7 +424,9 @@ public:
         : ntkApp(),
           ntkWindow(ntkApp, winId),
           fUI(createUiWrapper(ntkApp, ntkWindow, dspPtr)),
-          fData((fUI != nullptr) ? fUI->pData : nullptr)
+          fData((fUI != nullptr) ? fUI->pData : nullptr),
+          fNotifier(nullptr),
+          fIdlePending(false)
     {
         DISTRHO_SAFE_ASSERT_RETURN(fUI != nullptr,);
         DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
@@ -161,6 +437,7 @@ public:
         fData->setStateCallbackFunc  = setStateCall;
         fData->sendNoteCallbackFunc  = sendNoteCall;
         fData->setSizeCallbackFunc   = setSizeCall;
+        fData->flushScheduler        = &ntkApp.getRedrawScheduler();
 
         // set window size
         ntkWindow.size(fUI->w(), fUI->h());
@@ -211,7 +488,7 @@ public:
     {
         DISTRHO_SAFE_ASSERT_RETURN(fUI != nullptr,);
 
-        fUI->d_parameterChanged(index, value);
+        ntkApp.postAsync(_parameterChangedCallback, fUI, index, value);
     }
 
 #if DISTRHO_PLUGIN_WANT_PROGRAMS
@@ -219,7 +496,7 @@ public:
     {
         DISTRHO_SAFE_ASSERT_RETURN(fUI != nullptr,);
 
-        fUI->d_programChanged(index);
+        ntkApp.postAsync(_programChangedCallback, fUI, index);
     }
 #endif
 
@@ -230,7 +507,43 @@ public:
         DISTRHO_SAFE_ASSERT_RETURN(key != nullptr && key[0] != '\0',);
         DISTRHO_SAFE_ASSERT_RETURN(value != nullptr,);
 
-        fUI->d_stateChanged(key, value);
+        StateRequest request = { fUI, key, value };
+        ntkApp.postSync(_stateChangedCallback, &request);
+    }
+#endif
+
+   /*
+    * Use @a notifier for parameter changes coming from the plugin side.
+    * Changes are delivered to the UI once per idle call.
+    */
+    void setParameterNotifier(ParameterNotifier* const notifier) noexcept
+    {
+        fNotifier = notifier;
+    }
+
+#if DISTRHO_PLUGIN_WANT_UI_STREAM
+   /*
+    * Use @a stream as the source for NtkUI::d_readStreamData().
+    * The ring must outlive this UI; the UI thread is its only reader.
+    */
+    void setUIStream(RingBuffer<float>* const stream) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
+
+        fData->uiStream = stream;
+    }
+#endif
+
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+   /*
+    * Use @a snapshot as the source for NtkUI::d_readSnapshot().
+    * The UI thread is its only reader.
+    */
+    void setSnapshot(TripleBuffer* const snapshot) noexcept
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fData != nullptr,);
+
+        fData->snapshot = snapshot;
     }
 #endif
 
@@ -241,14 +554,17 @@ public:
         DISTRHO_SAFE_ASSERT_RETURN(fUI != nullptr, false);
 
         ntkApp.idle();
-        fUI->d_uiIdle();
+
+        // only keep one idle request in the queue
+        if (! fIdlePending.exchange(true))
+            ntkApp.postAsync(_idleCallback, this);
 
         return ! ntkApp.isQuiting();
     }
 
     void quit()
     {
-        ntkWindow.hide();
+        setWindowVisible(false);
         ntkApp.quit();
     }
 
@@ -258,28 +574,32 @@ public:
     {
         DISTRHO_SAFE_ASSERT_RETURN(fUI != nullptr,);
 
-        if (updateUI)
-            fUI->size(width, height);
-
-        ntkWindow.size(width, height);
+        WindowRequest request(this);
+        request.width    = width;
+        request.height   = height;
+        request.updateUI = updateUI;
+        ntkApp.postSync(_setWindowSizeCallback, &request);
     }
 
     void setWindowTitle(const char* const uiTitle)
     {
-        ntkWindow.label(uiTitle);
+        WindowRequest request(this);
+        request.title = uiTitle;
+        ntkApp.postSync(_setWindowTitleCallback, &request);
     }
 
     void setWindowTransientWinId(const intptr_t winId)
     {
-        ntkWindow.setTransientWinId(winId);
+        WindowRequest request(this);
+        request.winId = winId;
+        ntkApp.postSync(_setWindowTransientWinIdCallback, &request);
     }
 
     bool setWindowVisible(const bool yesNo)
     {
-        if (yesNo)
-            ntkWindow.show();
-        else
-            ntkWindow.hide();
+        WindowRequest request(this);
+        request.visible = yesNo;
+        ntkApp.postSync(_setWindowVisibleCallback, &request);
 
         return ! ntkApp.isQuiting();
     }
@@ -314,6 +634,105 @@ private:
     NtkUI* const fUI;
     NtkUI::PrivateData* const fData;
 
+    ParameterNotifier* fNotifier;
+    Atomic<bool> fIdlePending;
+
+    // -------------------------------------------------------------------
+    // Requests run on the NTK thread
+
+#if DISTRHO_PLUGIN_WANT_STATE
+    struct StateRequest {
+        NtkUI* ui;
+        const char* key;
+        const char* value;
+    };
+#endif
+
+    struct WindowRequest {
+        UIExporter* self;
+        uint width, height;
+        bool updateUI;
+        bool visible;
+        intptr_t winId;
+        const char* title;
+
+        WindowRequest(UIExporter* const s) noexcept
+            : self(s),
+              width(0),
+              height(0),
+              updateUI(false),
+              visible(false),
+              winId(0),
+              title(nullptr) {}
+    };
+
+    static void _parameterChangedCallback(void* ptr, uint32_t index, float value)
+    {
+        NtkUI* const ui((NtkUI*)ptr);
+        ui->pData->hostParameterValue(index, value);
+        ui->d_parameterChanged(index, value);
+    }
+
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+    static void _programChangedCallback(void* ptr, uint32_t index, float)
+    {
+        ((NtkUI*)ptr)->d_programChanged(index);
+    }
+#endif
+
+#if DISTRHO_PLUGIN_WANT_STATE
+    static void _stateChangedCallback(void* ptr)
+    {
+        const StateRequest* const request((const StateRequest*)ptr);
+        request->ui->d_stateChanged(request->key, request->value);
+    }
+#endif
+
+    static void _idleCallback(void* ptr, uint32_t, float)
+    {
+        UIExporter* const self((UIExporter*)ptr);
+        self->fIdlePending.store(false);
+
+        self->fData->flushParameterValues();
+
+        if (self->fNotifier != nullptr)
+            self->fNotifier->flush(_parameterChangedCallback, self->fUI);
+
+        self->fUI->d_uiIdle();
+    }
+
+    static void _setWindowSizeCallback(void* ptr)
+    {
+        const WindowRequest* const request((const WindowRequest*)ptr);
+
+        if (request->updateUI)
+            request->self->fUI->size(request->width, request->height);
+
+        request->self->ntkWindow.size(request->width, request->height);
+    }
+
+    static void _setWindowTitleCallback(void* ptr)
+    {
+        const WindowRequest* const request((const WindowRequest*)ptr);
+        request->self->ntkWindow.label(request->title);
+    }
+
+    static void _setWindowTransientWinIdCallback(void* ptr)
+    {
+        const WindowRequest* const request((const WindowRequest*)ptr);
+        request->self->ntkWindow.setTransientWinId(request->winId);
+    }
+
+    static void _setWindowVisibleCallback(void* ptr)
+    {
+        const WindowRequest* const request((const WindowRequest*)ptr);
+
+        if (request->visible)
+            request->self->ntkWindow.show();
+        else
+            request->self->ntkWindow.hide();
+    }
+
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(UIExporter)
 };
 
@@ -15,7 +15,9 @@
  */
 
 #include "DistrhoUIInternal.hpp"
+#include "DistrhoLV2State.hpp"
 
+#include "../extra/d_mutex.hpp"
 #include "../extra/d_string.hpp"
 
 #include "lv2/atom.h"
@@ -28,6 +30,12 @@
 #include "lv2/lv2_kxstudio_properties.h"
 #include "lv2/lv2_programs.h"
 
+#define DISTRHO_LV2_USE_UI_STREAM_PORT (DISTRHO_PLUGIN_WANT_UI_STREAM && ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS)
+
+#if DISTRHO_PLUGIN_WANT_STATE
+# include <list>
+#endif
+
 START_NAMESPACE_DISTRHO
 
 // -----------------------------------------------------------------------
@@ -38,8 +46,12 @@ public:
     UiLv2(const intptr_t winId,
           const LV2_Options_Option* options, const LV2_URID_Map* const uridMap, const LV2UI_Resize* const uiResz, const LV2UI_Touch* uiTouch,
           const LV2UI_Controller controller, const LV2UI_Write_Function writeFunc,
-          LV2UI_Widget* const widget, void* const dspPtr)
-        : fUI(this, winId, editParameterCallback, setParameterCallback, setStateCallback, sendNoteCallback, setSizeCallback, dspPtr),
+          LV2UI_Widget* const widget, void* const dspPtr, void* const uiStream, void* const snapshot)
+        :
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+          fUIStream(DISTRHO_PLUGIN_UI_STREAM_SIZE),
+#endif
+          fUI(this, winId, editParameterCallback, setParameterCallback, setStateCallback, sendNoteCallback, setSizeCallback, dspPtr),
           fUridMap(uridMap),
           fUiResize(uiResz),
           fUiTouch(uiTouch),
@@ -47,8 +59,30 @@ public:
           fWriteFunction(writeFunc),
           fEventTransferURID(uridMap->map(uridMap->handle, LV2_ATOM__eventTransfer)),
           fKeyValueURID(uridMap->map(uridMap->handle, "urn:distrho:keyValueState")),
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+          fAtomFloatURID(uridMap->map(uridMap->handle, LV2_ATOM__Float)),
+          fAtomVectorURID(uridMap->map(uridMap->handle, LV2_ATOM__Vector)),
+#endif
+          fFreewheelPort(LV2UI_INVALID_PORT_INDEX),
+#if DISTRHO_PLUGIN_WANT_BYPASS
+          fEnabledPort(LV2UI_INVALID_PORT_INDEX),
+#endif
           fWinIdWasNull(winId == 0)
     {
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+        fUI.setUIStream(&fUIStream);
+        (void)uiStream;
+#elif DISTRHO_PLUGIN_WANT_UI_STREAM
+        fUI.setUIStream((RingBuffer<float>*)uiStream);
+#else
+        (void)uiStream;
+#endif
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+        fUI.setSnapshot((TripleBuffer*)snapshot);
+#else
+        (void)snapshot;
+#endif
+
         if (fUiResize != nullptr && winId != 0)
             fUiResize->ui_resize(fUiResize->handle, fUI.getWidth(), fUI.getHeight());
 
@@ -102,6 +136,18 @@ public:
             fUI.setWindowTitle(DISTRHO_PLUGIN_NAME);
     }
 
+    void setFreewheelPort(const uint32_t index) noexcept
+    {
+        fFreewheelPort = index;
+    }
+
+#if DISTRHO_PLUGIN_WANT_BYPASS
+    void setEnabledPort(const uint32_t index) noexcept
+    {
+        fEnabledPort = index;
+    }
+#endif
+
     // -------------------------------------------------------------------
 
     void lv2ui_port_event(const uint32_t rindex, const uint32_t bufferSize, const uint32_t format, const void* const buffer)
@@ -110,23 +156,54 @@ public:
         {
             const uint32_t parameterOffset(fUI.getParameterOffset());
 
+            // framework ports come after the parameters and are not plugin parameters
+            if (rindex == fFreewheelPort)
+                return;
+#if DISTRHO_PLUGIN_WANT_BYPASS
+            if (rindex == fEnabledPort)
+                return;
+#endif
+
             DISTRHO_SAFE_ASSERT_RETURN(rindex >= parameterOffset,)
             DISTRHO_SAFE_ASSERT_RETURN(bufferSize == sizeof(float),)
 
             const float value(*(const float*)buffer);
             fUI.parameterChanged(rindex-parameterOffset, value);
         }
-#if DISTRHO_PLUGIN_WANT_STATE
+#if DISTRHO_PLUGIN_WANT_STATE || DISTRHO_LV2_USE_UI_STREAM_PORT
         else if (format == fEventTransferURID)
         {
             const LV2_Atom* const atom((const LV2_Atom*)buffer);
 
+# if DISTRHO_LV2_USE_UI_STREAM_PORT
+            if (atom->type == fAtomVectorURID)
+            {
+                const LV2_Atom_Vector* const vec((const LV2_Atom_Vector*)atom);
+
+                DISTRHO_SAFE_ASSERT_RETURN(vec->body.child_type == fAtomFloatURID && vec->body.child_size == sizeof(float),);
+                DISTRHO_SAFE_ASSERT_RETURN(atom->size >= sizeof(LV2_Atom_Vector_Body),);
+
+                // all or nothing, a full stream means the UI is not keeping up
+                fUIStream.write((const float*)(vec + 1), (atom->size - sizeof(LV2_Atom_Vector_Body))/sizeof(float));
+                return;
+            }
+# endif
+# if DISTRHO_PLUGIN_WANT_STATE
             DISTRHO_SAFE_ASSERT_RETURN(atom->type == fKeyValueURID,);
 
+            // part of a big value, wait for the rest
+            if (Lv2StateChunkReceiver::isChunk(LV2_ATOM_BODY_CONST(atom), atom->size))
+            {
+                if (fStateChunkReceiver.receive(LV2_ATOM_BODY_CONST(atom), atom->size))
+                    fUI.stateChanged(fStateChunkReceiver.getKey(), fStateChunkReceiver.getValue());
+                return;
+            }
+
             const char* const key   = (const char*)LV2_ATOM_BODY_CONST(atom);
             const char* const value = key+(std::strlen(key)+1);
 
             fUI.stateChanged(key, value);
+# endif
         }
 #endif
     }
@@ -135,6 +212,10 @@ public:
 
     int lv2ui_idle()
     {
+#if DISTRHO_PLUGIN_WANT_STATE
+        sendPendingStates();
+#endif
+
         if (fWinIdWasNull)
             return (fUI.idle() && fUI.isVisible()) ? 0 : 1;
 
@@ -219,34 +300,46 @@ protected:
     {
         DISTRHO_SAFE_ASSERT_RETURN(fWriteFunction != nullptr,);
 
-        const uint32_t eventInPortIndex(DISTRHO_PLUGIN_NUM_INPUTS + DISTRHO_PLUGIN_NUM_OUTPUTS);
-
-        // join key and value
-        d_string tmpStr;
-        tmpStr += key;
-        tmpStr += "\xff";
-        tmpStr += value;
+        const size_t keySize(std::strlen(key)+1);
+        const size_t valueSize(std::strlen(value)+1);
 
-        tmpStr[std::strlen(key)] = '\0';
+#if DISTRHO_PLUGIN_WANT_STATE
+        {
+            const MutexLocker cml(fPendingStatesMutex);
 
-        // set msg size (key + separator + value + null terminator)
-        const size_t msgSize(tmpStr.length()+1);
+            // a new value replaces any unfinished transfer of the same key
+            for (std::list<PendingState>::iterator it=fPendingStates.begin(), ite=fPendingStates.end(); it != ite; ++it)
+            {
+                if (it->key == key)
+                {
+                    fPendingStates.erase(it);
+                    break;
+                }
+            }
 
-        // reserve atom space
-        const size_t atomSize(lv2_atom_pad_size(sizeof(LV2_Atom) + msgSize));
-        char         atomBuf[atomSize];
-        std::memset(atomBuf, 0, atomSize);
+            // too big for a single message, send it in chunks from idle
+            if (keySize + valueSize > DISTRHO_LV2_STATE_CHUNK_SIZE)
+            {
+                PendingState pending;
+                pending.key    = key;
+                pending.value  = value;
+                pending.offset = 0;
+                fPendingStates.push_back(pending);
+                return;
+            }
+        }
+#endif
 
-        // set atom info
-        LV2_Atom* const atom((LV2_Atom*)atomBuf);
-        atom->size = msgSize;
-        atom->type = fKeyValueURID;
+        // key + value, each with its null terminator
+        const uint32_t msgSize(keySize + valueSize);
 
-        // set atom data
-        std::memcpy(atomBuf + sizeof(LV2_Atom), tmpStr.buffer(), msgSize);
+        if (LV2_Atom* const atom = allocateStateAtom(msgSize))
+        {
+            std::memcpy(LV2_ATOM_BODY(atom), key, keySize);
+            std::memcpy((char*)LV2_ATOM_BODY(atom) + keySize, value, valueSize);
 
-        // send to DSP side
-        fWriteFunction(fController, eventInPortIndex, atomSize, fEventTransferURID, atom);
+            writeStateAtom(atom);
+        }
     }
 
     void sendNote(const uint8_t /*channel*/, const uint8_t /*note*/, const uint8_t /*velocity*/)
@@ -262,6 +355,87 @@ protected:
     }
 
 private:
+#if DISTRHO_PLUGIN_WANT_STATE
+    // big values waiting to be sent in chunks, oldest first
+    struct PendingState {
+        d_string key;
+        d_string value;
+        uint32_t offset;
+    };
+
+    std::list<PendingState> fPendingStates;
+    Mutex fPendingStatesMutex;
+
+    // big values from the DSP side
+    Lv2StateChunkReceiver fStateChunkReceiver;
+
+    // Sends the next chunks of the pending values, oldest first.
+    // The DSP events port has room for DISTRHO_LV2_STATE_CHUNKS_PER_IDLE chunks on top of its regular events,
+    // so sending no more than that per idle never overflows it, even if the host delivers them in one cycle.
+    void sendPendingStates()
+    {
+        const MutexLocker cml(fPendingStatesMutex);
+
+        for (uint32_t sent=0; sent < DISTRHO_LV2_STATE_CHUNKS_PER_IDLE && ! fPendingStates.empty(); ++sent)
+        {
+            PendingState& pending(fPendingStates.front());
+
+            const uint32_t keySize(pending.key.length()+1);
+            const uint32_t valueSize(pending.value.length());
+
+            uint32_t size(valueSize - pending.offset);
+
+            if (size > DISTRHO_LV2_STATE_CHUNK_SIZE)
+                size = DISTRHO_LV2_STATE_CHUNK_SIZE;
+
+            if (LV2_Atom* const atom = allocateStateAtom(d_lv2StateChunkMessageSize(keySize, size)))
+            {
+                d_lv2StateChunkWrite(LV2_ATOM_BODY(atom), pending.key.buffer(), keySize, pending.value.buffer(), valueSize, pending.offset, size);
+                writeStateAtom(atom);
+            }
+
+            pending.offset += size;
+
+            if (pending.offset == valueSize)
+                fPendingStates.pop_front();
+        }
+    }
+#endif
+
+    LV2_Atom* allocateStateAtom(const uint32_t msgSize)
+    {
+        const size_t atomSize(lv2_atom_pad_size(sizeof(LV2_Atom) + msgSize));
+
+        uint8_t* atomBuf;
+
+        try {
+            atomBuf = new uint8_t[atomSize];
+        } DISTRHO_SAFE_EXCEPTION_RETURN("UiLv2::allocateStateAtom", nullptr);
+
+        std::memset(atomBuf, 0, atomSize);
+
+        LV2_Atom* const atom((LV2_Atom*)atomBuf);
+        atom->size = msgSize;
+        atom->type = fKeyValueURID;
+
+        return atom;
+    }
+
+    // sends to the DSP side and frees an atom from allocateStateAtom()
+    void writeStateAtom(LV2_Atom* const atom)
+    {
+        const uint32_t eventInPortIndex(DISTRHO_PLUGIN_NUM_INPUTS + DISTRHO_PLUGIN_NUM_OUTPUTS);
+
+        fWriteFunction(fController, eventInPortIndex, lv2_atom_pad_size(sizeof(LV2_Atom) + atom->size), fEventTransferURID, atom);
+
+        delete[] (uint8_t*)atom;
+    }
+
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+    // filled from the plugin UI stream port, must outlive fUI
+    RingBuffer<float> fUIStream;
+#endif
+
     UIExporter fUI;
 
     // LV2 features
@@ -276,6 +450,16 @@ private:
     // Need to save this
     const LV2_URID fEventTransferURID;
     const LV2_URID fKeyValueURID;
+#if DISTRHO_LV2_USE_UI_STREAM_PORT
+    const LV2_URID fAtomFloatURID;
+    const LV2_URID fAtomVectorURID;
+#endif
+
+    // found through ui:portMap, ignored in port events
+    uint32_t fFreewheelPort;
+#if DISTRHO_PLUGIN_WANT_BYPASS
+    uint32_t fEnabledPort;
+#endif
 
     // using ui:showInterface if true
     bool fWinIdWasNull;
@@ -327,15 +511,30 @@ static LV2UI_Handle lv2ui_instantiate(const LV2UI_Descriptor*, const char* uri,
     const LV2_URID_Map*       uridMap = nullptr;
     const LV2UI_Resize*      uiResize = nullptr;
     const LV2UI_Touch*       uiTouch  = nullptr;
+    const LV2UI_Port_Map*    portMap  = nullptr;
     void*                    parentId = nullptr;
     void*                    instance = nullptr;
+    void*                    uiStream = nullptr;
+    void*                    snapshot = nullptr;
 
 #if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
 # define DISTRHO_DIRECT_ACCESS_URI "urn:distrho:direct-access"
 
     struct LV2_DirectAccess_Interface {
         void* (*get_instance_pointer)(LV2_Handle handle);
+# if DISTRHO_PLUGIN_WANT_UI_STREAM
+        void* (*get_ui_stream)(LV2_Handle handle);
+# endif
     };
+#endif
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+# define DISTRHO_SNAPSHOT_URI "urn:distrho:snapshot"
+
+    struct LV2_Snapshot_Interface {
+        void* (*get_snapshot)(LV2_Handle handle);
+    };
+#endif
+#if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS || DISTRHO_PLUGIN_WANT_SNAPSHOT
     const LV2_Extension_Data_Feature* extData = nullptr;
 #endif
 
@@ -349,7 +548,9 @@ static LV2UI_Handle lv2ui_instantiate(const LV2UI_Descriptor*, const char* uri,
             uiResize = (const LV2UI_Resize*)features[i]->data;
         else if (std::strcmp(features[i]->URI, LV2_UI__parent) == 0)
             parentId = features[i]->data;
-#if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+        else if (std::strcmp(features[i]->URI, LV2_UI__portMap) == 0)
+            portMap = (const LV2UI_Port_Map*)features[i]->data;
+#if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS || DISTRHO_PLUGIN_WANT_SNAPSHOT
         else if (std::strcmp(features[i]->URI, LV2_DATA_ACCESS_URI) == 0)
             extData = (const LV2_Extension_Data_Feature*)features[i]->data;
         else if (std::strcmp(features[i]->URI, LV2_INSTANCE_ACCESS_URI) == 0)
@@ -374,6 +575,21 @@ static LV2UI_Handle lv2ui_instantiate(const LV2UI_Descriptor*, const char* uri,
         d_stdout("Parent Window Id missing, host should be using ui:showInterface...");
     }
 
+#if DISTRHO_PLUGIN_WANT_SNAPSHOT
+    // optional, only available when the host runs the plugin in the same process
+    if (extData != nullptr && instance != nullptr)
+    {
+        if (const LV2_Snapshot_Interface* const snapshotAccess = (const LV2_Snapshot_Interface*)extData->data_access(DISTRHO_SNAPSHOT_URI))
+            snapshot = snapshotAccess->get_snapshot(instance);
+    }
+
+    if (snapshot == nullptr)
+        d_stdout("Data or instance access missing, UI snapshots will not be available");
+# if ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+    instance = nullptr;
+# endif
+#endif
+
 #if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
     if (extData == nullptr || instance == nullptr)
     {
@@ -382,7 +598,12 @@ static LV2UI_Handle lv2ui_instantiate(const LV2UI_Descriptor*, const char* uri,
     }
 
     if (const LV2_DirectAccess_Interface* const directAccess = (const LV2_DirectAccess_Interface*)extData->data_access(DISTRHO_DIRECT_ACCESS_URI))
+    {
+# if DISTRHO_PLUGIN_WANT_UI_STREAM
+        uiStream = directAccess->get_ui_stream(instance);
+# endif
         instance = directAccess->get_instance_pointer(instance);
+    }
     else
         instance = nullptr;
 
@@ -419,7 +640,17 @@ static LV2UI_Handle lv2ui_instantiate(const LV2UI_Descriptor*, const char* uri,
         d_lastUiSampleRate = 44100.0;
     }
 
-    return new UiLv2(winId, options, uridMap, uiResize, uiTouch, controller, writeFunction, widget, instance);
+    UiLv2* const ui(new UiLv2(winId, options, uridMap, uiResize, uiTouch, controller, writeFunction, widget, instance, uiStream, snapshot));
+
+    if (portMap != nullptr)
+    {
+        ui->setFreewheelPort(portMap->port_index(portMap->handle, "lv2_freewheel"));
+#if DISTRHO_PLUGIN_WANT_BYPASS
+        ui->setEnabledPort(portMap->port_index(portMap->handle, "lv2_enabled"));
+#endif
+    }
+
+    return ui;
 }
 
 #define uiPtr ((UiLv2*)ui)
@@ -0,0 +1,255 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "Tests.hpp"
+#include "extra/d_convolver.hpp"
+
+#include <cmath>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+static uint32_t gRandomSeed = 1;
+
+static float randomSample() noexcept
+{
+    gRandomSeed = gRandomSeed * 1664525u + 1013904223u;
+    return static_cast<float>(gRandomSeed >> 8) / 16777216.0f - 0.5f;
+}
+
+// -----------------------------------------------------------------------
+// forward() matches a direct DFT, inverse(forward(x)) gives x back
+
+static void testFFT()
+{
+    {
+        // not a power of 2, reports a safe assertion
+        const FFT fft(100);
+        DISTRHO_TEST(! fft.isValid());
+    }
+
+    for (uint32_t size=4; size <= 4096; size *= 2)
+    {
+        const FFT fft(size);
+
+        DISTRHO_TEST_RETURN(fft.isValid(),);
+        DISTRHO_TEST(fft.getSize() == size);
+        DISTRHO_TEST(fft.getBinCount() == size/2 + 1);
+
+        const uint32_t bins(fft.getBinCount());
+        float* const in  = new float[size];
+        float* const out = new float[size];
+        float* const re  = new float[bins];
+        float* const im  = new float[bins];
+
+        for (uint32_t i=0; i < size; ++i)
+            in[i] = randomSample();
+
+        fft.forward(in, re, im);
+
+        double maxError = 0.0;
+
+        for (uint32_t k=0; k < bins; ++k)
+        {
+            double dftRe = 0.0, dftIm = 0.0;
+
+            for (uint32_t n=0; n < size; ++n)
+            {
+                const double a(-2.0 * M_PI * double(k) * double(n) / double(size));
+                dftRe += in[n] * std::cos(a);
+                dftIm += in[n] * std::sin(a);
+            }
+
+            maxError = std::fmax(maxError, std::fabs(dftRe - re[k]));
+            maxError = std::fmax(maxError, std::fabs(dftIm - im[k]));
+        }
+
+        DISTRHO_TEST(im[0] == 0.0f && im[bins-1] == 0.0f);
+        DISTRHO_TEST(maxError < 1e-5 * size);
+
+        fft.inverse(re, im, out);
+
+        maxError = 0.0;
+
+        for (uint32_t i=0; i < size; ++i)
+            maxError = std::fmax(maxError, std::fabs(double(in[i]) - out[i]));
+
+        DISTRHO_TEST(maxError < 1e-5);
+
+        delete[] in;
+        delete[] out;
+        delete[] re;
+        delete[] im;
+    }
+
+    // complex multiply-add: (1+2i)(3+4i) = -5+10i
+    float accRe[2] = { 1.0f, 0.0f }, accIm[2] = { 1.0f, 0.0f };
+    const float aRe[2] = { 1.0f, 0.0f }, aIm[2] = { 2.0f, 1.0f };
+    const float bRe[2] = { 3.0f, 0.0f }, bIm[2] = { 4.0f, 1.0f };
+
+    FFT::multiplyAdd(accRe, accIm, aRe, aIm, bRe, bIm, 2);
+
+    DISTRHO_TEST(accRe[0] == -4.0f && accIm[0] == 11.0f);
+    DISTRHO_TEST(accRe[1] == -1.0f && accIm[1] == 0.0f);
+}
+
+// -----------------------------------------------------------------------
+// Convolver output matches direct convolution, however the tail is computed
+
+enum TailMode {
+    kTailInline,    // no scheduler, tail computed in process()
+    kTailScheduler, // scheduler, processTail() called after each process() as a worker would
+    kTailPool       // thread pool, waited for after each process()
+};
+
+static bool gTailPending = false;
+
+static bool scheduleTail(void*)
+{
+    gTailPending = true;
+    return true;
+}
+
+static const uint32_t kSignalLength = 12000;
+
+static void testConvolver(const uint32_t irLength, const TailMode mode)
+{
+    float* const ir  = new float[irLength];
+    float* const in  = new float[kSignalLength];
+    float* const out = new float[kSignalLength];
+
+    for (uint32_t i=0; i < irLength; ++i)
+        ir[i] = randomSample() * std::exp(-static_cast<float>(i) / 2000.0f);
+
+    for (uint32_t i=0; i < kSignalLength; ++i)
+        in[i] = randomSample();
+
+    const ConvolverKernel kernel(ir, irLength, 64, 512);
+    DISTRHO_TEST_RETURN(kernel.isValid() && kernel.getLength() == irLength,);
+
+    ThreadPool pool("convolver", 1, 16);
+    Convolver convolver;
+    DISTRHO_TEST_RETURN(convolver.init(&kernel),);
+
+    if (mode == kTailScheduler)
+        convolver.setTailScheduler(scheduleTail, nullptr);
+    else if (mode == kTailPool)
+        convolver.setTailThreadPool(&pool);
+
+    gTailPending = false;
+
+    // odd block sizes, in place
+    std::memcpy(out, in, sizeof(float)*kSignalLength);
+
+    for (uint32_t pos=0, block=1; pos < kSignalLength; block = block*7 % 331 + 1)
+    {
+        const uint32_t frames((pos + block < kSignalLength) ? block : kSignalLength - pos);
+
+        convolver.process(out + pos, out + pos, frames);
+        pos += frames;
+
+        if (mode == kTailPool)
+            pool.waitForJobs();
+
+        if (gTailPending)
+        {
+            gTailPending = false;
+            convolver.processTail();
+        }
+    }
+
+    double maxError = 0.0;
+
+    for (uint32_t n=0; n < kSignalLength; ++n)
+    {
+        double sum = 0.0;
+
+        for (uint32_t j=0; j < irLength && j <= n; ++j)
+            sum += double(ir[j]) * in[n-j];
+
+        maxError = std::fmax(maxError, std::fabs(sum - out[n]));
+    }
+
+    DISTRHO_TEST(maxError < 1e-4);
+    DISTRHO_TEST(convolver.getTailOverruns() == 0);
+
+    convolver.setTailThreadPool(nullptr);
+
+    delete[] ir;
+    delete[] in;
+    delete[] out;
+}
+
+// -----------------------------------------------------------------------
+// A tail job that never runs is counted as an overrun instead of blocking process()
+
+static bool dropTail(void*)
+{
+    return true;
+}
+
+static void testConvolverOverrun()
+{
+    float ir[3000], buffer[256];
+
+    for (uint32_t i=0; i < 3000; ++i)
+        ir[i] = randomSample();
+
+    const ConvolverKernel kernel(ir, 3000, 64, 512);
+    Convolver convolver;
+    DISTRHO_TEST_RETURN(convolver.init(&kernel),);
+
+    convolver.setTailScheduler(dropTail, nullptr);
+
+    for (uint32_t i=0; i < 16; ++i)
+    {
+        std::memset(buffer, 0, sizeof(buffer));
+        convolver.process(buffer, buffer, 256);
+    }
+
+    // 8 tail blocks, the first one started but never finished
+    DISTRHO_TEST(convolver.getTailOverruns() == 7);
+
+    convolver.reset();
+    DISTRHO_TEST(convolver.getTailOverruns() == 0);
+}
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+int main()
+{
+    USE_NAMESPACE_DISTRHO;
+
+    testFFT();
+
+    // head only, head and body, body ending exactly at the tail, and with a tail
+    const uint32_t lengths[] = { 5, 64, 700, 1024, 1025, 5000 };
+
+    for (uint32_t i=0; i < sizeof(lengths)/sizeof(lengths[0]); ++i)
+    {
+        testConvolver(lengths[i], kTailInline);
+        testConvolver(lengths[i], kTailScheduler);
+        testConvolver(lengths[i], kTailPool);
+    }
+
+    testConvolverOverrun();
+
+    return d_testResult("FFT");
+}
@@ -0,0 +1,319 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "Tests.hpp"
+#include "extra/d_ringbuffer.hpp"
+#include "extra/d_thread.hpp"
+
+#include <sched.h>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+// SPSC: capacity, full/empty and wraparound, single-threaded
+
+static void testRingBufferBasics()
+{
+    RingBuffer<uint32_t> ring(5);
+    uint32_t data[16], out[16];
+
+    for (uint32_t i=0; i < 16; ++i)
+        data[i] = i + 1;
+
+    // rounded up to a power of 2, empty
+    DISTRHO_TEST(ring.getCapacity() == 8);
+    DISTRHO_TEST(ring.getReadableCount() == 0);
+    DISTRHO_TEST(ring.getWritableCount() == 8);
+    DISTRHO_TEST(ring.read(out, 16) == 0);
+
+    // full, writes are all or nothing
+    DISTRHO_TEST(ring.write(data, 6));
+    DISTRHO_TEST(! ring.write(data, 3));
+    DISTRHO_TEST(ring.write(data+6, 2));
+    DISTRHO_TEST(ring.getReadableCount() == 8);
+    DISTRHO_TEST(ring.getWritableCount() == 0);
+    DISTRHO_TEST(! ring.write(data, 1));
+
+    // partial read, then a write that wraps around the end
+    DISTRHO_TEST(ring.read(out, 5) == 5);
+    for (uint32_t i=0; i < 5; ++i)
+        DISTRHO_TEST(out[i] == i + 1);
+
+    DISTRHO_TEST(ring.write(data+8, 5));
+    DISTRHO_TEST(ring.getReadableCount() == 8);
+
+    // a read bigger than what is there returns what is there, in order across the wrap
+    DISTRHO_TEST(ring.read(out, 16) == 8);
+    for (uint32_t i=0; i < 8; ++i)
+        DISTRHO_TEST(out[i] == i + 6);
+
+    DISTRHO_TEST(ring.getReadableCount() == 0);
+    DISTRHO_TEST(ring.getWritableCount() == 8);
+
+    // many wraps with odd sizes
+    uint32_t next = 0, expected = 0;
+
+    for (uint32_t round=0; round < 1000; ++round)
+    {
+        const uint32_t count(1 + round % 7);
+
+        for (uint32_t i=0; i < count; ++i)
+            data[i] = next + i;
+
+        if (ring.write(data, count))
+            next += count;
+
+        const uint32_t got(ring.read(out, 1 + round % 5));
+
+        for (uint32_t i=0; i < got; ++i)
+            DISTRHO_TEST(out[i] == expected + i);
+
+        expected += got;
+    }
+
+    ring.clear();
+    DISTRHO_TEST(ring.getReadableCount() == 0);
+    DISTRHO_TEST(ring.getWritableCount() == 8);
+}
+
+// -----------------------------------------------------------------------
+// SPSC: a producer thread writes a counting sequence, the consumer checks it
+
+static const uint32_t kStreamLength = 200000;
+
+class RingBufferProducer : public Thread
+{
+public:
+    RingBufferProducer(RingBuffer<uint32_t>& ring)
+        : Thread("RingBufferProducer"),
+          fRing(ring) {}
+
+protected:
+    void run() override
+    {
+        uint32_t data[13];
+
+        for (uint32_t next=0; next < kStreamLength;)
+        {
+            uint32_t count(1 + next % 13);
+
+            if (count > kStreamLength - next)
+                count = kStreamLength - next;
+
+            for (uint32_t i=0; i < count; ++i)
+                data[i] = next + i;
+
+            if (fRing.write(data, count))
+                next += count;
+            else
+                sched_yield();
+        }
+    }
+
+private:
+    RingBuffer<uint32_t>& fRing;
+};
+
+static void testRingBufferThreaded()
+{
+    RingBuffer<uint32_t> ring(64);
+    RingBufferProducer producer(ring);
+
+    DISTRHO_TEST_RETURN(producer.startThread(),);
+
+    uint32_t out[32], expected = 0;
+    bool inOrder = true;
+
+    while (expected < kStreamLength)
+    {
+        const bool producerDone(! producer.isThreadRunning());
+        const uint32_t got(ring.read(out, 1 + expected % 32));
+
+        if (got == 0)
+        {
+            // producer done and nothing left, items were lost
+            if (producerDone)
+                break;
+
+            sched_yield();
+        }
+
+        for (uint32_t i=0; i < got; ++i)
+            inOrder = inOrder && out[i] == expected + i;
+
+        expected += got;
+    }
+
+    producer.stopThread(-1);
+
+    DISTRHO_TEST(expected == kStreamLength);
+    DISTRHO_TEST(inOrder);
+    DISTRHO_TEST(ring.getReadableCount() == 0);
+}
+
+// -----------------------------------------------------------------------
+// MPSC: full/empty and wraparound, single-threaded
+
+static void testMpscRingBufferBasics()
+{
+    MpscRingBuffer<uint32_t> ring(3);
+    uint32_t item = 0;
+
+    DISTRHO_TEST(ring.getCapacity() == 4);
+    DISTRHO_TEST(! ring.pop(item));
+
+    for (uint32_t i=0; i < 4; ++i)
+        DISTRHO_TEST(ring.push(i));
+
+    DISTRHO_TEST(! ring.push(99));
+
+    for (uint32_t i=0; i < 4; ++i)
+    {
+        DISTRHO_TEST(ring.pop(item));
+        DISTRHO_TEST(item == i);
+    }
+
+    DISTRHO_TEST(! ring.pop(item));
+
+    // keep it 3 deep for many laps
+    uint32_t next = 0, expected = 0;
+
+    for (uint32_t round=0; round < 1000; ++round)
+    {
+        while (next - expected < 3)
+            DISTRHO_TEST(ring.push(next++));
+
+        DISTRHO_TEST(ring.pop(item));
+        DISTRHO_TEST(item == expected);
+        ++expected;
+    }
+}
+
+// -----------------------------------------------------------------------
+// MPSC: several producer threads, each item arrives once and each producer's items in order
+
+static const uint32_t kMpscProducers     = 4;
+static const uint32_t kMpscItemsPerThread = 50000;
+
+class MpscProducer : public Thread
+{
+public:
+    MpscProducer(MpscRingBuffer<uint32_t>& ring, const uint32_t id)
+        : Thread("MpscProducer"),
+          fRing(ring),
+          fId(id) {}
+
+protected:
+    void run() override
+    {
+        for (uint32_t i=0; i < kMpscItemsPerThread;)
+        {
+            if (fRing.push(fId << 24 | i))
+                ++i;
+            else
+                sched_yield();
+        }
+    }
+
+private:
+    MpscRingBuffer<uint32_t>& fRing;
+    const uint32_t fId;
+};
+
+static bool isAnyProducerRunning(MpscProducer* const* const producers) noexcept
+{
+    for (uint32_t p=0; p < kMpscProducers; ++p)
+    {
+        if (producers[p]->isThreadRunning())
+            return true;
+    }
+
+    return false;
+}
+
+static void testMpscRingBufferThreaded()
+{
+    MpscRingBuffer<uint32_t> ring(256);
+    MpscProducer* producers[kMpscProducers];
+    uint32_t expected[kMpscProducers];
+
+    for (uint32_t p=0; p < kMpscProducers; ++p)
+    {
+        producers[p] = new MpscProducer(ring, p);
+        expected[p]  = 0;
+    }
+
+    for (uint32_t p=0; p < kMpscProducers; ++p)
+        DISTRHO_TEST(producers[p]->startThread());
+
+    bool valid = true;
+    uint32_t received = 0;
+
+    while (received < kMpscProducers*kMpscItemsPerThread)
+    {
+        uint32_t item;
+        const bool producersDone(! isAnyProducerRunning(producers));
+
+        if (! ring.pop(item))
+        {
+            // producers done and nothing left, items were lost
+            if (producersDone)
+                break;
+
+            sched_yield();
+            continue;
+        }
+
+        const uint32_t p(item >> 24);
+
+        valid = valid && p < kMpscProducers && (item & 0xFFFFFF) == expected[p];
+
+        if (! valid)
+            break;
+
+        ++expected[p];
+        ++received;
+    }
+
+    DISTRHO_TEST(valid);
+    DISTRHO_TEST(received == kMpscProducers*kMpscItemsPerThread);
+
+    for (uint32_t p=0; p < kMpscProducers; ++p)
+    {
+        producers[p]->stopThread(-1);
+        delete producers[p];
+    }
+
+    uint32_t item;
+    DISTRHO_TEST(! ring.pop(item));
+}
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+int main()
+{
+    USE_NAMESPACE_DISTRHO;
+
+    testRingBufferBasics();
+    testRingBufferThreaded();
+    testMpscRingBufferBasics();
+    testMpscRingBufferThreaded();
+
+    return d_testResult("RingBuffer");
+}
@@ -0,0 +1,193 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "Tests.hpp"
+#include "extra/d_seqlock.hpp"
+#include "extra/d_thread.hpp"
+
+#include <sched.h>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+// A value whose fields all hold the same number, so a torn copy is easy to spot.
+
+struct SeqLockValue {
+    uint32_t values[32];
+};
+
+static const uint32_t kSeqLockWrites  = 100000;
+static const uint32_t kSeqLockReaders = 3;
+
+static bool isConsistent(const SeqLockValue& value) noexcept
+{
+    for (uint32_t i=1; i < 32; ++i)
+    {
+        if (value.values[i] != value.values[0])
+            return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------
+
+static void testSeqLockBasics()
+{
+    SeqLock<SeqLockValue> lock;
+    SeqLockValue value;
+
+    DISTRHO_TEST(lock.getVersion() == 0);
+
+    // zero-initialized before the first write
+    value = lock.read();
+    DISTRHO_TEST(isConsistent(value) && value.values[0] == 0);
+
+    for (uint32_t i=0; i < 32; ++i)
+        value.values[i] = 7;
+
+    lock.write(value);
+    DISTRHO_TEST(lock.getVersion() == 1);
+
+    SeqLockValue copy;
+    DISTRHO_TEST_RETURN(lock.tryRead(copy),);
+    DISTRHO_TEST(isConsistent(copy) && copy.values[0] == 7);
+}
+
+// -----------------------------------------------------------------------
+// One writer and several readers, no reader may ever see a torn or older value.
+
+class SeqLockReader : public Thread
+{
+public:
+    SeqLockReader(const SeqLock<SeqLockValue>& lock)
+        : Thread("SeqLockReader"),
+          fLock(lock),
+          fTorn(0),
+          fBackwards(0),
+          fReads(0) {}
+
+    uint32_t getTornCount() const noexcept
+    {
+        return fTorn;
+    }
+
+    uint32_t getBackwardsCount() const noexcept
+    {
+        return fBackwards;
+    }
+
+    uint32_t getReadCount() const noexcept
+    {
+        return fReads;
+    }
+
+protected:
+    void run() override
+    {
+        uint32_t last = 0;
+
+        while (last < kSeqLockWrites)
+        {
+            SeqLockValue value;
+
+            if (fReads % 2 == 0)
+            {
+                value = fLock.read();
+            }
+            else if (! fLock.tryRead(value))
+            {
+                sched_yield();
+                continue;
+            }
+
+            ++fReads;
+
+            if (! isConsistent(value))
+            {
+                ++fTorn;
+                continue;
+            }
+
+            if (value.values[0] < last)
+                ++fBackwards;
+
+            last = value.values[0];
+
+            if (fReads % 64 == 0)
+                sched_yield();
+        }
+    }
+
+private:
+    const SeqLock<SeqLockValue>& fLock;
+    uint32_t fTorn;
+    uint32_t fBackwards;
+    uint32_t fReads;
+};
+
+static void testSeqLockConcurrentReads()
+{
+    SeqLock<SeqLockValue> lock;
+    SeqLockReader* readers[kSeqLockReaders];
+
+    for (uint32_t r=0; r < kSeqLockReaders; ++r)
+    {
+        readers[r] = new SeqLockReader(lock);
+        DISTRHO_TEST(readers[r]->startThread());
+    }
+
+    SeqLockValue value;
+
+    for (uint32_t n=1; n <= kSeqLockWrites; ++n)
+    {
+        for (uint32_t i=0; i < 32; ++i)
+            value.values[i] = n;
+
+        lock.write(value);
+
+        if (n % 64 == 0)
+            sched_yield();
+    }
+
+    DISTRHO_TEST(lock.getVersion() == kSeqLockWrites);
+
+    for (uint32_t r=0; r < kSeqLockReaders; ++r)
+    {
+        readers[r]->stopThread(-1);
+
+        DISTRHO_TEST(readers[r]->getReadCount() > 0);
+        DISTRHO_TEST(readers[r]->getTornCount() == 0);
+        DISTRHO_TEST(readers[r]->getBackwardsCount() == 0);
+
+        delete readers[r];
+    }
+}
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+int main()
+{
+    USE_NAMESPACE_DISTRHO;
+
+    testSeqLockBasics();
+    testSeqLockConcurrentReads();
+
+    return d_testResult("SeqLock");
+}
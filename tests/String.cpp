@@ -0,0 +1,217 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "Tests.hpp"
+#include "extra/d_string.hpp"
+
+#include <utility>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+// Short strings live inline, longer ones move to the heap and grow geometrically
+
+static void testStringStorage()
+{
+    d_string str;
+
+    DISTRHO_TEST(str.isEmpty());
+    DISTRHO_TEST(str.length() == 0);
+    DISTRHO_TEST(str == "");
+    DISTRHO_TEST(str.capacity() == 31);
+
+    str = "0123456789012345678901234567890";
+    DISTRHO_TEST(str.length() == 31);
+    DISTRHO_TEST(str.capacity() == 31);
+
+    // one more character leaves the inline buffer, keeping the contents
+    str += "x";
+    DISTRHO_TEST(str.length() == 32);
+    DISTRHO_TEST(str.capacity() >= 62);
+    DISTRHO_TEST(str == "0123456789012345678901234567890x");
+
+    // repeated appends reallocate a logarithmic number of times
+    uint32_t reallocations = 0;
+    size_t capacity(str.capacity());
+
+    for (uint32_t i=0; i < 10000; ++i)
+    {
+        str.append('a');
+
+        if (str.capacity() != capacity)
+        {
+            ++reallocations;
+            capacity = str.capacity();
+        }
+    }
+
+    DISTRHO_TEST(str.length() == 10032);
+    DISTRHO_TEST(reallocations <= 10);
+    DISTRHO_TEST(str.endsWith("aaaa"));
+
+    // clear and shorter assignments keep the buffer
+    str.clear();
+    DISTRHO_TEST(str.isEmpty());
+    DISTRHO_TEST(str.capacity() == capacity);
+
+    str = "short";
+    DISTRHO_TEST(str == "short");
+    DISTRHO_TEST(str.capacity() == capacity);
+
+    // reserve
+    d_string reserved;
+    DISTRHO_TEST(reserved.reserve(1000));
+    DISTRHO_TEST(reserved.capacity() >= 1000);
+    reserved = "abc";
+    DISTRHO_TEST(reserved == "abc");
+    DISTRHO_TEST(reserved.length() == 3);
+}
+
+// -----------------------------------------------------------------------
+// Copies are independent, moves take over the heap buffer and leave the source empty
+
+static void testStringCopyMove()
+{
+    const char* const longText = "a string too long for the inline buffer of d_string";
+
+    d_string a(longText);
+    d_string b(a);
+
+    DISTRHO_TEST(b == a);
+    DISTRHO_TEST(b.buffer() != a.buffer());
+
+    b[0] = 'A';
+    DISTRHO_TEST(a == longText);
+    DISTRHO_TEST(b != a);
+
+    const char* const heapBuffer(a.buffer());
+    d_string moved(std::move(a));
+
+    DISTRHO_TEST(moved == longText);
+    DISTRHO_TEST(moved.buffer() == heapBuffer);
+    DISTRHO_TEST(a.isEmpty());
+
+    // a moved-from string is still usable
+    a = "again";
+    DISTRHO_TEST(a == "again");
+
+    d_string assigned;
+    assigned = std::move(moved);
+    DISTRHO_TEST(assigned == longText);
+    DISTRHO_TEST(assigned.buffer() == heapBuffer);
+    DISTRHO_TEST(moved.isEmpty());
+
+    // short strings are copied out of the inline buffer
+    d_string shortStr("short");
+    d_string shortMoved(std::move(shortStr));
+    DISTRHO_TEST(shortMoved == "short");
+    DISTRHO_TEST(shortStr.isEmpty());
+
+    // self assignment
+    d_string& self(assigned);
+    assigned = self;
+    DISTRHO_TEST(assigned == longText);
+}
+
+// -----------------------------------------------------------------------
+// Appending or assigning from inside the same string
+
+static void testStringAliasing()
+{
+    d_string str("abcdefghijklmnopqrstuvwxyz");
+
+    // grows the buffer while reading from it
+    str.append(str.buffer(), str.length());
+    DISTRHO_TEST(str == "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz");
+
+    str += str;
+    DISTRHO_TEST(str.length() == 104);
+    DISTRHO_TEST(str.startsWith("abcdef") && str.endsWith("uvwxyz"));
+
+    // assigning a tail of itself
+    str = str.buffer() + 100;
+    DISTRHO_TEST(str == "wxyz");
+}
+
+// -----------------------------------------------------------------------
+
+static void testStringOperations()
+{
+    DISTRHO_TEST(d_string(42) == "42");
+    DISTRHO_TEST(d_string(-7) == "-7");
+    DISTRHO_TEST(d_string(255u, true) == "0xff");
+    DISTRHO_TEST(d_string('c') == "c");
+
+    d_string str("Hello World");
+
+    DISTRHO_TEST(str.contains("World"));
+    DISTRHO_TEST(str.contains("world", true));
+    DISTRHO_TEST(! str.contains("world"));
+    DISTRHO_TEST(str.startsWith('H') && str.startsWith("Hello"));
+    DISTRHO_TEST(str.endsWith('d') && str.endsWith("World"));
+
+    bool found;
+    DISTRHO_TEST(str.find('o', &found) == 4 && found);
+    DISTRHO_TEST(str.rfind('o', &found) == 7 && found);
+    DISTRHO_TEST(str.find("World", &found) == 6 && found);
+    str.find('z', &found);
+    DISTRHO_TEST(! found);
+
+    d_string joined(str + " again");
+    DISTRHO_TEST(joined == "Hello World again");
+    DISTRHO_TEST(str == "Hello World");
+
+    joined.appendFormat(" %i/%s", 3, "4");
+    DISTRHO_TEST(joined == "Hello World again 3/4");
+
+    // formatted text longer than the space left
+    d_string formatted("x");
+    formatted.appendFormat("%0100i", 1);
+    DISTRHO_TEST(formatted.length() == 101);
+    DISTRHO_TEST(formatted.endsWith("001"));
+
+    joined.truncate(5);
+    DISTRHO_TEST(joined == "Hello");
+
+    joined.toUpper();
+    DISTRHO_TEST(joined == "HELLO");
+    joined.toLower();
+    DISTRHO_TEST(joined == "hello");
+
+    joined.replace('l', 'L');
+    DISTRHO_TEST(joined == "heLLo");
+
+    d_string basic("a-b c.d");
+    basic.toBasic();
+    DISTRHO_TEST(basic == "a_b_c_d");
+}
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+int main()
+{
+    USE_NAMESPACE_DISTRHO;
+
+    testStringStorage();
+    testStringCopyMove();
+    testStringAliasing();
+    testStringOperations();
+
+    return d_testResult("String");
+}
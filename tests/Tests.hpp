@@ -0,0 +1,47 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DISTRHO_TESTS_HPP_INCLUDED
+#define DISTRHO_TESTS_HPP_INCLUDED
+
+#include "DistrhoUtils.hpp"
+
+// -----------------------------------------------------------------------
+// Minimal checks for the behaviour tests, each test is a small program.
+// A failed check is reported and counted, main() returns the count.
+
+static int gTestFailures = 0;
+
+#define DISTRHO_TEST(cond) \
+    if (! (cond)) { d_stderr2("test failed: \"%s\" in file %s, line %i", #cond, __FILE__, __LINE__); ++gTestFailures; }
+
+#define DISTRHO_TEST_RETURN(cond, ret) \
+    if (! (cond)) { d_stderr2("test failed: \"%s\" in file %s, line %i", #cond, __FILE__, __LINE__); ++gTestFailures; return ret; }
+
+static inline
+int d_testResult(const char* const name) noexcept
+{
+    if (gTestFailures == 0)
+        d_stdout("%s: ok", name);
+    else
+        d_stderr2("%s: %i failures", name, gTestFailures);
+
+    return gTestFailures;
+}
+
+// -----------------------------------------------------------------------
+
+#endif // DISTRHO_TESTS_HPP_INCLUDED
@@ -0,0 +1,170 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "Tests.hpp"
+#include "extra/d_sleep.hpp"
+#include "extra/d_thread.hpp"
+
+#include <sched.h>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+struct ThreadPoolJobData {
+    Atomic<uint32_t> runs;
+    uint32_t sleepMs;
+
+    ThreadPoolJobData()
+        : runs(0),
+          sleepMs(0) {}
+};
+
+static void countJob(void* const ptr)
+{
+    ThreadPoolJobData* const data(static_cast<ThreadPoolJobData*>(ptr));
+
+    if (data->sleepMs != 0)
+        d_msleep(data->sleepMs);
+
+    data->runs.fetchAdd(1);
+}
+
+struct ThreadPoolBlocker {
+    Signal release;
+    Atomic<bool> started;
+};
+
+static void blockJob(void* const ptr)
+{
+    ThreadPoolBlocker* const blocker(static_cast<ThreadPoolBlocker*>(ptr));
+
+    blocker->started.store(true);
+    blocker->release.wait();
+}
+
+static void addJobRetrying(ThreadPool& pool, ThreadPool::JobFunc func, void* const ptr)
+{
+    for (; ! pool.addJob(func, ptr);)
+        sched_yield();
+}
+
+// -----------------------------------------------------------------------
+// Every job runs exactly once, and waitForJobs() returns only after all of them
+
+static void testThreadPoolBatches()
+{
+    static const uint32_t kJobCount = 200;
+
+    ThreadPool pool("test", 3, 16);
+    ThreadPoolJobData jobs[kJobCount];
+
+    DISTRHO_TEST_RETURN(pool.getThreadCount() == 3,);
+
+    // nothing queued, returns right away
+    pool.waitForJobs();
+    DISTRHO_TEST(pool.getPendingJobCount() == 0);
+
+    for (uint32_t batch=1; batch <= 10; ++batch)
+    {
+        for (uint32_t i=0; i < kJobCount; ++i)
+        {
+            jobs[i].sleepMs = (i % 50 == 0) ? 1 : 0;
+            addJobRetrying(pool, countJob, &jobs[i]);
+        }
+
+        pool.waitForJobs();
+
+        DISTRHO_TEST(pool.getPendingJobCount() == 0);
+
+        for (uint32_t i=0; i < kJobCount; ++i)
+            DISTRHO_TEST(jobs[i].runs.load() == batch);
+    }
+}
+
+// -----------------------------------------------------------------------
+// A batch that finished without anyone waiting must not wake up the next waitForJobs() early
+
+static void testThreadPoolStaleWakeup()
+{
+    ThreadPool pool("test", 2, 16);
+    ThreadPoolJobData quick, slow[4];
+
+    addJobRetrying(pool, countJob, &quick);
+
+    for (; pool.getPendingJobCount() != 0;)
+        d_msleep(1);
+
+    for (uint32_t i=0; i < 4; ++i)
+    {
+        slow[i].sleepMs = 20;
+        addJobRetrying(pool, countJob, &slow[i]);
+    }
+
+    pool.waitForJobs();
+
+    DISTRHO_TEST(quick.runs.load() == 1);
+
+    for (uint32_t i=0; i < 4; ++i)
+        DISTRHO_TEST(slow[i].runs.load() == 1);
+}
+
+// -----------------------------------------------------------------------
+// addJob() fails once all queues are full, and the jobs queued before still run
+
+static void testThreadPoolFullQueue()
+{
+    ThreadPool pool("test", 1, 4);
+    ThreadPoolBlocker blocker;
+    ThreadPoolJobData jobs[4], rejected;
+
+    // keep the only thread busy
+    DISTRHO_TEST_RETURN(pool.addJob(blockJob, &blocker),);
+
+    for (; ! blocker.started.load();)
+        sched_yield();
+
+    for (uint32_t i=0; i < 4; ++i)
+        DISTRHO_TEST(pool.addJob(countJob, &jobs[i]));
+
+    DISTRHO_TEST(! pool.addJob(countJob, &rejected));
+    DISTRHO_TEST(pool.getPendingJobCount() == 5);
+
+    blocker.release.signal();
+    pool.waitForJobs();
+
+    DISTRHO_TEST(pool.getPendingJobCount() == 0);
+    DISTRHO_TEST(rejected.runs.load() == 0);
+
+    for (uint32_t i=0; i < 4; ++i)
+        DISTRHO_TEST(jobs[i].runs.load() == 1);
+}
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+int main()
+{
+    USE_NAMESPACE_DISTRHO;
+
+    testThreadPoolBatches();
+    testThreadPoolStaleWakeup();
+    testThreadPoolFullQueue();
+
+    return d_testResult("ThreadPool");
+}
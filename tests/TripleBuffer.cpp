@@ -0,0 +1,208 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "Tests.hpp"
+#include "extra/d_triplebuffer.hpp"
+#include "extra/d_thread.hpp"
+
+#include <sched.h>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+struct TripleBufferValue {
+    uint32_t serial;
+    float    levels[15];
+};
+
+static const uint32_t kTripleBufferWrites = 100000;
+
+// -----------------------------------------------------------------------
+// Handoff in a single thread: latest value wins, isFresh() follows writes and reads
+
+static void testTripleBufferHandoff()
+{
+    TripleBuffer buffer(16);
+    uint8_t data[16], out[16];
+
+    DISTRHO_TEST(buffer.getCapacity() == 16);
+    DISTRHO_TEST(! buffer.isFresh());
+
+    // nothing published yet
+    DISTRHO_TEST(! buffer.read(out, 8));
+
+    // size checks, these report a safe assertion
+    std::memset(data, 1, sizeof(data));
+    DISTRHO_TEST(! buffer.write(data, 0));
+    DISTRHO_TEST(! buffer.write(data, 17));
+    DISTRHO_TEST(! buffer.isFresh());
+
+    DISTRHO_TEST(buffer.write(data, 8));
+    DISTRHO_TEST(buffer.isFresh());
+
+    // a block of another size is not handed out
+    DISTRHO_TEST(! buffer.read(out, 4));
+    DISTRHO_TEST(! buffer.isFresh());
+
+    // reading again without a new write gives the same block
+    std::memset(out, 0, sizeof(out));
+    DISTRHO_TEST(buffer.read(out, 8));
+    DISTRHO_TEST(out[0] == 1 && out[7] == 1);
+    DISTRHO_TEST(! buffer.isFresh());
+
+    // several writes before a read, only the last one is seen
+    for (uint8_t i=2; i <= 5; ++i)
+    {
+        std::memset(data, i, sizeof(data));
+        DISTRHO_TEST(buffer.write(data, 8));
+    }
+
+    DISTRHO_TEST(buffer.isFresh());
+    DISTRHO_TEST(buffer.read(out, 8));
+    DISTRHO_TEST(out[0] == 5 && out[7] == 5);
+    DISTRHO_TEST(! buffer.isFresh());
+
+    // alternating writes and reads go through all slots
+    for (uint8_t i=6; i < 30; ++i)
+    {
+        std::memset(data, i, sizeof(data));
+        DISTRHO_TEST(buffer.write(data, 16));
+        DISTRHO_TEST(buffer.read(out, 16));
+        DISTRHO_TEST(out[0] == i && out[15] == i);
+    }
+
+    TypedTripleBuffer<TripleBufferValue> typed;
+    TripleBufferValue value;
+
+    value.serial = 0;
+    DISTRHO_TEST(! typed.read(value));
+    DISTRHO_TEST(value.serial == 0);
+
+    value.serial = 42;
+    typed.write(value);
+    value.serial = 0;
+
+    DISTRHO_TEST(typed.isFresh());
+    DISTRHO_TEST(typed.read(value));
+    DISTRHO_TEST(value.serial == 42);
+    DISTRHO_TEST(! typed.isFresh());
+}
+
+// -----------------------------------------------------------------------
+// Writer thread publishing numbered values, the reader never sees a torn or older one
+
+class TripleBufferWriter : public Thread
+{
+public:
+    TripleBufferWriter(TypedTripleBuffer<TripleBufferValue>& buffer)
+        : Thread("TripleBufferWriter"),
+          fBuffer(buffer) {}
+
+protected:
+    void run() override
+    {
+        TripleBufferValue value;
+
+        for (uint32_t n=1; n <= kTripleBufferWrites; ++n)
+        {
+            value.serial = n;
+
+            for (uint32_t i=0; i < 15; ++i)
+                value.levels[i] = static_cast<float>(n);
+
+            fBuffer.write(value);
+
+            if (n % 64 == 0)
+                sched_yield();
+        }
+    }
+
+private:
+    TypedTripleBuffer<TripleBufferValue>& fBuffer;
+};
+
+static void testTripleBufferThreaded()
+{
+    TypedTripleBuffer<TripleBufferValue> buffer;
+    TripleBufferWriter writer(buffer);
+
+    DISTRHO_TEST_RETURN(writer.startThread(),);
+
+    uint32_t last = 0, reads = 0, torn = 0, backwards = 0;
+
+    while (last < kTripleBufferWrites)
+    {
+        TripleBufferValue value;
+        const bool writerDone(! writer.isThreadRunning());
+
+        if (! buffer.read(value))
+        {
+            // writer done and nothing was handed over
+            if (writerDone)
+                break;
+
+            sched_yield();
+            continue;
+        }
+
+        ++reads;
+
+        for (uint32_t i=0; i < 15; ++i)
+        {
+            if (value.levels[i] != static_cast<float>(value.serial))
+            {
+                ++torn;
+                break;
+            }
+        }
+
+        if (value.serial < last)
+            ++backwards;
+
+        last = value.serial;
+
+        // this read came after the last write, it must have been the last value
+        if (writerDone)
+            break;
+
+        if (reads % 64 == 0)
+            sched_yield();
+    }
+
+    writer.stopThread(-1);
+
+    DISTRHO_TEST(reads > 0);
+    DISTRHO_TEST(last == kTripleBufferWrites);
+    DISTRHO_TEST(torn == 0);
+    DISTRHO_TEST(backwards == 0);
+    DISTRHO_TEST(! buffer.isFresh());
+}
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+int main()
+{
+    USE_NAMESPACE_DISTRHO;
+
+    testTripleBufferHandoff();
+    testTripleBufferThreaded();
+
+    return d_testResult("TripleBuffer");
+}
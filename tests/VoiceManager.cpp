@@ -0,0 +1,340 @@
+/*
+ * DISTRHO Plugin Framework (DPF)
+ * Copyright (C) 2012-2014 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "Tests.hpp"
+#include "extra/d_voices.hpp"
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------
+
+static const uint32_t kVoices = 8;
+static const uint32_t kGroups = kVoices / DISTRHO_VOICE_LANE_WIDTH;
+
+// Records the callbacks from VoiceManager::process()
+class TestRenderer : public VoiceRenderer
+{
+public:
+    uint32_t startedCount;
+    uint32_t lastStarted;
+    bool     lastStolen;
+
+    uint32_t renderedFrames[kGroups];
+    uint32_t renderedEnd[kGroups];
+    bool     contiguous;
+
+    TestRenderer()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        startedCount = 0;
+        lastStarted  = kVoices;
+        lastStolen   = false;
+        contiguous   = true;
+
+        for (uint32_t g=0; g < kGroups; ++g)
+        {
+            renderedFrames[g] = 0;
+            renderedEnd[g]    = 0;
+        }
+    }
+
+    void voiceStarted(uint32_t voice, bool stolen) override
+    {
+        ++startedCount;
+        lastStarted = voice;
+        lastStolen  = stolen;
+    }
+
+    void renderVoices(uint32_t firstVoice, uint32_t offset, uint32_t frames) override
+    {
+        const uint32_t g(firstVoice / DISTRHO_VOICE_LANE_WIDTH);
+
+        // sub-blocks of a group never overlap and never go backwards
+        if (firstVoice % DISTRHO_VOICE_LANE_WIDTH != 0 || g >= kGroups || offset < renderedEnd[g] || frames == 0)
+        {
+            contiguous = false;
+            return;
+        }
+
+        renderedFrames[g] += frames;
+        renderedEnd[g] = offset + frames;
+    }
+};
+
+static MidiEvent makeEvent(const uint32_t frame, const uint8_t status, const uint8_t data1, const uint8_t data2)
+{
+    MidiEvent event;
+    event.frame   = frame;
+    event.size    = 3;
+    event.data[0] = status;
+    event.data[1] = data1;
+    event.data[2] = data2;
+    event.data[3] = 0;
+    event.dataExt = nullptr;
+    return event;
+}
+
+static void processEvent(VoiceManager<kVoices>& voices, TestRenderer& renderer,
+                         const uint8_t status, const uint8_t data1, const uint8_t data2)
+{
+    const MidiEvent event(makeEvent(0, status, data1, data2));
+    voices.process(&event, 1, 0, renderer);
+}
+
+static bool isClose(const float a, const float b) noexcept
+{
+    return std::fabs(a - b) <= 1e-3f * b;
+}
+
+// -----------------------------------------------------------------------
+// Note on/off, velocity 0 and finishVoice()
+
+static void testNotes()
+{
+    VoiceManager<kVoices> voices;
+    TestRenderer renderer;
+    const VoiceState<kVoices>& state(voices.getState());
+
+    DISTRHO_TEST(voices.getActiveVoiceCount() == 0);
+
+    processEvent(voices, renderer, 0x90, 69, 127);
+
+    DISTRHO_TEST_RETURN(renderer.startedCount == 1 && renderer.lastStarted < kVoices,);
+    DISTRHO_TEST(! renderer.lastStolen);
+
+    const uint32_t v(renderer.lastStarted);
+
+    DISTRHO_TEST(voices.getActiveVoiceCount() == 1);
+    DISTRHO_TEST(state.active[v] == 1.0f && state.gate[v] == 1.0f);
+    DISTRHO_TEST(state.note[v] == 69 && state.channel[v] == 0);
+    DISTRHO_TEST(state.velocity[v] == 1.0f);
+    DISTRHO_TEST(isClose(state.frequency[v], 440.0f));
+
+    // the same note again restarts the same voice
+    processEvent(voices, renderer, 0x90, 69, 64);
+    DISTRHO_TEST(renderer.lastStarted == v && renderer.lastStolen);
+    DISTRHO_TEST(voices.getActiveVoiceCount() == 1);
+
+    // another note, on another channel, gets another voice
+    processEvent(voices, renderer, 0x91, 81, 100);
+    const uint32_t v2(renderer.lastStarted);
+    DISTRHO_TEST(v2 != v && ! renderer.lastStolen);
+    DISTRHO_TEST(state.channel[v2] == 1);
+    DISTRHO_TEST(isClose(state.frequency[v2], 880.0f));
+
+    // note off only releases the note on its own channel
+    processEvent(voices, renderer, 0x80, 69, 0);
+    processEvent(voices, renderer, 0x81, 69, 0);
+    DISTRHO_TEST(state.gate[v] == 0.0f && state.gate[v2] == 1.0f);
+
+    // releasing keeps the voice sounding until the plugin finishes it
+    DISTRHO_TEST(state.active[v] == 1.0f);
+    voices.finishVoice(v);
+    DISTRHO_TEST(state.active[v] == 0.0f);
+
+    // note on with velocity 0 is a note off
+    processEvent(voices, renderer, 0x91, 81, 0);
+    DISTRHO_TEST(state.gate[v2] == 0.0f && state.active[v2] == 1.0f);
+
+    // sysex and other long messages are ignored
+    MidiEvent sysex(makeEvent(0, 0x90, 60, 100));
+    sysex.size = MidiEvent::kDataSize + 1;
+    voices.process(&sysex, 1, 0, renderer);
+    DISTRHO_TEST(voices.getActiveVoiceCount() == 1);
+
+    voices.reset();
+    DISTRHO_TEST(voices.getActiveVoiceCount() == 0);
+}
+
+// -----------------------------------------------------------------------
+// Sustain pedal and all notes/sound off
+
+static void testControllers()
+{
+    VoiceManager<kVoices> voices;
+    TestRenderer renderer;
+    const VoiceState<kVoices>& state(voices.getState());
+
+    processEvent(voices, renderer, 0xB0, 64, 127);
+    processEvent(voices, renderer, 0x90, 60, 100);
+    const uint32_t v(renderer.lastStarted);
+
+    // held by the pedal
+    processEvent(voices, renderer, 0x80, 60, 0);
+    DISTRHO_TEST(state.gate[v] == 1.0f && state.sustained[v] != 0);
+
+    // pedal up releases it
+    processEvent(voices, renderer, 0xB0, 64, 0);
+    DISTRHO_TEST(state.gate[v] == 0.0f && state.sustained[v] == 0);
+    DISTRHO_TEST(state.active[v] == 1.0f);
+
+    // all notes off releases, only on its channel
+    processEvent(voices, renderer, 0x90, 62, 100);
+    const uint32_t held(renderer.lastStarted);
+    processEvent(voices, renderer, 0x92, 64, 100);
+    const uint32_t other(renderer.lastStarted);
+
+    processEvent(voices, renderer, 0xB0, 123, 0);
+    DISTRHO_TEST(state.gate[held] == 0.0f && state.active[held] == 1.0f);
+    DISTRHO_TEST(state.gate[other] == 1.0f);
+
+    // all sound off frees, only on its channel
+    processEvent(voices, renderer, 0xB0, 120, 0);
+    DISTRHO_TEST(state.active[v] == 0.0f && state.active[held] == 0.0f);
+    DISTRHO_TEST(state.active[other] == 1.0f);
+    DISTRHO_TEST(voices.getActiveVoiceCount() == 1);
+}
+
+// -----------------------------------------------------------------------
+// Voice stealing: a free voice, then the oldest released voice, then the oldest voice
+
+static void testStealing()
+{
+    VoiceManager<kVoices> voices;
+    TestRenderer renderer;
+    const VoiceState<kVoices>& state(voices.getState());
+    uint32_t voiceOfNote[kVoices];
+
+    for (uint32_t i=0; i < kVoices; ++i)
+    {
+        processEvent(voices, renderer, 0x90, static_cast<uint8_t>(40 + i), 100);
+        DISTRHO_TEST(! renderer.lastStolen);
+        voiceOfNote[i] = renderer.lastStarted;
+    }
+
+    DISTRHO_TEST(voices.getActiveVoiceCount() == kVoices);
+    DISTRHO_TEST(renderer.startedCount == kVoices);
+
+    // release two, the older of them is taken first
+    processEvent(voices, renderer, 0x80, 45, 0);
+    processEvent(voices, renderer, 0x80, 43, 0);
+
+    processEvent(voices, renderer, 0x90, 70, 100);
+    DISTRHO_TEST(renderer.lastStarted == voiceOfNote[3] && renderer.lastStolen);
+    DISTRHO_TEST(state.note[voiceOfNote[3]] == 70 && state.gate[voiceOfNote[3]] == 1.0f);
+
+    processEvent(voices, renderer, 0x90, 71, 100);
+    DISTRHO_TEST(renderer.lastStarted == voiceOfNote[5] && renderer.lastStolen);
+
+    // all held now, the oldest goes
+    processEvent(voices, renderer, 0x90, 72, 100);
+    DISTRHO_TEST(renderer.lastStarted == voiceOfNote[0] && renderer.lastStolen);
+
+    processEvent(voices, renderer, 0x90, 73, 100);
+    DISTRHO_TEST(renderer.lastStarted == voiceOfNote[1] && renderer.lastStolen);
+
+    // a finished voice is free again, and preferred
+    voices.finishVoice(voiceOfNote[6]);
+    processEvent(voices, renderer, 0x90, 74, 100);
+    DISTRHO_TEST(renderer.lastStarted == voiceOfNote[6] && ! renderer.lastStolen);
+
+    DISTRHO_TEST(voices.getActiveVoiceCount() == kVoices);
+}
+
+// -----------------------------------------------------------------------
+// Pitch bend follows the range and applies to held and new notes of its channel
+
+static void testPitchBend()
+{
+    VoiceManager<kVoices> voices;
+    TestRenderer renderer;
+    const VoiceState<kVoices>& state(voices.getState());
+
+    processEvent(voices, renderer, 0x90, 69, 100);
+    const uint32_t v(renderer.lastStarted);
+    processEvent(voices, renderer, 0x91, 69, 100);
+    const uint32_t other(renderer.lastStarted);
+
+    // full up is 8191/8192 of the range
+    processEvent(voices, renderer, 0xE0, 0x7F, 0x7F);
+    DISTRHO_TEST(isClose(state.frequency[v], 440.0f * std::pow(2.0f, 2.0f * 8191.0f / 8192.0f / 12.0f)));
+    DISTRHO_TEST(isClose(state.frequency[other], 440.0f));
+
+    // full down, with a 12 semitone range, affects new notes
+    voices.setPitchBendRange(12.0f);
+    processEvent(voices, renderer, 0xE0, 0x00, 0x00);
+    DISTRHO_TEST(isClose(state.frequency[v], 220.0f));
+
+    processEvent(voices, renderer, 0x90, 81, 100);
+    DISTRHO_TEST(isClose(state.frequency[renderer.lastStarted], 440.0f));
+
+    // center
+    processEvent(voices, renderer, 0xE0, 0x00, 0x40);
+    DISTRHO_TEST(isClose(state.frequency[v], 440.0f));
+}
+
+// -----------------------------------------------------------------------
+// The block is split at event frames, only groups with active voices are rendered
+
+static void testBlockSplitting()
+{
+    VoiceManager<kVoices> voices;
+    TestRenderer renderer;
+
+    // silent block, nothing to render
+    voices.process(nullptr, 0, 64, renderer);
+    for (uint32_t g=0; g < kGroups; ++g)
+        DISTRHO_TEST(renderer.renderedFrames[g] == 0);
+
+    const MidiEvent events[] = {
+        makeEvent(10, 0x90, 60, 100),
+        makeEvent(20, 0x90, 62, 100),
+        makeEvent(20, 0x80, 60, 0),
+        makeEvent(40, 0xB0, 64, 127),
+        // past the end of the block, applied at the end
+        makeEvent(100, 0x90, 64, 100)
+    };
+
+    voices.process(events, 5, 64, renderer);
+
+    DISTRHO_TEST(renderer.contiguous);
+    DISTRHO_TEST(renderer.startedCount == 3);
+
+    // group 0 starts sounding at frame 10 and renders the rest of the block
+    DISTRHO_TEST(renderer.renderedFrames[0] == 54);
+    DISTRHO_TEST(renderer.renderedEnd[0] == 64);
+
+    for (uint32_t g=1; g < kGroups; ++g)
+        DISTRHO_TEST(renderer.renderedFrames[g] == 0);
+
+    // the next block renders in full
+    renderer.clear();
+    voices.process(nullptr, 0, 64, renderer);
+    DISTRHO_TEST(renderer.contiguous);
+    DISTRHO_TEST(renderer.renderedFrames[0] == 64);
+}
+
+// -----------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+int main()
+{
+    USE_NAMESPACE_DISTRHO;
+
+    testNotes();
+    testControllers();
+    testStealing();
+    testPitchBend();
+    testBlockSplitting();
+
+    return d_testResult("VoiceManager");
+}